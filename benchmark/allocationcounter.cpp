@@ -0,0 +1,81 @@
+#include "allocationcounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<quint64> totalAllocations( 0 );
+static thread_local quint64 threadAllocations = 0;
+
+static inline void countAllocation() {
+    totalAllocations.fetch_add( 1, std::memory_order_relaxed );
+    threadAllocations++;
+}
+
+quint64 AllocationCounter::total() {
+    return totalAllocations.load( std::memory_order_relaxed );
+}
+
+quint64 AllocationCounter::thisThread() {
+    return threadAllocations;
+}
+
+#ifdef __GLIBC__
+
+// Qt's containers allocate with malloc() rather than new, so with glibc malloc itself is wrapped. operator new
+// ends up in here too.
+
+extern "C" {
+
+    void *__libc_malloc( size_t size );
+    void *__libc_calloc( size_t count, size_t size );
+    void *__libc_realloc( void *memory, size_t size );
+
+    void *malloc( size_t size ) {
+        countAllocation();
+        return __libc_malloc( size );
+    }
+
+    void *calloc( size_t count, size_t size ) {
+        countAllocation();
+        return __libc_calloc( count, size );
+    }
+
+    void *realloc( void *memory, size_t size ) {
+        countAllocation();
+        return __libc_realloc( memory, size );
+    }
+
+}
+
+#else
+
+// Elsewhere only operator new is counted.
+
+void *operator new( std::size_t size ) {
+
+    countAllocation();
+
+    void *memory = std::malloc( size ? size : 1 );
+
+    if( !memory ) {
+        throw std::bad_alloc();
+    }
+
+    return memory;
+
+}
+
+void *operator new[]( std::size_t size ) {
+    return operator new( size );
+}
+
+void operator delete( void *memory ) noexcept {
+    std::free( memory );
+}
+
+void operator delete[]( void *memory ) noexcept {
+    std::free( memory );
+}
+
+#endif
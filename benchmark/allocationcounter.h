@@ -0,0 +1,16 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+// The benchmark counts every heap allocation made in the process, and the ones made by the calling thread. Linking
+// allocationcounter.cpp in replaces the allocator for the whole binary, so it only belongs in the benchmark.
+
+namespace AllocationCounter {
+
+    quint64 total();
+    quint64 thisThread();
+
+}
+
+#endif // ALLOCATIONCOUNTER_H
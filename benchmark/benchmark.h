@@ -0,0 +1,27 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+
+// Benchmark is one run of the input benchmark, whichever part of the pipeline it measures. main() treats them all
+// the same: run it, print the report, then print whatever it got wrong, and fail if there's anything.
+
+class Benchmark {
+
+    public:
+
+        virtual ~Benchmark() = default;
+
+        // Returns false if the run never got going, like pads that never connected. failures() says why.
+        virtual bool run() = 0;
+
+        // One line of results, or more. Only meaningful once run() returned true.
+        virtual QString report() const = 0;
+
+        // One line for every check the run didn't pass, empty if it passed them all.
+        virtual QStringList failures() const = 0;
+
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,69 @@
+TEMPLATE = app
+
+TARGET = inputbenchmark
+
+# Only needed by the input headers, the benchmark runs headless on a QCoreApplication
+QT += gui qml
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+##
+## Compiler settings
+##
+
+    OBJECTS_DIR = obj
+    MOC_DIR     = moc
+    RCC_DIR     = rcc
+
+    # Include libraries
+    win32: INCLUDEPATH += C:/msys64/mingw64/include C:/msys64/mingw64/include/SDL2 # MSYS2
+    macx:  INCLUDEPATH += /usr/local/include /usr/local/include/SDL2               # Homebrew
+    macx:  INCLUDEPATH += /usr/local/include /opt/local/include/SDL2               # MacPorts
+    unix:  INCLUDEPATH += /usr/include /usr/include/SDL2                           # Linux
+
+INCLUDEPATH += ../backend ../backend/input
+
+HEADERS += allocationcounter.h \
+           benchmark.h \
+           eventqueuebenchmark.h \
+           inputbenchmark.h \
+           netplaybenchmark.h \
+           networkgamepadbenchmark.h \
+           runaheadbenchmark.h \
+           stickbenchmark.h
+
+SOURCES += main.cpp \
+           allocationcounter.cpp \
+           eventqueuebenchmark.cpp \
+           inputbenchmark.cpp \
+           netplaybenchmark.cpp \
+           networkgamepadbenchmark.cpp \
+           runaheadbenchmark.cpp \
+           stickbenchmark.cpp
+
+##
+## Linker settings
+##
+
+    # Our stuff
+    LIBS += -L../backend
+
+    # Force the benchmark to be relinked if the backend code has changed
+    TARGETDEPS += ../backend/libphoenix-backend.a
+
+    # SDL2
+    macx: LIBS += -L/usr/local/lib -L/opt/local/lib # Homebrew, MacPorts
+
+    # Our stuff
+    LIBS += -lphoenix-backend
+
+    # SDL 2
+    win32: LIBS += -lmingw32 -lSDL2main
+    LIBS += -lSDL2
+
+    # Other libraries we use
+    LIBS += -lsamplerate -lz
+
+    # shm_open(), for the input export
+    linux: LIBS += -lrt
@@ -0,0 +1,202 @@
+#include "eventqueuebenchmark.h"
+
+#include "input/inputclock.h"
+#include "input/inputeventqueue.h"
+#include "input/inputsnapshot.h"
+#include "input/xorshift.h"
+
+#include <QThread>
+
+#include <memory>
+
+// The producer pushes this many transitions a millisecond, timed together so reading the clock doesn't dominate.
+static const int pushBatch = 8;
+
+namespace {
+
+    // Stands in for the poll thread: pushes numbered transitions, mostly a few at a time, sometimes a burst far
+    // bigger than a queue, like a button mashed by a turbo controller while the core is stalled.
+    class Producer : public QThread {
+
+        public:
+
+            Producer( InputEventQueue *queues, const int pads, const quint32 seed )
+                : queues( queues ),
+                  pads( pads ),
+                  random( seed ? seed : 1 ),
+                  attempts( new quint64[ pads ]() ),
+                  pushNs( 0 ),
+                  pushed( 0 ) {
+
+            }
+
+            void run() override {
+
+                while( !isInterruptionRequested() ) {
+
+                    int pad = static_cast<int>( xorshift32( random ) % static_cast<quint32>( pads ) );
+                    int burst = xorshift32( random ) % 64 == 0 ? InputEventQueue::queueSize * 2 : pushBatch;
+
+                    qint64 before = inputClockNs();
+
+                    for( int i = 0; i < burst; ++i ) {
+                        quint64 number = ++attempts[ pad ];
+                        queues[ pad ].push( static_cast<qint64>( number ), static_cast<int>( number % 17 ),
+                                            static_cast<qint16>( number & 1 ) );
+                    }
+
+                    pushNs += inputClockNs() - before;
+                    pushed += static_cast<quint64>( burst );
+
+                    QThread::usleep( 1000 );
+
+                }
+
+            }
+
+            InputEventQueue *queues;
+            int pads;
+            quint32 random;
+
+            // Transitions pushed into each queue, whether they fit or not.
+            std::unique_ptr<quint64[]> attempts;
+
+            qint64 pushNs;
+            quint64 pushed;
+
+    };
+
+}
+
+EventQueueBenchmark::EventQueueBenchmark( const int pads, const qint64 duration, const int frameRate,
+                                          const quint32 seed )
+    : pads( qBound( 1, pads, static_cast<int>( InputSnapshot::maxPorts ) ) ),
+      duration( duration ),
+      frameRate( qMax( frameRate, 1 ) ),
+      seed( seed ? seed : 1 ),
+      pushed( 0 ),
+      pushNs( 0 ),
+      drained( 0 ),
+      frames( 0 ),
+      drainNs( 0 ),
+      maxPerFrame( 0 ),
+      overflows( 0 ),
+      missing( 0 ),
+      outOfOrder( 0 ) {
+
+}
+
+bool EventQueueBenchmark::run() {
+
+    std::unique_ptr<InputEventQueue[]> queues( new InputEventQueue[ pads ] );
+    std::unique_ptr<quint64[]> lastNumber( new quint64[ pads ]() );
+    std::unique_ptr<quint64[]> received( new quint64[ pads ]() );
+    std::unique_ptr<InputFrameEvents> frame( new InputFrameEvents );
+
+    for( int pad = 0; pad < pads; ++pad ) {
+        queues[ pad ].setEnabled( true );
+    }
+
+    // What InputManager does every frame, checking each transition comes after the one before.
+    auto collect = [ & ] {
+
+        frame->count = 0;
+        frame->overflowed = 0;
+
+        for( int pad = 0; pad < pads; ++pad ) {
+
+            InputEvent *events = frame->events + frame->count;
+            int count = queues[ pad ].drain( events, InputFrameEvents::maxEvents - frame->count );
+
+            for( int i = 0; i < count; ++i ) {
+                auto number = static_cast<quint64>( events[ i ].timestamp );
+
+                outOfOrder += number <= lastNumber[ pad ] ? 1 : 0;
+                lastNumber[ pad ] = number;
+            }
+
+            received[ pad ] += static_cast<quint64>( count );
+            frame->count += count;
+            frame->overflowed += queues[ pad ].takeOverflows();
+
+        }
+
+        drained += static_cast<quint64>( frame->count );
+        overflows += frame->overflowed;
+        maxPerFrame = qMax( maxPerFrame, static_cast<quint64>( frame->count ) );
+
+    };
+
+    Producer producer( queues.get(), pads, seed );
+    producer.start();
+
+    qint64 framePeriod = 1000000000 / frameRate;
+    qint64 started = inputClockNs();
+    qint64 deadline = started;
+
+    while( deadline - started < duration ) {
+
+        deadline += framePeriod;
+        qint64 remaining = deadline - inputClockNs();
+
+        if( remaining > 0 ) {
+            QThread::usleep( static_cast<unsigned long>( remaining / 1000 ) );
+        }
+
+        qint64 before = inputClockNs();
+        collect();
+        drainNs += inputClockNs() - before;
+        frames++;
+
+    }
+
+    producer.requestInterruption();
+    producer.wait();
+
+    // Whatever is left, now that nothing is pushed anymore.
+    do {
+        collect();
+    } while( frame->count > 0 );
+
+    pushed = producer.pushed;
+    pushNs = producer.pushNs;
+
+    quint64 lost = 0;
+
+    for( int pad = 0; pad < pads; ++pad ) {
+        lost += producer.attempts[ pad ] - received[ pad ];
+    }
+
+    missing = lost > overflows ? lost - overflows : overflows - lost;
+
+    return true;
+
+}
+
+QString EventQueueBenchmark::report() const {
+
+    return QStringLiteral( "%1 pads, event queues: push %2 ns, drain %3 us/frame (most %4 events), %5 pushed, "
+                           "%6 drained, %7 overflowed, %8 out of order, %9 unaccounted for" )
+           .arg( pads, 3 )
+           .arg( pushed > 0 ? static_cast<qreal>( pushNs ) / pushed : 0.0, 0, 'f', 1 )
+           .arg( frames > 0 ? drainNs / 1000.0 / frames : 0.0, 0, 'f', 2 )
+           .arg( maxPerFrame )
+           .arg( pushed )
+           .arg( drained )
+           .arg( overflows )
+           .arg( outOfOrder )
+           .arg( missing );
+
+}
+
+QStringList EventQueueBenchmark::failures() const {
+
+    QStringList failures;
+
+    if( outOfOrder > 0 || missing > 0 ) {
+        failures << QStringLiteral( "transitions came out of order, or went missing without counting as overflows" );
+    }
+
+    return failures;
+
+}
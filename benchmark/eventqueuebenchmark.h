@@ -0,0 +1,46 @@
+#ifndef EVENTQUEUEBENCHMARK_H
+#define EVENTQUEUEBENCHMARK_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include "benchmark.h"
+
+// EventQueueBenchmark has one thread push button transitions into an InputEventQueue per pad, in bursts that now
+// and then overflow them, while the calling thread drains every queue once a frame like InputManager does. Every
+// transition is numbered, so the drained ones have to come out in order, and the ones missing have to be exactly
+// the overflows the queues reported. A run where they aren't is a failure.
+
+class EventQueueBenchmark : public Benchmark {
+
+    public:
+
+        EventQueueBenchmark( const int pads, const qint64 duration, const int frameRate, const quint32 seed );
+
+        bool run() override;
+        QString report() const override;
+
+        // Fails if transitions came out of order, or more or fewer went missing than were reported lost.
+        QStringList failures() const override;
+
+    private:
+
+        int pads;
+        qint64 duration;
+        int frameRate;
+        quint32 seed;
+
+        quint64 pushed;
+        qint64 pushNs;
+        quint64 drained;
+        quint64 frames;
+        qint64 drainNs;
+        quint64 maxPerFrame;
+
+        quint64 overflows;
+        quint64 missing;
+        quint64 outOfOrder;
+
+};
+
+#endif // EVENTQUEUEBENCHMARK_H
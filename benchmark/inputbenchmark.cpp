@@ -0,0 +1,540 @@
+#include "inputbenchmark.h"
+
+#include "allocationcounter.h"
+#include "input/inputclock.h"
+#include "input/inputexportreader.h"
+#include "input/inputmanager.h"
+
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QThread>
+
+#include <atomic>
+
+#include <memory>
+
+#ifdef Q_OS_LINUX
+#include <time.h>
+#endif
+
+static void sleepUntil( const qint64 deadline ) {
+#ifdef Q_OS_LINUX
+    struct timespec wakeup;
+    wakeup.tv_sec = deadline / 1000000000;
+    wakeup.tv_nsec = deadline % 1000000000;
+
+    while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, nullptr ) != 0 ) {
+    }
+#else
+    qint64 remaining = deadline - inputClockNs();
+
+    if( remaining > 0 ) {
+        QThread::usleep( static_cast<unsigned long>( remaining / 1000 ) );
+    }
+#endif
+}
+
+// Unplugs a random pad, then plugs it back in, over and over until interrupted.
+class PlugCycler : public QThread {
+
+    public:
+
+        PlugCycler( SimulatedJoystickBackend *backend, const int pads, const quint32 seed )
+            : backend( backend ),
+              pads( pads ),
+              seed( seed ),
+              cycles( 0 ) {
+
+        }
+
+        void run() override {
+
+            quint32 random = seed;
+
+            while( !isInterruptionRequested() ) {
+
+                random = random * 1664525u + 1013904223u;
+                backend->unplug( static_cast<int>( ( random >> 16 ) % static_cast<quint32>( pads ) ) );
+                QThread::msleep( 2 );
+
+                backend->plugIn( pads );
+                QThread::msleep( 2 );
+
+                cycles++;
+
+            }
+
+        }
+
+        SimulatedJoystickBackend *backend;
+        const int pads;
+        const quint32 seed;
+        std::atomic<quint64> cycles;
+
+};
+
+// Follows the input export from its own mapping, like an overlay in another process would, a thousand times a
+// second until interrupted.
+class ExportFollower : public QThread {
+
+    public:
+
+        explicit ExportFollower( const QString &name )
+            : name( name.toLocal8Bit() ),
+              frame( new InputExportFrame ),
+              reads( 0 ),
+              failedReads( 0 ),
+              outOfOrder( 0 ),
+              retries( 0 ),
+              opened( false ),
+              ready( false ) {
+
+        }
+
+        void run() override {
+
+            InputExportReader reader;
+            opened = reader.open( name.constData() );
+            ready = true;
+
+            if( !opened ) {
+                return;
+            }
+
+            quint64 lastFrame = 0;
+
+            while( !isInterruptionRequested() ) {
+
+                if( reader.read( *frame ) ) {
+                    reads++;
+                    age.record( inputClockNs() - frame->timestamp );
+
+                    if( frame->frame < lastFrame ) {
+                        outOfOrder++;
+                    }
+
+                    lastFrame = frame->frame;
+                } else {
+                    failedReads++;
+                }
+
+                QThread::usleep( 1000 );
+
+            }
+
+            retries = reader.retries();
+
+        }
+
+        const QByteArray name;
+        std::unique_ptr<InputExportFrame> frame;
+
+        quint64 reads;
+        quint64 failedReads;
+        quint64 outOfOrder;
+        quint64 retries;
+        bool opened;
+
+        // Set once the thread is up and has opened the export, or failed to.
+        std::atomic<bool> ready;
+
+        // How old each frame was when it was read.
+        LatencyHistogram age;
+
+};
+
+InputBenchmark::Options::Options()
+    : pads( 1 ),
+      mode( SDLEventLoop::EventDriven ),
+      leadTime( 2000 ),
+      duration( Q_INT64_C( 5000000000 ) ),
+      frameRate( 60 ),
+      eventsPerSecond( 20 ),
+      seed( 1 ),
+      stress( false ),
+      allowAllocations( false ),
+      frontend( false ) {
+
+}
+
+InputBenchmark::InputBenchmark( const Options &options )
+    : options( options ),
+      frames( 0 ),
+      polls( 0 ),
+      pollCpuNs( 0 ),
+      wakeups( 0 ),
+      contendedLocks( 0 ),
+      allocations( 0 ),
+      coreAllocations( 0 ),
+      coreCpuNs( 0 ),
+      droppedEvents( 0 ),
+      averageStaleness( 0 ),
+      recordedFrames( 0 ),
+      recordingBytes( 0 ),
+      replayNs( 0 ),
+      plugCycles( 0 ),
+      guardedReads( 0 ),
+      exportReads( 0 ),
+      exportRetries( 0 ),
+      exportFailedReads( 0 ),
+      evdevStaleness( 0 ),
+      checksum( 0 ) {
+
+}
+
+bool InputBenchmark::run() {
+
+    // The backend is large, and must outlive the InputManager.
+    std::unique_ptr<SimulatedJoystickBackend> backend( new SimulatedJoystickBackend );
+    backend->plugIn( options.pads );
+
+    InputManager manager( backend.get() );
+
+    bool frameSynchronized = options.mode == SDLEventLoop::FrameSynchronized;
+    manager.setPollMode( frameSynchronized ? SDLEventLoop::EventDriven : options.mode );
+
+    // The joysticks are created on the poll thread and handed to the InputManager through queued signals.
+    qint64 giveUp = inputClockNs() + Q_INT64_C( 5000000000 );
+    int connected = 0;
+
+    while( connected < options.pads && inputClockNs() < giveUp ) {
+
+        QCoreApplication::processEvents();
+        QThread::msleep( 1 );
+
+        connected = 0;
+
+        for( int i = 0; i < options.pads; ++i ) {
+            connected += manager.at( i ) ? 1 : 0;
+        }
+
+    }
+
+    if( connected < options.pads ) {
+        setupFailure = QStringLiteral( "%1 pads, %2: the simulated pads never connected" )
+                       .arg( options.pads ).arg( modeName( options.mode ) );
+        return false;
+    }
+
+    manager.setPollLeadTime( frameSynchronized ? options.leadTime : 0 );
+
+    if( !options.frontend ) {
+        manager.setRun( true );
+    }
+
+    if( options.trace.isEmpty() ) {
+        backend->setTrace( SimulatedJoystickBackend::randomTrace( options.pads, options.duration,
+                                                                  options.eventsPerSecond, options.seed ) );
+    } else {
+        backend->setTrace( options.trace );
+    }
+
+    // Recording must not allocate either, so it's on for the whole run.
+    if( !options.recording.isEmpty() ) {
+        manager.startRecording( options.recording );
+    }
+
+    // Neither must exporting, or following the export.
+    ExportFollower follower( options.exportName );
+    bool exporting = !options.exportName.isEmpty() && manager.startExport( options.exportName );
+
+    if( exporting ) {
+        follower.start();
+
+        // Starting a thread allocates, on the thread too.
+        while( !follower.ready ) {
+            QThread::yieldCurrentThread();
+        }
+    }
+
+    manager.statistics().reset();
+    manager.resetLatency();
+
+    quint64 allocationsBefore = AllocationCounter::total();
+    quint64 coreAllocationsBefore = AllocationCounter::thisThread();
+
+    qint64 framePeriod = 1000000000 / qMax( options.frameRate, 1 );
+    qint64 started = inputClockNs();
+    qint64 deadline = started;
+
+    backend->start( started );
+
+    PlugCycler cycler( backend.get(), options.pads, options.seed );
+
+    if( options.stress && options.pads > 0 ) {
+        cycler.start();
+    }
+
+    while( deadline - started < options.duration ) {
+
+        deadline += framePeriod;
+        sleepUntil( deadline );
+
+        // Only the poll thread works, the snapshots it publishes go unread.
+        if( options.frontend ) {
+            QCoreApplication::processEvents();
+            frames++;
+            continue;
+        }
+
+        qint64 cpuBefore = inputThreadCpuNs();
+
+        // What a core does every frame: poll, then read every port.
+        manager.pollStates();
+        auto &snapshot = manager.snapshot();
+
+        for( int port = 0; port < snapshot.portCount; ++port ) {
+            checksum += snapshot.ports[ port ].buttons;
+            checksum += static_cast<quint16>( snapshot.ports[ port ].axes[ InputPortState::LeftX ] );
+        }
+
+        // Unplugged devices are only taken off their ports, and plugged in ones given one, by the event loop.
+        // Reading them straight off the ports meanwhile must never touch a freed device.
+        if( options.stress ) {
+
+            QCoreApplication::processEvents();
+
+            InputEpoch::Guard guard( manager.epoch() );
+
+            for( int port = 0; port < options.pads; ++port ) {
+                if( auto *device = manager.at( port ) ) {
+                    checksum += device->states()->buttons();
+                    guardedReads++;
+                }
+            }
+
+        }
+
+        coreCpuNs += inputThreadCpuNs() - cpuBefore;
+        frames++;
+
+    }
+
+    coreAllocations = AllocationCounter::thisThread() - coreAllocationsBefore;
+    allocations = AllocationCounter::total() - allocationsBefore;
+
+    if( options.stress ) {
+        cycler.requestInterruption();
+        cycler.wait();
+        plugCycles = cycler.cycles;
+    }
+
+    if( exporting ) {
+        follower.requestInterruption();
+        follower.wait();
+        manager.stopExport();
+
+        exportReads = follower.reads;
+        exportFailedReads = follower.opened ? follower.failedReads + follower.outOfOrder : 1;
+        exportRetries = follower.retries;
+        exportAge = follower.age.summary();
+    }
+
+    auto &statistics = manager.statistics();
+    polls = statistics.polls();
+    pollCpuNs = statistics.pollCpuNs();
+    wakeups = statistics.wakeups();
+    contendedLocks = statistics.contended();
+    droppedEvents = backend->droppedEvents();
+    averageStaleness = manager.frameTiming().averageStaleness();
+    captureLatency = manager.latencySummary();
+    publishLatency = manager.publishLatency().summary();
+
+    manager.setRun( false );
+
+    if( !options.recording.isEmpty() ) {
+        manager.stopRecording();
+        timeReplay();
+    }
+
+    if( !options.evdevRecording.isEmpty() ) {
+        timeEvdev();
+    }
+
+    return true;
+
+}
+
+void InputBenchmark::timeReplay() {
+
+    InputReplay replay;
+
+    if( !replay.open( options.recording ) ) {
+        return;
+    }
+
+    recordingBytes = static_cast<quint64>( QFileInfo( options.recording ).size() );
+
+    // Only the ports a core would read are needed, so reuse one snapshot.
+    std::unique_ptr<InputSnapshot> snapshot( new InputSnapshot );
+    qint64 started = inputClockNs();
+
+    while( replay.next( *snapshot ) ) {
+        checksum += snapshot->portCount > 0 ? snapshot->ports[ 0 ].buttons : 0;
+    }
+
+    replayNs = inputClockNs() - started;
+    recordedFrames = replay.frames();
+
+}
+
+void InputBenchmark::timeEvdev() {
+
+    // No simulated pads this time, the recording is the only device.
+    std::unique_ptr<SimulatedJoystickBackend> backend( new SimulatedJoystickBackend );
+    InputManager manager( backend.get() );
+
+    bool frameSynchronized = options.mode == SDLEventLoop::FrameSynchronized;
+    manager.setPollMode( frameSynchronized ? SDLEventLoop::EventDriven : options.mode );
+
+    if( !manager.startEvdev( { options.evdevRecording } ) ) {
+        return;
+    }
+
+    qint64 giveUp = inputClockNs() + Q_INT64_C( 5000000000 );
+
+    while( !manager.at( 0 ) && inputClockNs() < giveUp ) {
+        QCoreApplication::processEvents();
+        QThread::msleep( 1 );
+    }
+
+    if( !manager.at( 0 ) ) {
+        return;
+    }
+
+    manager.setPollLeadTime( frameSynchronized ? options.leadTime : 0 );
+    manager.setRun( true );
+    manager.resetLatency();
+
+    qint64 framePeriod = 1000000000 / qMax( options.frameRate, 1 );
+    qint64 started = inputClockNs();
+    qint64 deadline = started;
+
+    while( deadline - started < options.duration ) {
+
+        deadline += framePeriod;
+        sleepUntil( deadline );
+
+        manager.pollStates();
+        checksum += manager.snapshot().ports[ 0 ].buttons;
+
+    }
+
+    evdevLatency = manager.latencySummary();
+    evdevStaleness = manager.frameTiming().averageStaleness();
+
+    manager.setRun( false );
+    manager.stopEvdev();
+
+}
+
+QString InputBenchmark::report() const {
+
+    auto perPoll = [ this ]( const quint64 value ) {
+        return polls ? static_cast<qreal>( value ) / polls : 0.0;
+    };
+
+    QString line = QStringLiteral( "%1 pads, %2: %3 polls, %4 us CPU/poll, %5 allocs/poll, %6 allocs/frame, "
+                                   "%7 contended locks, %8 wakeups, %9 us core CPU/frame" )
+                   .arg( options.pads, 3 )
+                   .arg( modeName( options.mode ) )
+                   .arg( polls )
+                   .arg( perPoll( pollCpuNs ) / 1000.0, 0, 'f', 2 )
+                   .arg( perPoll( allocations ), 0, 'f', 2 )
+                   .arg( frames ? static_cast<qreal>( coreAllocations ) / frames : 0.0, 0, 'f', 2 )
+                   .arg( contendedLocks )
+                   .arg( wakeups )
+                   .arg( frames ? coreCpuNs / 1000.0 / frames : 0.0, 0, 'f', 2 );
+
+    line += QStringLiteral( "\n    capture to core: %1\n    publish to core: %2\n    staleness: %3 ms" )
+            .arg( captureLatency )
+            .arg( publishLatency )
+            .arg( averageStaleness / 1000000.0, 0, 'f', 2 );
+
+    if( recordedFrames > 0 ) {
+        qreal recordedSeconds = static_cast<qreal>( recordedFrames ) / qMax( options.frameRate, 1 );
+
+        line += QStringLiteral( "\n    recording: %1 frames in %2 bytes, replayed in %3 ms (%4x real time)" )
+                .arg( recordedFrames )
+                .arg( recordingBytes )
+                .arg( replayNs / 1000000.0, 0, 'f', 2 )
+                .arg( replayNs > 0 ? recordedSeconds * 1000000000 / replayNs : 0.0, 0, 'f', 0 );
+    }
+
+    if( !evdevLatency.isEmpty() ) {
+        line += QStringLiteral( "\n    evdev, event to core: %1\n    evdev staleness: %2 ms" )
+                .arg( evdevLatency )
+                .arg( evdevStaleness / 1000000.0, 0, 'f', 2 );
+    }
+
+    if( options.frontend ) {
+        qreal seconds = options.duration / 1000000000.0;
+
+        line += QStringLiteral( "\n    frontend: %1 wakeups/s, %2 us poll CPU/s" )
+                .arg( seconds > 0 ? wakeups / seconds : 0.0, 0, 'f', 1 )
+                .arg( seconds > 0 ? pollCpuNs / 1000.0 / seconds : 0.0, 0, 'f', 1 );
+    }
+
+    if( !exportAge.isEmpty() ) {
+        line += QStringLiteral( "\n    export: %1 reads, %2 retried, %3 failed, frame age %4" )
+                .arg( exportReads )
+                .arg( exportRetries )
+                .arg( exportFailedReads )
+                .arg( exportAge );
+    }
+
+    if( plugCycles > 0 ) {
+        line += QStringLiteral( "\n    stress: %1 unplug and plug in cycles, %2 device reads off the ports" )
+                .arg( plugCycles )
+                .arg( guardedReads );
+    }
+
+    if( droppedEvents > 0 ) {
+        line += QStringLiteral( "\n    %1 simulated events were dropped, the results are off" ).arg( droppedEvents );
+    }
+
+    return line;
+
+}
+
+QStringList InputBenchmark::failures() const {
+
+    QStringList failures;
+
+    if( !setupFailure.isEmpty() ) {
+        failures << setupFailure;
+        return failures;
+    }
+
+    if( exportFailedReads > 0 ) {
+        failures << QStringLiteral( "%1 reads of the export failed, or went back in time" ).arg( exportFailedReads );
+    }
+
+    // Hot-plugging allocates, so stress runs are only checked for surviving it.
+    if( allocations > 0 && !options.allowAllocations && !options.stress ) {
+        failures << QStringLiteral( "%1 allocations after every pad connected, expected none" ).arg( allocations );
+    }
+
+    return failures;
+
+}
+
+QString InputBenchmark::modeName( const SDLEventLoop::PollMode mode ) {
+
+    switch( mode ) {
+        case SDLEventLoop::Polled:
+            return QStringLiteral( "polled" );
+
+        case SDLEventLoop::EventDriven:
+            return QStringLiteral( "event" );
+
+        case SDLEventLoop::FrameSynchronized:
+            return QStringLiteral( "frame" );
+
+        case SDLEventLoop::Adaptive:
+            return QStringLiteral( "adaptive" );
+    }
+
+    return QString();
+
+}
@@ -0,0 +1,118 @@
+#ifndef INPUTBENCHMARK_H
+#define INPUTBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+#include "benchmark.h"
+#include "input/sdleventloop.h"
+#include "input/simulatedjoystickbackend.h"
+
+// InputBenchmark runs the real SDLEventLoop, InputManager and InputDevices against a SimulatedJoystickBackend,
+// with the calling thread standing in for a core that reads input once per frame. It needs no display and no
+// controllers, only a QCoreApplication.
+
+// A run reports what polling costs (CPU time per poll, allocations per poll and per frame, contended locks), and
+// how long a change took from the simulated controller to the core.
+
+class InputBenchmark : public Benchmark {
+
+    public:
+
+        struct Options {
+            Options();
+
+            int pads;
+
+            // FrameSynchronized is FramePollScheduler polling with leadTime, the others poll on the core thread.
+            SDLEventLoop::PollMode mode;
+            int leadTime;
+
+            qint64 duration;
+            int frameRate;
+
+            // Used to make a random trace when there's no scripted one.
+            int eventsPerSecond;
+            quint32 seed;
+            QVector<SimulatedInput> trace;
+
+            // If set, record the run to this file, then time replaying it back.
+            QString recording;
+
+            // Keep unplugging and plugging pads back in on another thread for the whole run, while the core
+            // reads every device through InputManager::at() too. Unplugging allocates, so these runs do as well.
+            bool stress;
+
+            // Don't fail a run that allocates once every pad is connected. Stress runs never fail for it.
+            bool allowAllocations;
+
+            // If set, export every snapshot to this shared memory segment, and follow it from another thread
+            // through InputExportReader for the whole run.
+            QString exportName;
+
+            // Leave the game stopped for the whole run, so the poll thread keeps going in mode like it does in the
+            // menus while the core does nothing. Shows what polling costs while nobody is playing.
+            bool frontend;
+
+            // If set, also play this evdev recording through EvdevMonitor after the run, and report its latency
+            // from the kernel's event time to the core, next to the SDL path's. Linux only.
+            QString evdevRecording;
+        };
+
+        explicit InputBenchmark( const Options &options );
+
+        // Returns false if the simulated pads never showed up.
+        bool run() override;
+        QString report() const override;
+
+        // Fails on heap allocations while the simulated game was running, on any thread: once every device is
+        // connected, polling and publishing must not allocate at all. Also fails on reads of the export that
+        // failed, came back older than the one before, or couldn't open it at all.
+        QStringList failures() const override;
+
+        static QString modeName( const SDLEventLoop::PollMode mode );
+
+    private:
+
+        Options options;
+
+        // Why run() returned false.
+        QString setupFailure;
+
+        quint64 frames;
+        quint64 polls;
+        quint64 pollCpuNs;
+        quint64 wakeups;
+        quint64 contendedLocks;
+        quint64 allocations;
+        quint64 coreAllocations;
+        quint64 coreCpuNs;
+        quint64 droppedEvents;
+        qint64 averageStaleness;
+        QString captureLatency;
+        QString publishLatency;
+
+        quint64 recordedFrames;
+        quint64 recordingBytes;
+        qint64 replayNs;
+
+        quint64 plugCycles;
+        quint64 guardedReads;
+
+        quint64 exportReads;
+        quint64 exportRetries;
+        quint64 exportFailedReads;
+        QString exportAge;
+
+        QString evdevLatency;
+        qint64 evdevStaleness;
+
+        void timeReplay();
+        void timeEvdev();
+
+        // Keeps the compiler from dropping the snapshot reads.
+        quint64 checksum;
+
+};
+
+#endif // INPUTBENCHMARK_H
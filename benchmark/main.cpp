@@ -0,0 +1,269 @@
+#include <QtGlobal>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTextStream>
+
+#include "benchmark.h"
+#include "eventqueuebenchmark.h"
+#include "inputbenchmark.h"
+#include "netplaybenchmark.h"
+#include "networkgamepadbenchmark.h"
+#include "runaheadbenchmark.h"
+#include "stickbenchmark.h"
+
+#include "input/inputframequeue.h"
+
+#include <memory>
+
+// Runs the input pipeline against simulated controllers, once for every combination of pad count and poll mode,
+// and prints one result per run. No display or controllers needed, so it's safe to run on CI. Exits with 1 if any
+// run failed: the pads never connected, or polling allocated once they had.
+
+// Each of these options runs only one part of the pipeline instead, once for every pad count unless it says
+// otherwise. See each benchmark's class for what it measures.
+
+// --sticks: the stick processing. Fails if the vectorized and scalar paths disagree.
+
+// --event-queues: the per-device button transition queues. Fails if transitions come out of order, or go missing
+// without being counted as overflows.
+
+// --run-ahead: the run-ahead input history. Fails if a stand-in core that only runs frames again when the input
+// changed shows something different from one that always does.
+
+// --network-pads: loopback clients stand in for phones connected to the network gamepad server. Fails if a pad's
+// port doesn't end up with what it sent last, or a packet that arrived late was applied.
+
+// --netplay: two netplay sessions play each other over loopback, once as configured, then once at the most delay
+// and prediction the queue allows, with only one side's packets lost. Fails if their games end up different.
+
+namespace {
+
+    // Run one benchmark and print its results, then everything it got wrong. Returns false if it failed.
+    bool runBenchmark( Benchmark &benchmark, QTextStream &out ) {
+
+        if( benchmark.run() ) {
+            out << benchmark.report() << endl;
+        }
+
+        auto failures = benchmark.failures();
+
+        for( auto &failure : failures ) {
+            out << "    FAIL: " << failure << endl;
+        }
+
+        return failures.isEmpty();
+
+    }
+
+    // Run the benchmark make() returns for every pad count in counts. Returns what main() does.
+    template<typename Make>
+    int runForEachPadCount( const QString &counts, QTextStream &out, Make make ) {
+
+        int failures = 0;
+
+        for( auto &count : counts.split( ',', QString::SkipEmptyParts ) ) {
+            std::unique_ptr<Benchmark> benchmark( make( count.toInt() ) );
+            failures += runBenchmark( *benchmark, out ) ? 0 : 1;
+        }
+
+        return failures > 0 ? 1 : 0;
+
+    }
+
+}
+
+int main( int argc, char *argv[] ) {
+
+    QCoreApplication app( argc, argv );
+
+    QCoreApplication::setApplicationName( "inputbenchmark" );
+    QCoreApplication::setOrganizationDomain( "http://phoenix.vg/" );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Benchmarks the input pipeline with simulated controllers." );
+    parser.addHelpOption();
+
+    QCommandLineOption padsOption( "pads", "Comma separated pad counts, 0 - 128.", "counts", "1,8,128" );
+    QCommandLineOption modesOption( "modes", "Comma separated poll modes: polled, event, frame, adaptive.", "modes",
+                                    "polled,event,frame" );
+    QCommandLineOption secondsOption( "seconds", "Length of each run.", "seconds", "5" );
+    QCommandLineOption frameRateOption( "frame-rate", "Frames per second of the simulated core.", "fps", "60" );
+    QCommandLineOption leadTimeOption( "lead-time", "Poll lead time of the frame mode, in microseconds.", "usec",
+                                       "2000" );
+    QCommandLineOption rateOption( "rate", "Changes per second per pad in the random trace.", "rate", "20" );
+    QCommandLineOption seedOption( "seed", "Seed of the random trace.", "seed", "1" );
+    QCommandLineOption traceOption( "trace", "Replay this scripted trace instead of a random one.", "file" );
+    QCommandLineOption recordOption( "record", "Record each run to this file, and time replaying it.", "file" );
+    QCommandLineOption evdevOption( "evdev", "After each run, play this evdev recording and compare its latency.",
+                                    "file" );
+    QCommandLineOption exportOption( "export", "Export to this shared memory segment, and follow it during each run.",
+                                     "name" );
+    QCommandLineOption sticksOption( "sticks", "Only time the vectorized stick processing against the scalar one." );
+    QCommandLineOption netplayOption( "netplay", "Only play two netplay sessions against each other over loopback." );
+    QCommandLineOption latencyOption( "latency", "One way latency of the simulated netplay network, in milliseconds.",
+                                      "msec", "40" );
+    QCommandLineOption lossOption( "loss", "Percentage of netplay packets the simulated network loses.", "percent",
+                                   "5" );
+    QCommandLineOption delayOption( "delay", "Local input delay of both netplay sessions, in frames.", "frames", "2" );
+    QCommandLineOption predictionOption( "prediction", "How far both netplay sessions may predict, in frames.",
+                                         "frames", "8" );
+    QCommandLineOption runAheadOption( "run-ahead", "Only time the run-ahead input history, this many frames ahead.",
+                                       "frames" );
+    QCommandLineOption networkPadsOption( "network-pads", "Only connect loopback network gamepads, up to 16." );
+    QCommandLineOption reorderOption( "reorder", "Percentage of network gamepad packets followed by a late one.",
+                                      "percent", "5" );
+    QCommandLineOption eventQueuesOption( "event-queues", "Only time the per-device button transition queues." );
+    QCommandLineOption frontendOption( "frontend", "Leave the game stopped, and only measure the poll thread." );
+    QCommandLineOption stressOption( "stress", "Keep unplugging and plugging pads back in during each run." );
+    QCommandLineOption allowAllocationsOption( "allow-allocations",
+                                               "Don't fail runs that allocate once every pad is connected." );
+
+    parser.addOptions( { padsOption, modesOption, secondsOption, frameRateOption, leadTimeOption, rateOption,
+                         seedOption, traceOption, recordOption, evdevOption, exportOption, sticksOption,
+                         netplayOption, latencyOption, lossOption, delayOption, predictionOption, runAheadOption,
+                         networkPadsOption, reorderOption, eventQueuesOption, frontendOption, stressOption,
+                         allowAllocationsOption
+                       } );
+
+    parser.process( app );
+
+    QTextStream out( stdout );
+
+    InputBenchmark::Options options;
+    options.duration = static_cast<qint64>( parser.value( secondsOption ).toDouble() * 1000000000 );
+    options.frameRate = parser.value( frameRateOption ).toInt();
+    options.leadTime = parser.value( leadTimeOption ).toInt();
+    options.eventsPerSecond = parser.value( rateOption ).toInt();
+    options.seed = parser.value( seedOption ).toUInt();
+    options.recording = parser.value( recordOption );
+    options.stress = parser.isSet( stressOption );
+    options.allowAllocations = parser.isSet( allowAllocationsOption );
+    options.frontend = parser.isSet( frontendOption );
+    options.evdevRecording = parser.value( evdevOption );
+    options.exportName = parser.value( exportOption );
+
+    if( parser.isSet( traceOption ) ) {
+
+        QFile traceFile( parser.value( traceOption ) );
+
+        if( !traceFile.open( QIODevice::ReadOnly | QIODevice::Text ) ) {
+            qCritical( "Unable to open %s", qPrintable( traceFile.fileName() ) );
+            return 1;
+        }
+
+        options.trace = SimulatedJoystickBackend::loadTrace( &traceFile );
+
+    }
+
+    QString padCounts = parser.value( padsOption );
+
+    if( parser.isSet( sticksOption ) ) {
+        return runForEachPadCount( padCounts, out, [ & ]( const int pads ) {
+            return new StickBenchmark( pads, options.duration, options.seed );
+        } );
+    }
+
+    if( parser.isSet( eventQueuesOption ) ) {
+        return runForEachPadCount( padCounts, out, [ & ]( const int pads ) {
+            return new EventQueueBenchmark( pads, options.duration, options.frameRate, options.seed );
+        } );
+    }
+
+    if( parser.isSet( runAheadOption ) ) {
+        return runForEachPadCount( padCounts, out, [ & ]( const int pads ) {
+            RunAheadBenchmark::Options runAheadOptions;
+            runAheadOptions.ports = pads;
+            runAheadOptions.frames = parser.value( runAheadOption ).toInt();
+            runAheadOptions.duration = options.duration;
+            runAheadOptions.frameRate = options.frameRate;
+            runAheadOptions.eventsPerSecond = options.eventsPerSecond;
+            runAheadOptions.seed = options.seed;
+
+            return new RunAheadBenchmark( runAheadOptions );
+        } );
+    }
+
+    if( parser.isSet( networkPadsOption ) ) {
+        return runForEachPadCount( padCounts, out, [ & ]( const int pads ) {
+            NetworkGamepadBenchmark::Options networkOptions;
+            networkOptions.pads = pads;
+            networkOptions.duration = options.duration;
+            networkOptions.frameRate = options.frameRate;
+            networkOptions.eventsPerSecond = options.eventsPerSecond;
+            networkOptions.reorder = parser.value( reorderOption ).toDouble() / 100;
+            networkOptions.seed = options.seed;
+
+            return new NetworkGamepadBenchmark( networkOptions );
+        } );
+    }
+
+    if( parser.isSet( netplayOption ) ) {
+
+        NetplayBenchmark::Options netplayOptions;
+        netplayOptions.duration = options.duration;
+        netplayOptions.frameRate = options.frameRate;
+        netplayOptions.delay = parser.value( delayOption ).toInt();
+        netplayOptions.prediction = parser.value( predictionOption ).toInt();
+        netplayOptions.latency = static_cast<qint64>( parser.value( latencyOption ).toDouble() * 1000000 );
+        netplayOptions.loss = parser.value( lossOption ).toDouble() / 100;
+        netplayOptions.oneWayLoss = false;
+        netplayOptions.seed = options.seed;
+
+        NetplayBenchmark benchmark( netplayOptions );
+        bool passed = runBenchmark( benchmark, out );
+
+        // Where the ring is the fullest it gets: everything it can hold ahead, and acknowledgements that stall.
+        netplayOptions.delay = InputFrameQueue::maxDelay;
+        netplayOptions.prediction = InputFrameQueue::maxMaxPrediction;
+        netplayOptions.oneWayLoss = true;
+
+        NetplayBenchmark limits( netplayOptions );
+        passed = runBenchmark( limits, out ) && passed;
+
+        return passed ? 0 : 1;
+
+    }
+
+    QList<SDLEventLoop::PollMode> modes;
+
+    for( auto &name : parser.value( modesOption ).split( ',', QString::SkipEmptyParts ) ) {
+
+        bool found = false;
+
+        for( auto mode : { SDLEventLoop::Polled, SDLEventLoop::EventDriven, SDLEventLoop::FrameSynchronized,
+                           SDLEventLoop::Adaptive
+                         } ) {
+            if( InputBenchmark::modeName( mode ) == name.trimmed() ) {
+                modes.append( mode );
+                found = true;
+            }
+        }
+
+        if( !found ) {
+            qCritical( "Unknown poll mode %s", qPrintable( name ) );
+            return 1;
+        }
+
+    }
+
+    int failures = 0;
+
+    for( auto &count : padCounts.split( ',', QString::SkipEmptyParts ) ) {
+
+        options.pads = qBound( 0, count.toInt(), SimulatedJoystickBackend::maxPads );
+
+        for( auto mode : modes ) {
+
+            options.mode = mode;
+
+            InputBenchmark benchmark( options );
+            failures += runBenchmark( benchmark, out ) ? 0 : 1;
+
+        }
+
+    }
+
+    return failures > 0 ? 1 : 0;
+
+}
@@ -0,0 +1,240 @@
+#include "netplaybenchmark.h"
+
+#include "input/inputclock.h"
+#include "input/inputnetplay.h"
+#include "input/xorshift.h"
+
+#include <QThread>
+#include <QVector>
+
+#include <memory>
+
+// Frames both sides keep playing released, after their last real input, so every real one gets confirmed.
+static const int settleFrames = 2 * InputFrameQueue::maxDelay + 1;
+
+namespace {
+
+    // One side of the match: a session, and a game whose state is a hash of every frame's input.
+    struct Player {
+
+        InputNetplay netplay;
+        InputSnapshot snapshot;
+
+        // states[ n ] is the game after running frames 0 to n - 1.
+        QVector<quint64> states;
+
+        quint32 random;
+        InputPortState held;
+        quint32 inputs;
+
+        quint64 rollbacks;
+        quint64 replayed;
+
+        static quint64 step( quint64 state, const InputSnapshot &frame ) {
+
+            // FNV-1a over both ports.
+            for( int i = 0; i < frame.portCount; ++i ) {
+                state = ( state ^ frame.ports[ i ].buttons ) * 1099511628211ull;
+
+                for( auto axis : frame.ports[ i ].axes ) {
+                    state = ( state ^ static_cast<quint16>( axis ) ) * 1099511628211ull;
+                }
+            }
+
+            return state;
+
+        }
+
+        // A new button mask or stick position every few frames, like a person.
+        InputPortState nextInput( const quint32 lastInput ) {
+
+            if( inputs >= lastInput ) {
+                return InputPortState();
+            }
+
+            xorshift32( random );
+
+            if( random % 8 == 0 ) {
+                held.buttons = static_cast<quint16>( random >> 16 );
+                held.axes[ random % InputPortState::AxisCount ] = static_cast<qint16>( random );
+            }
+
+            return held;
+
+        }
+
+        void play( const quint32 lastInput, LatencyHistogram &advanceTime, qint64 &advanceNs ) {
+
+            auto input = nextInput( lastInput );
+
+            qint64 before = inputClockNs();
+            bool advanced = netplay.advance( input, snapshot );
+            qint64 taken = inputClockNs() - before;
+
+            advanceTime.record( taken );
+            advanceNs += taken;
+
+            if( advanced ) {
+                inputs++;
+            }
+
+            quint32 current = netplay.queue().currentFrame();
+            quint32 rollback;
+
+            // Go back to the first frame that ran on a wrong guess, and run everything from there again. Input can
+            // come in while waiting too.
+            if( netplay.queue().takeRollback( rollback ) ) {
+                rollbacks++;
+
+                for( quint32 frame = rollback; frame < current; ++frame ) {
+                    netplay.replay( frame, snapshot );
+                    states[ frame + 1 ] = step( states[ frame ], snapshot );
+                    replayed++;
+                }
+            } else if( advanced ) {
+                states[ current ] = step( states[ current - 1 ], snapshot );
+            }
+
+        }
+
+    };
+
+}
+
+NetplayBenchmark::NetplayBenchmark( const Options &options )
+    : options( options ),
+      frames( 0 ),
+      rollbacks( 0 ),
+      replayedFrames( 0 ),
+      stalls( 0 ),
+      packets( 0 ),
+      bytes( 0 ),
+      dropped( 0 ),
+      statesMatch( false ),
+      advanceNs( 0 ),
+      advances( 0 ) {
+
+    this->options.frameRate = qMax( this->options.frameRate, 1 );
+
+}
+
+bool NetplayBenchmark::run() {
+
+    frames = static_cast<quint32>( options.duration * options.frameRate / 1000000000 );
+
+    std::unique_ptr<Player> players[ 2 ] = { std::unique_ptr<Player>( new Player ),
+                                             std::unique_ptr<Player>( new Player )
+                                           };
+
+    for( int i = 0; i < 2; ++i ) {
+
+        auto &player = *players[ i ];
+
+        if( !player.netplay.start( i, 0 ) ) {
+            setupFailure = QStringLiteral( "netplay: the sessions couldn't be started" );
+            return false;
+        }
+
+        player.netplay.queue().setLocalDelay( options.delay );
+        player.netplay.queue().setMaxPrediction( options.prediction );
+        player.netplay.transport().simulate( options.latency, options.latency / 4,
+                                             i == 0 || !options.oneWayLoss ? options.loss : 0.0, options.seed + i );
+
+        // Allocated up front, the frames themselves shouldn't be timing the allocator.
+        player.states.fill( 0, static_cast<int>( frames ) + settleFrames * 4 + 2 );
+        player.random = ( options.seed ? options.seed : 1 ) * ( i + 1 );
+        player.held = InputPortState();
+        player.inputs = 0;
+        player.rollbacks = 0;
+        player.replayed = 0;
+
+    }
+
+    for( int i = 0; i < 2; ++i ) {
+        players[ i ]->netplay.connectTo( QStringLiteral( "127.0.0.1" ),
+                                         players[ 1 - i ]->netplay.transport().localPort() );
+    }
+
+    // Played until both have confirmed every frame they played, or for twice as long as that should take.
+    quint32 confirmed = frames + settleFrames;
+    qint64 interval = 1000000000 / options.frameRate;
+    qint64 deadline = inputClockNs();
+    qint64 giveUp = deadline + options.duration * 2 + 5000000000;
+
+    while( players[ 0 ]->netplay.queue().confirmedFrames() < confirmed
+           || players[ 1 ]->netplay.queue().confirmedFrames() < confirmed ) {
+
+        for( auto &player : players ) {
+            if( player->netplay.queue().currentFrame() + 1 < static_cast<quint32>( player->states.size() ) ) {
+                player->play( frames, advanceTime, advanceNs );
+                advances++;
+            }
+        }
+
+        deadline += interval;
+        qint64 remaining = deadline - inputClockNs();
+
+        if( remaining > 0 ) {
+            QThread::usleep( static_cast<unsigned long>( remaining / 1000 ) );
+        }
+
+        if( inputClockNs() > giveUp ) {
+            setupFailure = QStringLiteral( "netplay: the sessions never caught up with each other" );
+            return false;
+        }
+
+    }
+
+    statesMatch = players[ 0 ]->states[ confirmed ] == players[ 1 ]->states[ confirmed ];
+
+    for( auto &player : players ) {
+        rollbacks += player->rollbacks;
+        replayedFrames += player->replayed;
+        stalls += player->netplay.stalls();
+        packets += player->netplay.transport().datagramsSent();
+        bytes += player->netplay.transport().bytesSent();
+        dropped += player->netplay.transport().datagramsDropped();
+    }
+
+    return true;
+
+}
+
+QString NetplayBenchmark::report() const {
+
+    qreal meanUsec = advances > 0 ? advanceNs / 1000.0 / advances : 0.0;
+
+    return QStringLiteral( "netplay: %1 frames, delay %2, prediction %3, %4 ms latency, %5% loss%6: %7 us/frame "
+                           "(p99 %8 us, max %9 us), %10 rollbacks replaying %11 frames, %12 stalls, "
+                           "%13 bytes/packet, %14 dropped, %15" )
+           .arg( frames )
+           .arg( options.delay )
+           .arg( options.prediction )
+           .arg( options.latency / 1000000 )
+           .arg( options.loss * 100, 0, 'f', 1 )
+           .arg( options.oneWayLoss ? QStringLiteral( " one way" ) : QString() )
+           .arg( meanUsec, 0, 'f', 2 )
+           .arg( advanceTime.percentile( 0.99 ) )
+           .arg( advanceTime.max() )
+           .arg( rollbacks )
+           .arg( replayedFrames )
+           .arg( stalls )
+           .arg( packets > 0 ? static_cast<qreal>( bytes ) / packets : 0.0, 0, 'f', 1 )
+           .arg( dropped )
+           .arg( statesMatch ? QStringLiteral( "games in sync" ) : QStringLiteral( "games OUT OF SYNC" ) );
+
+}
+
+QStringList NetplayBenchmark::failures() const {
+
+    QStringList failures;
+
+    if( !setupFailure.isEmpty() ) {
+        failures << setupFailure;
+    } else if( !statesMatch ) {
+        failures << QStringLiteral( "the two games ended up in different states" );
+    }
+
+    return failures;
+
+}
@@ -0,0 +1,70 @@
+#ifndef NETPLAYBENCHMARK_H
+#define NETPLAYBENCHMARK_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include "benchmark.h"
+
+#include "input/latencyhistogram.h"
+
+// NetplayBenchmark plays two InputNetplay sessions against each other over loopback, with a simulated network in
+// between, and times every advance(). Each side runs a stand-in game, a hash of every frame's input, and rolls it
+// back whenever its queue says so. Once both sides have confirmed every frame they played, their games have to be
+// in the same state, a run where they aren't is a failure.
+
+class NetplayBenchmark : public Benchmark {
+
+    public:
+
+        struct Options {
+            qint64 duration;
+            int frameRate;
+            int delay;
+            int prediction;
+
+            // One way, in nanoseconds, with up to a quarter of it in jitter.
+            qint64 latency;
+
+            // 0 - 1.
+            qreal loss;
+
+            // Only the first session's packets are lost. The second one's input keeps coming in while its
+            // acknowledgements of the first one's don't, the most the first one's ring ever has to hold.
+            bool oneWayLoss;
+
+            quint32 seed;
+        };
+
+        explicit NetplayBenchmark( const Options &options );
+
+        // False if the sessions couldn't be set up, or never caught up with each other.
+        bool run() override;
+        QString report() const override;
+
+        // Fails if the two games ended up in different states.
+        QStringList failures() const override;
+
+    private:
+
+        Options options;
+
+        // Why run() returned false.
+        QString setupFailure;
+
+        quint32 frames;
+        quint64 rollbacks;
+        quint64 replayedFrames;
+        quint64 stalls;
+        quint64 packets;
+        quint64 bytes;
+        quint64 dropped;
+        bool statesMatch;
+
+        LatencyHistogram advanceTime;
+        qint64 advanceNs;
+        quint64 advances;
+
+};
+
+#endif // NETPLAYBENCHMARK_H
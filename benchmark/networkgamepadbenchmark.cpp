@@ -0,0 +1,296 @@
+#include "networkgamepadbenchmark.h"
+
+#include "input/inputclock.h"
+#include "input/inputmanager.h"
+#include "input/networkgamepad.h"
+#include "input/networkgamepadclient.h"
+#include "input/simulatedjoystickbackend.h"
+#include "input/xorshift.h"
+
+#include <QCoreApplication>
+#include <QThread>
+
+#include <memory>
+
+namespace {
+
+    // One stand-in phone, and which port it got.
+    struct Pad {
+
+        NetworkGamepadClient client;
+        InputPortState state;
+        qint64 lastSent;
+        int port;
+
+    };
+
+    // Give every event loop connection a chance to run until done() or five seconds have passed.
+    template<typename Done>
+    bool waitFor( Done done ) {
+
+        qint64 giveUp = inputClockNs() + Q_INT64_C( 5000000000 );
+
+        while( !done() && inputClockNs() < giveUp ) {
+            QCoreApplication::processEvents();
+            QThread::msleep( 1 );
+        }
+
+        return done();
+
+    }
+
+}
+
+NetworkGamepadBenchmark::NetworkGamepadBenchmark( const Options &options )
+    : options( options ),
+      frames( 0 ),
+      packetsSent( 0 ),
+      latePacketsSent( 0 ),
+      packetsReceived( 0 ),
+      outOfOrder( 0 ),
+      lost( 0 ),
+      batches( 0 ),
+      mismatches( 0 ),
+      lingering( 0 ),
+      checksum( 0 ) {
+
+    this->options.pads = qBound( 1, options.pads, static_cast<int>( NetworkGamepadServer::maxClients ) );
+    this->options.frameRate = qMax( options.frameRate, 1 );
+
+}
+
+bool NetworkGamepadBenchmark::run() {
+
+    // No simulated pads, the network ones are the only devices.
+    std::unique_ptr<SimulatedJoystickBackend> backend( new SimulatedJoystickBackend );
+    InputManager manager( backend.get() );
+
+    // Without a lead time every pollStates() publishes, so the core sees what the server wrote right away.
+    manager.setPollMode( SDLEventLoop::EventDriven );
+    manager.setPollLeadTime( 0 );
+
+    if( !manager.startNetworkGamepads( 0 ) ) {
+        setupFailure = QStringLiteral( "%1 network pads: the server didn't start" ).arg( options.pads );
+        return false;
+    }
+
+    auto *server = manager.networkGamepads();
+    int pads = options.pads;
+    std::unique_ptr<Pad[]> pad( new Pad[ pads ] );
+
+    for( int i = 0; i < pads; ++i ) {
+
+        if( !pad[ i ].client.connectTo( QStringLiteral( "127.0.0.1" ), server->port() ) ) {
+            setupFailure = QStringLiteral( "%1 network pads: a client couldn't connect" ).arg( options.pads );
+            return false;
+        }
+
+        pad[ i ].state = InputPortState();
+        pad[ i ].lastSent = inputClockNs();
+        pad[ i ].port = -1;
+        pad[ i ].client.sendHello( QStringLiteral( "Benchmark Pad %1" ).arg( i ) );
+
+    }
+
+    // Ports are handed out in whatever order the hellos came in.
+    auto connected = [ & ] {
+
+        int found = 0;
+
+        for( int port = 0; port < InputDeviceRegistry::maxDevices; ++port ) {
+
+            auto *device = manager.at( port );
+
+            for( int i = 0; device && i < pads; ++i ) {
+                if( device->name() == QStringLiteral( "Benchmark Pad %1" ).arg( i ) ) {
+                    pad[ i ].port = port;
+                    found++;
+                }
+            }
+
+        }
+
+        return found == pads;
+
+    };
+
+    if( !waitFor( connected ) ) {
+        setupFailure = QStringLiteral( "%1 network pads: the pads never connected" ).arg( options.pads );
+        return false;
+    }
+
+    manager.setRun( true );
+    manager.resetLatency();
+    server->resetStatistics();
+
+    quint32 random = options.seed ? options.seed : 1;
+    quint32 chance = static_cast<quint32>( qBound( 0.0, static_cast<qreal>( options.eventsPerSecond )
+                                                   / options.frameRate, 1.0 ) * 4294967295.0 );
+    quint32 lateChance = static_cast<quint32>( qBound( 0.0, options.reorder, 1.0 ) * 4294967295.0 );
+
+    qint64 framePeriod = 1000000000 / options.frameRate;
+    qint64 started = inputClockNs();
+    qint64 deadline = started;
+
+    while( deadline - started < options.duration ) {
+
+        qint64 now = inputClockNs();
+
+        for( int i = 0; i < pads; ++i ) {
+
+            auto &p = pad[ i ];
+            InputPortState previous = p.state;
+
+            if( xorshift32( random ) < chance ) {
+
+                quint32 value = xorshift32( random );
+
+                if( value & 1 ) {
+                    p.state.buttons ^= static_cast<quint16>( 1 << ( value >> 1 ) % 16 );
+                } else {
+                    p.state.axes[ ( value >> 1 ) % InputPortState::AxisCount ] = static_cast<qint16>( value >> 16 );
+                }
+
+            } else if( now - p.lastSent < NetworkGamepadPacket::keepAliveInterval ) {
+                continue;
+            }
+
+            p.client.sendState( p.state );
+            p.lastSent = now;
+            packetsSent++;
+
+            // What a network that reorders would do: the packet before this one, only arriving now.
+            if( xorshift32( random ) < lateChance ) {
+                uchar late[ NetworkGamepadPacket::maxSize ];
+                int size = NetworkGamepadPacket::write( late, NetworkGamepadPacket::State,
+                                                        static_cast<quint16>( p.client.sequence() - 1 ), previous );
+
+                p.client.send( late, size );
+                latePacketsSent++;
+            }
+
+        }
+
+        deadline += framePeriod;
+        qint64 remaining = deadline - inputClockNs();
+
+        if( remaining > 0 ) {
+            QThread::usleep( static_cast<unsigned long>( remaining / 1000 ) );
+        }
+
+        // What a core does every frame: poll, then read every port.
+        manager.pollStates();
+        auto &snapshot = manager.snapshot();
+
+        for( int i = 0; i < pads; ++i ) {
+            checksum += snapshot.ports[ pad[ i ].port ].buttons;
+        }
+
+        frames++;
+
+    }
+
+    // Everything sent has long arrived by the next frame or so, loopback doesn't lose packets.
+    QThread::msleep( 50 );
+    manager.pollStates();
+
+    auto &snapshot = manager.snapshot();
+
+    for( int i = 0; i < pads; ++i ) {
+
+        auto &port = snapshot.ports[ pad[ i ].port ];
+        bool same = port.buttons == pad[ i ].state.buttons;
+
+        for( int axis = 0; axis < InputPortState::AxisCount; ++axis ) {
+            same = same && port.axes[ axis ] == pad[ i ].state.axes[ axis ];
+        }
+
+        mismatches += same ? 0 : 1;
+
+    }
+
+    packetsReceived = server->packetsReceived();
+    outOfOrder = server->packetsOutOfOrder();
+    lost = server->packetsLost();
+    batches = server->batches();
+    packetLatency = server->packetLatency().summary();
+    captureLatency = manager.latencySummary();
+
+    // Saying goodbye has to free the port.
+    for( int i = 0; i < pads; ++i ) {
+        pad[ i ].client.sendGoodbye();
+    }
+
+    auto gone = [ & ] {
+
+        int remaining = 0;
+
+        for( int i = 0; i < pads; ++i ) {
+            remaining += manager.at( pad[ i ].port ) ? 1 : 0;
+        }
+
+        lingering = static_cast<quint64>( remaining );
+
+        return remaining == 0;
+
+    };
+
+    waitFor( gone );
+
+    manager.setRun( false );
+    manager.stopNetworkGamepads();
+
+    return true;
+
+}
+
+QString NetworkGamepadBenchmark::report() const {
+
+    QString line = QStringLiteral( "%1 network pads: %2 frames, %3 packets sent (%4 late), %5 received in %6 batches, "
+                                   "%7 dropped out of order, %8 lost, %9 ports wrong, %10 never left" )
+                   .arg( options.pads, 3 )
+                   .arg( frames )
+                   .arg( packetsSent )
+                   .arg( latePacketsSent )
+                   .arg( packetsReceived )
+                   .arg( batches )
+                   .arg( outOfOrder )
+                   .arg( lost )
+                   .arg( mismatches )
+                   .arg( lingering );
+
+    line += QStringLiteral( "\n    packet to state: %1\n    packet to core: %2" )
+            .arg( packetLatency )
+            .arg( captureLatency );
+
+    return line;
+
+}
+
+QStringList NetworkGamepadBenchmark::failures() const {
+
+    QStringList failures;
+
+    if( !setupFailure.isEmpty() ) {
+        failures << setupFailure;
+        return failures;
+    }
+
+    // On loopback every late packet arrives after the one it was sent after, and has to be dropped.
+    quint64 applied = latePacketsSent > outOfOrder ? latePacketsSent - outOfOrder : 0;
+
+    if( mismatches > 0 ) {
+        failures << QStringLiteral( "%1 ports ended up different from what their pad sent last" ).arg( mismatches );
+    }
+
+    if( applied > 0 ) {
+        failures << QStringLiteral( "%1 late packets were applied" ).arg( applied );
+    }
+
+    if( lingering > 0 ) {
+        failures << QStringLiteral( "%1 pads kept their port after saying goodbye" ).arg( lingering );
+    }
+
+    return failures;
+
+}
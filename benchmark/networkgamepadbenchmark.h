@@ -0,0 +1,72 @@
+#ifndef NETWORKGAMEPADBENCHMARK_H
+#define NETWORKGAMEPADBENCHMARK_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include "benchmark.h"
+
+// NetworkGamepadBenchmark has loopback NetworkGamepadClients stand in for phones, connected to a real
+// InputManager's NetworkGamepadServer, with the calling thread standing in for a core that reads input once per
+// frame. Every client sends a random trace, and now and then an older packet right after a newer one, which the
+// server has to drop.
+
+// A run reports how long a packet took from arriving to its state being written, and from arriving to the core.
+// It fails if a pad's port doesn't end up with exactly what its client sent last, if any late packet got through,
+// or if a pad that said goodbye kept its port. Linux only, like the server.
+
+class NetworkGamepadBenchmark : public Benchmark {
+
+    public:
+
+        struct Options {
+            int pads;
+            qint64 duration;
+            int frameRate;
+
+            // Changes per second per pad.
+            int eventsPerSecond;
+
+            // Share of the changes followed by the packet before them again, 0 - 1.
+            qreal reorder;
+
+            quint32 seed;
+        };
+
+        explicit NetworkGamepadBenchmark( const Options &options );
+
+        // Returns false if the server didn't start, or the pads never connected.
+        bool run() override;
+        QString report() const override;
+
+        // Fails if a pad's port ended up wrong, a late packet was applied, or a pad never went away.
+        QStringList failures() const override;
+
+    private:
+
+        Options options;
+
+        // Why run() returned false.
+        QString setupFailure;
+
+        quint64 frames;
+        quint64 packetsSent;
+        quint64 latePacketsSent;
+
+        quint64 packetsReceived;
+        quint64 outOfOrder;
+        quint64 lost;
+        quint64 batches;
+
+        QString packetLatency;
+        QString captureLatency;
+
+        quint64 mismatches;
+        quint64 lingering;
+
+        // Keeps the compiler from dropping the snapshot reads.
+        quint64 checksum;
+
+};
+
+#endif // NETWORKGAMEPADBENCHMARK_H
@@ -0,0 +1,222 @@
+#include "runaheadbenchmark.h"
+
+#include "input/inputclock.h"
+#include "input/inputrunahead.h"
+#include "input/xorshift.h"
+
+#include <memory>
+
+// How much game time the stand-in core plays, in seconds. It doesn't wait for frames, this takes well under one.
+static const int playedSeconds = 600;
+
+// Commits and restores are timed this many at a time, so reading the clock doesn't dominate.
+static const int timedBatch = 1024;
+
+namespace {
+
+    // The stand-in core's state after a frame: FNV-1a of the state before and everything it could read.
+    quint64 step( quint64 state, const InputSnapshot &input ) {
+
+        for( int i = 0; i < input.portCount; ++i ) {
+            state = ( state ^ input.ports[ i ].buttons ) * 1099511628211ull;
+
+            for( auto axis : input.ports[ i ].axes ) {
+                state = ( state ^ static_cast<quint16>( axis ) ) * 1099511628211ull;
+            }
+        }
+
+        return ( state ^ input.keyboard.modifiers ) * 1099511628211ull;
+
+    }
+
+    // Change each port with the given chance, out of 2^32.
+    void changePorts( InputSnapshot &snapshot, quint32 &random, const quint32 chance ) {
+
+        for( int i = 0; i < snapshot.portCount; ++i ) {
+            if( xorshift32( random ) < chance ) {
+                quint32 value = xorshift32( random );
+
+                auto &port = snapshot.ports[ i ];
+
+                if( value & 1 ) {
+                    port.buttons ^= static_cast<quint16>( 1 << ( value >> 1 ) % 16 );
+                } else {
+                    port.axes[ ( value >> 1 ) % InputPortState::AxisCount ] = static_cast<qint16>( value >> 16 );
+                }
+            }
+        }
+
+    }
+
+}
+
+RunAheadBenchmark::RunAheadBenchmark( const Options &options )
+    : options( options ),
+      commits( 0 ),
+      commitNs( 0 ),
+      restores( 0 ),
+      restoreNs( 0 ),
+      playedFrames( 0 ),
+      changedFrames( 0 ),
+      framesRun( 0 ),
+      mismatchCount( 0 ) {
+
+    this->options.ports = qBound( 1, options.ports, static_cast<int>( InputSnapshot::maxPorts ) );
+    this->options.frames = qBound( 0, options.frames, static_cast<int>( InputRunAhead::maxFrames ) );
+    this->options.frameRate = qMax( options.frameRate, 1 );
+
+}
+
+bool RunAheadBenchmark::run() {
+
+    std::unique_ptr<InputRunAhead> runAhead( new InputRunAhead );
+
+    quint32 chance = static_cast<quint32>( qBound( 0.0, static_cast<qreal>( options.eventsPerSecond )
+                                                   / options.frameRate, 1.0 ) * 4294967295.0 );
+    quint32 random = options.seed ? options.seed : 1;
+
+    // Timing first, on a few prepared frames cycled through.
+    static const int sets = 16;
+    std::unique_ptr<InputSnapshot[]> snapshots( new InputSnapshot[ sets ] );
+
+    for( int set = 0; set < sets; ++set ) {
+        auto &snapshot = snapshots[ set ];
+
+        snapshot.frame = set;
+        snapshot.timestamp = 0;
+        snapshot.portCount = options.ports;
+        snapshot.keyboard.clear();
+
+        for( int i = 0; i < options.ports; ++i ) {
+            snapshot.ports[ i ] = set > 0 ? snapshots[ set - 1 ].ports[ i ] : InputPortState();
+            snapshot.captured[ i ] = 0;
+        }
+
+        changePorts( snapshot, random, chance );
+    }
+
+    std::unique_ptr<InputSnapshot> restored( new InputSnapshot );
+    qint64 started = inputClockNs();
+
+    while( inputClockNs() - started < options.duration / 2 ) {
+
+        qint64 before = inputClockNs();
+
+        for( int i = 0; i < timedBatch; ++i ) {
+            runAhead->commit( snapshots[ i % sets ] );
+        }
+
+        commitNs += inputClockNs() - before;
+        commits += timedBatch;
+
+        before = inputClockNs();
+
+        for( int i = 0; i < timedBatch; ++i ) {
+            runAhead->restore( runAhead->committedFrames() - 1 - i % InputRunAhead::historySize, *restored );
+        }
+
+        restoreNs += inputClockNs() - before;
+        restores += timedBatch;
+
+    }
+
+    // Then the stand-in core. real is the state after the last real frame, ahead[ n ] the state n + 1 frames
+    // after that, run with the last real frame's input.
+    runAhead->reset();
+
+    std::unique_ptr<InputSnapshot> input( new InputSnapshot );
+    *input = snapshots[ 0 ];
+
+    int frames = options.frames;
+    quint64 real = 0;
+    quint64 ahead[ InputRunAhead::maxFrames + 1 ];
+
+    playedFrames = static_cast<quint64>( playedSeconds ) * options.frameRate;
+
+    for( quint64 frame = 0; frame < playedFrames; ++frame ) {
+
+        changePorts( *input, random, chance );
+
+        quint64 before = real;
+
+        if( runAhead->commit( *input ) ) {
+
+            // Load the last real state, and run this frame and every frame ahead again, with the input as it was
+            // committed.
+            changedFrames++;
+            runAhead->restore( runAhead->committedFrames() - 1, *restored );
+
+            real = step( before, *restored );
+            quint64 state = real;
+
+            for( int i = 0; i < frames; ++i ) {
+                state = step( state, *restored );
+                ahead[ i ] = state;
+            }
+
+            framesRun += frames + 1;
+
+        } else if( frames > 0 ) {
+
+            // The first frame ahead was this one, with the same input. Only the new last frame has to be run.
+            real = ahead[ 0 ];
+
+            for( int i = 0; i + 1 < frames; ++i ) {
+                ahead[ i ] = ahead[ i + 1 ];
+            }
+
+            ahead[ frames - 1 ] = step( frames > 1 ? ahead[ frames - 2 ] : real, *input );
+            framesRun++;
+
+        } else {
+
+            real = step( before, *input );
+            framesRun++;
+
+        }
+
+        // A core that always runs everything again.
+        quint64 expected = step( before, *input );
+
+        for( int i = 0; i < frames; ++i ) {
+            expected = step( expected, *input );
+        }
+
+        if( ( frames > 0 ? ahead[ frames - 1 ] : real ) != expected ) {
+            mismatchCount++;
+        }
+
+    }
+
+    return true;
+
+}
+
+QString RunAheadBenchmark::report() const {
+
+    qreal perFrame = playedFrames > 0 ? static_cast<qreal>( framesRun ) / playedFrames : 0.0;
+
+    return QStringLiteral( "%1 ports, run-ahead %2: commit %3 ns, restore %4 ns, %5% of frames changed, "
+                           "%6 frames run per frame (%7 always running again), %8 mismatches" )
+           .arg( options.ports, 3 )
+           .arg( options.frames )
+           .arg( commits > 0 ? static_cast<qreal>( commitNs ) / commits : 0.0, 0, 'f', 1 )
+           .arg( restores > 0 ? static_cast<qreal>( restoreNs ) / restores : 0.0, 0, 'f', 1 )
+           .arg( playedFrames > 0 ? 100.0 * changedFrames / playedFrames : 0.0, 0, 'f', 1 )
+           .arg( perFrame, 0, 'f', 2 )
+           .arg( options.frames + 1 )
+           .arg( mismatchCount );
+
+}
+
+QStringList RunAheadBenchmark::failures() const {
+
+    QStringList failures;
+
+    if( mismatchCount > 0 ) {
+        failures << QStringLiteral( "skipping frames that didn't have to run again changed what was shown" );
+    }
+
+    return failures;
+
+}
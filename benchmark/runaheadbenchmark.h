@@ -0,0 +1,54 @@
+#ifndef RUNAHEADBENCHMARK_H
+#define RUNAHEADBENCHMARK_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include "benchmark.h"
+
+// RunAheadBenchmark times InputRunAhead's commits and restores, then plays a random trace through a stand-in core
+// that runs ahead: a hash of every frame's input, which only runs its frames again when commit() says the input
+// changed. What it shows every frame has to be exactly what a core that always runs everything again would show, a
+// run where it isn't is a failure.
+
+class RunAheadBenchmark : public Benchmark {
+
+    public:
+
+        struct Options {
+            int ports;
+            int frames;
+            qint64 duration;
+            int frameRate;
+
+            // Changes per second per port.
+            int eventsPerSecond;
+
+            quint32 seed;
+        };
+
+        explicit RunAheadBenchmark( const Options &options );
+
+        bool run() override;
+        QString report() const override;
+
+        // Fails if the stand-in core showed any frame differently from one that runs everything again.
+        QStringList failures() const override;
+
+    private:
+
+        Options options;
+
+        quint64 commits;
+        qint64 commitNs;
+        quint64 restores;
+        qint64 restoreNs;
+
+        quint64 playedFrames;
+        quint64 changedFrames;
+        quint64 framesRun;
+        quint64 mismatchCount;
+
+};
+
+#endif // RUNAHEADBENCHMARK_H
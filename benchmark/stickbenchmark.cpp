@@ -0,0 +1,120 @@
+#include "stickbenchmark.h"
+
+#include "input/inputclock.h"
+#include "input/stickprocessor.h"
+#include "input/xorshift.h"
+
+#include <memory>
+
+StickBenchmark::StickBenchmark( const int pads, const qint64 duration, const quint32 seed )
+    : pads( qBound( 1, pads, static_cast<int>( InputDeviceRegistry::maxDevices ) ) ),
+      duration( duration ),
+      seed( seed ? seed : 1 ),
+      batches( 0 ),
+      vectorNs( 0 ),
+      scalarNs( 0 ),
+      mismatchCount( 0 ) {
+
+}
+
+bool StickBenchmark::run() {
+
+    // One settings per pad, like real devices. Every shape, with and without a curve.
+    auto gentle = std::make_shared<StickCurve>( 2.0 );
+    auto twitchy = std::make_shared<StickCurve>( 0.6 );
+    std::unique_ptr<StickSettings[]> settings( new StickSettings[ pads ] );
+
+    for( int pad = 0; pad < pads; ++pad ) {
+        settings[ pad ].shape = static_cast<StickSettings::DeadZoneShape>( pad % 3 );
+        settings[ pad ].deadZone = static_cast<qint16>( 2000 + pad * 997 % 6000 );
+        settings[ pad ].curve = pad % 4 == 1 ? gentle : pad % 4 == 3 ? twitchy : nullptr;
+    }
+
+    quint32 state = seed ? seed : 1;
+    auto next = [ &state ] {
+        return xorshift32( state );
+    };
+
+    std::unique_ptr<StickBatch> vector( new StickBatch );
+    std::unique_ptr<StickBatch> scalar( new StickBatch );
+
+    // New positions every batch would mostly time the random numbers, so cycle through a few sets of them.
+    static const int sets = 16;
+    std::unique_ptr<StickBatch[]> positions( new StickBatch[ sets ] );
+
+    for( int set = 0; set < sets; ++set ) {
+        for( int pad = 0; pad < pads; ++pad ) {
+            for( int stick = 0; stick < 2; ++stick ) {
+                auto x = static_cast<qint16>( next() );
+                auto y = static_cast<qint16>( next() );
+
+                // Plenty of sticks rest in the middle.
+                if( next() % 4 == 0 ) {
+                    x /= 16;
+                    y /= 16;
+                }
+
+                positions[ set ].add( x, y, &settings[ pad ] );
+            }
+        }
+    }
+
+    qint64 started = inputClockNs();
+
+    while( inputClockNs() - started < duration ) {
+
+        auto &set = positions[ batches % sets ];
+
+        *vector = set;
+        qint64 before = inputClockNs();
+        vector->process();
+        vectorNs += inputClockNs() - before;
+
+        *scalar = set;
+        before = inputClockNs();
+        StickProcessor::processScalar( scalar->x, scalar->y, scalar->settings, scalar->dpad, scalar->count );
+        scalarNs += inputClockNs() - before;
+
+        for( int i = 0; i < set.count; ++i ) {
+            if( vector->x[ i ] != scalar->x[ i ] || vector->y[ i ] != scalar->y[ i ]
+                || vector->dpad[ i ] != scalar->dpad[ i ] ) {
+                mismatchCount++;
+            }
+        }
+
+        batches++;
+
+    }
+
+    return true;
+
+}
+
+QString StickBenchmark::report() const {
+
+    qreal sticks = static_cast<qreal>( batches ) * pads * 2;
+    qreal vectorPerStick = sticks > 0 ? vectorNs / sticks : 0.0;
+    qreal scalarPerStick = sticks > 0 ? scalarNs / sticks : 0.0;
+
+    return QStringLiteral( "%1 pads, sticks: %2 ns/stick %3, %4 ns/stick scalar (%5x), %6 batches, %7 mismatches" )
+           .arg( pads, 3 )
+           .arg( vectorPerStick, 0, 'f', 2 )
+           .arg( StickProcessor::vectorized() ? QStringLiteral( "SSE2" ) : QStringLiteral( "unvectorized" ) )
+           .arg( scalarPerStick, 0, 'f', 2 )
+           .arg( vectorPerStick > 0 ? scalarPerStick / vectorPerStick : 0.0, 0, 'f', 2 )
+           .arg( batches )
+           .arg( mismatchCount );
+
+}
+
+QStringList StickBenchmark::failures() const {
+
+    QStringList failures;
+
+    if( mismatchCount > 0 ) {
+        failures << QStringLiteral( "the vectorized and scalar results differ" );
+    }
+
+    return failures;
+
+}
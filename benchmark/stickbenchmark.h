@@ -0,0 +1,38 @@
+#ifndef STICKBENCHMARK_H
+#define STICKBENCHMARK_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include "benchmark.h"
+
+// StickBenchmark times StickProcessor::process() against processScalar() on the same random sticks, the way a
+// polled poll hands them over: two per pad, with a mix of dead zone shapes and response curves. Both have to come
+// up with exactly the same results, a run that doesn't is a failure.
+
+class StickBenchmark : public Benchmark {
+
+    public:
+
+        StickBenchmark( const int pads, const qint64 duration, const quint32 seed );
+
+        bool run() override;
+        QString report() const override;
+
+        // Fails if the two paths disagreed on any stick.
+        QStringList failures() const override;
+
+    private:
+
+        int pads;
+        qint64 duration;
+        quint32 seed;
+
+        quint64 batches;
+        qint64 vectorNs;
+        qint64 scalarNs;
+        quint64 mismatchCount;
+
+};
+
+#endif // STICKBENCHMARK_H
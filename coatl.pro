@@ -1,5 +1,6 @@
 TEMPLATE = subdirs
 
-SUBDIRS += backend frontend
+SUBDIRS += backend frontend benchmark
 
 frontend.depends = backend
+benchmark.depends = backend
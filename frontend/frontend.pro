@@ -74,3 +74,6 @@ RESOURCES += qml.qrc
 
     # Other libraries we use
     LIBS += -lsamplerate -lz
+
+    # shm_open(), for the input export
+    linux: LIBS += -lrt
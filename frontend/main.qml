@@ -109,13 +109,23 @@ ApplicationWindow {
             }
 
             MenuItem {
-                visible: false;
-                text: "Frame Rate: ";
+                id: inputLatencyItem;
+                visible: videoItem.coreState !== Core.STATEUNINITIALIZED;
+                enabled: false;
+                text: "Input Latency: ";
             }
         }
 
     }
 
+    // Input latency histograms are sampled rather than bound, they change every frame.
+    Timer {
+        interval: 1000;
+        repeat: true;
+        running: inputLatencyItem.visible;
+        onTriggered: inputLatencyItem.text = "Input Latency: " + input.latencySummary();
+    }
+
     statusBar: StatusBar {
         RowLayout {
             Button {
@@ -0,0 +1,317 @@
+#include "controllerdatabase.h"
+
+#include "logging.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMap>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+
+#include <SDL.h>
+
+#include <cstring>
+
+const quint32 ControllerDatabase::magic;
+const quint16 ControllerDatabase::version;
+
+ControllerDatabase::ControllerDatabase()
+    : table( nullptr ),
+      entryCount( 0 ) {
+
+}
+
+ControllerDatabase::~ControllerDatabase() {
+    unload();
+}
+
+bool ControllerDatabase::load() {
+
+    unload();
+
+    // Ensures the resources at loaded at startup, even during
+    // static compilation.
+    Q_INIT_RESOURCE( controllerdb );
+    QFile source( ":/input/gamecontrollerdb.txt" );
+
+    if( !source.open( QIODevice::ReadOnly ) ) {
+        qCWarning( phxInput ) << "Unable to open the controller database";
+        return false;
+    }
+
+    // Only hashed, not parsed, unless the cache is out of date.
+    auto text = source.readAll();
+    quint32 sourceHash = hash( text );
+
+    cacheFile.setFileName( cachePath() );
+
+    if( cacheFile.open( QIODevice::ReadOnly ) ) {
+
+        auto *data = cacheFile.map( 0, cacheFile.size() );
+
+        if( data && useTable( data, cacheFile.size(), sourceHash ) ) {
+            return true;
+        }
+
+        if( data ) {
+            cacheFile.unmap( data );
+        }
+
+        cacheFile.close();
+
+    }
+
+    compiled = compile( text, SDL_GetPlatform() );
+
+    if( !useTable( reinterpret_cast<const uchar *>( compiled.constData() ), compiled.size(), sourceHash ) ) {
+        qCWarning( phxInput ) << "Unable to compile the controller database";
+        compiled.clear();
+        return false;
+    }
+
+    // A failed write only costs the next launch a compile.
+    QDir().mkpath( QFileInfo( cachePath() ).absolutePath() );
+    QSaveFile cache( cachePath() );
+
+    if( !cache.open( QIODevice::WriteOnly ) || cache.write( compiled ) != compiled.size() || !cache.commit() ) {
+        qCDebug( phxInput ) << "Unable to cache the controller database at" << cachePath();
+    }
+
+    return true;
+
+}
+
+int ControllerDatabase::addOverrides( const QString &path ) {
+
+    QFile file( path );
+
+    if( !file.open( QIODevice::ReadOnly | QIODevice::Text ) ) {
+        return 0;
+    }
+
+    // Users only ever have a handful of these, compile them the same way and copy them out of the table.
+    auto userTable = compile( file.readAll(), SDL_GetPlatform() );
+    auto *data = reinterpret_cast<const uchar *>( userTable.constData() );
+    int count = static_cast<int>( qFromLittleEndian<quint32>( data + 12 ) );
+
+    for( int i = 0; i < count; ++i ) {
+
+        auto *entry = data + headerSize + i * entrySize;
+        auto offset = qFromLittleEndian<quint32>( entry + 16 );
+        auto length = qFromLittleEndian<quint32>( entry + 20 );
+
+        overrides.insert( QByteArray( reinterpret_cast<const char *>( entry ), 16 ),
+                          userTable.mid( static_cast<int>( offset ), static_cast<int>( length ) ) );
+
+    }
+
+    if( count > 0 ) {
+        qCDebug( phxInput ) << "Loaded" << count << "controller mappings from" << path;
+    }
+
+    return count;
+
+}
+
+QByteArray ControllerDatabase::mapping( const QString &guid ) const {
+
+    uchar key[ 16 ];
+
+    if( !parseGuid( guid.toLatin1(), key ) ) {
+        return QByteArray();
+    }
+
+    auto userMapping = overrides.constFind( QByteArray( reinterpret_cast<const char *>( key ), sizeof( key ) ) );
+
+    if( userMapping != overrides.constEnd() ) {
+        return userMapping.value();
+    }
+
+    int low = 0;
+    int high = entryCount;
+
+    while( low < high ) {
+
+        int middle = low + ( high - low ) / 2;
+        auto *entry = table + headerSize + middle * entrySize;
+        int order = std::memcmp( entry, key, sizeof( key ) );
+
+        if( order == 0 ) {
+            auto offset = qFromLittleEndian<quint32>( entry + 16 );
+            auto length = qFromLittleEndian<quint32>( entry + 20 );
+
+            return QByteArray( reinterpret_cast<const char *>( table + offset ), static_cast<int>( length ) );
+        }
+
+        if( order < 0 ) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+
+    }
+
+    return QByteArray();
+
+}
+
+int ControllerDatabase::size() const {
+    return entryCount;
+}
+
+QByteArray ControllerDatabase::compile( const QByteArray &text, const QByteArray &platform ) {
+
+    // Sorted by the binary GUID, which is the order the table is searched in.
+    QMap<QByteArray, QByteArray> lines;
+
+    for( auto line : text.split( '\n' ) ) {
+
+        line = line.trimmed();
+
+        if( line.isEmpty() || line.startsWith( '#' ) ) {
+            continue;
+        }
+
+        uchar guid[ 16 ];
+
+        if( !parseGuid( line.left( line.indexOf( ',' ) ), guid ) ) {
+            continue;
+        }
+
+        // The database isn't consistent about the case of the key.
+        int platformField = line.toLower().indexOf( ",platform:" );
+
+        if( platformField != -1 ) {
+
+            int start = platformField + 10;
+            int end = line.indexOf( ',', start );
+
+            if( line.mid( start, end == -1 ? -1 : end - start ) != platform ) {
+                continue;
+            }
+
+        }
+
+        lines.insert( QByteArray( reinterpret_cast<const char *>( guid ), sizeof( guid ) ), line );
+
+    }
+
+    QByteArray table( headerSize + lines.size() * entrySize, '\0' );
+    auto *header = reinterpret_cast<uchar *>( table.data() );
+
+    qToLittleEndian<quint32>( magic, header );
+    qToLittleEndian<quint16>( version, header + 4 );
+    qToLittleEndian<quint32>( hash( text ), header + 8 );
+    qToLittleEndian<quint32>( static_cast<quint32>( lines.size() ), header + 12 );
+
+    int index = 0;
+
+    for( auto it = lines.constBegin(); it != lines.constEnd(); ++it, ++index ) {
+
+        quint32 offset = static_cast<quint32>( table.size() );
+        table.append( it.value() );
+
+        // append() may have moved the table.
+        auto *entry = reinterpret_cast<uchar *>( table.data() ) + headerSize + index * entrySize;
+        std::memcpy( entry, it.key().constData(), 16 );
+        qToLittleEndian<quint32>( offset, entry + 16 );
+        qToLittleEndian<quint32>( static_cast<quint32>( it.value().size() ), entry + 20 );
+
+    }
+
+    return table;
+
+}
+
+QString ControllerDatabase::cachePath() {
+    return QStandardPaths::writableLocation( QStandardPaths::CacheLocation )
+           + QStringLiteral( "/gamecontrollerdb-%1.bin" ).arg( QString( SDL_GetPlatform() ).remove( ' ' ) );
+}
+
+QString ControllerDatabase::overridesPath() {
+    return QStandardPaths::writableLocation( QStandardPaths::AppDataLocation )
+           + QStringLiteral( "/gamecontrollerdb.txt" );
+}
+
+bool ControllerDatabase::useTable( const uchar *data, const qint64 size, const quint32 sourceHash ) {
+
+    if( size < headerSize
+        || qFromLittleEndian<quint32>( data ) != magic
+        || qFromLittleEndian<quint16>( data + 4 ) != version
+        || qFromLittleEndian<quint32>( data + 8 ) != sourceHash ) {
+        return false;
+    }
+
+    qint64 count = qFromLittleEndian<quint32>( data + 12 );
+
+    if( headerSize + count * entrySize > size ) {
+        return false;
+    }
+
+    // Checked once here, so lookups can trust every entry.
+    for( qint64 i = 0; i < count; ++i ) {
+
+        auto *entry = data + headerSize + i * entrySize;
+        qint64 end = static_cast<qint64>( qFromLittleEndian<quint32>( entry + 16 ) )
+                     + qFromLittleEndian<quint32>( entry + 20 );
+
+        if( end > size ) {
+            return false;
+        }
+
+    }
+
+    table = data;
+    entryCount = static_cast<int>( count );
+
+    return true;
+
+}
+
+void ControllerDatabase::unload() {
+
+    if( table && cacheFile.isOpen() ) {
+        cacheFile.unmap( const_cast<uchar *>( table ) );
+    }
+
+    cacheFile.close();
+    compiled.clear();
+
+    table = nullptr;
+    entryCount = 0;
+
+}
+
+quint32 ControllerDatabase::hash( const QByteArray &data ) {
+
+    quint32 hash = 2166136261u;
+
+    for( char byte : data ) {
+        hash = ( hash ^ static_cast<uchar>( byte ) ) * 16777619u;
+    }
+
+    return hash;
+
+}
+
+bool ControllerDatabase::parseGuid( const QByteArray &text, uchar *guid ) {
+
+    if( text.size() != 32 ) {
+        return false;
+    }
+
+    for( int i = 0; i < 16; ++i ) {
+
+        bool ok;
+        guid[ i ] = static_cast<uchar>( text.mid( i * 2, 2 ).toUInt( &ok, 16 ) );
+
+        if( !ok ) {
+            return false;
+        }
+
+    }
+
+    return true;
+
+}
@@ -0,0 +1,83 @@
+#ifndef CONTROLLERDATABASE_H
+#define CONTROLLERDATABASE_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+// ControllerDatabase looks up the game controller mapping of one GUID, so SDL only ever has to parse the mappings
+// of the controllers that are actually plugged in, instead of the whole database on every launch.
+
+// The bundled gamecontrollerdb.txt is compiled into a table of this platform's mappings, sorted by GUID, and
+// cached on disk. Later launches memory map the cache and binary search it, the text is only read again when the
+// bundled database changes. If there's nowhere to write the cache, the compiled table is kept in memory instead.
+
+// The compiled table starts with a 16 byte header: the magic "PXDB", a 16 bit version, 16 reserved bits, the
+// FNV-1a hash of the text it was compiled from, and the number of entries. Each entry is the 16 byte binary GUID
+// and the 32 bit offset and length of its mapping line, and the lines follow the entries. Every integer is little
+// endian.
+
+// User overrides, in the same format as the database, are kept apart from the table and take precedence over it.
+
+class ControllerDatabase {
+
+    public:
+
+        ControllerDatabase();
+        ~ControllerDatabase();
+
+        // Load the bundled database for this platform, from the cache when it's up to date.
+        bool load();
+
+        // Add the mappings in this file on top of the bundled ones. Returns how many were read, a file that
+        // doesn't exist has none.
+        int addOverrides( const QString &path );
+
+        // The mapping line for this GUID, as SDL_GameControllerAddMapping() takes it. Empty if there's none.
+        QByteArray mapping( const QString &guid ) const;
+
+        // Number of compiled mappings, not counting the overrides.
+        int size() const;
+
+        // Compile a database into a table, keeping only the lines for this platform, as SDL_GetPlatform() names
+        // it, and the ones for any platform. A later line for the same GUID replaces an earlier one.
+        static QByteArray compile( const QByteArray &text, const QByteArray &platform );
+
+        // Where the compiled table of the bundled database is cached, and where users put their own mappings.
+        static QString cachePath();
+        static QString overridesPath();
+
+    private:
+
+        static const quint32 magic = 0x42445850; // "PXDB"
+        static const quint16 version = 1;
+        static const int headerSize = 16;
+        static const int entrySize = 24;
+
+        QFile cacheFile;
+
+        // The table, either mapped from cacheFile or pointing into compiled.
+        const uchar *table;
+        QByteArray compiled;
+
+        int entryCount;
+
+        QHash<QByteArray, QByteArray> overrides;
+
+        // Point table at this data if it's a valid table compiled from text with this hash.
+        bool useTable( const uchar *data, const qint64 size, const quint32 sourceHash );
+
+        void unload();
+
+        static quint32 hash( const QByteArray &data );
+
+        // Parse a 32 digit hex GUID. Returns false if it isn't one.
+        static bool parseGuid( const QByteArray &text, uchar *guid );
+
+        Q_DISABLE_COPY( ControllerDatabase )
+
+};
+
+#endif // CONTROLLERDATABASE_H
@@ -0,0 +1,269 @@
+#include "evdevdevice.h"
+
+#include <linux/input.h>
+#include <sys/ioctl.h>
+
+const int EvdevDevice::absoluteAxes;
+
+static_assert( EvdevDevice::absoluteAxes == ABS_CNT, "absoluteAxes must match the kernel's" );
+
+// Whether a bit is set in an array of longs as filled in by EVIOCGBIT and EVIOCGKEY.
+static bool testBit( const unsigned long *bits, const int bit ) {
+    const int longBits = static_cast<int>( sizeof( unsigned long ) * 8 );
+    return ( bits[ bit / longBits ] >> ( bit % longBits ) ) & 1;
+}
+
+EvdevDevice::EvdevDevice( const QString &name, QObject *parent )
+    : InputDevice( LibretroType::DigitalGamepad, name, parent ),
+      hatX( 0 ),
+      hatY( 0 ) {
+
+    for( auto &range : ranges ) {
+        range.minimum = -32768;
+        range.maximum = 32767;
+    }
+
+}
+
+bool EvdevDevice::isGamepad( const int fd ) {
+
+    unsigned long keys[ ( KEY_CNT + sizeof( unsigned long ) * 8 - 1 ) / ( sizeof( unsigned long ) * 8 ) ] = {};
+
+    if( ioctl( fd, EVIOCGBIT( EV_KEY, sizeof( keys ) ), keys ) < 0 ) {
+        return false;
+    }
+
+    return testBit( keys, BTN_GAMEPAD );
+
+}
+
+void EvdevDevice::readRanges( const int fd ) {
+
+    for( int code = 0; code < absoluteAxes; ++code ) {
+
+        struct input_absinfo info;
+
+        if( ioctl( fd, EVIOCGABS( code ), &info ) == 0 && info.maximum > info.minimum ) {
+            ranges[ code ].minimum = info.minimum;
+            ranges[ code ].maximum = info.maximum;
+        }
+
+    }
+
+}
+
+void EvdevDevice::assumeDefaultRanges() {
+
+    // xpad: sticks are signed 16 bit, triggers 0 - 255 (0 - 1023 on newer pads, which then saturate early).
+    for( int code : { ABS_Z, ABS_RZ } ) {
+        ranges[ code ].minimum = 0;
+        ranges[ code ].maximum = 255;
+    }
+
+    for( int code : { ABS_HAT0X, ABS_HAT0Y } ) {
+        ranges[ code ].minimum = -1;
+        ranges[ code ].maximum = 1;
+    }
+
+}
+
+void EvdevDevice::handle( const quint16 type, const quint16 code, const qint32 value, const qint64 timestamp ) {
+
+    switch( type ) {
+        case EV_KEY:
+            handleButton( code, value != 0, timestamp );
+            break;
+
+        case EV_ABS:
+            handleAxis( code, value, timestamp );
+            break;
+
+        default:
+            break;
+    }
+
+}
+
+void EvdevDevice::resync( const int fd, const qint64 timestamp ) {
+
+    unsigned long keys[ ( KEY_CNT + sizeof( unsigned long ) * 8 - 1 ) / ( sizeof( unsigned long ) * 8 ) ] = {};
+
+    if( ioctl( fd, EVIOCGKEY( sizeof( keys ) ), keys ) == 0 ) {
+        for( int code = BTN_GAMEPAD; code < BTN_GAMEPAD + 16; ++code ) {
+            handleButton( static_cast<quint16>( code ), testBit( keys, code ), timestamp );
+        }
+
+        for( int code = BTN_DPAD_UP; code <= BTN_DPAD_RIGHT; ++code ) {
+            handleButton( static_cast<quint16>( code ), testBit( keys, code ), timestamp );
+        }
+    }
+
+    for( int code : { ABS_X, ABS_Y, ABS_RX, ABS_RY, ABS_Z, ABS_RZ, ABS_HAT0X, ABS_HAT0Y } ) {
+
+        struct input_absinfo info;
+
+        if( ioctl( fd, EVIOCGABS( code ), &info ) == 0 ) {
+            handleAxis( static_cast<quint16>( code ), info.value, timestamp );
+        }
+
+    }
+
+}
+
+void EvdevDevice::handleButton( const quint16 code, const bool pressed, const qint64 timestamp ) {
+
+    InputDeviceEvent::Event event;
+
+    // Switched to a SNES layout, like Joystick does: south is B, east is A, west is Y and north is X.
+    switch( code ) {
+        case BTN_SOUTH:
+            event = InputDeviceEvent::B;
+            break;
+
+        case BTN_EAST:
+            event = InputDeviceEvent::A;
+            break;
+
+        case BTN_WEST:
+            event = InputDeviceEvent::Y;
+            break;
+
+        case BTN_NORTH:
+            event = InputDeviceEvent::X;
+            break;
+
+        case BTN_TL:
+            event = InputDeviceEvent::L;
+            break;
+
+        case BTN_TR:
+            event = InputDeviceEvent::R;
+            break;
+
+        case BTN_TL2:
+            event = InputDeviceEvent::L2;
+            break;
+
+        case BTN_TR2:
+            event = InputDeviceEvent::R2;
+            break;
+
+        case BTN_SELECT:
+            event = InputDeviceEvent::Select;
+            break;
+
+        case BTN_START:
+            event = InputDeviceEvent::Start;
+            break;
+
+        case BTN_MODE:
+            event = InputDeviceEvent::Guide;
+            break;
+
+        case BTN_THUMBL:
+            event = InputDeviceEvent::L3;
+            break;
+
+        case BTN_THUMBR:
+            event = InputDeviceEvent::R3;
+            break;
+
+        case BTN_DPAD_UP:
+            event = InputDeviceEvent::Up;
+            break;
+
+        case BTN_DPAD_DOWN:
+            event = InputDeviceEvent::Down;
+            break;
+
+        case BTN_DPAD_LEFT:
+            event = InputDeviceEvent::Left;
+            break;
+
+        case BTN_DPAD_RIGHT:
+            event = InputDeviceEvent::Right;
+            break;
+
+        default:
+            return;
+    }
+
+    // Key repeats and resyncs write the same state again, which changes nothing.
+    if( ( value( event ) != 0 ) != pressed ) {
+        insertAt( event, pressed, timestamp );
+    }
+
+}
+
+void EvdevDevice::handleAxis( const quint16 code, const qint32 value, const qint64 timestamp ) {
+
+    switch( code ) {
+        case ABS_X:
+            insertAxisAt( InputPortState::LeftX, scale( code, value ), timestamp );
+            break;
+
+        case ABS_Y:
+            insertAxisAt( InputPortState::LeftY, scale( code, value ), timestamp );
+            break;
+
+        case ABS_RX:
+            insertAxisAt( InputPortState::RightX, scale( code, value ), timestamp );
+            break;
+
+        case ABS_RY:
+            insertAxisAt( InputPortState::RightY, scale( code, value ), timestamp );
+            break;
+
+        // Analog triggers, the digital ones come as BTN_TL2 and BTN_TR2.
+        case ABS_Z:
+        case ABS_RZ: {
+            auto event = code == ABS_Z ? InputDeviceEvent::L2 : InputDeviceEvent::R2;
+            qint16 level = scale( code, value );
+
+            if( this->value( event ) != level ) {
+                insertAt( event, level, timestamp );
+            }
+
+            break;
+        }
+
+        // Most pads report their D-Pad as a hat rather than as BTN_DPAD_*.
+        case ABS_HAT0X:
+        case ABS_HAT0Y: {
+            int &hat = code == ABS_HAT0X ? hatX : hatY;
+            int direction = value < 0 ? -1 : value > 0 ? 1 : 0;
+
+            if( direction == hat ) {
+                break;
+            }
+
+            hat = direction;
+
+            auto negative = code == ABS_HAT0X ? InputDeviceEvent::Left : InputDeviceEvent::Up;
+            auto positive = code == ABS_HAT0X ? InputDeviceEvent::Right : InputDeviceEvent::Down;
+
+            insertAt( negative, direction < 0, timestamp );
+            insertAt( positive, direction > 0, timestamp );
+            break;
+        }
+
+        default:
+            break;
+    }
+
+}
+
+qint16 EvdevDevice::scale( const quint16 code, const qint32 value ) const {
+
+    const Range &range = ranges[ code < absoluteAxes ? code : 0 ];
+    qint64 span = static_cast<qint64>( range.maximum ) - range.minimum;
+    qint64 offset = qBound<qint64>( 0, static_cast<qint64>( value ) - range.minimum, span );
+
+    // Axes that start at zero, like triggers, only have a positive half.
+    if( range.minimum >= 0 ) {
+        return static_cast<qint16>( offset * 32767 / span );
+    }
+
+    return static_cast<qint16>( offset * 65535 / span - 32768 );
+
+}
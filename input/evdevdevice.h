@@ -0,0 +1,60 @@
+#ifndef EVDEVDEVICE_H
+#define EVDEVDEVICE_H
+
+#include "inputdevice.h"
+
+// EvdevDevice is a gamepad read straight from a Linux evdev node, /dev/input/event*, without SDL. Its buttons
+// and axes follow the kernel's gamepad layout (BTN_SOUTH, ABS_X, ABS_HAT0X and so on), which every mainline
+// gamepad driver reports, so no mapping database is needed.
+
+// Every change is written with the kernel's timestamp of the event, so a state's capture time is when the
+// driver saw it, not when anyone got around to reading it.
+
+// Linux only. Only the thread reading the node calls handle() and resync(), see EvdevMonitor.
+
+class EvdevDevice : public InputDevice {
+
+    public:
+
+        // ABS_CNT, the kernel's number of absolute axes.
+        static const int absoluteAxes = 64;
+
+        explicit EvdevDevice( const QString &name, QObject *parent = 0 );
+
+        // Whether an open node is a gamepad.
+        static bool isGamepad( const int fd );
+
+        // Read the axis ranges of an open node.
+        void readRanges( const int fd );
+
+        // Axis ranges for a node that can't be asked, like a recording: an Xbox controller's.
+        void assumeDefaultRanges();
+
+        // One event from the node, timestamp already on inputClockNs()'s clock.
+        void handle( const quint16 type, const quint16 code, const qint32 value, const qint64 timestamp );
+
+        // The kernel dropped events, re-read every button and axis from the node.
+        void resync( const int fd, const qint64 timestamp );
+
+    private:
+
+        struct Range {
+            qint32 minimum;
+            qint32 maximum;
+        };
+
+        Range ranges[ absoluteAxes ];
+
+        // ABS_HAT0X and ABS_HAT0Y, -1, 0 or 1.
+        int hatX;
+        int hatY;
+
+        void handleButton( const quint16 code, const bool pressed, const qint64 timestamp );
+        void handleAxis( const quint16 code, const qint32 value, const qint64 timestamp );
+
+        // Scale a raw value to -32768 - 32767, or to 0 - 32767 for axes that don't go below zero.
+        qint16 scale( const quint16 code, const qint32 value ) const;
+
+};
+
+#endif // EVDEVDEVICE_H
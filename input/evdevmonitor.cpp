@@ -0,0 +1,570 @@
+#include "evdevmonitor.h"
+
+#include "evdevdevice.h"
+#include "inputclock.h"
+#include "logging.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+const int EvdevMonitor::batchSize;
+const int EvdevMonitor::maxSources;
+
+static const char *nodeDirectory = "/dev/input";
+
+// epoll tags past the sources.
+static const quint64 inotifyTag = EvdevMonitor::maxSources;
+static const quint64 wakeTag = EvdevMonitor::maxSources + 1;
+
+static qint64 eventTime( const input_event &event ) {
+    return static_cast<qint64>( event.input_event_sec ) * 1000000000 + event.input_event_usec * 1000;
+}
+
+EvdevMonitor::EvdevMonitor( QObject *parent )
+    : QThread( parent ),
+      watchNodes( true ),
+      inotifyFd( -1 ) {
+
+    for( auto &source : sources ) {
+        source.fd = -1;
+        source.device = nullptr;
+    }
+
+    epollFd = epoll_create1( EPOLL_CLOEXEC );
+    wakeFd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+
+    if( epollFd == -1 || wakeFd == -1 ) {
+        qFatal( "Fatal: Unable to create the evdev monitor: %s", strerror( errno ) );
+    }
+
+    struct epoll_event wake = {};
+    wake.events = EPOLLIN;
+    wake.data.u64 = wakeTag;
+    epoll_ctl( epollFd, EPOLL_CTL_ADD, wakeFd, &wake );
+
+}
+
+EvdevMonitor::~EvdevMonitor() {
+
+    stop();
+
+    close( epollFd );
+    close( wakeFd );
+
+}
+
+void EvdevMonitor::setWatchNodes( const bool watch ) {
+    Q_ASSERT( !isRunning() );
+    watchNodes = watch;
+}
+
+void EvdevMonitor::addRecording( const QString &path ) {
+    Q_ASSERT( !isRunning() );
+    recordings.append( path );
+}
+
+void EvdevMonitor::setSdlDevices( const QStringList &guids ) {
+
+    {
+        QMutexLocker locker( &sdlMutex );
+        sdlGuids = guids;
+    }
+
+    // The thread closes the nodes SDL took when it wakes up.
+    quint64 one = 1;
+
+    if( write( wakeFd, &one, sizeof( one ) ) < 0 ) {
+        qCWarning( phxInput ) << "Unable to wake the evdev monitor:" << strerror( errno );
+    }
+
+}
+
+void EvdevMonitor::stop() {
+
+    if( !isRunning() ) {
+        return;
+    }
+
+    requestInterruption();
+
+    quint64 one = 1;
+
+    if( write( wakeFd, &one, sizeof( one ) ) < 0 ) {
+        qCWarning( phxInput ) << "Unable to wake the evdev monitor:" << strerror( errno );
+    }
+
+    wait();
+
+}
+
+void EvdevMonitor::run() {
+
+    if( watchNodes ) {
+
+        inotifyFd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+        // Nodes show up owned by root, and only become readable once udev has set their permissions.
+        if( inotifyFd != -1 && inotify_add_watch( inotifyFd, nodeDirectory, IN_CREATE | IN_ATTRIB ) != -1 ) {
+            struct epoll_event hotplug = {};
+            hotplug.events = EPOLLIN;
+            hotplug.data.u64 = inotifyTag;
+            epoll_ctl( epollFd, EPOLL_CTL_ADD, inotifyFd, &hotplug );
+        } else {
+            qCWarning( phxInput ) << "Unable to watch" << nodeDirectory << "for new devices:" << strerror( errno );
+        }
+
+        for( auto &node : QDir( nodeDirectory ).entryList( { "event*" }, QDir::System ) ) {
+            openNode( QString( nodeDirectory ) + '/' + node );
+        }
+
+    }
+
+    for( auto &recording : recordings ) {
+        openRecording( recording );
+    }
+
+    while( !isInterruptionRequested() ) {
+
+        struct epoll_event ready[ 16 ];
+        int count = epoll_wait( epollFd, ready, 16, -1 );
+
+        if( count < 0 ) {
+
+            if( errno != EINTR ) {
+                qCWarning( phxInput ) << "Evdev monitor stopped:" << strerror( errno );
+                break;
+            }
+
+            continue;
+
+        }
+
+        for( int i = 0; i < count; ++i ) {
+
+            quint64 tag = ready[ i ].data.u64;
+
+            if( tag == wakeTag ) {
+                quint64 wakeups;
+
+                if( read( wakeFd, &wakeups, sizeof( wakeups ) ) < 0 ) {
+                    continue;
+                }
+
+                closeSdlDevices();
+            }
+
+            else if( tag == inotifyTag ) {
+                readHotplug();
+            }
+
+            else if( sources[ tag ].device ) {
+
+                if( !sources[ tag ].events.isEmpty() ) {
+
+                    if( !playRecording( static_cast<int>( tag ) ) && activeRecordings() == 0 ) {
+                        emit recordingsFinished();
+                    }
+
+                }
+
+                else {
+                    readNode( static_cast<int>( tag ) );
+                }
+
+            }
+
+        }
+
+    }
+
+    for( int i = 0; i < maxSources; ++i ) {
+
+        auto *device = sources[ i ].device;
+
+        if( device ) {
+            closeSource( i );
+            emit deviceRemoved( device );
+        }
+
+    }
+
+    if( inotifyFd != -1 ) {
+        close( inotifyFd );
+        inotifyFd = -1;
+    }
+
+}
+
+int EvdevMonitor::freeSource() const {
+
+    for( int i = 0; i < maxSources; ++i ) {
+        if( !sources[ i ].device ) {
+            return i;
+        }
+    }
+
+    return -1;
+
+}
+
+void EvdevMonitor::openNode( const QString &path ) {
+
+    // IN_ATTRIB fires for nodes that are open already.
+    for( auto &source : sources ) {
+        if( source.device && source.path == path ) {
+            return;
+        }
+    }
+
+    int fd = open( QFile::encodeName( path ).constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC );
+
+    // Not readable (yet), or gone again.
+    if( fd == -1 ) {
+        return;
+    }
+
+    int index = freeSource();
+
+    if( !EvdevDevice::isGamepad( fd ) || index == -1 ) {
+
+        if( index == -1 ) {
+            qCWarning( phxInput ) << "Too many evdev devices," << path << "ignored";
+        }
+
+        close( fd );
+        return;
+
+    }
+
+    input_id kernelID = {};
+    ioctl( fd, EVIOCGID, &kernelID );
+
+    DeviceID id = { kernelID.bustype, kernelID.vendor, kernelID.product, kernelID.version };
+
+    if( openedBySdl( id ) ) {
+        qCDebug( phxInput ) << path << "is open in SDL already, ignored";
+        close( fd );
+        return;
+    }
+
+    char name[ 256 ] = {};
+    ioctl( fd, EVIOCGNAME( sizeof( name ) - 1 ), name );
+
+    auto *device = new EvdevDevice( QString::fromUtf8( name ) );
+    device->readRanges( fd );
+
+    Source &source = sources[ index ];
+    source.fd = fd;
+    source.device = device;
+    source.path = path;
+    source.dropping = false;
+    source.node = true;
+    source.id = id;
+
+    int clock = CLOCK_MONOTONIC;
+    source.kernelTime = ioctl( fd, EVIOCSCLOCKID, &clock ) == 0;
+
+    if( !source.kernelTime ) {
+        qCWarning( phxInput ) << path << "can't use the monotonic clock, its timestamps are ignored";
+    }
+
+    // Events only carry changes, start from whatever is held right now.
+    device->resync( fd, inputClockNs() );
+
+    struct epoll_event readable = {};
+    readable.events = EPOLLIN;
+    readable.data.u64 = static_cast<quint64>( index );
+    epoll_ctl( epollFd, EPOLL_CTL_ADD, fd, &readable );
+
+    qCDebug( phxInput ) << "Evdev gamepad" << device->name() << "at" << path;
+
+    publish( device );
+
+}
+
+void EvdevMonitor::openRecording( const QString &path ) {
+
+    QFile file( path );
+
+    if( !file.open( QIODevice::ReadOnly ) ) {
+        qCWarning( phxInput ) << "Unable to open evdev recording" << path;
+        return;
+    }
+
+    QByteArray events = file.readAll();
+    events.truncate( events.size() - events.size() % static_cast<int>( sizeof( input_event ) ) );
+
+    int index = freeSource();
+
+    if( events.isEmpty() || index == -1 ) {
+        qCWarning( phxInput ) << "Evdev recording" << path << "is empty, or there's no room for it";
+        return;
+    }
+
+    int fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+
+    if( fd == -1 ) {
+        qCWarning( phxInput ) << "Unable to play" << path << ":" << strerror( errno );
+        return;
+    }
+
+    auto *device = new EvdevDevice( QStringLiteral( "Evdev Recording %1" ).arg( QFileInfo( path ).fileName() ) );
+    device->assumeDefaultRanges();
+
+    Source &source = sources[ index ];
+    source.fd = fd;
+    source.device = device;
+    source.path = path;
+    source.dropping = false;
+    source.node = false;
+    source.kernelTime = true;
+    source.events = events;
+    source.next = 0;
+    source.start = inputClockNs();
+
+    struct epoll_event readable = {};
+    readable.events = EPOLLIN;
+    readable.data.u64 = static_cast<quint64>( index );
+    epoll_ctl( epollFd, EPOLL_CTL_ADD, fd, &readable );
+
+    publish( device );
+
+    // Plays whatever is due at the start, then arms the timer.
+    playRecording( index );
+
+}
+
+void EvdevMonitor::closeSource( const int index ) {
+
+    Source &source = sources[ index ];
+
+    if( source.fd != -1 ) {
+        epoll_ctl( epollFd, EPOLL_CTL_DEL, source.fd, nullptr );
+        close( source.fd );
+    }
+
+    source.fd = -1;
+    source.device = nullptr;
+    source.path.clear();
+    source.events.clear();
+
+}
+
+bool EvdevMonitor::openedBySdl( const DeviceID &id ) {
+
+    QMutexLocker locker( &sdlMutex );
+
+    for( auto &guid : sdlGuids ) {
+
+        QByteArray bytes = QByteArray::fromHex( guid.toLatin1() );
+
+        if( bytes.size() != 16 ) {
+            continue;
+        }
+
+        auto *data = reinterpret_cast<const uchar *>( bytes.constData() );
+
+        // The words in between are 0, or a CRC of the name in newer SDLs, which HIDAPI devices also mark in the
+        // last two bytes. Neither changes which device it is.
+        if( qFromLittleEndian<quint16>( data ) == id.bus && qFromLittleEndian<quint16>( data + 4 ) == id.vendor
+            && qFromLittleEndian<quint16>( data + 8 ) == id.product
+            && qFromLittleEndian<quint16>( data + 12 ) == id.version ) {
+            return true;
+        }
+
+    }
+
+    return false;
+
+}
+
+void EvdevMonitor::closeSdlDevices() {
+
+    for( int i = 0; i < maxSources; ++i ) {
+
+        Source &source = sources[ i ];
+
+        if( !source.device || !source.node || !openedBySdl( source.id ) ) {
+            continue;
+        }
+
+        auto *device = source.device;
+        qCDebug( phxInput ) << "Evdev gamepad" << device->name() << "left to SDL";
+
+        closeSource( i );
+        emit deviceRemoved( device );
+
+    }
+
+}
+
+void EvdevMonitor::readNode( const int index ) {
+
+    Source &source = sources[ index ];
+    input_event events[ batchSize ];
+
+    forever {
+
+        ssize_t bytes = read( source.fd, events, sizeof( events ) );
+
+        if( bytes < 0 ) {
+
+            if( errno == EAGAIN || errno == EINTR ) {
+                return;
+            }
+
+            // Unplugged, ENODEV. Anything else we can't recover from either.
+            auto *device = source.device;
+            qCDebug( phxInput ) << "Evdev gamepad" << device->name() << "removed:" << strerror( errno );
+
+            closeSource( index );
+            emit deviceRemoved( device );
+            return;
+
+        }
+
+        int count = static_cast<int>( bytes / static_cast<ssize_t>( sizeof( input_event ) ) );
+        qint64 now = inputClockNs();
+
+        for( int i = 0; i < count; ++i ) {
+
+            const input_event &event = events[ i ];
+            qint64 timestamp = source.kernelTime ? eventTime( event ) : now;
+
+            if( event.type == EV_SYN ) {
+
+                if( event.code == SYN_DROPPED ) {
+                    source.dropping = true;
+                } else if( event.code == SYN_REPORT && source.dropping ) {
+                    source.dropping = false;
+                    source.device->resync( source.fd, timestamp );
+                }
+
+                continue;
+
+            }
+
+            if( !source.dropping ) {
+                source.device->handle( event.type, event.code, event.value, timestamp );
+            }
+
+        }
+
+        // Drained.
+        if( count < batchSize ) {
+            return;
+        }
+
+    }
+
+}
+
+bool EvdevMonitor::playRecording( const int index ) {
+
+    Source &source = sources[ index ];
+
+    quint64 expirations;
+
+    if( read( source.fd, &expirations, sizeof( expirations ) ) < 0 && errno != EAGAIN ) {
+        qCWarning( phxInput ) << "Unable to read the playback timer:" << strerror( errno );
+    }
+
+    int count = source.events.size() / static_cast<int>( sizeof( input_event ) );
+    qint64 now = inputClockNs();
+
+    input_event first;
+    memcpy( &first, source.events.constData(), sizeof( first ) );
+
+    while( source.next < count ) {
+
+        input_event event;
+        memcpy( &event, source.events.constData() + source.next * sizeof( input_event ), sizeof( event ) );
+
+        qint64 due = source.start + ( eventTime( event ) - eventTime( first ) );
+
+        if( due > now ) {
+            struct itimerspec timer = {};
+            timer.it_value.tv_sec = due / 1000000000;
+            timer.it_value.tv_nsec = due % 1000000000;
+            timerfd_settime( source.fd, TFD_TIMER_ABSTIME, &timer, nullptr );
+            return true;
+        }
+
+        source.next++;
+
+        if( event.type != EV_SYN ) {
+            source.device->handle( event.type, event.code, event.value, due );
+        }
+
+    }
+
+    // The pad stays connected with whatever it held last, until the monitor stops.
+    epoll_ctl( epollFd, EPOLL_CTL_DEL, source.fd, nullptr );
+    close( source.fd );
+    source.fd = -1;
+    source.events.clear();
+
+    return false;
+
+}
+
+void EvdevMonitor::readHotplug() {
+
+    alignas( struct inotify_event ) char buffer[ 4096 ];
+
+    forever {
+
+        ssize_t bytes = read( inotifyFd, buffer, sizeof( buffer ) );
+
+        if( bytes <= 0 ) {
+            return;
+        }
+
+        for( ssize_t offset = 0; offset < bytes; ) {
+
+            auto *event = reinterpret_cast<const struct inotify_event *>( buffer + offset );
+            offset += static_cast<ssize_t>( sizeof( struct inotify_event ) + event->len );
+
+            if( event->len > 0 && strncmp( event->name, "event", 5 ) == 0 ) {
+                openNode( QString( nodeDirectory ) + '/' + QString::fromUtf8( event->name ) );
+            }
+
+        }
+
+    }
+
+}
+
+void EvdevMonitor::publish( EvdevDevice *device ) {
+
+    // Owned by the thread that made us from now on, like the SDL joysticks are.
+    device->moveToThread( thread() );
+
+    emit deviceConnected( device );
+
+}
+
+int EvdevMonitor::activeRecordings() const {
+
+    int active = 0;
+
+    for( auto &source : sources ) {
+        active += !source.events.isEmpty() ? 1 : 0;
+    }
+
+    return active;
+
+}
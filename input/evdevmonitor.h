@@ -0,0 +1,137 @@
+#ifndef EVDEVMONITOR_H
+#define EVDEVMONITOR_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+
+#include "inputdeviceregistry.h"
+
+class InputDevice;
+class EvdevDevice;
+
+// EvdevMonitor reads gamepads straight from /dev/input on its own thread, for when SDL's polling and event queue
+// add too much latency. One epoll set holds every open node, an inotify watch on /dev/input for hot-plugging and
+// an eventfd to wake the thread up, so it sleeps until the kernel has something and reads it right away, in
+// batches of up to batchSize events.
+
+// For testing without hardware, recordings of a node can stand in for it. A recording is the node's raw
+// struct input_event stream, as written by "cat /dev/input/eventN > file". It's played back on a timerfd in the
+// same epoll set, with the original spacing, every event stamped as if it happened at its time in the playback.
+// Recordings don't know their axis ranges, an Xbox controller's are assumed.
+
+// New devices are handed to the thread that made the monitor through deviceConnected(). A device that went away
+// is reported with deviceRemoved() and never touched by the monitor again, its owner retires it.
+
+// Hardware SDL has opened too is left to SDL, see setSdlDevices(), so no gamepad shows up twice. Linux only.
+
+class EvdevMonitor : public QThread {
+        Q_OBJECT
+
+    public:
+
+        static const int batchSize = 64;
+        static const int maxSources = InputDeviceRegistry::maxDevices;
+
+        explicit EvdevMonitor( QObject *parent = 0 );
+        ~EvdevMonitor();
+
+        // Whether to watch /dev/input, on by default. Turned off, only recordings are played.
+        void setWatchNodes( const bool watch );
+
+        // Play this recording as one more gamepad. Only before start().
+        void addRecording( const QString &path );
+
+        // The GUIDs of the joysticks SDL has open. Nodes of the same hardware aren't opened, and the ones that are
+        // open already are closed and reported removed. A node SDL lets go of again is only picked up once it's
+        // plugged back in. Safe from any thread.
+        void setSdlDevices( const QStringList &guids );
+
+        // Ask the thread to finish, and block until it does.
+        void stop();
+
+    signals:
+
+        void deviceConnected( InputDevice *device );
+        void deviceRemoved( InputDevice *device );
+
+        // Every recording played to the end.
+        void recordingsFinished();
+
+    protected:
+
+        void run() override;
+
+    private:
+
+        // A node's EVIOCGID. On Linux, SDL's GUID for a device is made of these, little endian, in its 16 bytes.
+        struct DeviceID {
+            quint16 bus;
+            quint16 vendor;
+            quint16 product;
+            quint16 version;
+        };
+
+        struct Source {
+            int fd;
+            EvdevDevice *device;
+            QString path;
+
+            // The node dropped events, ignore them up to the next SYN_REPORT and then resync.
+            bool dropping;
+
+            // The node's timestamps are on CLOCK_MONOTONIC. If it couldn't be switched, they're not used.
+            bool kernelTime;
+
+            // A /dev/input node rather than a recording, and its ID.
+            bool node;
+            DeviceID id;
+
+            // Recordings only: the events, the next one due, and inputClockNs() of the first one.
+            QByteArray events;
+            int next;
+            qint64 start;
+        };
+
+        bool watchNodes;
+        QStringList recordings;
+
+        Source sources[ maxSources ];
+
+        QMutex sdlMutex;
+        QStringList sdlGuids;
+
+        int epollFd;
+        int inotifyFd;
+        int wakeFd;
+
+        // Free slot in sources, -1 if none.
+        int freeSource() const;
+
+        void openNode( const QString &path );
+        void openRecording( const QString &path );
+        void closeSource( const int index );
+
+        void readNode( const int index );
+
+        // Play every event that's due, then arm the timer for the next one. Returns false at the end.
+        bool playRecording( const int index );
+
+        void readHotplug();
+
+        // Whether SDL has the device open, see setSdlDevices().
+        bool openedBySdl( const DeviceID &id );
+
+        // Close every node SDL has opened since.
+        void closeSdlDevices();
+
+        // Hand a new device over to our owner's thread and announce it.
+        void publish( EvdevDevice *device );
+
+        int activeRecordings() const;
+
+};
+
+#endif // EVDEVMONITOR_H
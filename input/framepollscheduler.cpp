@@ -0,0 +1,100 @@
+#include "framepollscheduler.h"
+
+FramePollScheduler::FramePollScheduler()
+    : leadTimeNs( 0 ) {
+    reset();
+}
+
+qint64 FramePollScheduler::leadTime() const {
+    return leadTimeNs / 1000;
+}
+
+void FramePollScheduler::setLeadTime( const qint64 usec ) {
+    leadTimeNs = qMax<qint64>( usec, 0 ) * 1000;
+}
+
+bool FramePollScheduler::frameStarted( const qint64 now, const qint64 lastPollTime ) {
+
+    qint64 previousFrame = lastFrameTime.load( std::memory_order_relaxed );
+    qint64 average = period.load( std::memory_order_relaxed );
+
+    if( previousFrame > 0 ) {
+
+        qint64 interval = now - previousFrame;
+
+        // Moving average over about 8 frames. Long gaps are the core pausing, not a change of frame rate.
+        if( average == 0 ) {
+            average = interval;
+        } else if( interval < average * outlierFactor ) {
+            average += ( interval - average ) / 8;
+        }
+
+        period.store( average, std::memory_order_relaxed );
+
+    }
+
+    lastFrameTime.store( now, std::memory_order_relaxed );
+
+    // Without a lead time the core thread always polls by itself. Otherwise, the poll thread has either missed
+    // this frame or hasn't got a prediction yet, and the input would be a whole frame old.
+    bool pollNow = leadTimeNs.load( std::memory_order_relaxed ) == 0
+                   || previousFrame == 0
+                   || lastPollTime <= previousFrame;
+
+    qint64 age = pollNow ? 0 : now - lastPollTime;
+    qint64 averageAge = stalenessAverage.load( std::memory_order_relaxed );
+
+    staleness.store( age, std::memory_order_relaxed );
+    stalenessAverage.store( averageAge + ( age - averageAge ) / 16, std::memory_order_relaxed );
+
+    if( age > stalenessMax.load( std::memory_order_relaxed ) ) {
+        stalenessMax.store( age, std::memory_order_relaxed );
+    }
+
+    return pollNow;
+
+}
+
+qint64 FramePollScheduler::nextPollTime( const qint64 now ) const {
+
+    qint64 lastFrame = lastFrameTime.load( std::memory_order_relaxed );
+    qint64 average = period.load( std::memory_order_relaxed );
+
+    if( lastFrame == 0 || average == 0 ) {
+        return now + defaultPeriod;
+    }
+
+    qint64 next = lastFrame + average - leadTimeNs.load( std::memory_order_relaxed );
+
+    // Already past this frame's poll, aim for the next one that's still ahead.
+    if( next <= now ) {
+        next += ( ( now - next ) / average + 1 ) * average;
+    }
+
+    return next;
+
+}
+
+qint64 FramePollScheduler::framePeriod() const {
+    return period.load( std::memory_order_relaxed );
+}
+
+qint64 FramePollScheduler::lastStaleness() const {
+    return staleness.load( std::memory_order_relaxed );
+}
+
+qint64 FramePollScheduler::averageStaleness() const {
+    return stalenessAverage.load( std::memory_order_relaxed );
+}
+
+qint64 FramePollScheduler::maxStaleness() const {
+    return stalenessMax.load( std::memory_order_relaxed );
+}
+
+void FramePollScheduler::reset() {
+    lastFrameTime = 0;
+    period = 0;
+    staleness = 0;
+    stalenessAverage = 0;
+    stalenessMax = 0;
+}
@@ -0,0 +1,66 @@
+#ifndef FRAMEPOLLSCHEDULER_H
+#define FRAMEPOLLSCHEDULER_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+// FramePollScheduler times input polls against the core's frames, so that input is read as late as possible
+// before the core asks for it.
+
+// The core thread calls frameStarted() each time it's about to read input (retro_input_poll). From the spacing
+// of those calls the scheduler predicts when the next read will happen, and nextPollTime() tells the poll
+// thread to wake up the lead time before that. The lead time should be just long enough to cover one poll and
+// publish, a few hundred microseconds is typical.
+
+// Each frame also records how stale its input was: the time between the poll that produced the input, and the
+// core reading it.
+
+class FramePollScheduler {
+
+    public:
+
+        FramePollScheduler();
+
+        // In microseconds. 0 disables frame synchronized polling, the core thread then polls by itself.
+        qint64 leadTime() const;
+        void setLeadTime( const qint64 usec );
+
+        // Core thread: input is about to be read. Returns true if no poll has happened since the last frame, and
+        // so the caller should poll right now.
+        bool frameStarted( const qint64 now, const qint64 lastPollTime );
+
+        // Poll thread: the absolute time to poll at next.
+        qint64 nextPollTime( const qint64 now ) const;
+
+        // Estimated time between two frames, 0 until there's enough frames to tell.
+        qint64 framePeriod() const;
+
+        // How old the input was when the core read it, in nanoseconds.
+        qint64 lastStaleness() const;
+        qint64 averageStaleness() const;
+        qint64 maxStaleness() const;
+
+        // Forget the frame timing and staleness, for when the core stops or restarts.
+        void reset();
+
+    private:
+
+        // Ignore frame intervals this many times longer than the average, they're pauses and not frames.
+        static const int outlierFactor = 4;
+
+        // Until the core's frame rate is known, poll at this period.
+        static const qint64 defaultPeriod = 5000000;
+
+        std::atomic<qint64> leadTimeNs;
+
+        std::atomic<qint64> lastFrameTime;
+        std::atomic<qint64> period;
+
+        std::atomic<qint64> staleness;
+        std::atomic<qint64> stalenessAverage;
+        std::atomic<qint64> stalenessMax;
+
+};
+
+#endif // FRAMEPOLLSCHEDULER_H
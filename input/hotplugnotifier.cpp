@@ -0,0 +1,73 @@
+#include "hotplugnotifier.h"
+
+#include "logging.h"
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+HotplugNotifier::HotplugNotifier()
+    : inotifyFd( -1 ) {
+
+#ifdef Q_OS_LINUX
+
+    inotifyFd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+    // Permissions are set by udev after the node is created, that's when SDL can open it.
+    if( inotifyFd != -1 && inotify_add_watch( inotifyFd, "/dev/input", IN_CREATE | IN_ATTRIB | IN_DELETE ) == -1 ) {
+        close( inotifyFd );
+        inotifyFd = -1;
+    }
+
+    if( inotifyFd == -1 ) {
+        qCWarning( phxInput ) << "Unable to watch /dev/input for new devices:" << strerror( errno );
+    }
+
+#endif
+
+}
+
+HotplugNotifier::~HotplugNotifier() {
+
+#ifdef Q_OS_LINUX
+
+    if( inotifyFd != -1 ) {
+        close( inotifyFd );
+    }
+
+#endif
+
+}
+
+int HotplugNotifier::descriptor() const {
+    return inotifyFd;
+}
+
+bool HotplugNotifier::drain() {
+
+#ifdef Q_OS_LINUX
+
+    if( inotifyFd == -1 ) {
+        return false;
+    }
+
+    // Which node it was doesn't matter, SDL works that out.
+    alignas( struct inotify_event ) char buffer[ 4096 ];
+    bool changed = false;
+
+    while( read( inotifyFd, buffer, sizeof( buffer ) ) > 0 ) {
+        changed = true;
+    }
+
+    return changed;
+
+#else
+
+    return false;
+
+#endif
+
+}
@@ -0,0 +1,34 @@
+#ifndef HOTPLUGNOTIFIER_H
+#define HOTPLUGNOTIFIER_H
+
+#include <QtGlobal>
+
+// HotplugNotifier tells a sleeping thread that input devices may have come or gone, so it doesn't have to keep
+// waking up to ask. On Linux it's an inotify watch on /dev/input, elsewhere there's nothing to wait on and
+// descriptor() is -1.
+
+// It's only a hint: a node showing up doesn't mean SDL has seen it yet, udev tells SDL separately and a little
+// later. Whoever is woken should keep looking for a while.
+
+class HotplugNotifier {
+
+    public:
+
+        HotplugNotifier();
+        ~HotplugNotifier();
+
+        // Turns readable when something changed in /dev/input, -1 if there's no such thing here.
+        int descriptor() const;
+
+        // Clear the pending notifications, never blocks. Returns true if there were any.
+        bool drain();
+
+    private:
+
+        int inotifyFd;
+
+        Q_DISABLE_COPY( HotplugNotifier )
+
+};
+
+#endif // HOTPLUGNOTIFIER_H
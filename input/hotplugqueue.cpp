@@ -0,0 +1,110 @@
+#include "hotplugqueue.h"
+
+#include "inputdevice.h"
+
+#include <QRunnable>
+
+// QThreadPool only takes QRunnables before Qt 5.15.
+class HotplugTask : public QRunnable {
+
+    public:
+
+        explicit HotplugTask( HotplugQueue::Task task )
+            : task( task ) {
+
+        }
+
+        void run() override {
+            task();
+        }
+
+    private:
+
+        HotplugQueue::Task task;
+
+};
+
+HotplugQueue::HotplugQueue( Task ready )
+    : readyCallback( ready ),
+      readyHead( 0 ),
+      readyCount( 0 ) {
+
+    worker.setMaxThreadCount( 1 );
+
+    for( auto &slot : opening ) {
+        slot = false;
+    }
+
+}
+
+HotplugQueue::~HotplugQueue() {
+
+    worker.waitForDone();
+
+    int slot;
+    InputDevice *device;
+
+    while( takeReady( slot, device ) ) {
+        delete device;
+    }
+
+}
+
+bool HotplugQueue::open( const int slot, Open open ) {
+
+    if( slot < 0 || slot >= InputDeviceRegistry::maxDevices || opening[ slot ] ) {
+        return false;
+    }
+
+    opening[ slot ] = true;
+
+    run( [ this, slot, open ] {
+
+        auto *device = open();
+
+        readyMutex.lock();
+        ready[ ( readyHead + readyCount ) % InputDeviceRegistry::maxDevices ] = { slot, device };
+        readyCount++;
+        readyMutex.unlock();
+
+        if( readyCallback ) {
+            readyCallback();
+        }
+
+    } );
+
+    return true;
+
+}
+
+bool HotplugQueue::isOpening( const int slot ) const {
+    return slot >= 0 && slot < InputDeviceRegistry::maxDevices && opening[ slot ];
+}
+
+bool HotplugQueue::takeReady( int &slot, InputDevice *&device ) {
+
+    QMutexLocker locker( &readyMutex );
+
+    if( readyCount == 0 ) {
+        return false;
+    }
+
+    slot = ready[ readyHead ].slot;
+    device = ready[ readyHead ].device;
+
+    readyHead = ( readyHead + 1 ) % InputDeviceRegistry::maxDevices;
+    readyCount--;
+
+    opening[ slot ] = false;
+
+    return true;
+
+}
+
+void HotplugQueue::run( Task task ) {
+    worker.start( new HotplugTask( task ) );
+}
+
+void HotplugQueue::waitForDone() {
+    worker.waitForDone();
+}
@@ -0,0 +1,71 @@
+#ifndef HOTPLUGQUEUE_H
+#define HOTPLUGQUEUE_H
+
+#include <QMutex>
+#include <QThreadPool>
+
+#include "inputdeviceregistry.h"
+
+#include <functional>
+
+class InputDevice;
+
+// HotplugQueue opens and closes devices on a worker thread, so neither the poll thread nor the GUI thread ever
+// waits on the hardware, on parsing a mapping or on QSettings while other controllers are in use.
+
+// A device is opened with open(): the function given runs on the worker and returns the prepared device, which
+// is queued until the poll thread picks it up with takeReady() and publishes it. Closing works the same way
+// through run(). There's only one worker, so opens and closes happen in the order they were asked for.
+
+// open(), isOpening() and takeReady() are for the poll thread only. run() may be called from any thread.
+
+class HotplugQueue {
+
+    public:
+
+        using Open = std::function<InputDevice *()>;
+        using Task = std::function<void()>;
+
+        // ready is called on the worker whenever a device is ready, to wake up the poll thread.
+        explicit HotplugQueue( Task ready );
+
+        // Waits for the worker, then deletes the devices nobody picked up.
+        ~HotplugQueue();
+
+        // Returns false if the slot is out of range, or already being opened.
+        bool open( const int slot, Open open );
+        bool isOpening( const int slot ) const;
+
+        // The next prepared device, in the order they were opened. A device that failed to open comes back as
+        // nullptr. Returns false if there's nothing ready.
+        bool takeReady( int &slot, InputDevice *&device );
+
+        void run( Task task );
+
+        // Block until the worker is idle.
+        void waitForDone();
+
+    private:
+
+        struct Ready {
+            int slot;
+            InputDevice *device;
+        };
+
+        QThreadPool worker;
+        Task readyCallback;
+
+        // Guards the ready queue, which is a fixed ring so the poll thread never allocates to empty it.
+        QMutex readyMutex;
+        Ready ready[ InputDeviceRegistry::maxDevices ];
+        int readyHead;
+        int readyCount;
+
+        // Poll thread only.
+        bool opening[ InputDeviceRegistry::maxDevices ];
+
+        Q_DISABLE_COPY( HotplugQueue )
+
+};
+
+#endif // HOTPLUGQUEUE_H
@@ -0,0 +1,43 @@
+#ifndef INPUTCLOCK_H
+#define INPUTCLOCK_H
+
+#include <QtGlobal>
+
+#ifdef Q_OS_LINUX
+#include <time.h>
+#else
+#include <QElapsedTimer>
+#endif
+
+// Every timestamp in the input code comes from this clock, in nanoseconds. On Linux it is CLOCK_MONOTONIC, the
+// same clock timerfd sleeps on, so deadlines and timestamps can be compared directly.
+
+inline qint64 inputClockNs() {
+#ifdef Q_OS_LINUX
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return static_cast<qint64>( now.tv_sec ) * 1000000000 + now.tv_nsec;
+#else
+    static const QElapsedTimer clock = [] {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+
+    return clock.nsecsElapsed();
+#endif
+}
+
+// CPU time used by the calling thread so far, in nanoseconds. Only measured on Linux, elsewhere it's always 0.
+
+inline qint64 inputThreadCpuNs() {
+#ifdef Q_OS_LINUX
+    struct timespec used;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &used );
+    return static_cast<qint64>( used.tv_sec ) * 1000000000 + used.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+#endif // INPUTCLOCK_H
@@ -1,31 +1,24 @@
 #include "inputdevice.h"
 
+#include "inputclock.h"
+
+#include <QTimer>
+
 //
 // Constructors
 //
 
 bool InputDevice::gamepadControlsFrontend = true;
 
+const int InputDevice::deliveryInterval;
+
 InputDevice::InputDevice( const InputDevice::LibretroType type, const QString name, QObject *parent )
     : QObject( parent ),
-      deviceStates( std::unique_ptr<InputStateMap> ( new InputStateMap {
-        { InputDeviceEvent::B, false },
-        { InputDeviceEvent::A, false },
-        { InputDeviceEvent::X, false },
-        { InputDeviceEvent::Y, false },
-        { InputDeviceEvent::Up, false },
-        { InputDeviceEvent::Down, false },
-        { InputDeviceEvent::Right, false },
-        { InputDeviceEvent::Left, false },
-        { InputDeviceEvent::R, false },
-        { InputDeviceEvent::L, false },
-        { InputDeviceEvent::L2, false },
-        { InputDeviceEvent::R2, false },
-        { InputDeviceEvent::R3, false },
-        { InputDeviceEvent::L3, false },
-        { InputDeviceEvent::Start, false },
-        { InputDeviceEvent::Select, false },
-    } ) ),
+      deviceStates( new InputStateBlock ),
+      deviceEvents( new InputEventQueue ),
+      pendingChanges( 0 ),
+      pendingPresses( 0 ),
+      lastDelivery( 0 ),
     deviceType( type ),
     deviceName( name ),
     qmlEditMode( false ),
@@ -71,10 +64,14 @@ InputDevice::LibretroType InputDevice::type() const {
     return deviceType;
 }
 
-InputStateMap *InputDevice::states() {
+InputStateBlock *InputDevice::states() {
     return deviceStates.get();
 }
 
+InputEventQueue *InputDevice::events() {
+    return deviceEvents.get();
+}
+
 void InputDevice::setName( const QString name ) {
     deviceName = name;
     emit nameChanged();
@@ -112,21 +109,15 @@ void InputDevice::selfDestruct() {
 //
 
 int16_t InputDevice::value( const InputDeviceEvent::Event &event, const int16_t defaultValue ) {
-    mutex.lock();
-    auto pressed = deviceStates->value( event, defaultValue );
-    mutex.unlock();
-    return pressed;
+    return deviceStates->value( event, defaultValue );
 }
 
 void InputDevice::insert( const InputDeviceEvent::Event &value, const int16_t &state ) {
-    mutex.lock();
-
-    if( InputDevice::gamepadControlsFrontend ) {
-        emit inputDeviceEvent( value, state );
-    }
+    insertAt( value, state, inputClockNs() );
+}
 
-    deviceStates->insert( value, state );
-    mutex.unlock();
+void InputDevice::insertAxis( const InputPortState::Axis &axis, const int16_t &value ) {
+    insertAxisAt( axis, value, inputClockNs() );
 }
 
 void InputDevice::setMapping( const QVariantMap mapping ) {
@@ -134,14 +125,88 @@ void InputDevice::setMapping( const QVariantMap mapping ) {
     return;
 }
 
+//
+// Protected
+//
+
+void InputDevice::insertAt( const InputDeviceEvent::Event &value, const int16_t state, const qint64 timestamp ) {
+
+    bool transition = deviceStates->insert( value, state );
+    deviceStates->setCaptureTime( timestamp );
+
+    if( transition ) {
+        deviceEvents->push( timestamp, InputStateBlock::slot( value ), state );
+    }
+
+    // The Guide button always reaches the frontend, even in game, so it can bring up its menus.
+    if( transition && ( InputDevice::gamepadControlsFrontend || value == InputDeviceEvent::Guide ) ) {
+        quint32 bit = 1u << InputStateBlock::slot( value );
+        queueStateChange( bit, state ? bit : 0 );
+    }
+
+}
+
+void InputDevice::insertAxisAt( const InputPortState::Axis &axis, const int16_t value, const qint64 timestamp ) {
+    deviceStates->setAxis( axis, value );
+    deviceStates->setCaptureTime( timestamp );
+}
+
+//
+// Private slots
+//
+
+void InputDevice::deliverStateChanges() {
+
+    qint64 now = inputClockNs();
+    qint64 wait = lastDelivery + deliveryInterval * Q_INT64_C( 1000000 ) - now;
+
+    // Too soon after the last one. The pending bits stay set, so no other delivery gets scheduled meanwhile.
+    if( wait > 0 ) {
+        QTimer::singleShot( static_cast<int>( ( wait + 999999 ) / 1000000 ), this, SLOT( deliverStateChanges() ) );
+        return;
+    }
+
+    quint32 changed = pendingChanges.exchange( 0, std::memory_order_acq_rel );
+    quint32 pressed = pendingPresses.exchange( 0, std::memory_order_acq_rel );
+
+    if( !changed ) {
+        return;
+    }
+
+    quint32 current = deviceStates->buttons();
+
+    // Pressed and released again since the last delivery. Show the press now, and the release next time.
+    quint32 tapped = pressed & ~current;
+
+    lastDelivery = now;
+
+    emit inputStateChanged( changed, current | tapped );
+
+    if( tapped ) {
+        queueStateChange( tapped, 0 );
+    }
+
+}
+
 //
 // Private
 //
 
-void InputDevice::resetStates() {
-    for( auto &key : deviceStates->keys() ) {
-        deviceStates->value( key, false );
+void InputDevice::queueStateChange( const quint32 changed, const quint32 pressed ) {
+
+    if( pressed ) {
+        pendingPresses.fetch_or( pressed, std::memory_order_relaxed );
     }
+
+    // Only the first change since the last delivery schedules one, the rest ride along with it.
+    if( pendingChanges.fetch_or( changed, std::memory_order_acq_rel ) == 0 ) {
+        QMetaObject::invokeMethod( this, "deliverStateChanges", Qt::QueuedConnection );
+    }
+
+}
+
+void InputDevice::resetStates() {
+    deviceStates->reset();
 }
 
 void InputDevice::setRetroButtonCount( const int count ) {
@@ -2,7 +2,6 @@
 #define INPUTDEVICE
 
 #include <QObject>
-#include <QMutex>
 #include <QHash>
 #include <QDebug>
 #include <QMap>
@@ -10,11 +9,14 @@
 #include <QVariantMap>
 #include <QSettings>
 #include <QFile>
+#include <atomic>
 #include <memory>
 
 #include "libretro.h"
 #include "logging.h"
 #include "inputdeviceevent.h"
+#include "inputeventqueue.h"
+#include "inputstate.h"
 
 // InputDevice represents an abstract controller.
 
@@ -25,8 +27,10 @@
 // 'inputDevice->selfDestruct'. This is because changes to the InputDevice's mapping are only written to a save file
 // when the application closes.
 
-// Use alias so we don't have to type this out every time. :/
-using InputStateMap = QHash<InputDeviceEvent::Event, int16_t>;
+// While the gamepad controls the frontend, button changes are handed to the frontend in batches: every change
+// between two deliveries is collected into one inputStateChanged() signal, emitted from the device's own thread no
+// more than once every deliveryInterval. Only real transitions count, writing a button's current state again
+// delivers nothing.
 
 class InputDevice : public QObject {
         Q_OBJECT
@@ -41,6 +45,9 @@ class InputDevice : public QObject {
         // and set to true when the game stops. The setRun function of InputManager toggles this.
         static bool gamepadControlsFrontend;
 
+        // Minimum time between two inputStateChanged() signals, in milliseconds. About one frame at 60 Hz.
+        static const int deliveryInterval = 16;
+
         // Controller types from libretro's perspective
         enum  LibretroType {
             DigitalGamepad = RETRO_DEVICE_JOYPAD,
@@ -65,7 +72,12 @@ class InputDevice : public QObject {
         QString mappingString() const;
         bool resetMapping() const;// QML
         LibretroType type() const;
-        InputStateMap *states();
+
+        // The device's state block, readable from any thread without locking.
+        InputStateBlock *states();
+
+        // The device's button transitions with their times, off until someone turns it on and drains it.
+        InputEventQueue *events();
 
         // Setters
         void setName( const QString name ); // QML
@@ -90,13 +102,24 @@ class InputDevice : public QObject {
         // Set button state (setter)
         virtual void insert( const InputDeviceEvent::Event &value, const int16_t &state );
 
+        // Set analog stick state (setter)
+        void insertAxis( const InputPortState::Axis &axis, const int16_t &value );
+
         // Set the device -> SDL2 gamepad mapping
         virtual void setMapping( const QVariantMap mapping );
 
     protected:
 
         // The device's current state (whether certain buttons are pressed)
-        std::unique_ptr<InputStateMap> deviceStates;
+        std::unique_ptr<InputStateBlock> deviceStates;
+
+        // Every change of a button's pressed state, when it's on. Written by insertAt() alongside deviceStates.
+        std::unique_ptr<InputEventQueue> deviceEvents;
+
+        // insert() and insertAxis() for sources that know when the change happened, like the kernel's own event
+        // timestamps. timestamp is on inputClockNs()'s clock, and becomes the state's capture time.
+        void insertAt( const InputDeviceEvent::Event &value, const int16_t state, const qint64 timestamp );
+        void insertAxisAt( const InputPortState::Axis &axis, const int16_t value, const qint64 timestamp );
 
     signals:
 
@@ -105,23 +128,39 @@ class InputDevice : public QObject {
         void retroButtonCountChanged(); // QML
         void resetMappingChanged(); // QML
 
-        // The inputDeviceEvent signal is used to connect to the QMLInputDevice
+        // The inputStateChanged signal is used to connect to the QMLInputDevice
         // and shouldn't be connected to anything else.
-        void inputDeviceEvent( InputDeviceEvent::Event event, int state ); // QML
+
+        // changed has a bit set for every button that changed since the last signal, state has one for every
+        // button that's held, both indexed by InputStateBlock::slot(). A button that was pressed and released in
+        // between is reported as held, and released in the next signal, so quick taps aren't lost.
+        void inputStateChanged( quint32 changed, quint32 state ); // QML
 
         // The editModeEvent signal is used for changing the InputDevice's internal button map.
         // This should be connected to any time the user wants to change the mapping.
         // After this mapping has been edited, this signal can be disconnected.
         void editModeEvent( int event, int state ); // QML
 
+    private slots:
+
+        // Emit the collected changes, or put it off until deliveryInterval has passed.
+        void deliverStateChanges();
+
     private:
 
+        // Buttons changed, and buttons pressed, since the last delivery. Written by whichever thread polls.
+        std::atomic<quint32> pendingChanges;
+        std::atomic<quint32> pendingPresses;
+
+        // inputClockNs() of the last delivery, only touched on the device's thread.
+        qint64 lastDelivery;
+
+        // Collect a change and schedule a delivery if none is pending. Doesn't emit anything.
+        void queueStateChange( const quint32 changed, const quint32 pressed );
+
         // Type of controller this input device is
         LibretroType deviceType;
 
-        // Controller states are read by a different thread, lock access with a mutex
-        QMutex mutex;
-
         // Clear button states
         void resetStates();
         void setRetroButtonCount( const int count );
@@ -0,0 +1,280 @@
+#include "inputdeviceregistry.h"
+
+InputDeviceRegistry::InputDeviceRegistry()
+    : denseCount( 0 ),
+      portEnd( 0 ) {
+
+    for( auto &entry : hash ) {
+        entry.instanceID = emptyKey;
+        entry.slot = -1;
+    }
+
+    for( int i = 0; i < maxDevices; ++i ) {
+        slotDevices[ i ] = nullptr;
+        dense[ i ] = nullptr;
+        denseSlot[ i ] = -1;
+        slotDense[ i ] = -1;
+        ports[ i ].store( nullptr, std::memory_order_relaxed );
+        slotPort[ i ] = -1;
+        portSlot[ i ] = -1;
+    }
+
+}
+
+bool InputDeviceRegistry::add( const qint32 instanceID, const int slot, InputDevice *device ) {
+
+    if( slot < 0 || slot >= maxDevices || slotDevices[ slot ] || instanceID == emptyKey
+        || findEntry( instanceID ) != -1 ) {
+        return false;
+    }
+
+    // There's always an empty entry, the table is twice as big as the number of slots.
+    int entry = hashOf( instanceID );
+
+    while( hash[ entry ].instanceID != emptyKey ) {
+        entry = ( entry + 1 ) & ( hashSize - 1 );
+    }
+
+    hash[ entry ].instanceID = instanceID;
+    hash[ entry ].slot = static_cast<qint16>( slot );
+
+    slotDevices[ slot ] = device;
+
+    dense[ denseCount ] = device;
+    denseSlot[ denseCount ] = static_cast<qint16>( slot );
+    slotDense[ slot ] = static_cast<qint16>( denseCount );
+    denseCount++;
+
+    return true;
+
+}
+
+int InputDeviceRegistry::remove( const qint32 instanceID ) {
+
+    int entry = findEntry( instanceID );
+
+    if( entry == -1 ) {
+        return -1;
+    }
+
+    int slot = hash[ entry ].slot;
+
+    // Backward shift deletion: pull later entries of the probe sequence into the gap, so lookups never need
+    // tombstones. SDL never reuses instance IDs, so tombstones would pile up forever.
+    int gap = entry;
+    int next = ( gap + 1 ) & ( hashSize - 1 );
+
+    while( hash[ next ].instanceID != emptyKey ) {
+
+        int home = hashOf( hash[ next ].instanceID );
+
+        // Move the entry if its home isn't cyclically within ( gap, next ].
+        if( ( ( next - home ) & ( hashSize - 1 ) ) >= ( ( next - gap ) & ( hashSize - 1 ) ) ) {
+            hash[ gap ] = hash[ next ];
+            gap = next;
+        }
+
+        next = ( next + 1 ) & ( hashSize - 1 );
+
+    }
+
+    hash[ gap ].instanceID = emptyKey;
+    hash[ gap ].slot = -1;
+
+    // Move the last packed device into the removed one's place.
+    int position = slotDense[ slot ];
+    int last = denseCount - 1;
+
+    dense[ position ] = dense[ last ];
+    denseSlot[ position ] = denseSlot[ last ];
+    slotDense[ denseSlot[ position ] ] = static_cast<qint16>( position );
+
+    dense[ last ] = nullptr;
+    denseSlot[ last ] = -1;
+    slotDense[ slot ] = -1;
+    denseCount--;
+
+    slotDevices[ slot ] = nullptr;
+
+    return slot;
+
+}
+
+InputDevice *InputDeviceRegistry::find( const qint32 instanceID ) const {
+
+    int entry = findEntry( instanceID );
+
+    return entry == -1 ? nullptr : slotDevices[ hash[ entry ].slot ];
+
+}
+
+InputDevice *InputDeviceRegistry::atSlot( const int slot ) const {
+    return slot >= 0 && slot < maxDevices ? slotDevices[ slot ] : nullptr;
+}
+
+int InputDeviceRegistry::count() const {
+    return denseCount;
+}
+
+InputDevice *InputDeviceRegistry::at( const int index ) const {
+    return dense[ index ];
+}
+
+int InputDeviceRegistry::insertPort( const int slot, InputDevice *device ) {
+
+    if( slot < 0 || slot >= maxDevices ) {
+        return -1;
+    }
+
+    int port = ports[ slot ].load( std::memory_order_relaxed ) ? -1 : slot;
+
+    for( int i = 0; port == -1 && i < maxDevices; ++i ) {
+        if( !ports[ i ].load( std::memory_order_relaxed ) ) {
+            port = i;
+        }
+    }
+
+    if( port == -1 ) {
+        return -1;
+    }
+
+    // Release, so a reader that finds the device also finds it fully constructed.
+    ports[ port ].store( device, std::memory_order_release );
+    portSlot[ port ] = static_cast<qint16>( slot );
+    slotPort[ slot ] = static_cast<qint16>( port );
+
+    updatePortEnd();
+
+    return port;
+
+}
+
+void InputDeviceRegistry::setPort( const int port, InputDevice *device ) {
+
+    if( port < 0 || port >= maxDevices ) {
+        return;
+    }
+
+    if( portSlot[ port ] != -1 ) {
+        slotPort[ portSlot[ port ] ] = -1;
+        portSlot[ port ] = -1;
+    }
+
+    ports[ port ].store( device, std::memory_order_release );
+
+    updatePortEnd();
+
+}
+
+InputDevice *InputDeviceRegistry::takePort( const int port ) {
+
+    if( port < 0 || port >= maxDevices ) {
+        return nullptr;
+    }
+
+    auto *device = ports[ port ].load( std::memory_order_relaxed );
+    setPort( port, nullptr );
+
+    return device;
+
+}
+
+void InputDeviceRegistry::swapPorts( const int port1, const int port2 ) {
+
+    if( port1 < 0 || port1 >= maxDevices || port2 < 0 || port2 >= maxDevices ) {
+        return;
+    }
+
+    auto *device1 = ports[ port1 ].load( std::memory_order_relaxed );
+    ports[ port1 ].store( ports[ port2 ].load( std::memory_order_relaxed ), std::memory_order_release );
+    ports[ port2 ].store( device1, std::memory_order_release );
+    qSwap( portSlot[ port1 ], portSlot[ port2 ] );
+
+    for( int port : { port1, port2 } ) {
+        if( portSlot[ port ] != -1 ) {
+            slotPort[ portSlot[ port ] ] = static_cast<qint16>( port );
+        }
+    }
+
+    updatePortEnd();
+
+}
+
+int InputDeviceRegistry::portForSlot( const int slot ) const {
+    return slot >= 0 && slot < maxDevices ? slotPort[ slot ] : -1;
+}
+
+int InputDeviceRegistry::freePort() const {
+
+    for( int i = 0; i < maxDevices; ++i ) {
+        if( !ports[ i ].load( std::memory_order_relaxed ) ) {
+            return i;
+        }
+    }
+
+    return -1;
+
+}
+
+int InputDeviceRegistry::portOf( const InputDevice *device ) const {
+
+    for( int i = 0; i < portEnd.load( std::memory_order_relaxed ); ++i ) {
+        if( ports[ i ].load( std::memory_order_relaxed ) == device ) {
+            return i;
+        }
+    }
+
+    return -1;
+
+}
+
+InputDevice *InputDeviceRegistry::atPort( const int port ) const {
+    return port >= 0 && port < maxDevices ? ports[ port ].load( std::memory_order_acquire ) : nullptr;
+}
+
+int InputDeviceRegistry::portCount() const {
+    return portEnd.load( std::memory_order_acquire );
+}
+
+int InputDeviceRegistry::hashOf( const qint32 instanceID ) {
+
+    // Fibonacci hashing, instance IDs are usually small consecutive numbers.
+    quint32 mixed = static_cast<quint32>( instanceID ) * 2654435761u;
+
+    return static_cast<int>( mixed >> 24 ) & ( hashSize - 1 );
+
+}
+
+int InputDeviceRegistry::findEntry( const qint32 instanceID ) const {
+
+    if( instanceID == emptyKey ) {
+        return -1;
+    }
+
+    int entry = hashOf( instanceID );
+
+    while( hash[ entry ].instanceID != emptyKey ) {
+
+        if( hash[ entry ].instanceID == instanceID ) {
+            return entry;
+        }
+
+        entry = ( entry + 1 ) & ( hashSize - 1 );
+
+    }
+
+    return -1;
+
+}
+
+void InputDeviceRegistry::updatePortEnd() {
+
+    int end = maxDevices;
+
+    while( end > 0 && !ports[ end - 1 ].load( std::memory_order_relaxed ) ) {
+        end--;
+    }
+
+    portEnd.store( end, std::memory_order_release );
+
+}
@@ -0,0 +1,117 @@
+#ifndef INPUTDEVICEREGISTRY_H
+#define INPUTDEVICEREGISTRY_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+class InputDevice;
+
+// InputDeviceRegistry is the one place connected devices are kept. It maps SDL instance IDs to slots, the index
+// SDL reported the device at, and slots to ports, the index the core reads the device at.
+
+// Every table is a fixed size array, so nothing here ever allocates, and every lookup is O(1). Instance IDs are
+// found through a small open addressing hash table, and connected devices are also kept packed together so a
+// poll only walks the devices that exist.
+
+// The two halves belong to different threads. The slot half is only touched by whoever is polling SDL (with
+// SDLEventLoop's poll mutex held). The port half is changed with the InputManager's mutex held, but atPort() and
+// portCount() may be called by anyone without it, from inside an InputEpoch guard. A device taken off its port
+// stays valid for as long as the guard it was read in, see SDLEventLoop::retire().
+
+class InputDeviceRegistry {
+
+    public:
+
+        // Same as Joystick::maxNumOfDevices
+        static const int maxDevices = 128;
+
+        InputDeviceRegistry();
+
+        //
+        // Slots
+        //
+
+        // Register a newly connected device. Returns false if the slot is taken or out of range.
+        bool add( const qint32 instanceID, const int slot, InputDevice *device );
+
+        // Forget a disconnected device, returns its slot or -1 if the ID isn't known.
+        int remove( const qint32 instanceID );
+
+        // nullptr if there's no such device.
+        InputDevice *find( const qint32 instanceID ) const;
+        InputDevice *atSlot( const int slot ) const;
+
+        // The connected devices, packed, in no particular order. Removing a device moves the last one into its
+        // place, so don't remove while iterating.
+        int count() const;
+        InputDevice *at( const int index ) const;
+
+        //
+        // Ports
+        //
+
+        // Give a slot's device a port: the one with the same index if it's free, the first free one if not.
+        // Returns the port, or -1 if every port is taken.
+        int insertPort( const int slot, InputDevice *device );
+
+        // Put a device that didn't come from SDL, like the keyboard, on a port.
+        void setPort( const int port, InputDevice *device );
+
+        // Clear a port, returns the device that was there.
+        InputDevice *takePort( const int port );
+
+        // A reader without the lock may see the device on both ports, or on neither, for a moment.
+        void swapPorts( const int port1, const int port2 );
+
+        // -1 if the slot has no port.
+        int portForSlot( const int slot ) const;
+
+        // For devices that didn't come from SDL: the first free port, and the port a device is on. -1 if there's
+        // none.
+        int freePort() const;
+        int portOf( const InputDevice *device ) const;
+
+        InputDevice *atPort( const int port ) const;
+
+        // One past the last port in use, ports from here on are all empty.
+        int portCount() const;
+
+    private:
+
+        // Twice the devices, so probe sequences stay short.
+        static const int hashSize = maxDevices * 2;
+        static const qint32 emptyKey = -1;
+
+        struct HashEntry {
+            qint32 instanceID;
+            qint16 slot;
+        };
+
+        HashEntry hash[ hashSize ];
+
+        InputDevice *slotDevices[ maxDevices ];
+
+        // Packed connected devices, with the position of every slot in it.
+        InputDevice *dense[ maxDevices ];
+        qint16 denseSlot[ maxDevices ];
+        qint16 slotDense[ maxDevices ];
+        int denseCount;
+
+        // Read without the lock, the rest of the port half isn't.
+        std::atomic<InputDevice *> ports[ maxDevices ];
+        std::atomic<int> portEnd;
+
+        qint16 slotPort[ maxDevices ];
+        qint16 portSlot[ maxDevices ];
+
+        static int hashOf( const qint32 instanceID );
+        int findEntry( const qint32 instanceID ) const;
+
+        void updatePortEnd();
+
+        Q_DISABLE_COPY( InputDeviceRegistry )
+
+};
+
+#endif // INPUTDEVICEREGISTRY_H
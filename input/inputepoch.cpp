@@ -0,0 +1,92 @@
+#include "inputepoch.h"
+
+#include <QThread>
+
+const int InputEpoch::maxReaders;
+
+// Where the calling thread last found a free slot, so threads mostly stick to one each.
+static thread_local int lastReader = 0;
+
+InputEpoch::Guard::Guard( InputEpoch &epoch )
+    : epoch( epoch ),
+      reader( epoch.enter() ) {
+
+}
+
+InputEpoch::Guard::~Guard() {
+    epoch.exit( reader );
+}
+
+InputEpoch::InputEpoch()
+    : current( 1 ) {
+
+    for( auto &reader : readers ) {
+        reader.taken.store( false, std::memory_order_relaxed );
+        reader.epoch.store( 0, std::memory_order_relaxed );
+    }
+
+}
+
+void InputEpoch::synchronize() {
+
+    quint64 target = current.fetch_add( 1, std::memory_order_seq_cst ) + 1;
+
+    // Pairs with the fence in enter(): a reader we don't see here is guaranteed to see the unlink.
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+    for( auto &reader : readers ) {
+
+        forever {
+            quint64 entered = reader.epoch.load( std::memory_order_acquire );
+
+            if( entered == 0 || entered >= target ) {
+                break;
+            }
+
+            QThread::yieldCurrentThread();
+        }
+
+    }
+
+}
+
+int InputEpoch::activeReaders() const {
+
+    int active = 0;
+
+    for( auto &reader : readers ) {
+        active += reader.epoch.load( std::memory_order_relaxed ) != 0 ? 1 : 0;
+    }
+
+    return active;
+
+}
+
+int InputEpoch::enter() {
+
+    // Every slot taken means maxReaders guards are open at once. They're all short, so one frees up soon.
+    for( int i = lastReader; ; i = ( i + 1 ) % maxReaders ) {
+
+        bool expected = false;
+
+        if( !readers[ i ].taken.load( std::memory_order_relaxed )
+            && readers[ i ].taken.compare_exchange_strong( expected, true, std::memory_order_acquire ) ) {
+
+            lastReader = i;
+            readers[ i ].epoch.store( current.load( std::memory_order_seq_cst ), std::memory_order_seq_cst );
+
+            // Our epoch has to be visible before we read any device pointer.
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+
+            return i;
+
+        }
+
+    }
+
+}
+
+void InputEpoch::exit( const int reader ) {
+    readers[ reader ].epoch.store( 0, std::memory_order_release );
+    readers[ reader ].taken.store( false, std::memory_order_release );
+}
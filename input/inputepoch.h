@@ -0,0 +1,73 @@
+#ifndef INPUTEPOCH_H
+#define INPUTEPOCH_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+// InputEpoch decides when a device that's been taken off its port can be freed, without readers ever locking.
+
+// A reader wraps its accesses in a Guard, which claims a free slot, publishes the current epoch in it and clears
+// it again: a compare and swap and a few stores, it never waits. A writer unlinks the device first, so no new reader
+// can find it, then calls synchronize(). That starts a new epoch and waits until every reader is either outside
+// a guard or entered it after the new epoch began, after which nobody can still hold the device and it can go.
+
+// Only the writer waits, and only for guards that were already open, which last as long as a snapshot copy. It
+// should be called from a worker thread, never from a reader.
+
+// Every open guard holds one of maxReaders slots, so guards nest and any thread may read. A slot is claimed with
+// a single compare and swap, starting from the one the thread used last.
+
+class InputEpoch {
+
+    public:
+
+        static const int maxReaders = 32;
+
+        class Guard {
+
+            public:
+
+                explicit Guard( InputEpoch &epoch );
+                ~Guard();
+
+            private:
+
+                InputEpoch &epoch;
+                int reader;
+
+                Q_DISABLE_COPY( Guard )
+
+        };
+
+        InputEpoch();
+
+        // Wait until no reader can still see anything unlinked before this call.
+        void synchronize();
+
+        // Readers inside a guard right now, for diagnostics.
+        int activeReaders() const;
+
+    private:
+
+        // epoch is 0 while the slot is free, the epoch its guard was opened in otherwise. Padded to a cache line,
+        // so readers on different threads don't share one. (Padded rather than aligned, the InputManager that
+        // holds this is allocated with plain new.)
+        struct Reader {
+            std::atomic<bool> taken;
+            std::atomic<quint64> epoch;
+            char padding[ 64 - sizeof( std::atomic<quint64> ) * 2 ];
+        };
+
+        std::atomic<quint64> current;
+        Reader readers[ maxReaders ];
+
+        // Claim a slot and publish the current epoch in it.
+        int enter();
+        void exit( const int reader );
+
+        Q_DISABLE_COPY( InputEpoch )
+
+};
+
+#endif // INPUTEPOCH_H
@@ -0,0 +1,84 @@
+#include "inputeventqueue.h"
+
+const int InputEventQueue::queueSize;
+const int InputFrameEvents::maxEvents;
+
+static_assert( ( InputEventQueue::queueSize & ( InputEventQueue::queueSize - 1 ) ) == 0,
+               "queueSize must be a power of two" );
+
+InputEventQueue::InputEventQueue()
+    : enabled( false ),
+      queued( 0 ),
+      taken( 0 ),
+      dropped( 0 ),
+      reportedDrops( 0 ) {
+
+}
+
+void InputEventQueue::setEnabled( const bool enabled ) {
+    this->enabled.store( enabled, std::memory_order_relaxed );
+}
+
+bool InputEventQueue::isEnabled() const {
+    return enabled.load( std::memory_order_relaxed );
+}
+
+bool InputEventQueue::push( const qint64 timestamp, const int slot, const qint16 value ) {
+
+    if( !enabled.load( std::memory_order_relaxed ) ) {
+        return false;
+    }
+
+    quint32 head = queued.load( std::memory_order_relaxed );
+
+    if( head - taken.load( std::memory_order_acquire ) >= static_cast<quint32>( queueSize ) ) {
+        dropped.fetch_add( 1, std::memory_order_relaxed );
+        return false;
+    }
+
+    auto &event = events[ head & ( queueSize - 1 ) ];
+    event.timestamp = timestamp;
+    event.value = value;
+    event.slot = static_cast<quint8>( slot );
+    event.port = 0;
+
+    queued.store( head + 1, std::memory_order_release );
+
+    return true;
+
+}
+
+int InputEventQueue::drain( InputEvent *events, const int capacity ) {
+
+    quint32 tail = taken.load( std::memory_order_relaxed );
+    quint32 available = queued.load( std::memory_order_acquire ) - tail;
+    int count = static_cast<int>( qMin<quint32>( available, static_cast<quint32>( qMax( capacity, 0 ) ) ) );
+
+    for( int i = 0; i < count; ++i ) {
+        events[ i ] = this->events[ ( tail + i ) & ( queueSize - 1 ) ];
+    }
+
+    taken.store( tail + count, std::memory_order_release );
+
+    return count;
+
+}
+
+quint64 InputEventQueue::takeOverflows() {
+
+    quint64 total = dropped.load( std::memory_order_relaxed );
+    quint64 overflows = total - reportedDrops;
+    reportedDrops = total;
+
+    return overflows;
+
+}
+
+void InputEventQueue::clear() {
+    taken.store( queued.load( std::memory_order_acquire ), std::memory_order_release );
+    reportedDrops = dropped.load( std::memory_order_relaxed );
+}
+
+quint64 InputEventQueue::overflows() const {
+    return dropped.load( std::memory_order_relaxed );
+}
@@ -0,0 +1,96 @@
+#ifndef INPUTEVENTQUEUE_H
+#define INPUTEVENTQUEUE_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+// InputEvent is one button going down or up, at the time its source says it did.
+struct InputEvent {
+
+    // On inputClockNs()'s clock.
+    qint64 timestamp;
+
+    // The level after the change, 0 is released. Analog buttons like triggers have their level here.
+    qint16 value;
+
+    // InputStateBlock::slot() of the button.
+    quint8 slot;
+
+    // Filled in when InputManager collects it, see InputFrameEvents.
+    quint8 port;
+
+};
+
+// InputEventQueue keeps the button transitions of one InputDevice, next to the levels in its InputStateBlock. The
+// levels only have the latest state, so two presses within a frame look like one, or like none if the button was
+// let go again, and nobody can tell when within the frame it happened. Rhythm and fighting games care about both.
+
+// It's a fixed ring with one producer, the thread writing the device, and one consumer. Nothing is queued until
+// it's turned on, so devices nobody drains cost one relaxed load per transition. When it's full, new transitions
+// are dropped and counted, the levels are still right: a consumer that sees an overflow knows it missed some.
+
+class InputEventQueue {
+
+    public:
+
+        // A power of two.
+        static const int queueSize = 256;
+
+        InputEventQueue();
+
+        // Off by default. Any thread.
+        void setEnabled( const bool enabled );
+        bool isEnabled() const;
+
+        // Producer: returns false if the queue is off or full.
+        bool push( const qint64 timestamp, const int slot, const qint16 value );
+
+        // Consumer: move up to capacity of the oldest transitions to events, returns how many.
+        int drain( InputEvent *events, const int capacity );
+
+        // Consumer: transitions dropped since the last call.
+        quint64 takeOverflows();
+
+        // Consumer: throw away everything queued, and forget the overflows.
+        void clear();
+
+        // Transitions dropped so far, any thread.
+        quint64 overflows() const;
+
+    private:
+
+        InputEvent events[ queueSize ];
+
+        std::atomic<bool> enabled;
+
+        // Only ever incremented, the slot is the count modulo queueSize.
+        std::atomic<quint32> queued;
+        std::atomic<quint32> taken;
+
+        std::atomic<quint64> dropped;
+        quint64 reportedDrops;
+
+        Q_DISABLE_COPY( InputEventQueue )
+
+};
+
+// InputFrameEvents is every button transition since the last frame, collected from every port's InputEventQueue
+// once a frame, see InputManager::frameEvents(). They're grouped by port, each port's oldest first.
+
+struct InputFrameEvents {
+
+    static const int maxEvents = 1024;
+
+    int count;
+
+    // Transitions dropped since the last frame because their device's queue was full. Once a frame has some, its
+    // events are incomplete, the snapshot's levels are still right. Ones that don't fit here aren't dropped, they
+    // wait in their queue for the next frame.
+    quint64 overflowed;
+
+    InputEvent events[ maxEvents ];
+
+};
+
+#endif // INPUTEVENTQUEUE_H
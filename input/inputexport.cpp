@@ -0,0 +1,142 @@
+#include "inputexport.h"
+
+#include "logging.h"
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+InputExporter::InputExporter()
+    : segment( nullptr ) {
+
+}
+
+InputExporter::~InputExporter() {
+    stop();
+}
+
+bool InputExporter::start( const QString &name ) {
+
+    stop();
+
+#ifdef Q_OS_UNIX
+
+    this->name = name.toLocal8Bit();
+
+    // A segment left behind by a crash may be a different size, or still mapped by readers. Start over.
+    shm_unlink( this->name.constData() );
+
+    int fd = shm_open( this->name.constData(), O_CREAT | O_EXCL | O_RDWR, 0644 );
+
+    if( fd == -1 ) {
+        qCWarning( phxInput ) << "Unable to create the input export" << name << ":" << strerror( errno );
+        return false;
+    }
+
+    void *memory = MAP_FAILED;
+
+    if( ftruncate( fd, sizeof( InputExportSegment ) ) == 0 ) {
+        memory = mmap( nullptr, sizeof( InputExportSegment ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    }
+
+    if( memory == MAP_FAILED ) {
+        qCWarning( phxInput ) << "Unable to map the input export" << name << ":" << strerror( errno );
+        close( fd );
+        shm_unlink( this->name.constData() );
+        return false;
+    }
+
+    // The mapping keeps it open.
+    close( fd );
+
+    // A new segment is all zeroes, so sequence is even and portCount 0 until the first frame.
+    segment = static_cast<InputExportSegment *>( memory );
+    segment->version = InputExportLayout::version;
+    segment->maxPorts = InputExportLayout::maxPorts;
+    segment->size = sizeof( InputExportSegment );
+
+    // Readers check the magic last, once it's there the rest is too.
+    std::atomic_thread_fence( std::memory_order_release );
+    segment->magic = InputExportLayout::magic;
+
+    return true;
+
+#else
+
+    qCWarning( phxInput ) << "Unable to export input to" << name << ": there's no shared memory here";
+    return false;
+
+#endif
+
+}
+
+void InputExporter::stop() {
+
+    if( !segment ) {
+        return;
+    }
+
+#ifdef Q_OS_UNIX
+
+    beginFrame();
+    segment->closed = 1;
+    endFrame();
+
+    munmap( segment, sizeof( InputExportSegment ) );
+    shm_unlink( name.constData() );
+
+#endif
+
+    segment = nullptr;
+
+}
+
+bool InputExporter::isExporting() const {
+    return segment;
+}
+
+void InputExporter::publish( const InputSnapshot &snapshot ) {
+
+    if( !segment ) {
+        return;
+    }
+
+    int portCount = qMin( snapshot.portCount, InputExportLayout::maxPorts );
+
+    beginFrame();
+
+    segment->frame = snapshot.frame;
+    segment->timestamp = snapshot.timestamp;
+    segment->portCount = static_cast<uint32_t>( portCount );
+
+    for( int i = 0; i < portCount; ++i ) {
+        auto &port = segment->ports[ i ];
+
+        port.buttons = snapshot.ports[ i ].buttons;
+        std::memcpy( port.axes, snapshot.ports[ i ].axes, sizeof( port.axes ) );
+        port.captured = snapshot.captured[ i ];
+    }
+
+    endFrame();
+
+}
+
+void InputExporter::beginFrame() {
+
+    auto sequence = segment->sequence.load( std::memory_order_relaxed );
+    segment->sequence.store( sequence + 1, std::memory_order_relaxed );
+
+    // None of the frame's writes may be seen before sequence turns odd.
+    std::atomic_thread_fence( std::memory_order_release );
+
+}
+
+void InputExporter::endFrame() {
+    segment->sequence.fetch_add( 1, std::memory_order_release );
+}
@@ -0,0 +1,50 @@
+#ifndef INPUTEXPORT_H
+#define INPUTEXPORT_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QString>
+
+#include "inputexportlayout.h"
+#include "inputsnapshot.h"
+
+// InputExporter copies every published InputSnapshot into a POSIX shared memory segment, see InputExportLayout,
+// where any number of local processes can map it read only and follow the controllers with InputExportReader.
+// Nobody is waited for: a frame is a few hundred bytes written under a seqlock, no system calls.
+
+// The segment is readable by every local user, like /dev/input's joysticks usually are. Only the ports are
+// exported, never the keyboard.
+
+// Not thread safe. InputManager calls it under its publish mutex, right after filling in a snapshot. Does nothing
+// where there's no POSIX shared memory.
+
+class InputExporter {
+
+    public:
+
+        InputExporter();
+        ~InputExporter();
+
+        // name is a shared memory object name, like "/phoenix-input". It's replaced if it already exists.
+        bool start( const QString &name );
+
+        // Tells the readers, then removes the segment. Readers that have it mapped can still read the last frame.
+        void stop();
+
+        bool isExporting() const;
+
+        void publish( const InputSnapshot &snapshot );
+
+    private:
+
+        QByteArray name;
+        InputExportSegment *segment;
+
+        void beginFrame();
+        void endFrame();
+
+        Q_DISABLE_COPY( InputExporter )
+
+};
+
+#endif // INPUTEXPORT_H
@@ -0,0 +1,75 @@
+#ifndef INPUTEXPORTLAYOUT_H
+#define INPUTEXPORTLAYOUT_H
+
+#include <atomic>
+#include <cstdint>
+
+// The layout of the shared memory segment an InputExporter publishes every poll to, for overlays, stream tools and
+// the like running beside the frontend. Plain C++11, no Qt, so the tools that read it only need this header and
+// InputExportReader.
+
+// The segment starts with a header: the magic "PXIE", the layout version, how many ports it has room for, then a
+// sequence number and the frame. After that come the ports, of which only the first portCount are in use.
+
+// The frame is guarded by a seqlock. The writer makes sequence odd, writes the frame, then makes it even again.
+// Readers copy what they need between two reads of sequence, and try again if it was odd or has moved, so they
+// never see half a frame and never hold the writer up. Timestamps are CLOCK_MONOTONIC nanoseconds.
+
+// Everything is in the machine's own byte order, readers are on the same machine.
+
+namespace InputExportLayout {
+
+    static const uint32_t magic = 0x45495850; // "PXIE"
+    static const uint16_t version = 1;
+
+    // Same as InputSnapshot::maxPorts
+    static const int maxPorts = 128;
+
+}
+
+struct InputExportPort {
+
+    // Bit n is RETRO_DEVICE_ID_JOYPAD n.
+    uint16_t buttons;
+
+    // Left X, left Y, right X, right Y, as in RETRO_DEVICE_ANALOG.
+    int16_t axes[ 4 ];
+
+    uint16_t reserved;
+
+    // When the port's state last changed, 0 if it never did or nothing is plugged into it.
+    int64_t captured;
+
+};
+
+struct InputExportSegment {
+
+    // Written once, before the first frame.
+    uint32_t magic;
+    uint16_t version;
+    uint16_t maxPorts;
+    uint32_t size;
+    uint32_t reserved;
+
+    // Odd while the writer is in the middle of a frame.
+    std::atomic<uint64_t> sequence;
+
+    // The frame, from here on.
+
+    // The InputManager's snapshot number, and when it was taken.
+    uint64_t frame;
+    int64_t timestamp;
+
+    uint32_t portCount;
+
+    // Set by the writer's last frame, when it stops exporting.
+    uint32_t closed;
+
+    InputExportPort ports[ InputExportLayout::maxPorts ];
+
+};
+
+static_assert( sizeof( InputExportPort ) == 24, "InputExportPort is part of the shared layout" );
+static_assert( ATOMIC_LLONG_LOCK_FREE == 2, "The sequence must be lock free to work across processes" );
+
+#endif // INPUTEXPORTLAYOUT_H
@@ -0,0 +1,170 @@
+#include "inputexportreader.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const int InputExportReader::maxAttempts;
+
+InputExportReader::InputExportReader()
+    : segment( nullptr ),
+      retryCount( 0 ) {
+
+}
+
+InputExportReader::~InputExportReader() {
+    close();
+}
+
+bool InputExportReader::open( const char *name ) {
+
+    close();
+
+    int fd = shm_open( name, O_RDONLY, 0 );
+
+    if( fd == -1 ) {
+        return false;
+    }
+
+    // Before the writer has sized it, reading the mapping would raise SIGBUS.
+    struct stat info;
+
+    if( fstat( fd, &info ) == -1 || info.st_size < static_cast<off_t>( sizeof( InputExportSegment ) ) ) {
+        ::close( fd );
+        return false;
+    }
+
+    void *memory = mmap( nullptr, sizeof( InputExportSegment ), PROT_READ, MAP_SHARED, fd, 0 );
+
+    // The mapping keeps it open.
+    ::close( fd );
+
+    if( memory == MAP_FAILED ) {
+        return false;
+    }
+
+    auto *mapped = static_cast<const InputExportSegment *>( memory );
+
+    // The writer fills in the magic last.
+    bool valid = mapped->magic == InputExportLayout::magic;
+    std::atomic_thread_fence( std::memory_order_acquire );
+
+    valid = valid && mapped->version == InputExportLayout::version
+            && mapped->maxPorts == InputExportLayout::maxPorts && mapped->size == sizeof( InputExportSegment );
+
+    if( !valid ) {
+        munmap( memory, sizeof( InputExportSegment ) );
+        return false;
+    }
+
+    segment = mapped;
+    return true;
+
+}
+
+void InputExportReader::close() {
+
+    if( segment ) {
+        munmap( const_cast<InputExportSegment *>( segment ), sizeof( InputExportSegment ) );
+        segment = nullptr;
+    }
+
+}
+
+bool InputExportReader::isOpen() const {
+    return segment;
+}
+
+bool InputExportReader::writerClosed() const {
+    return segment && segment->closed;
+}
+
+bool InputExportReader::readPort( const int port, InputExportPort &state, uint64_t *frame ) {
+
+    if( !segment || port < 0 || port >= InputExportLayout::maxPorts ) {
+        return false;
+    }
+
+    for( int attempt = 0; attempt < maxAttempts; ++attempt ) {
+
+        uint64_t before = segment->sequence.load( std::memory_order_acquire );
+
+        if( before & 1 ) {
+            retryCount++;
+            continue;
+        }
+
+        bool used = static_cast<uint32_t>( port ) < segment->portCount;
+
+        if( used ) {
+            std::memcpy( &state, &segment->ports[ port ], sizeof( state ) );
+        } else {
+            std::memset( &state, 0, sizeof( state ) );
+        }
+
+        uint64_t copiedFrame = segment->frame;
+
+        // The copy must be done before sequence is checked again.
+        std::atomic_thread_fence( std::memory_order_acquire );
+
+        if( segment->sequence.load( std::memory_order_relaxed ) == before ) {
+            if( frame ) {
+                *frame = copiedFrame;
+            }
+
+            return true;
+        }
+
+        retryCount++;
+
+    }
+
+    return false;
+
+}
+
+bool InputExportReader::read( InputExportFrame &frame ) {
+
+    if( !segment ) {
+        return false;
+    }
+
+    for( int attempt = 0; attempt < maxAttempts; ++attempt ) {
+
+        uint64_t before = segment->sequence.load( std::memory_order_acquire );
+
+        if( before & 1 ) {
+            retryCount++;
+            continue;
+        }
+
+        frame.frame = segment->frame;
+        frame.timestamp = segment->timestamp;
+
+        // Bounded before it's used, a torn count is thrown away below anyway.
+        uint32_t portCount = segment->portCount;
+        uint32_t maxPorts = InputExportLayout::maxPorts;
+        frame.portCount = static_cast<int>( portCount < maxPorts ? portCount : maxPorts );
+
+        std::memcpy( frame.ports, segment->ports, sizeof( InputExportPort ) * frame.portCount );
+
+        std::atomic_thread_fence( std::memory_order_acquire );
+
+        if( segment->sequence.load( std::memory_order_relaxed ) == before ) {
+            return true;
+        }
+
+        retryCount++;
+
+    }
+
+    return false;
+
+}
+
+uint64_t InputExportReader::retries() const {
+    return retryCount;
+}
@@ -0,0 +1,62 @@
+#ifndef INPUTEXPORTREADER_H
+#define INPUTEXPORTREADER_H
+
+#include <cstdint>
+
+#include "inputexportlayout.h"
+
+// InputExportReader follows an InputExporter from another process. It maps the segment read only, so reading is
+// copying what's wanted out of it, with no system calls and no round trips to the frontend. Plain C++11 and
+// POSIX, it's meant to be built into other tools as is.
+
+// One reader per thread. Reads never block: if the writer keeps getting in the way, which takes it publishing
+// maxAttempts times during one copy, they give up and return false.
+
+struct InputExportFrame {
+
+    uint64_t frame;
+    int64_t timestamp;
+    int portCount;
+    InputExportPort ports[ InputExportLayout::maxPorts ];
+
+};
+
+class InputExportReader {
+
+    public:
+
+        static const int maxAttempts = 64;
+
+        InputExportReader();
+        ~InputExportReader();
+
+        // Fails if there's no such segment, the writer hasn't sized it yet, or it has a layout we don't know.
+        bool open( const char *name );
+        void close();
+
+        bool isOpen() const;
+
+        // Whether the writer has stopped. The last frame stays readable.
+        bool writerClosed() const;
+
+        // A consistent copy of one port, and the frame it's from. A port past the frame's port count comes back
+        // released.
+        bool readPort( const int port, InputExportPort &state, uint64_t *frame = nullptr );
+
+        // A consistent copy of the whole frame, up to its port count.
+        bool read( InputExportFrame &frame );
+
+        // Copies that had to be started over because the writer was busy, for diagnostics.
+        uint64_t retries() const;
+
+    private:
+
+        const InputExportSegment *segment;
+        uint64_t retryCount;
+
+        InputExportReader( const InputExportReader & ) = delete;
+        InputExportReader &operator=( const InputExportReader & ) = delete;
+
+};
+
+#endif // INPUTEXPORTREADER_H
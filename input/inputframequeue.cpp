@@ -0,0 +1,287 @@
+#include "inputframequeue.h"
+
+const int InputFrameQueue::maxPlayers;
+const int InputFrameQueue::historySize;
+const int InputFrameQueue::maxDelay;
+const int InputFrameQueue::maxMaxPrediction;
+
+static bool samePort( const InputPortState &a, const InputPortState &b ) {
+
+    if( a.buttons != b.buttons ) {
+        return false;
+    }
+
+    for( int i = 0; i < InputPortState::AxisCount; ++i ) {
+        if( a.axes[ i ] != b.axes[ i ] ) {
+            return false;
+        }
+    }
+
+    return true;
+
+}
+
+InputFrameQueue::InputFrameQueue()
+    : delay( 2 ),
+      prediction( 8 ) {
+
+    reset( 2, 0 );
+
+}
+
+void InputFrameQueue::reset( const int players, const int localPlayer ) {
+
+    playerCount = qBound( 1, players, static_cast<int>( maxPlayers ) );
+    local = qBound( 0, localPlayer, playerCount - 1 );
+
+    current = 0;
+    acknowledged = 0;
+    rollbackPending = false;
+    rollbackFrame = 0;
+
+    for( int i = 0; i < maxPlayers; ++i ) {
+        confirmedCount[ i ] = 0;
+        lastConfirmed[ i ] = InputPortState();
+    }
+
+    // A frame no slot is ever claimed for, so the first claim of every slot starts it over.
+    for( auto &slot : ring ) {
+        slot.frame = ~0u;
+    }
+
+}
+
+int InputFrameQueue::players() const {
+    return playerCount;
+}
+
+int InputFrameQueue::localPlayer() const {
+    return local;
+}
+
+int InputFrameQueue::localDelay() const {
+    return delay;
+}
+
+void InputFrameQueue::setLocalDelay( const int frames ) {
+    delay = qBound( 0, frames, static_cast<int>( maxDelay ) );
+}
+
+int InputFrameQueue::maxPrediction() const {
+    return prediction;
+}
+
+void InputFrameQueue::setMaxPrediction( const int frames ) {
+    prediction = qBound( 0, frames, static_cast<int>( maxMaxPrediction ) );
+}
+
+qint64 InputFrameQueue::addLocalInput( const InputPortState &state ) {
+
+    quint32 target = current + static_cast<quint32>( delay );
+    quint32 next = confirmedCount[ local ];
+
+    // The delay was lowered, and the frames up to the new one are already scheduled.
+    if( next > target ) {
+        return -1;
+    }
+
+    if( target - oldestFrame() >= static_cast<quint32>( historySize - 1 ) ) {
+        return -1;
+    }
+
+    // The delay was raised, or frames advanced without any local input. The player is still doing the same thing.
+    for( ; next < target; ++next ) {
+        confirm( local, next, lastConfirmed[ local ] );
+    }
+
+    confirm( local, target, state );
+
+    return target;
+
+}
+
+bool InputFrameQueue::addRemoteInput( const int player, const quint32 frame, const InputPortState &state ) {
+
+    if( player < 0 || player >= playerCount || player == local ) {
+        return false;
+    }
+
+    if( frame != confirmedCount[ player ] || frame - oldestFrame() >= static_cast<quint32>( historySize - 1 ) ) {
+        return false;
+    }
+
+    confirm( player, frame, state );
+
+    return true;
+
+}
+
+quint32 InputFrameQueue::currentFrame() const {
+    return current;
+}
+
+quint32 InputFrameQueue::confirmedFrames( const int player ) const {
+    return player >= 0 && player < playerCount ? confirmedCount[ player ] : 0;
+}
+
+quint32 InputFrameQueue::confirmedFrames() const {
+
+    quint32 frames = confirmedCount[ 0 ];
+
+    for( int i = 1; i < playerCount; ++i ) {
+        frames = qMin( frames, confirmedCount[ i ] );
+    }
+
+    return frames;
+
+}
+
+quint32 InputFrameQueue::acknowledgedFrames() const {
+    return acknowledged;
+}
+
+void InputFrameQueue::setAcknowledgedFrames( const quint32 frames ) {
+
+    // Acknowledgements can arrive out of order, they only ever move forward.
+    acknowledged = qBound( acknowledged, frames, confirmedCount[ local ] );
+
+}
+
+bool InputFrameQueue::canAdvance() const {
+
+    quint32 confirmed = confirmedFrames();
+    bool predictable = current < confirmed || current - confirmed < static_cast<quint32>( prediction );
+
+    // One past the frame the local input for this one lands on, or further if the delay was just lowered. Adding
+    // it must not leave the frame unable to advance.
+    quint32 end = qMax( current + static_cast<quint32>( delay ) + 1, confirmedCount[ local ] );
+
+    return predictable && end - oldestFrame() < static_cast<quint32>( historySize );
+
+}
+
+const InputPortState *InputFrameQueue::advance() {
+
+    if( !canAdvance() ) {
+        return nullptr;
+    }
+
+    return predict( claim( current++ ) );
+
+}
+
+const InputPortState *InputFrameQueue::replay( const quint32 frame ) {
+
+    if( frame >= current || current - frame > static_cast<quint32>( historySize ) ) {
+        return nullptr;
+    }
+
+    auto &replayed = slot( frame );
+
+    return replayed.frame == frame ? predict( replayed ) : nullptr;
+
+}
+
+bool InputFrameQueue::takeRollback( quint32 &frame ) {
+
+    if( !rollbackPending ) {
+        return false;
+    }
+
+    frame = rollbackFrame;
+    rollbackPending = false;
+
+    return true;
+
+}
+
+bool InputFrameQueue::confirmedInput( const int player, const qint64 frame, InputPortState &state ) const {
+
+    if( player < 0 || player >= playerCount || frame < -1 || frame >= confirmedCount[ player ] ) {
+        return false;
+    }
+
+    if( frame == -1 ) {
+        state = InputPortState();
+        return true;
+    }
+
+    auto &confirmed = ring[ frame & ( historySize - 1 ) ];
+
+    if( confirmed.frame != frame || !( confirmed.confirmed & ( 1 << player ) ) ) {
+        return false;
+    }
+
+    state = confirmed.ports[ player ];
+    return true;
+
+}
+
+quint32 InputFrameQueue::oldestFrame() const {
+
+    quint32 confirmed = confirmedFrames();
+
+    // Alone, nobody has to acknowledge anything.
+    return playerCount > 1 ? qMin( confirmed, acknowledged ) : confirmed;
+
+}
+
+InputFrameQueue::Slot &InputFrameQueue::slot( const quint32 frame ) {
+    return ring[ frame & ( historySize - 1 ) ];
+}
+
+InputFrameQueue::Slot &InputFrameQueue::claim( const quint32 frame ) {
+
+    auto &claimed = slot( frame );
+
+    if( claimed.frame != frame ) {
+        claimed.frame = frame;
+        claimed.confirmed = 0;
+        claimed.predicted = 0;
+
+        for( auto &port : claimed.ports ) {
+            port = InputPortState();
+        }
+    }
+
+    return claimed;
+
+}
+
+void InputFrameQueue::confirm( const int player, const quint32 frame, const InputPortState &state ) {
+
+    auto &confirmed = claim( frame );
+    quint8 bit = static_cast<quint8>( 1 << player );
+
+    // The frame ran with a guess, which is only a problem if it was wrong.
+    if( ( confirmed.predicted & bit ) && !samePort( confirmed.ports[ player ], state ) ) {
+        if( !rollbackPending || frame < rollbackFrame ) {
+            rollbackFrame = frame;
+        }
+
+        rollbackPending = true;
+    }
+
+    confirmed.ports[ player ] = state;
+    confirmed.confirmed |= bit;
+    confirmed.predicted &= ~bit;
+
+    lastConfirmed[ player ] = state;
+    confirmedCount[ player ] = frame + 1;
+
+}
+
+const InputPortState *InputFrameQueue::predict( Slot &predicted ) {
+
+    for( int i = 0; i < playerCount; ++i ) {
+        quint8 bit = static_cast<quint8>( 1 << i );
+
+        if( !( predicted.confirmed & bit ) ) {
+            predicted.ports[ i ] = lastConfirmed[ i ];
+            predicted.predicted |= bit;
+        }
+    }
+
+    return predicted.ports;
+
+}
@@ -0,0 +1,134 @@
+#ifndef INPUTFRAMEQUEUE_H
+#define INPUTFRAMEQUEUE_H
+
+#include <QtGlobal>
+
+#include "inputsnapshot.h"
+
+// InputFrameQueue is the input of a netplay session, frame by frame: a ring of the last historySize frames, each
+// with every player's state. Frames are numbered from 0, the first frame of the session.
+
+// The local player's input is confirmed as soon as it's added, but lands localDelay() frames in the future, which
+// gives the other players' input that long to arrive before it's needed. Other players' input comes in confirmed,
+// in order. A frame can run before all of it has arrived: the missing players are predicted to still be doing what
+// they did last. When their input does arrive and differs from what was predicted, the frame it's for is where the
+// game has to roll back to, and run every frame after it again with replay().
+
+// Frames are only ever predicted up to maxPrediction() past the last frame everybody has confirmed. Past that,
+// canAdvance() is false until the others catch up.
+
+// Not thread safe. Never allocates.
+
+class InputFrameQueue {
+
+    public:
+
+        static const int maxPlayers = 4;
+
+        // A power of two.
+        static const int historySize = 128;
+
+        static const int maxDelay = 15;
+
+        // Leaves room in the ring for the delay, and for the frames the other players haven't got yet.
+        static const int maxMaxPrediction = ( historySize - maxDelay * 2 ) / 2;
+
+        InputFrameQueue();
+
+        // Start over at frame 0.
+        void reset( const int players, const int localPlayer );
+
+        int players() const;
+        int localPlayer() const;
+
+        // Raising it repeats the last local input to fill the gap. Lowering it drops local input, one frame for
+        // every frame advanced, until the queue has caught up.
+        int localDelay() const;
+        void setLocalDelay( const int frames );
+
+        int maxPrediction() const;
+        void setMaxPrediction( const int frames );
+
+        // Schedule the local player's next input, localDelay() frames after the current frame. Returns the frame it
+        // landed on, or -1 if it was dropped.
+        qint64 addLocalInput( const InputPortState &state );
+
+        // A remote player's confirmed input. Returns false if it isn't the player's next frame, which is fine for
+        // repeats, or doesn't fit in the ring yet.
+        bool addRemoteInput( const int player, const quint32 frame, const InputPortState &state );
+
+        // The next frame to run.
+        quint32 currentFrame() const;
+
+        // How many frames of the player's input are confirmed, all of them from frame 0 on.
+        quint32 confirmedFrames( const int player ) const;
+
+        // How many frames are confirmed for every player. Those never roll back again.
+        quint32 confirmedFrames() const;
+
+        // How many frames of the local player's input every other player has. The rest stay in the ring until they
+        // do, so they can be sent again.
+        quint32 acknowledgedFrames() const;
+        void setAcknowledgedFrames( const quint32 frames );
+
+        // Whether advance() can run the current frame without predicting too far, and there's room in the ring for
+        // the local input that goes with it.
+        bool canAdvance() const;
+
+        // Every player's input for the current frame, then move on to the next. Only valid until the next call.
+        const InputPortState *advance();
+
+        // A frame that already ran, with the confirmations and predictions as they are now. Call this for every
+        // frame after a rollback, up to the current frame.
+        const InputPortState *replay( const quint32 frame );
+
+        // The earliest frame that ran on a prediction that turned out wrong since the last call, if any.
+        bool takeRollback( quint32 &frame );
+
+        // A confirmed input, as long as it's still in the ring. Frame -1 is before the session, where every player
+        // was released.
+        bool confirmedInput( const int player, const qint64 frame, InputPortState &state ) const;
+
+    private:
+
+        struct Slot {
+            quint32 frame;
+            quint8 confirmed;
+            quint8 predicted;
+            InputPortState ports[ maxPlayers ];
+        };
+
+        Slot ring[ historySize ];
+
+        int playerCount;
+        int local;
+        int delay;
+        int prediction;
+
+        quint32 current;
+        quint32 confirmedCount[ maxPlayers ];
+        quint32 acknowledged;
+
+        // The last confirmed input of every player, what their missing input is predicted to be.
+        InputPortState lastConfirmed[ maxPlayers ];
+
+        bool rollbackPending;
+        quint32 rollbackFrame;
+
+        // The oldest frame still needed, not counting the last acknowledged local input before it, which the rest
+        // are sent relative to. That one keeps its slot too: frames are only written up to historySize - 2 past it.
+        quint32 oldestFrame() const;
+
+        Slot &slot( const quint32 frame );
+
+        // Frames are written in order, a slot is taken over by the first write of its new frame.
+        Slot &claim( const quint32 frame );
+
+        void confirm( const int player, const quint32 frame, const InputPortState &state );
+        const InputPortState *predict( Slot &predicted );
+
+        Q_DISABLE_COPY( InputFrameQueue )
+
+};
+
+#endif // INPUTFRAMEQUEUE_H
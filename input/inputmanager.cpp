@@ -1,21 +1,83 @@
 #include "inputmanager.h"
 
+#include "inputclock.h"
+
+#include <QGuiApplication>
+
 InputManager::InputManager( QObject *parent )
+    : InputManager( nullptr, parent ) {
+
+}
+
+InputManager::InputManager( JoystickBackend *backend, QObject *parent )
     : QObject( parent ),
       keyboard( new Keyboard() ),
-      sdlEventLoop( this ) {
+      sdlEventLoop( backend, this ),
+      registry( sdlEventLoop.registry() ),
+      snapshotFrame( 0 ),
+      frameSnapshot( nullptr ),
+      lastPollTime( 0 ),
+      frontendPollMode( sdlEventLoop.mode() ),
+      consumedFrame( 0 ),
+      netplayFrameAdvanced( false ),
+      frameEventsOn( false ),
+      speculating( false ),
+      keyboardCallback( nullptr ) {
 
     keyboard->loadMapping();
 
+    // Once none of our windows has the focus, key releases go elsewhere and would never reach the keyboard.
+    if( qGuiApp ) {
+        connect( qGuiApp, &QGuiApplication::focusWindowChanged, keyboard, [ this ]( QWindow *window ) {
+            if( !window ) {
+                keyboard->releaseKeys();
+            }
+        } );
+    }
+
+    netplaySnapshot.frame = 0;
+    netplaySnapshot.timestamp = 0;
+    netplaySnapshot.portCount = 0;
+    netplaySnapshot.keyboard.clear();
+
+    speculativeSnapshot.frame = 0;
+    speculativeSnapshot.timestamp = 0;
+    speculativeSnapshot.portCount = 0;
+    speculativeSnapshot.keyboard.clear();
+
+    collectedEvents.count = 0;
+    collectedEvents.overflowed = 0;
+
+    for( auto &capture : consumedCapture ) {
+        capture = 0;
+    }
+
     connect( &sdlEventLoop, &SDLEventLoop::deviceConnected, this, &InputManager::insert );
-    connect( &sdlEventLoop, &SDLEventLoop::deviceRemoved, this, &InputManager::removeAt );
+
+    // Removals come with the slot, which may have been swapped to another port since. A joystick that never got
+    // a port only had its slot, which the poll thread has let go of already.
+    connect( &sdlEventLoop, &SDLEventLoop::deviceRemoved, this, [ this ]( int slot, InputDevice *device ) {
+        sdlDeviceChanged( static_cast<Joystick *>( device )->guid(), false );
+
+        statistics().lock( mutex );
+        int port = registry.portForSlot( slot );
+        mutex.unlock();
+
+        if( port != -1 ) {
+            removeAt( port );
+        } else {
+            sdlEventLoop.retire( device );
+        }
+    } );
 
     // The Keyboard will be always active in port 0,
     // unless changed by the user.
 
-    for( int i = 0; i < Joystick::maxNumOfDevices; ++i ) {
-        deviceList.append( nullptr );
-    }
+    // Every poll on the poll thread is published too, so the snapshot is never older than the last poll.
+    sdlEventLoop.setFrameScheduler( &frameScheduler );
+    sdlEventLoop.setPollHook( [ this ] {
+        publishSnapshot();
+    } );
 
     sdlEventLoop.start();
 
@@ -24,12 +86,25 @@ InputManager::InputManager( QObject *parent )
 InputManager::~InputManager() {
 
     sdlEventLoop.stop();
+    stopEvdev();
+    stopNetworkGamepads();
 
     // I can't guarantee that the device won't be deleted by the deviceRemoved() signal.
     // So make sure we check.
 
-    for( auto device : deviceList ) {
-        if( device ) {
+    for( int port = 0; port < registry.portCount(); ++port ) {
+        auto *device = registry.atPort( port );
+
+        if( device && device != keyboard ) {
+            device->selfDestruct();
+        }
+    }
+
+    // Joysticks that never got a port, the poll thread is stopped so their slots can be read from here.
+    for( int i = 0; i < registry.count(); ++i ) {
+        auto *device = registry.at( i );
+
+        if( registry.portOf( device ) == -1 ) {
             device->selfDestruct();
         }
     }
@@ -39,16 +114,95 @@ InputManager::~InputManager() {
 }
 
 int InputManager::size() const {
-    return deviceList.size();
+    return InputDeviceRegistry::maxDevices;
 }
 
 InputDevice *InputManager::at( int index ) {
-    QMutexLocker locker( &mutex );
-    return deviceList.at( index );
+    return registry.atPort( index );
+}
+
+InputEpoch &InputManager::epoch() {
+    return sdlEventLoop.epoch();
+}
+
+void InputManager::setKeyboardCallback( retro_keyboard_event_t callback ) {
+    keyboardCallback.store( callback, std::memory_order_release );
 }
 
 void InputManager::pollStates() {
-    sdlEventLoop.pollEvents();
+
+    // Frames run ahead, or again, are run with input that's already known.
+    if( speculating ) {
+        return;
+    }
+
+    deliverKeyEvents();
+
+    if( frameScheduler.frameStarted( inputClockNs(), lastPollTime ) ) {
+        sdlEventLoop.pollEvents();
+        publishSnapshot();
+    }
+
+    // From here on, the poll thread publishing a newer one doesn't change what this frame reads.
+    auto &local = acquireSnapshot();
+
+    if( frameEventsOn.load( std::memory_order_relaxed ) ) {
+        collectFrameEvents();
+    }
+
+    if( netplaySession.isRunning() ) {
+        netplayFrameAdvanced = netplaySession.advance( local.portCount > 0 ? local.ports[ 0 ] : InputPortState(),
+                                                       netplaySnapshot );
+    }
+
+    // What snapshot() returns for the rest of the frame, the input the frame actually runs on.
+    if( runAheadHistory.frames() > 0 ) {
+        runAheadHistory.commit( netplaySession.isRunning() ? netplaySnapshot : local );
+    }
+
+}
+
+void InputManager::deliverKeyEvents() {
+
+    auto callback = keyboardCallback.load( std::memory_order_acquire );
+    KeyboardState::KeyEvent event;
+
+    // Emptied even without a callback, so a core that registers one later doesn't get stale keys.
+    while( keyboard->keyState().take( event ) ) {
+        if( callback ) {
+            callback( event.down, event.keycode, event.character, event.modifiers );
+        }
+    }
+
+}
+
+const InputSnapshot &InputManager::snapshot() {
+
+    if( speculating ) {
+        return speculativeSnapshot;
+    }
+
+    if( netplaySession.isRunning() ) {
+        return netplaySnapshot;
+    }
+
+    // Read before the core's first pollStates().
+    return frameSnapshot ? *frameSnapshot : acquireSnapshot();
+
+}
+
+const InputSnapshot &InputManager::acquireSnapshot() {
+
+    auto &current = snapshots.acquire();
+
+    if( current.frame != consumedFrame ) {
+        consumedFrame = current.frame;
+        recordLatency( current );
+    }
+
+    frameSnapshot = &current;
+
+    return current;
 
 }
 
@@ -61,75 +215,592 @@ void InputManager::setGamepadControlsFrontend( const bool control ) {
     emit gamepadControlsFrontendChanged();
 }
 
+int InputManager::pollLeadTime() const {
+    return frameScheduler.leadTime();
+}
+
+void InputManager::setPollLeadTime( const int usec ) {
+    frameScheduler.setLeadTime( usec );
+    emit pollLeadTimeChanged();
+}
+
+SDLEventLoop::PollMode InputManager::pollMode() const {
+    return sdlEventLoop.mode();
+}
+
+void InputManager::setPollMode( const SDLEventLoop::PollMode mode ) {
+    sdlEventLoop.setMode( mode );
+}
+
+InputStatistics &InputManager::statistics() {
+    return sdlEventLoop.statistics();
+}
+
+const FramePollScheduler &InputManager::frameTiming() const {
+    return frameScheduler;
+}
+
 void InputManager::insert( InputDevice *device ) {
 
-    device->loadMapping();
-    mutex.lock();
+    // The mapping was loaded while the device was being opened, see SDLEventLoop::prepareController().
+    statistics().lock( mutex );
     auto *joystick = static_cast<Joystick *>( device );
 
-    deviceList[ joystick->sdlIndex() ] = joystick;
+    int port = registry.insertPort( joystick->sdlIndex(), joystick );
+    joystick->events()->setEnabled( frameEventsOn.load( std::memory_order_relaxed ) );
 
     mutex.unlock();
+
+    sdlDeviceChanged( joystick->guid(), true );
+
+    // The poll thread still has it in its slot, so it stays open without a port until it's unplugged.
+    if( port == -1 ) {
+        qCWarning( phxInput ) << "No free port for" << joystick->name() << "ignored";
+        return;
+    }
+
     emit deviceAdded( joystick );
 
 }
 
 void InputManager::removeAt( int index ) {
 
-    mutex.lock();
-
-    auto *device = static_cast<Joystick *>( deviceList.at( index ) );
-    device->selfDestruct();
+    statistics().lock( mutex );
 
-    deviceList[ index ] = nullptr;
+    auto *device = registry.takePort( index );
 
-    if( deviceList.first() == nullptr ) {
-        deviceList[ 0 ] = keyboard;
+    if( registry.atPort( 0 ) == nullptr ) {
+        registry.setPort( 0, keyboard );
     }
 
     mutex.unlock();
 
+    // Closing the device happens off this thread, the port is already free.
+    if( device && device != keyboard ) {
+        sdlEventLoop.retire( device );
+    }
+
 }
 
 void InputManager::setRun( bool run ) {
 
-    mutex.lock();
-
     setGamepadControlsFrontend( !run );
 
+    // The poll thread publishes under the publish mutex, so it must not be held while waiting for the thread to stop.
     if( run ) {
-        sdlEventLoop.stop();
+        frameScheduler.reset();
+
+        // With a lead time, the poll thread keeps running and polls right before each frame. Without one, the
+        // core polls by itself through pollStates().
+        if( frameScheduler.leadTime() > 0 ) {
+            frontendPollMode = sdlEventLoop.mode();
+            sdlEventLoop.setMode( SDLEventLoop::FrameSynchronized );
+        } else {
+            sdlEventLoop.stop();
+        }
 
-        for( auto device : deviceList ) {
-            if( device ) {
+        statistics().lock( mutex );
+
+        for( int port = 0; port < registry.portCount(); ++port ) {
+            if( auto *device = registry.atPort( port ) ) {
                 device->setEditMode( false );
             }
         }
+
+        mutex.unlock();
     }
 
     else {
+        if( sdlEventLoop.mode() == SDLEventLoop::FrameSynchronized ) {
+            sdlEventLoop.setMode( frontendPollMode );
+        }
+
         sdlEventLoop.start();
     }
 
+}
+
+void InputManager::swap( const int index1, const int index2 ) {
+    statistics().lock( mutex );
+    registry.swapPorts( index1, index2 );
     mutex.unlock();
+}
+
+void InputManager::publishSnapshot() {
+
+    // Only another publish can hold this up, never a port change.
+    statistics().lock( publishMutex );
+
+    auto &next = snapshots.writeBuffer();
+    next.frame = ++snapshotFrame;
+    next.timestamp = inputClockNs();
+
+    bool replayed = replay.isOpen() && replay.next( next );
+    bool replayEnded = replay.isOpen() && !replayed;
+
+    if( replayEnded ) {
+        replay.close();
+    }
+
+    if( !replayed ) {
+
+        keyboard->keyState().copyTo( next.keyboard );
+
+        // A device unplugged halfway through is either copied or not, but never freed while being copied.
+        InputEpoch::Guard guard( sdlEventLoop.epoch() );
+
+        next.portCount = qMin( registry.portCount(), static_cast<int>( InputSnapshot::maxPorts ) );
+
+        // Ports from portCount on are never read, so they're left alone.
+        for( int i = 0; i < next.portCount; ++i ) {
+
+            auto *device = registry.atPort( i );
+
+            if( device ) {
+                device->states()->copyTo( next.ports[ i ] );
+                next.captured[ i ] = device->states()->captureTime();
+            } else {
+                next.ports[ i ] = InputPortState();
+                next.captured[ i ] = 0;
+            }
+
+        }
+
+    } else {
+
+        // Recordings only hold the ports, every key stays up while one plays.
+        next.keyboard.clear();
+
+    }
+
+    recorder.record( next );
+    exporter.publish( next );
+
+    // The poll thread and the core thread may both publish, the mutex keeps them from doing it at once.
+    snapshots.publish();
+    lastPollTime = next.timestamp;
+
+    publishMutex.unlock();
+
+    if( replayEnded ) {
+        emit replayFinished();
+    }
 
 }
 
-void InputManager::swap( const int index1, const int index2 ) {
-    deviceList.swap( index1, index2 );
+bool InputManager::startRecording( const QString &path ) {
+    statistics().lock( publishMutex );
+    bool started = recorder.start( path );
+    publishMutex.unlock();
+    return started;
+}
+
+void InputManager::stopRecording() {
+    statistics().lock( publishMutex );
+    recorder.stop();
+    publishMutex.unlock();
+}
+
+bool InputManager::startReplay( const QString &path ) {
+    statistics().lock( publishMutex );
+    bool started = replay.open( path );
+    publishMutex.unlock();
+    return started;
+}
+
+void InputManager::stopReplay() {
+    statistics().lock( publishMutex );
+    replay.close();
+    publishMutex.unlock();
+}
+
+bool InputManager::replaying() {
+    statistics().lock( publishMutex );
+    bool open = replay.isOpen();
+    publishMutex.unlock();
+    return open;
+}
+
+bool InputManager::startExport( const QString &name ) {
+    statistics().lock( publishMutex );
+    bool started = exporter.start( name );
+    publishMutex.unlock();
+    return started;
+}
+
+void InputManager::stopExport() {
+    statistics().lock( publishMutex );
+    exporter.stop();
+    publishMutex.unlock();
+}
+
+bool InputManager::startNetplay( const int player, const quint16 localPort, const QString &host,
+                                 const quint16 remotePort, const int delay ) {
+
+    if( !netplaySession.start( player, localPort ) || !netplaySession.connectTo( host, remotePort ) ) {
+        netplaySession.stop();
+        return false;
+    }
+
+    netplaySession.queue().setLocalDelay( delay );
+    netplayFrameAdvanced = false;
+
+    qCDebug( phxInput ) << "Netplay as player" << player + 1 << "on port" << netplaySession.transport().localPort()
+                        << "with" << host << "port" << remotePort;
+
+    return true;
+
+}
+
+void InputManager::stopNetplay() {
+    netplaySession.stop();
+    netplayFrameAdvanced = false;
+}
+
+InputNetplay &InputManager::netplay() {
+    return netplaySession;
+}
+
+bool InputManager::netplayAdvanced() const {
+    return !netplaySession.isRunning() || netplayFrameAdvanced;
+}
+
+InputRunAhead &InputManager::runAhead() {
+    return runAheadHistory;
+}
+
+bool InputManager::beginSpeculation() {
+
+    quint64 committed = runAheadHistory.committedFrames();
+
+    return committed > 0 && beginReplay( committed - 1 );
+
+}
+
+bool InputManager::beginReplay( const quint64 frame ) {
+
+    if( !runAheadHistory.restore( frame, speculativeSnapshot ) ) {
+        return false;
+    }
+
+    speculativeSnapshot.timestamp = inputClockNs();
+    speculating = true;
+
+    return true;
+
+}
+
+void InputManager::endSpeculation() {
+    speculating = false;
+}
+
+void InputManager::setFrameEvents( const bool enabled ) {
+
+    frameEventsOn.store( enabled, std::memory_order_relaxed );
+
+    // Holding the mutex, none of them can be taken off their port and retired meanwhile.
+    statistics().lock( mutex );
+
+    for( int port = 0; port < registry.portCount(); ++port ) {
+        if( auto *device = registry.atPort( port ) ) {
+            auto *queue = device->events();
+            queue->setEnabled( enabled );
+
+            // Whatever is left from the last time it was on is long out of date.
+            queue->clear();
+        }
+    }
+
+    mutex.unlock();
+
+    collectedEvents.count = 0;
+    collectedEvents.overflowed = 0;
+
+}
+
+bool InputManager::frameEventsEnabled() const {
+    return frameEventsOn.load( std::memory_order_relaxed );
+}
+
+const InputFrameEvents &InputManager::frameEvents() const {
+    return collectedEvents;
+}
+
+bool InputManager::startEvdev( const QStringList &recordings ) {
+
+#ifdef Q_OS_LINUX
+
+    if( evdevMonitor ) {
+        return true;
+    }
+
+    qRegisterMetaType<InputDevice *>();
+
+    evdevMonitor.reset( new EvdevMonitor );
+    evdevMonitor->setWatchNodes( recordings.isEmpty() );
+    evdevMonitor->setSdlDevices( sdlGuids );
+
+    for( auto &recording : recordings ) {
+        evdevMonitor->addRecording( recording );
+    }
+
+    connect( evdevMonitor.get(), &EvdevMonitor::deviceConnected, this, &InputManager::attachDevice );
+    connect( evdevMonitor.get(), &EvdevMonitor::deviceRemoved, this, &InputManager::detachDevice );
+
+    evdevMonitor->start();
+
+    return true;
+
+#else
+    Q_UNUSED( recordings );
+    return false;
+#endif
+
+}
+
+void InputManager::stopEvdev() {
+
+#ifdef Q_OS_LINUX
+
+    // Every device it still had is reported removed on the way out.
+    if( evdevMonitor ) {
+        evdevMonitor->stop();
+        evdevMonitor.reset();
+    }
+
+#endif
+
+}
+
+void InputManager::sdlDeviceChanged( const QString &guid, const bool opened ) {
+
+#ifdef Q_OS_LINUX
+
+    if( opened ) {
+        sdlGuids.append( guid );
+    } else {
+        sdlGuids.removeOne( guid );
+    }
+
+    if( evdevMonitor ) {
+        evdevMonitor->setSdlDevices( sdlGuids );
+    }
+
+#else
+    Q_UNUSED( guid );
+    Q_UNUSED( opened );
+#endif
+
+}
+
+bool InputManager::startNetworkGamepads( const quint16 port ) {
+
+#ifdef Q_OS_LINUX
+
+    if( networkGamepadServer ) {
+        return true;
+    }
+
+    qRegisterMetaType<InputDevice *>();
+
+    networkGamepadServer.reset( new NetworkGamepadServer );
+
+    if( !networkGamepadServer->listen( port ) ) {
+        networkGamepadServer.reset();
+        return false;
+    }
+
+    connect( networkGamepadServer.get(), &NetworkGamepadServer::deviceConnected, this, &InputManager::attachDevice );
+    connect( networkGamepadServer.get(), &NetworkGamepadServer::deviceRemoved, this, &InputManager::detachDevice );
+
+    networkGamepadServer->start();
+
+    return true;
+
+#else
+    Q_UNUSED( port );
+    return false;
+#endif
+
+}
+
+void InputManager::stopNetworkGamepads() {
+
+#ifdef Q_OS_LINUX
+
+    // Every client it still had is reported removed on the way out.
+    if( networkGamepadServer ) {
+        networkGamepadServer->stop();
+        networkGamepadServer.reset();
+    }
+
+#endif
+
+}
+
+NetworkGamepadServer *InputManager::networkGamepads() const {
+
+#ifdef Q_OS_LINUX
+    return networkGamepadServer.get();
+#else
+    return nullptr;
+#endif
+
+}
+
+const LatencyHistogram &InputManager::captureLatency( const int port ) const {
+    return captureLatencies[ qBound( 0, port, latencyPorts - 1 ) ];
+}
+
+const LatencyHistogram &InputManager::publishLatency() const {
+    return publishLatencies;
+}
+
+QString InputManager::latencySummary() const {
+
+    LatencyHistogram merged;
+
+    for( auto &histogram : captureLatencies ) {
+        merged.merge( histogram );
+    }
+
+    return merged.summary();
+
+}
+
+void InputManager::dumpLatency() const {
+
+    qCDebug( phxInput ) << "Snapshot publish to core:" << publishLatencies.summary();
+
+    for( int i = 0; i < latencyPorts; ++i ) {
+        if( captureLatencies[ i ].count() > 0 ) {
+            qCDebug( phxInput ) << "Port" << i << "capture to core:" << captureLatencies[ i ].summary();
+        }
+    }
+
+}
+
+void InputManager::resetLatency() {
+
+    publishLatencies.reset();
+
+    for( auto &histogram : captureLatencies ) {
+        histogram.reset();
+    }
+
+}
+
+void InputManager::recordLatency( const InputSnapshot &consumed ) {
+
+    qint64 now = inputClockNs();
+
+    publishLatencies.record( now - consumed.timestamp );
+
+    for( int i = 0; i < consumed.portCount; ++i ) {
+
+        int port = qMin( i, latencyPorts - 1 );
+
+        if( consumed.captured[ i ] > consumedCapture[ port ] ) {
+            captureLatencies[ port ].record( now - consumed.captured[ i ] );
+            consumedCapture[ port ] = consumed.captured[ i ];
+        }
+
+    }
+
+}
+
+void InputManager::attachDevice( InputDevice *device ) {
+
+    // The devices don't have SDL slots, they take the first free port.
+    statistics().lock( mutex );
+    int port = registry.freePort();
+    registry.setPort( port, device );
+    device->events()->setEnabled( frameEventsOn.load( std::memory_order_relaxed ) );
+    mutex.unlock();
+
+    // Its source keeps writing to it, so it can only go once it's unplugged.
+    if( port == -1 ) {
+        qCWarning( phxInput ) << "No free port for" << device->name() << "ignored";
+        return;
+    }
+
+    emit deviceAdded( device );
+
+}
+
+void InputManager::detachDevice( InputDevice *device ) {
+
+    statistics().lock( mutex );
+    int port = registry.portOf( device );
+    mutex.unlock();
+
+    if( port != -1 ) {
+        removeAt( port );
+    } else {
+        sdlEventLoop.retire( device );
+    }
+
+}
+
+void InputManager::collectFrameEvents() {
+
+    collectedEvents.count = 0;
+    collectedEvents.overflowed = 0;
+
+    // Like publishing, a device unplugged halfway through is either drained or not, but never freed meanwhile.
+    InputEpoch::Guard guard( sdlEventLoop.epoch() );
+
+    int portCount = qMin( registry.portCount(), static_cast<int>( InputSnapshot::maxPorts ) );
+
+    for( int port = 0; port < portCount; ++port ) {
+
+        auto *device = registry.atPort( port );
+
+        if( !device ) {
+            continue;
+        }
+
+        // What doesn't fit stays queued for the next frame.
+        auto *queue = device->events();
+        InputEvent *events = collectedEvents.events + collectedEvents.count;
+        int count = queue->drain( events, InputFrameEvents::maxEvents - collectedEvents.count );
+
+        for( int i = 0; i < count; ++i ) {
+            events[ i ].port = static_cast<quint8>( port );
+        }
+
+        collectedEvents.count += count;
+        collectedEvents.overflowed += queue->takeOverflows();
+
+    }
+
 }
 
 void InputManager::emitConnectedDevices() {
 
     emit deviceAdded( keyboard );
 
-    for( auto inputDevice : deviceList ) {
+    // Copied out first, so the receivers are free to call at().
+    InputDevice *devices[ InputDeviceRegistry::maxDevices ];
+    int count = 0;
+
+    statistics().lock( mutex );
+
+    for( int port = 0; port < registry.portCount(); ++port ) {
+
+        auto *inputDevice = registry.atPort( port );
 
-        if( inputDevice ) {
-            emit deviceAdded( inputDevice );
+        if( inputDevice && inputDevice != keyboard ) {
+            devices[ count++ ] = inputDevice;
         }
 
     }
 
+    mutex.unlock();
+
+    for( int i = 0; i < count; ++i ) {
+        emit deviceAdded( devices[ i ] );
+    }
+
 }
 
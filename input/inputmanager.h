@@ -9,8 +9,23 @@
 #include "input/sdleventloop.h"
 #include "input/inputdevice.h"
 #include "input/keyboard.h"
+#include "input/inputsnapshot.h"
+#include "input/framepollscheduler.h"
+#include "input/latencyhistogram.h"
+#include "input/inputrecording.h"
+#include "input/inputexport.h"
+#include "input/inputnetplay.h"
+#include "input/inputrunahead.h"
+#include "input/inputeventqueue.h"
+#ifdef Q_OS_LINUX
+#include "input/evdevmonitor.h"
+#include "input/networkgamepadserver.h"
+#else
+class NetworkGamepadServer;
+#endif
 #include "logging.h"
 
+#include <atomic>
 #include <memory>
 
 class InputManager : public QObject {
@@ -19,9 +34,15 @@ class InputManager : public QObject {
         Q_PROPERTY( bool gamepadControlsFrontend READ gamepadControlsFrontend
                     WRITE setGamepadControlsFrontend NOTIFY gamepadControlsFrontendChanged )
 
+        // How long before the core reads input to poll it, in microseconds. 0 polls on the core thread instead.
+        Q_PROPERTY( int pollLeadTime READ pollLeadTime WRITE setPollLeadTime NOTIFY pollLeadTimeChanged )
+
     public:
 
         explicit InputManager( QObject *parent = 0 );
+
+        // Read controllers through this backend instead of SDL, see SDLEventLoop.
+        explicit InputManager( JoystickBackend *backend, QObject *parent = 0 );
         ~InputManager();
 
         // One keyboard is reserved for being always active.
@@ -29,21 +50,131 @@ class InputManager : public QObject {
 
         int size() const;
 
+        // Never locks. The device stays valid for as long as the caller holds a guard on epoch(), or on the GUI
+        // thread, until it returns to the event loop.
         InputDevice *at( int index );
 
+        // Readers of at() from other threads wrap their use of the device in an InputEpoch::Guard on this.
+        InputEpoch &epoch();
+
+        // The core's retro_keyboard_callback, nullptr for none. Key events are handed to it on the core thread, at
+        // the start of pollStates().
+        void setKeyboardCallback( retro_keyboard_event_t callback );
+
+        // Called by the core once per frame, right before it reads input. Unless the poll thread has just
+        // published a frame synchronized poll, poll every device and publish their states as one snapshot.
         void pollStates();
 
+        // The snapshot of every port for the current frame: the one most recently published when pollStates() was
+        // last called. Every call until the next pollStates() returns the same one, even if the poll thread has
+        // published a newer one meanwhile. This never locks and never blocks, so it's safe to call from
+        // retro_input_state. It must only be called from one thread, the core thread, and the returned snapshot
+        // stays valid until the next pollStates().
+        const InputSnapshot &snapshot();
+
         bool gamepadControlsFrontend() const;
 
         // This is just a wrapper around InputDevice::gamepadControlsFrontend.
         void setGamepadControlsFrontend( const bool control );
 
+        int pollLeadTime() const;
+        void setPollLeadTime( const int usec );
+
+        // How the poll thread reads controllers while no game is running. A running game with a poll lead time
+        // switches to SDLEventLoop::FrameSynchronized by itself.
+        SDLEventLoop::PollMode pollMode() const;
+        void setPollMode( const SDLEventLoop::PollMode mode );
+
+        // Poll counts, poll CPU time and lock contention of the whole pipeline.
+        InputStatistics &statistics();
+
+        // Frame timing, and how stale each frame's input was.
+        const FramePollScheduler &frameTiming() const;
+
+        // Only the first few ports are instrumented, the rest are counted in the last one.
+        static const int latencyPorts = 8;
+
+        // Time from a port's state changing (capture), to the core acquiring a snapshot with that change in it.
+        const LatencyHistogram &captureLatency( const int port ) const;
+
+        // Time from a snapshot being published, to the core acquiring it.
+        const LatencyHistogram &publishLatency() const;
+
+        // All the instrumented ports merged, in one line of text.
+        Q_INVOKABLE QString latencySummary() const;
+
+        // Record every published snapshot to a file, see InputRecording. Frames are whatever gets published:
+        // once per frame while a game runs, once per poll otherwise.
+        Q_INVOKABLE bool startRecording( const QString &path );
+        Q_INVOKABLE void stopRecording();
+
+        // Publish the frames of a recording instead of the devices' states, one per publish, until it runs out.
+        // The devices are still polled, but what they say is ignored until then.
+        Q_INVOKABLE bool startReplay( const QString &path );
+        Q_INVOKABLE void stopReplay();
+        bool replaying();
+
+        // Also publish every snapshot's ports to this POSIX shared memory segment, for other processes to read
+        // with InputExportReader. Returns false where there's no shared memory.
+        Q_INVOKABLE bool startExport( const QString &name = QStringLiteral( "/phoenix-input" ) );
+        Q_INVOKABLE void stopExport();
+
+        // Play over the network against one other player, see InputNetplay. The local player's input is port 0's,
+        // and the snapshot holds both players' on ports 0 and 1 from the next pollStates() on. Core thread only, like
+        // snapshot(). delay is the local input delay, in frames.
+        bool startNetplay( const int player, const quint16 localPort, const QString &host, const quint16 remotePort,
+                           const int delay = 2 );
+        void stopNetplay();
+
+        // The running session, for cores that roll back, see InputNetplay::replay().
+        InputNetplay &netplay();
+
+        // Whether the last pollStates() moved netplay on by a frame. While it hasn't, the core should call it again
+        // instead of running the frame, the other player is too far behind. Always true without netplay.
+        bool netplayAdvanced() const;
+
+        // Run-ahead, see InputRunAhead. While its frames() is above 0, pollStates() commits every real frame's input
+        // to it, and its changed() then says whether the frames run ahead have to be run again.
+        InputRunAhead &runAhead();
+
+        // Until endSpeculation(), pollStates() does nothing and snapshot() returns the last real frame's input, for
+        // running frames ahead with. False if run-ahead hasn't committed a frame yet. Core thread only.
+        bool beginSpeculation();
+
+        // Until endSpeculation(), snapshot() returns this real frame's input, for running it again after loading
+        // the state from before it. False if it's not in the run-ahead history anymore. Core thread only.
+        bool beginReplay( const quint64 frame );
+
+        void endSpeculation();
+
+        // Sub-frame input, see InputEventQueue. Turned on, every device queues its button transitions with their
+        // times, and pollStates() collects every port's into frameEvents(), so two presses within one frame are
+        // still two, and a core can tell when in the frame they happened. Off by default. Core thread only.
+        void setFrameEvents( const bool enabled );
+        bool frameEventsEnabled() const;
+
+        // What the last pollStates() collected. Core thread only, valid until the next pollStates().
+        const InputFrameEvents &frameEvents() const;
+
+        // Also read gamepads straight from their Linux evdev nodes, see EvdevMonitor. Given recordings, only those
+        // are played and /dev/input isn't watched. Returns false where there's no evdev.
+        bool startEvdev( const QStringList &recordings = QStringList() );
+        void stopEvdev();
+
+        // Also let phones and tablets be gamepads, see NetworkGamepadServer. Port 0 picks any free one, ask
+        // networkGamepads() which. Returns false if the port is taken, or where there's no recvmmsg().
+        bool startNetworkGamepads( const quint16 port = 55400 );
+        void stopNetworkGamepads();
+
+        // The running server, for its port and statistics. Null if it isn't running.
+        NetworkGamepadServer *networkGamepads() const;
+
     public slots:
 
-        // Insert or append an inputDevice to the deviceList.
+        // Give a newly connected device a port.
         void insert( InputDevice *device );
 
-        // Remove and delete inputDevice at index.
+        // Remove the inputDevice at this port. It's closed and deleted in the background.
         void removeAt( int index );
 
         // Handle when the game has started playing.
@@ -55,21 +186,105 @@ class InputManager : public QObject {
         // Iterate through, and expose inputDevices to QML.
         void emitConnectedDevices();
 
+        // Log every latency histogram.
+        void dumpLatency() const;
+
+        void resetLatency();
+
     signals:
 
         void gamepadControlsFrontendChanged();
+        void pollLeadTimeChanged();
         void device( InputDevice *device );
         void deviceAdded( InputDevice *device );
         void incomingEvent( InputDeviceEvent *event );
 
+        // The replay ran out of frames. Emitted from whichever thread published last.
+        void replayFinished();
+
     private:
 
+        // Guards changes to the ports of the registry. Reading them doesn't take it, see at().
         QMutex mutex;
 
-        QList<InputDevice *> deviceList;
+        // Guards publishing, the recorder, the replay and the exporter.
+        QMutex publishMutex;
 
         SDLEventLoop sdlEventLoop;
 
+        // The SDLEventLoop's registry, which also holds every port.
+        InputDeviceRegistry &registry;
+
+        InputSnapshotBuffer snapshots;
+        quint64 snapshotFrame;
+
+        // Core thread only. The snapshot of the local devices the current frame reads, acquired once per
+        // pollStates(). The buffer is the reader's until the next acquire, which only pollStates() does.
+        const InputSnapshot *frameSnapshot;
+
+        FramePollScheduler frameScheduler;
+        std::atomic<qint64> lastPollTime;
+
+        // The SDLEventLoop's mode from before a frame synchronized game started.
+        SDLEventLoop::PollMode frontendPollMode;
+
+        // Core thread only: what the last acquired snapshot was, so each change is only measured once.
+        quint64 consumedFrame;
+        qint64 consumedCapture[ latencyPorts ];
+
+        LatencyHistogram captureLatencies[ latencyPorts ];
+        LatencyHistogram publishLatencies;
+
+        // Guarded by the publish mutex.
+        InputRecorder recorder;
+        InputReplay replay;
+        InputExporter exporter;
+
+        void recordLatency( const InputSnapshot &consumed );
+
+        // Core thread only. What snapshot() returns while netplay is running.
+        InputNetplay netplaySession;
+        InputSnapshot netplaySnapshot;
+        bool netplayFrameAdvanced;
+
+        // Devices given a port on other threads check the flag, the events are core thread only.
+        std::atomic<bool> frameEventsOn;
+        InputFrameEvents collectedEvents;
+
+        // Move every port's queued transitions to collectedEvents.
+        void collectFrameEvents();
+
+        // Core thread only. What snapshot() returns while speculating.
+        InputRunAhead runAheadHistory;
+        InputSnapshot speculativeSnapshot;
+        bool speculating;
+
+        std::atomic<retro_keyboard_event_t> keyboardCallback;
+
+#ifdef Q_OS_LINUX
+        std::unique_ptr<EvdevMonitor> evdevMonitor;
+        std::unique_ptr<NetworkGamepadServer> networkGamepadServer;
+
+        // The GUID of every joystick SDL has open, one entry each, for the evdev monitor to leave alone.
+        QStringList sdlGuids;
+#endif
+
+        // Keep sdlGuids up to date as SDL opens and closes joysticks, and tell the evdev monitor.
+        void sdlDeviceChanged( const QString &guid, const bool opened );
+
+        // Give a device from a source without SDL slots the first free port, and take it off again once it's gone.
+        void attachDevice( InputDevice *device );
+        void detachDevice( InputDevice *device );
+
+        // Copy every port's state into the next snapshot and hand it to the core thread.
+        void publishSnapshot();
+
+        // Hand every queued key event to keyboardCallback, core thread only.
+        void deliverKeyEvents();
+
+        // Take the most recently published snapshot of the local devices as the current frame's, see snapshot().
+        const InputSnapshot &acquireSnapshot();
+
 
 };
 
@@ -0,0 +1,254 @@
+#include "inputnetplay.h"
+
+#include "inputclock.h"
+
+#include <QtEndian>
+
+static_assert( InputNetplayPacket::maxSize <= NetplayTransport::maxDatagramSize, "A packet must fit a datagram" );
+
+InputNetplay::InputNetplay()
+    : running( false ),
+      remote( 1 ),
+      stallCount( 0 ),
+      rejected( 0 ) {
+
+}
+
+bool InputNetplay::start( const int player, const quint16 localPort ) {
+
+    stop();
+
+    if( player < 0 || player > 1 || !socket.open( localPort ) ) {
+        return false;
+    }
+
+    frames.reset( 2, player );
+    remote = 1 - player;
+    stallCount = 0;
+    rejected = 0;
+    running = true;
+
+    return true;
+
+}
+
+bool InputNetplay::connectTo( const QString &host, const quint16 port ) {
+    return running && socket.setPeer( host, port );
+}
+
+void InputNetplay::stop() {
+    socket.close();
+    running = false;
+}
+
+bool InputNetplay::isRunning() const {
+    return running;
+}
+
+InputFrameQueue &InputNetplay::queue() {
+    return frames;
+}
+
+NetplayTransport &InputNetplay::transport() {
+    return socket;
+}
+
+bool InputNetplay::advance( const InputPortState &local, InputSnapshot &snapshot ) {
+
+    if( !running ) {
+        return false;
+    }
+
+    receive();
+
+    // Still sent, the other player may be waiting for us just the same.
+    if( !frames.canAdvance() ) {
+        stallCount++;
+        send();
+        return false;
+    }
+
+    frames.addLocalInput( local );
+    send();
+
+    quint32 frame = frames.currentFrame();
+    fill( frame, frames.advance(), snapshot );
+
+    return true;
+
+}
+
+bool InputNetplay::replay( const quint32 frame, InputSnapshot &snapshot ) {
+
+    auto *ports = frames.replay( frame );
+
+    if( !ports ) {
+        return false;
+    }
+
+    fill( frame, ports, snapshot );
+
+    return true;
+
+}
+
+quint64 InputNetplay::stalls() const {
+    return stallCount;
+}
+
+quint64 InputNetplay::rejectedPackets() const {
+    return rejected;
+}
+
+void InputNetplay::receive() {
+
+    int size;
+
+    while( ( size = socket.receive( packet, sizeof( packet ) ) ) >= 0 ) {
+        if( !decode( size ) ) {
+            rejected++;
+        }
+    }
+
+}
+
+bool InputNetplay::decode( const int size ) {
+
+    using namespace InputNetplayPacket;
+
+    if( size < headerSize || qFromLittleEndian<quint32>( packet ) != magic || packet[ 4 ] != version
+        || packet[ 5 ] != remote || packet[ 6 ] > maxFrames ) {
+        return false;
+    }
+
+    int count = packet[ 6 ];
+    quint32 first = qFromLittleEndian<quint32>( packet + 8 );
+
+    frames.setAcknowledgedFrames( qFromLittleEndian<quint32>( packet + 12 ) );
+
+    // Records are against the frame before, which has to be one we have.
+    InputPortState state;
+
+    if( first > frames.confirmedFrames( remote )
+        || !frames.confirmedInput( remote, static_cast<qint64>( first ) - 1, state ) ) {
+        return false;
+    }
+
+    const uchar *in = packet + headerSize;
+    const uchar *end = packet + size;
+
+    for( int i = 0; i < count; ++i ) {
+
+        if( in == end ) {
+            return false;
+        }
+
+        int fields = *in++;
+
+        if( in + ( fields & 1 ) * 2 + qPopulationCount( static_cast<quint8>( fields >> 1 ) ) * 2 > end ) {
+            return false;
+        }
+
+        if( fields & 1 ) {
+            state.buttons ^= qFromLittleEndian<quint16>( in );
+            in += 2;
+        }
+
+        for( int axis = 0; axis < InputPortState::AxisCount; ++axis ) {
+            if( fields & ( 2 << axis ) ) {
+                state.axes[ axis ] = qFromLittleEndian<qint16>( in );
+                in += 2;
+            }
+        }
+
+        // Frames we already have only move the base along.
+        quint32 frame = first + i;
+
+        if( frame == frames.confirmedFrames( remote ) && !frames.addRemoteInput( remote, frame, state ) ) {
+            break;
+        }
+
+    }
+
+    return true;
+
+}
+
+void InputNetplay::send() {
+
+    using namespace InputNetplayPacket;
+
+    int local = frames.localPlayer();
+    quint32 first = frames.acknowledgedFrames();
+    quint32 available = frames.confirmedFrames( local ) - first;
+    int count = static_cast<int>( qMin<quint32>( available, maxFrames ) );
+
+    InputPortState previous;
+
+    // The queue keeps every unacknowledged frame and the one before them, which they're sent relative to. Nothing
+    // goes out without it, the other side couldn't decode it.
+    if( !frames.confirmedInput( local, static_cast<qint64>( first ) - 1, previous ) ) {
+        count = 0;
+    }
+
+    uchar *out = packet + headerSize;
+
+    for( int i = 0; i < count; ++i ) {
+
+        InputPortState state;
+
+        if( !frames.confirmedInput( local, first + i, state ) ) {
+            count = i;
+            break;
+        }
+
+        uchar &fields = *out++;
+        fields = 0;
+
+        if( state.buttons != previous.buttons ) {
+            fields |= 1;
+            qToLittleEndian<quint16>( state.buttons ^ previous.buttons, out );
+            out += 2;
+        }
+
+        for( int axis = 0; axis < InputPortState::AxisCount; ++axis ) {
+            if( state.axes[ axis ] != previous.axes[ axis ] ) {
+                fields |= 2 << axis;
+                qToLittleEndian<qint16>( state.axes[ axis ], out );
+                out += 2;
+            }
+        }
+
+        previous = state;
+
+    }
+
+    qToLittleEndian<quint32>( magic, packet );
+    packet[ 4 ] = version;
+    packet[ 5 ] = static_cast<uchar>( local );
+    packet[ 6 ] = static_cast<uchar>( count );
+    packet[ 7 ] = 0;
+    qToLittleEndian<quint32>( first, packet + 8 );
+    qToLittleEndian<quint32>( frames.confirmedFrames( remote ), packet + 12 );
+
+    socket.send( packet, static_cast<int>( out - packet ) );
+
+}
+
+void InputNetplay::fill( const quint32 frame, const InputPortState *ports, InputSnapshot &snapshot ) const {
+
+    snapshot.frame = frame;
+    snapshot.timestamp = inputClockNs();
+    snapshot.portCount = frames.players();
+
+    for( int i = 0; i < snapshot.portCount; ++i ) {
+        snapshot.ports[ i ] = ports[ i ];
+
+        // Half of it came over the network, there's no capture latency to measure.
+        snapshot.captured[ i ] = 0;
+    }
+
+    // Only the ports are shared, every key stays up.
+    snapshot.keyboard.clear();
+
+}
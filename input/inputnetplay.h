@@ -0,0 +1,103 @@
+#ifndef INPUTNETPLAY_H
+#define INPUTNETPLAY_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include "inputframequeue.h"
+#include "inputsnapshot.h"
+#include "netplaytransport.h"
+
+// A netplay packet is one UDP datagram: a 16 byte header, then a run of the sender's input, one record per frame.
+//     magic               32 bits, "PXNP"
+//     version             8 bits
+//     player              8 bits, the sender's
+//     count               8 bits, records that follow
+//     reserved            8 bits
+//     first               32 bits, the frame of the first record
+//     ack                 32 bits, how many frames of the receiver's input the sender has
+// A record is a byte of which fields changed since the frame before (bit 0 for buttons, bit 1 + i for axis i),
+// then the button mask XOR the old one as 16 bits, then each changed axis as 16 bits. The frame before the first
+// record is one the receiver already has, the first record of a session is against every player released.
+
+// Every packet carries every frame the receiver hasn't acknowledged yet, up to maxFrames of them, so a lost packet
+// is made up for by the next one and nothing is ever sent again on its own. An unchanged frame costs a byte.
+
+// Every integer is little endian.
+
+namespace InputNetplayPacket {
+
+    static const quint32 magic = 0x504e5850; // "PXNP"
+    static const quint8 version = 1;
+
+    static const int headerSize = 16;
+    static const int maxFrames = 64;
+    static const int maxRecordSize = 1 + 2 + InputPortState::AxisCount * 2;
+    static const int maxSize = headerSize + maxFrames * maxRecordSize;
+
+}
+
+// InputNetplay is a two player netplay session: an InputFrameQueue, kept in sync with the other player's through a
+// NetplayTransport. advance() is called once a frame, and does all of the work: it takes in whatever input arrived,
+// schedules the local player's, sends the other player everything they haven't got yet, and hands back the frame's
+// input. It never blocks and never allocates, a frame costs a few microseconds and two or three system calls.
+
+// Games that can roll back check queue().takeRollback() after every advance(), go back to that frame, and run every
+// frame up to the current one again with replay(). Games that can't should set the queue's max prediction to 0,
+// which holds every frame back until it's confirmed.
+
+// Not thread safe, everything happens on the core thread.
+
+class InputNetplay {
+
+    public:
+
+        InputNetplay();
+
+        // Play as player 0 or 1, listening on this port. Nothing is sent until there's a peer.
+        bool start( const int player, const quint16 localPort );
+        bool connectTo( const QString &host, const quint16 port );
+        void stop();
+
+        bool isRunning() const;
+
+        InputFrameQueue &queue();
+        NetplayTransport &transport();
+
+        // Run the next frame with this local input. Returns false if it has to wait for the other player, nothing
+        // was advanced then and the local input wasn't used.
+        bool advance( const InputPortState &local, InputSnapshot &snapshot );
+
+        // Fill in a frame that already ran, after a rollback.
+        bool replay( const quint32 frame, InputSnapshot &snapshot );
+
+        // Frames advance() had to wait for.
+        quint64 stalls() const;
+
+        // Packets that were damaged, from someone else, or started past the frames we have.
+        quint64 rejectedPackets() const;
+
+    private:
+
+        InputFrameQueue frames;
+        NetplayTransport socket;
+
+        bool running;
+        int remote;
+
+        quint64 stallCount;
+        quint64 rejected;
+
+        uchar packet[ InputNetplayPacket::maxSize ];
+
+        void receive();
+        bool decode( const int size );
+        void send();
+
+        void fill( const quint32 frame, const InputPortState *ports, InputSnapshot &snapshot ) const;
+
+        Q_DISABLE_COPY( InputNetplay )
+
+};
+
+#endif // INPUTNETPLAY_H
@@ -0,0 +1,471 @@
+#include "inputrecording.h"
+
+#include "logging.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+quint32 InputRecording::checksum( const uchar *data, const int size ) {
+
+    quint32 hash = 2166136261u;
+
+    for( int i = 0; i < size; ++i ) {
+        hash = ( hash ^ data[ i ] ) * 16777619u;
+    }
+
+    return hash;
+
+}
+
+static uchar *writeVarint( uchar *out, quint64 value ) {
+
+    while( value >= 0x80 ) {
+        *out++ = static_cast<uchar>( value | 0x80 );
+        value >>= 7;
+    }
+
+    *out++ = static_cast<uchar>( value );
+
+    return out;
+
+}
+
+static quint32 zigzag( const qint32 value ) {
+    return ( static_cast<quint32>( value ) << 1 ) ^ static_cast<quint32>( value >> 31 );
+}
+
+static qint32 unzigzag( const quint32 value ) {
+    return static_cast<qint32>( value >> 1 ) ^ -static_cast<qint32>( value & 1 );
+}
+
+static int changedFields( const InputPortState &from, const InputPortState &to ) {
+
+    int fields = from.buttons != to.buttons ? 1 : 0;
+
+    for( int i = 0; i < InputPortState::AxisCount; ++i ) {
+        if( from.axes[ i ] != to.axes[ i ] ) {
+            fields |= 2 << i;
+        }
+    }
+
+    return fields;
+
+}
+
+static void clearPorts( InputPortState *ports, const int from ) {
+    for( int i = from; i < InputSnapshot::maxPorts; ++i ) {
+        ports[ i ] = InputPortState();
+    }
+}
+
+InputRecorder::InputRecorder()
+    : previousPortCount( 0 ),
+      run( 0 ),
+      recordedFrames( 0 ),
+      written( 0 ),
+      framesSinceFlush( 0 ),
+      chunkUsed( 0 ) {
+
+}
+
+InputRecorder::~InputRecorder() {
+    stop();
+}
+
+bool InputRecorder::start( const QString &path ) {
+
+    stop();
+
+    file.setFileName( path );
+
+    // Unbuffered, so every chunk goes to the OS in one write() and a crash can't leave half of one behind in Qt.
+    if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered ) ) {
+        qCWarning( phxInput ) << "Unable to record input to" << path << ":" << file.errorString();
+        return false;
+    }
+
+    uchar header[ InputRecording::headerSize ];
+    qToLittleEndian<quint32>( InputRecording::magic, header );
+    qToLittleEndian<quint16>( InputRecording::version, header + 4 );
+    qToLittleEndian<quint16>( 0, header + 6 );
+
+    if( file.write( reinterpret_cast<const char *>( header ), sizeof( header ) ) != sizeof( header ) ) {
+        qCWarning( phxInput ) << "Unable to record input to" << path << ":" << file.errorString();
+        file.close();
+        return false;
+    }
+
+    clearPorts( previous, 0 );
+    previousPortCount = 0;
+    run = 0;
+    recordedFrames = 0;
+    written = sizeof( header );
+    framesSinceFlush = 0;
+    chunkUsed = 0;
+
+    return true;
+
+}
+
+void InputRecorder::stop() {
+
+    if( !file.isOpen() ) {
+        return;
+    }
+
+    // A record without changes stands for one more unchanged frame.
+    if( run > 0 ) {
+        run--;
+        writeRecord( nullptr, 0 );
+    }
+
+    flush();
+    file.close();
+
+}
+
+bool InputRecorder::isRecording() const {
+    return file.isOpen();
+}
+
+void InputRecorder::record( const InputSnapshot &snapshot ) {
+
+    if( !file.isOpen() ) {
+        return;
+    }
+
+    recordedFrames++;
+    framesSinceFlush++;
+
+    int changes = 0;
+
+    for( int i = 0; i < snapshot.portCount; ++i ) {
+        changes += changedFields( previous[ i ], snapshot.ports[ i ] ) ? 1 : 0;
+    }
+
+    if( changes == 0 && snapshot.portCount == previousPortCount ) {
+        run++;
+    } else {
+        writeRecord( &snapshot, changes );
+        run = 0;
+    }
+
+    if( framesSinceFlush >= flushInterval && chunkUsed > 0 ) {
+        flush();
+    }
+
+}
+
+quint64 InputRecorder::frames() const {
+    return recordedFrames;
+}
+
+quint64 InputRecorder::bytesWritten() const {
+    return written;
+}
+
+void InputRecorder::writeRecord( const InputSnapshot *snapshot, const int changes ) {
+
+    if( InputRecording::chunkHeaderSize + chunkUsed + InputRecording::maxRecordSize > InputRecording::chunkSize ) {
+        flush();
+    }
+
+    uchar *out = chunk + InputRecording::chunkHeaderSize + chunkUsed;
+
+    bool portCountChanged = snapshot && snapshot->portCount != previousPortCount;
+
+    out = writeVarint( out, run );
+    out = writeVarint( out, static_cast<quint64>( changes ) << 1 | ( portCountChanged ? 1 : 0 ) );
+
+    if( portCountChanged ) {
+        out = writeVarint( out, static_cast<quint64>( snapshot->portCount ) );
+
+        // Ports past the end are released, so a port coming back is compared against nothing held.
+        if( snapshot->portCount < previousPortCount ) {
+            clearPorts( previous, snapshot->portCount );
+        }
+
+        previousPortCount = snapshot->portCount;
+    }
+
+    int lastPort = -1;
+
+    for( int i = 0; changes > 0 && i < snapshot->portCount; ++i ) {
+
+        auto &port = snapshot->ports[ i ];
+        auto &old = previous[ i ];
+        int fields = changedFields( old, port );
+
+        if( !fields ) {
+            continue;
+        }
+
+        out = writeVarint( out, static_cast<quint64>( i - lastPort - 1 ) );
+        *out++ = static_cast<uchar>( fields );
+
+        if( fields & 1 ) {
+            out = writeVarint( out, static_cast<quint16>( port.buttons ^ old.buttons ) );
+        }
+
+        for( int axis = 0; axis < InputPortState::AxisCount; ++axis ) {
+            if( fields & ( 2 << axis ) ) {
+                out = writeVarint( out, zigzag( static_cast<qint32>( port.axes[ axis ] ) - old.axes[ axis ] ) );
+            }
+        }
+
+        old = port;
+        lastPort = i;
+
+    }
+
+    chunkUsed = static_cast<int>( out - chunk ) - InputRecording::chunkHeaderSize;
+
+}
+
+void InputRecorder::flush() {
+
+    if( chunkUsed == 0 ) {
+        return;
+    }
+
+    uchar *payload = chunk + InputRecording::chunkHeaderSize;
+    qToLittleEndian<quint32>( static_cast<quint32>( chunkUsed ), chunk );
+    qToLittleEndian<quint32>( InputRecording::checksum( payload, chunkUsed ), chunk + 4 );
+
+    qint64 length = InputRecording::chunkHeaderSize + chunkUsed;
+
+    if( file.write( reinterpret_cast<const char *>( chunk ), length ) != length ) {
+        qCWarning( phxInput ) << "Input recording stopped:" << file.errorString();
+        file.close();
+    } else {
+        written += static_cast<quint64>( length );
+    }
+
+    chunkUsed = 0;
+    framesSinceFlush = 0;
+
+}
+
+InputReplay::InputReplay()
+    : data( nullptr ),
+      size( 0 ),
+      position( 0 ),
+      chunkEnd( 0 ),
+      repeats( 0 ),
+      changesPending( false ),
+      playedFrames( 0 ),
+      portCount( 0 ) {
+
+}
+
+InputReplay::~InputReplay() {
+    close();
+}
+
+bool InputReplay::open( const QString &path ) {
+
+    close();
+
+    file.setFileName( path );
+
+    if( !file.open( QIODevice::ReadOnly ) ) {
+        qCWarning( phxInput ) << "Unable to replay" << path << ":" << file.errorString();
+        return false;
+    }
+
+    size = file.size();
+    data = size >= InputRecording::headerSize ? file.map( 0, size ) : nullptr;
+
+    if( !data
+        || qFromLittleEndian<quint32>( data ) != InputRecording::magic
+        || qFromLittleEndian<quint16>( data + 4 ) != InputRecording::version ) {
+        qCWarning( phxInput ) << path << "is not an input recording";
+        close();
+        return false;
+    }
+
+    position = InputRecording::headerSize;
+    chunkEnd = position;
+    repeats = 0;
+    changesPending = false;
+    playedFrames = 0;
+    portCount = 0;
+    clearPorts( ports, 0 );
+
+    return true;
+
+}
+
+void InputReplay::close() {
+
+    if( data ) {
+        file.unmap( const_cast<uchar *>( data ) );
+        data = nullptr;
+    }
+
+    file.close();
+    size = 0;
+
+}
+
+bool InputReplay::isOpen() const {
+    return data != nullptr;
+}
+
+bool InputReplay::next( InputSnapshot &snapshot ) {
+
+    if( !data ) {
+        return false;
+    }
+
+    if( repeats > 0 ) {
+        repeats--;
+    } else if( changesPending ) {
+        changesPending = false;
+
+        if( !applyChanges() ) {
+            return false;
+        }
+    } else {
+        if( position == chunkEnd && !nextChunk() ) {
+            return false;
+        }
+
+        quint64 run;
+
+        if( !readVarint( run ) ) {
+            return false;
+        }
+
+        // This frame is the first of the unchanged run, the changes come after it.
+        if( run > 0 ) {
+            repeats = run - 1;
+            changesPending = true;
+        } else if( !applyChanges() ) {
+            return false;
+        }
+    }
+
+    snapshot.portCount = portCount;
+
+    for( int i = 0; i < portCount; ++i ) {
+        snapshot.ports[ i ] = ports[ i ];
+        snapshot.captured[ i ] = 0;
+    }
+
+    playedFrames++;
+
+    return true;
+
+}
+
+quint64 InputReplay::frames() const {
+    return playedFrames;
+}
+
+bool InputReplay::nextChunk() {
+
+    if( size - position < InputRecording::chunkHeaderSize ) {
+        return false;
+    }
+
+    qint64 length = qFromLittleEndian<quint32>( data + position );
+    quint32 checksum = qFromLittleEndian<quint32>( data + position + 4 );
+    qint64 payload = position + InputRecording::chunkHeaderSize;
+
+    if( length == 0 || length > size - payload
+        || InputRecording::checksum( data + payload, static_cast<int>( length ) ) != checksum ) {
+        qCDebug( phxInput ) << "Input recording ends with a damaged chunk at" << position;
+        return false;
+    }
+
+    position = payload;
+    chunkEnd = payload + length;
+
+    return true;
+
+}
+
+bool InputReplay::readVarint( quint64 &value ) {
+
+    value = 0;
+
+    for( int shift = 0; shift < 64 && position < chunkEnd; shift += 7 ) {
+
+        uchar byte = data[ position++ ];
+        value |= static_cast<quint64>( byte & 0x7f ) << shift;
+
+        if( !( byte & 0x80 ) ) {
+            return true;
+        }
+
+    }
+
+    return false;
+
+}
+
+bool InputReplay::applyChanges() {
+
+    quint64 header;
+
+    if( !readVarint( header ) ) {
+        return false;
+    }
+
+    if( header & 1 ) {
+
+        quint64 count;
+
+        if( !readVarint( count ) || count > static_cast<quint64>( InputSnapshot::maxPorts ) ) {
+            return false;
+        }
+
+        if( static_cast<int>( count ) < portCount ) {
+            clearPorts( ports, static_cast<int>( count ) );
+        }
+
+        portCount = static_cast<int>( count );
+
+    }
+
+    int port = -1;
+
+    for( quint64 changes = header >> 1; changes > 0; --changes ) {
+
+        quint64 skip;
+
+        if( !readVarint( skip ) || skip >= static_cast<quint64>( portCount - port - 1 ) || position >= chunkEnd ) {
+            return false;
+        }
+
+        port += static_cast<int>( skip ) + 1;
+
+        int fields = data[ position++ ];
+        quint64 value;
+
+        if( fields & 1 ) {
+            if( !readVarint( value ) ) {
+                return false;
+            }
+
+            ports[ port ].buttons ^= static_cast<quint16>( value );
+        }
+
+        for( int axis = 0; axis < InputPortState::AxisCount; ++axis ) {
+            if( fields & ( 2 << axis ) ) {
+                if( !readVarint( value ) ) {
+                    return false;
+                }
+
+                ports[ port ].axes[ axis ] = static_cast<int16_t>( ports[ port ].axes[ axis ]
+                                                                   + unzigzag( static_cast<quint32>( value ) ) );
+            }
+        }
+
+    }
+
+    return true;
+
+}
@@ -0,0 +1,150 @@
+#ifndef INPUTRECORDING_H
+#define INPUTRECORDING_H
+
+#include <QtGlobal>
+#include <QFile>
+#include <QString>
+
+#include "inputsnapshot.h"
+
+// An input recording is every published InputSnapshot, one frame after another, stored as the differences from
+// the frame before. It starts with an 8 byte header: the magic "PXIR", a 16 bit version and 16 reserved bits.
+
+// Frames are grouped into chunks: a 32 bit payload length, a 32 bit FNV-1a checksum of the payload, then the
+// payload itself. A chunk is written with a single write(), and a recording is read up to its first short or
+// damaged chunk, so a crash only ever loses the last chunk or so (about a second).
+
+// A payload is a list of records, each a frame with at least one change, and all varints (LEB128):
+//     run                 number of unchanged frames before this one
+//     changes << 1 | n    n set if the port count changed, then the new port count follows
+//     per changed port:   port - previous changed port - 1, a byte of which fields changed (bit 0 for buttons,
+//                         bit 1 + i for axis i), the button mask XOR the old one, and each axis as a zigzag
+//                         encoded difference from the old one.
+
+// Unchanged frames cost nothing until the next change, and a typical change is 4 or 5 bytes. An hour of four
+// players fits in a megabyte or two.
+
+// Every integer is little endian.
+
+namespace InputRecording {
+
+    static const quint32 magic = 0x52495850; // "PXIR"
+    static const quint16 version = 1;
+
+    static const int headerSize = 8;
+    static const int chunkHeaderSize = 8;
+
+    // Both sides keep their buffers this size, a chunk never goes over it.
+    static const int chunkSize = 16384;
+
+    // Worst case size of one record: three varints up front, then every port with every field changed.
+    static const int maxRecordSize = 3 * 10 + InputSnapshot::maxPorts * ( 2 + 1 + 3 + InputPortState::AxisCount * 3 );
+
+    quint32 checksum( const uchar *data, const int size );
+
+}
+
+// InputRecorder writes every snapshot handed to record() to a recording. It never allocates once started, and only
+// touches the disk once a chunk is full or has been held back for flushInterval frames.
+
+// Not thread safe. InputManager calls it under its mutex, right after filling in a snapshot.
+
+class InputRecorder {
+
+    public:
+
+        // Write out a partly filled chunk after this many frames.
+        static const int flushInterval = 60;
+
+        InputRecorder();
+        ~InputRecorder();
+
+        // Truncates the file if it exists.
+        bool start( const QString &path );
+
+        // Writes out the unchanged frames since the last change too, and closes the file.
+        void stop();
+
+        bool isRecording() const;
+
+        void record( const InputSnapshot &snapshot );
+
+        quint64 frames() const;
+        quint64 bytesWritten() const;
+
+    private:
+
+        QFile file;
+
+        InputPortState previous[ InputSnapshot::maxPorts ];
+        int previousPortCount;
+
+        // Unchanged frames since the last record.
+        quint64 run;
+
+        quint64 recordedFrames;
+        quint64 written;
+        int framesSinceFlush;
+
+        uchar chunk[ InputRecording::chunkSize ];
+        int chunkUsed;
+
+        void writeRecord( const InputSnapshot *snapshot, const int changes );
+        void flush();
+
+        Q_DISABLE_COPY( InputRecorder )
+
+};
+
+// InputReplay plays a recording back one frame at a time. The file is memory mapped read only and decoded in
+// place, so next() neither allocates nor copies more than the ports it changes.
+
+class InputReplay {
+
+    public:
+
+        InputReplay();
+        ~InputReplay();
+
+        // Fails if the file can't be mapped or isn't a recording.
+        bool open( const QString &path );
+        void close();
+
+        bool isOpen() const;
+
+        // Fill in the ports of the next frame, the same as it was recorded. Every capture time is 0, replayed
+        // input has no latency to measure. Returns false at the end of the recording, or at its first damaged
+        // chunk.
+        bool next( InputSnapshot &snapshot );
+
+        // Frames played back so far.
+        quint64 frames() const;
+
+    private:
+
+        QFile file;
+        const uchar *data;
+        qint64 size;
+
+        // Read position, and the end of the chunk it's in.
+        qint64 position;
+        qint64 chunkEnd;
+
+        // Unchanged frames left before the next record's changes are applied.
+        quint64 repeats;
+        bool changesPending;
+
+        quint64 playedFrames;
+
+        InputPortState ports[ InputSnapshot::maxPorts ];
+        int portCount;
+
+        bool nextChunk();
+        bool readVarint( quint64 &value );
+        bool applyChanges();
+
+        Q_DISABLE_COPY( InputReplay )
+
+};
+
+#endif // INPUTRECORDING_H
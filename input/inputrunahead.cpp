@@ -0,0 +1,90 @@
+#include "inputrunahead.h"
+
+#include <cstring>
+
+const int InputRunAhead::historySize;
+const int InputRunAhead::maxFrames;
+
+// Ports are compared and copied as bytes, which needs them to have no padding.
+static_assert( sizeof( InputPortState ) == sizeof( quint16 ) * ( 1 + InputPortState::AxisCount ),
+               "InputPortState must be packed" );
+
+static bool sameKeyboard( const InputKeyboardState &a, const InputKeyboardState &b ) {
+    return a.modifiers == b.modifiers && std::memcmp( a.keys, b.keys, sizeof( a.keys ) ) == 0;
+}
+
+InputRunAhead::InputRunAhead()
+    : speculativeFrames( 0 ) {
+
+    reset();
+
+}
+
+int InputRunAhead::frames() const {
+    return speculativeFrames;
+}
+
+void InputRunAhead::setFrames( const int frames ) {
+    speculativeFrames = qBound( 0, frames, static_cast<int>( maxFrames ) );
+}
+
+void InputRunAhead::reset() {
+    committed = 0;
+    lastChanged = true;
+}
+
+bool InputRunAhead::commit( const InputSnapshot &snapshot ) {
+
+    auto &packed = history[ committed & ( historySize - 1 ) ];
+    int portCount = qBound( 0, snapshot.portCount, static_cast<int>( InputSnapshot::maxPorts ) );
+
+    packed.snapshotFrame = snapshot.frame;
+    packed.portCount = portCount;
+    packed.keyboard = snapshot.keyboard;
+    std::memcpy( packed.ports, snapshot.ports, sizeof( InputPortState ) * portCount );
+
+    // Nothing was run ahead of the first frame, so it can't have guessed right.
+    if( committed == 0 ) {
+        lastChanged = true;
+    } else {
+        auto &previous = history[ ( committed - 1 ) & ( historySize - 1 ) ];
+
+        lastChanged = previous.portCount != portCount || !sameKeyboard( previous.keyboard, packed.keyboard )
+                      || std::memcmp( previous.ports, packed.ports, sizeof( InputPortState ) * portCount ) != 0;
+    }
+
+    committed++;
+
+    return lastChanged;
+
+}
+
+bool InputRunAhead::changed() const {
+    return lastChanged;
+}
+
+quint64 InputRunAhead::committedFrames() const {
+    return committed;
+}
+
+bool InputRunAhead::restore( const quint64 frame, InputSnapshot &snapshot ) const {
+
+    if( frame >= committed || committed - frame > static_cast<quint64>( historySize ) ) {
+        return false;
+    }
+
+    auto &packed = history[ frame & ( historySize - 1 ) ];
+
+    snapshot.frame = packed.snapshotFrame;
+    snapshot.portCount = packed.portCount;
+    snapshot.keyboard = packed.keyboard;
+    std::memcpy( snapshot.ports, packed.ports, sizeof( InputPortState ) * packed.portCount );
+
+    // Restored input is an old frame's, there's no latency to measure.
+    for( int i = 0; i < packed.portCount; ++i ) {
+        snapshot.captured[ i ] = 0;
+    }
+
+    return true;
+
+}
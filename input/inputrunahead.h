@@ -0,0 +1,68 @@
+#ifndef INPUTRUNAHEAD_H
+#define INPUTRUNAHEAD_H
+
+#include <QtGlobal>
+
+#include "inputsnapshot.h"
+
+// InputRunAhead is the input side of run-ahead, which hides a core's internal lag by running a few frames ahead
+// of what it has input for and showing the last of them. Every real frame's input is committed to a short history
+// of packed copies, only the ports in use plus the keyboard, so a commit is a couple of small memcpys.
+
+// Speculative frames are run with the last committed input, repeated. As long as the next real frame's input is
+// the same, the speculation was right: the first speculative frame's state is the next real state, and only one
+// new speculative frame has to be run. commit() says when it isn't, that's the only time the core has to load its
+// last real state and run every frame again. Held buttons and resting sticks make that a small share of frames.
+
+// Not thread safe, core thread only. Never allocates.
+
+class InputRunAhead {
+
+    public:
+
+        // Real frames kept, a power of two.
+        static const int historySize = 16;
+
+        static const int maxFrames = 4;
+
+        InputRunAhead();
+
+        // Speculative frames to run, 0 turns run-ahead off.
+        int frames() const;
+        void setFrames( const int frames );
+
+        // Forget every committed frame.
+        void reset();
+
+        // Record the next real frame's input. Returns true if it's different from the last one, which the frames
+        // run ahead assumed it would be.
+        bool commit( const InputSnapshot &snapshot );
+
+        // What the last commit() returned.
+        bool changed() const;
+
+        // Real frames committed so far, numbered from 0.
+        quint64 committedFrames() const;
+
+        // Unpack a committed frame, to run it again. Fails once it's left the history.
+        bool restore( const quint64 frame, InputSnapshot &snapshot ) const;
+
+    private:
+
+        struct PackedFrame {
+            quint64 snapshotFrame;
+            int portCount;
+            InputKeyboardState keyboard;
+            InputPortState ports[ InputSnapshot::maxPorts ];
+        };
+
+        PackedFrame history[ historySize ];
+        quint64 committed;
+        int speculativeFrames;
+        bool lastChanged;
+
+        Q_DISABLE_COPY( InputRunAhead )
+
+};
+
+#endif // INPUTRUNAHEAD_H
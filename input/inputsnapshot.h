@@ -0,0 +1,158 @@
+#ifndef INPUTSNAPSHOT_H
+#define INPUTSNAPSHOT_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+#include "libretro.h"
+
+// InputPortState is the packed state of one port: a RetroPad button mask, where bit n is
+// RETRO_DEVICE_ID_JOYPAD n, plus both analog sticks.
+
+struct InputPortState {
+
+    enum Axis {
+        LeftX = RETRO_DEVICE_INDEX_ANALOG_LEFT * 2 + RETRO_DEVICE_ID_ANALOG_X,
+        LeftY = RETRO_DEVICE_INDEX_ANALOG_LEFT * 2 + RETRO_DEVICE_ID_ANALOG_Y,
+        RightX = RETRO_DEVICE_INDEX_ANALOG_RIGHT * 2 + RETRO_DEVICE_ID_ANALOG_X,
+        RightY = RETRO_DEVICE_INDEX_ANALOG_RIGHT * 2 + RETRO_DEVICE_ID_ANALOG_Y,
+        AxisCount,
+    };
+
+    quint16 buttons;
+    int16_t axes[ AxisCount ];
+
+    // Same arguments and meaning as retro_input_state_t, minus the port.
+    int16_t value( const unsigned device, const unsigned index, const unsigned id ) const {
+        switch( device ) {
+            case RETRO_DEVICE_JOYPAD:
+                return id < 16 ? ( buttons >> id ) & 1 : 0;
+
+            case RETRO_DEVICE_ANALOG:
+                return index < 2 && id < 2 ? axes[ index * 2 + id ] : 0;
+
+            default:
+                return 0;
+        }
+    }
+
+};
+
+// InputKeyboardState is every key of the keyboard, one bit per RETROK_ code, plus the RETROKMOD_ modifiers held.
+
+struct InputKeyboardState {
+
+    static const int keyCount = RETROK_LAST;
+    static const int wordCount = ( keyCount + 63 ) / 64;
+
+    quint64 keys[ wordCount ];
+    quint16 modifiers;
+
+    bool isDown( const unsigned key ) const {
+        return key < static_cast<unsigned>( keyCount ) && ( keys[ key / 64 ] >> ( key % 64 ) ) & 1;
+    }
+
+    void clear() {
+        for( auto &word : keys ) {
+            word = 0;
+        }
+
+        modifiers = 0;
+    }
+
+};
+
+// InputSnapshot is the state of every port for one frame. Once published it is never written to again, so
+// the core can read all of its ports without ever seeing a mix of two polls.
+
+struct InputSnapshot {
+
+    // Same as Joystick::maxNumOfDevices
+    static const int maxPorts = 128;
+
+    // Incremented by every publish.
+    quint64 frame;
+
+    // inputClockNs() when the ports were read.
+    qint64 timestamp;
+
+    // Only ports below portCount can hold a device, the rest are always released.
+    int portCount;
+
+    InputPortState ports[ maxPorts ];
+
+    // inputClockNs() of each port's last change, see InputStateBlock::captureTime().
+    qint64 captured[ maxPorts ];
+
+    // There's only one keyboard, it answers on every port.
+    InputKeyboardState keyboard;
+
+    int16_t value( const unsigned port, const unsigned device, const unsigned index, const unsigned id ) const {
+        if( device == RETRO_DEVICE_KEYBOARD ) {
+            return keyboard.isDown( id );
+        }
+
+        return port < static_cast<unsigned>( portCount ) ? ports[ port ].value( device, index, id ) : 0;
+    }
+
+};
+
+// InputSnapshotBuffer hands snapshots from one writer thread to one reader thread through a triple buffer.
+// Neither side ever waits: the writer always has a free buffer to fill, and the reader always gets the most
+// recent complete snapshot.
+
+class InputSnapshotBuffer {
+
+    public:
+
+        InputSnapshotBuffer()
+            : middle( 1 ),
+              back( 0 ),
+              front( 2 ) {
+            for( auto &buffer : buffers ) {
+                buffer.frame = 0;
+                buffer.timestamp = 0;
+                buffer.portCount = 0;
+                buffer.keyboard.clear();
+            }
+        }
+
+        // Writer: fill this in, then call publish(). Only valid until the next publish().
+        InputSnapshot &writeBuffer() {
+            return buffers[ back ];
+        }
+
+        // Writer: hand the write buffer over to the reader.
+        void publish() {
+            back = middle.exchange( back | freshBit, std::memory_order_acq_rel ) & indexMask;
+        }
+
+        // Reader: the latest published snapshot. Stays untouched until the next call to acquire().
+        const InputSnapshot &acquire() {
+            if( middle.load( std::memory_order_relaxed ) & freshBit ) {
+                front = middle.exchange( front, std::memory_order_acq_rel ) & indexMask;
+            }
+
+            return buffers[ front ];
+        }
+
+    private:
+
+        static const quint8 freshBit = 0x4;
+        static const quint8 indexMask = 0x3;
+
+        InputSnapshot buffers[ 3 ];
+
+        // Index of the buffer in between the two threads. freshBit is set if the reader hasn't seen it yet.
+        std::atomic<quint8> middle;
+
+        // Owned by the writer and the reader respectively.
+        quint8 back;
+        quint8 front;
+
+        Q_DISABLE_COPY( InputSnapshotBuffer )
+
+};
+
+#endif // INPUTSNAPSHOT_H
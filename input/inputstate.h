@@ -0,0 +1,153 @@
+#ifndef INPUTSTATE_H
+#define INPUTSTATE_H
+
+#include <QtGlobal>
+
+#include <atomic>
+#include <new>
+
+#include "inputdeviceevent.h"
+#include "inputsnapshot.h"
+
+// InputStateBlock holds the current state of one InputDevice in a fixed layout.
+
+// Every button owns one bit in the packed button mask and one slot in the analog array, both indexed directly
+// by InputDeviceEvent::Event. The analog sticks sit beside them, indexed by InputPortState::Axis. A read or a
+// write is a single atomic operation, so the poll thread and the core thread never wait on each other.
+
+// The block is exactly one cache line and is allocated on a cache line boundary, so writing one device's
+// state never invalidates the cache line of another device, or of the InputDevice that owns it.
+
+class alignas( 64 ) InputStateBlock {
+
+    public:
+
+        // Guide has no libretro ID (it's -1), so it's given the first slot after the RetroPad buttons.
+        enum Slot {
+            GuideSlot = InputDeviceEvent::Unknown,
+            SlotCount,
+            InvalidSlot = -1,
+        };
+
+        static const int cacheLineSize = 64;
+
+        InputStateBlock() {
+            reset();
+        }
+
+        static int slot( const InputDeviceEvent::Event &event ) {
+            if( event >= 0 && event < InputDeviceEvent::Unknown ) {
+                return event;
+            }
+
+            return event == InputDeviceEvent::Guide ? GuideSlot : InvalidSlot;
+        }
+
+        // Poll button state (getter)
+        int16_t value( const InputDeviceEvent::Event &event, const int16_t defaultValue = 0 ) const {
+            auto index = slot( event );
+
+            if( index == InvalidSlot ) {
+                return defaultValue;
+            }
+
+            return analog[ index ].load( std::memory_order_relaxed );
+        }
+
+        // Set button state (setter). Returns true if the button went from released to pressed, or back.
+        bool insert( const InputDeviceEvent::Event &event, const int16_t &state ) {
+            auto index = slot( event );
+
+            if( index == InvalidSlot ) {
+                return false;
+            }
+
+            analog[ index ].store( state, std::memory_order_relaxed );
+
+            const quint32 bit = 1u << index;
+            quint32 previous;
+
+            if( state ) {
+                previous = buttonMask.fetch_or( bit, std::memory_order_release );
+            } else {
+                previous = buttonMask.fetch_and( ~bit, std::memory_order_release );
+            }
+
+            return ( ( previous & bit ) != 0 ) != ( state != 0 );
+        }
+
+        // One bit per slot, set while the button is held.
+        quint32 buttons() const {
+            return buttonMask.load( std::memory_order_acquire );
+        }
+
+        int16_t axis( const InputPortState::Axis axis ) const {
+            return axes[ axis ].load( std::memory_order_relaxed );
+        }
+
+        void setAxis( const InputPortState::Axis axis, const int16_t value ) {
+            axes[ axis ].store( value, std::memory_order_relaxed );
+        }
+
+        // inputClockNs() of the last write, or when the source says the change happened if it knows, for measuring
+        // how long input takes to reach its consumers.
+        qint64 captureTime() const {
+            return captured.load( std::memory_order_relaxed );
+        }
+
+        void setCaptureTime( const qint64 timestamp ) {
+            captured.store( timestamp, std::memory_order_relaxed );
+        }
+
+        // Pack the current state for a snapshot.
+        void copyTo( InputPortState &port ) const {
+            port.buttons = static_cast<quint16>( buttons() );
+
+            for( int i = 0; i < InputPortState::AxisCount; ++i ) {
+                port.axes[ i ] = axes[ i ].load( std::memory_order_relaxed );
+            }
+        }
+
+        void reset() {
+            for( auto &level : analog ) {
+                level.store( 0, std::memory_order_relaxed );
+            }
+
+            for( auto &level : axes ) {
+                level.store( 0, std::memory_order_relaxed );
+            }
+
+            captured.store( 0, std::memory_order_relaxed );
+            buttonMask.store( 0, std::memory_order_release );
+        }
+
+        // Plain new doesn't honor alignas() before C++17, so allocate the block ourselves.
+        static void *operator new( size_t size ) {
+            auto *block = qMallocAligned( size, cacheLineSize );
+
+            if( !block ) {
+                throw std::bad_alloc();
+            }
+
+            return block;
+        }
+
+        static void operator delete( void *block ) {
+            qFreeAligned( block );
+        }
+
+    private:
+
+        std::atomic<quint32> buttonMask;
+        std::atomic<int16_t> analog[ SlotCount ];
+        std::atomic<int16_t> axes[ InputPortState::AxisCount ];
+        std::atomic<qint64> captured;
+
+        Q_DISABLE_COPY( InputStateBlock )
+
+};
+
+static_assert( sizeof( InputStateBlock ) == InputStateBlock::cacheLineSize,
+               "InputStateBlock must fill exactly one cache line" );
+
+#endif // INPUTSTATE_H
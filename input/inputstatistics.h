@@ -0,0 +1,74 @@
+#ifndef INPUTSTATISTICS_H
+#define INPUTSTATISTICS_H
+
+#include <QtGlobal>
+#include <QMutex>
+
+#include <atomic>
+
+// InputStatistics counts what the input pipeline costs: how often it polls, how much CPU those polls take, and how
+// often a thread had to wait for another one's lock. The counters are relaxed atomics, cheap enough to leave on
+// in release builds.
+
+class InputStatistics {
+
+    public:
+
+        InputStatistics() {
+            reset();
+        }
+
+        // Lock the mutex, counting it if someone else was holding it.
+        void lock( QMutex &mutex ) {
+            if( !mutex.tryLock() ) {
+                contendedLocks.fetch_add( 1, std::memory_order_relaxed );
+                mutex.lock();
+            }
+        }
+
+        // One poll, which took this much CPU time on its thread.
+        void recordPoll( const qint64 cpuNs ) {
+            pollCount.fetch_add( 1, std::memory_order_relaxed );
+            pollCpu.fetch_add( static_cast<quint64>( qMax<qint64>( cpuNs, 0 ) ), std::memory_order_relaxed );
+        }
+
+        // The poll thread woke up.
+        void recordWakeup() {
+            wakeupCount.fetch_add( 1, std::memory_order_relaxed );
+        }
+
+        quint64 polls() const {
+            return pollCount.load( std::memory_order_relaxed );
+        }
+
+        quint64 pollCpuNs() const {
+            return pollCpu.load( std::memory_order_relaxed );
+        }
+
+        quint64 wakeups() const {
+            return wakeupCount.load( std::memory_order_relaxed );
+        }
+
+        quint64 contended() const {
+            return contendedLocks.load( std::memory_order_relaxed );
+        }
+
+        void reset() {
+            pollCount.store( 0, std::memory_order_relaxed );
+            pollCpu.store( 0, std::memory_order_relaxed );
+            wakeupCount.store( 0, std::memory_order_relaxed );
+            contendedLocks.store( 0, std::memory_order_relaxed );
+        }
+
+    private:
+
+        std::atomic<quint64> pollCount;
+        std::atomic<quint64> pollCpu;
+        std::atomic<quint64> wakeupCount;
+        std::atomic<quint64> contendedLocks;
+
+        Q_DISABLE_COPY( InputStatistics )
+
+};
+
+#endif // INPUTSTATISTICS_H
@@ -2,32 +2,40 @@
 
 const int Joystick::maxNumOfDevices = 128;
 
-Joystick::Joystick( const int joystickIndex, QObject *parent )
+Joystick::Joystick( JoystickBackend *backend, const int joystickIndex, QObject *parent )
     : InputDevice( LibretroType::DigitalGamepad, parent ),
+      qmlInstanceID( -1 ),
       qmlSdlIndex( joystickIndex ),
+      qmlButtonCount( 0 ),
+      qmlAxisCount( 0 ),
+      qmlHatCount( 0 ),
+      qmlBallCount( 0 ),
       qmlDeadZone( 12000 ),
       qmlAnalogMode( false ),
-      mSDLButtonVector( SDL_CONTROLLER_BUTTON_MAX, SDL_CONTROLLER_BUTTON_INVALID ),
-      mSDLAxisVector( SDL_CONTROLLER_BUTTON_MAX, SDL_CONTROLLER_BUTTON_INVALID ) {
-
-    device = SDL_GameControllerOpen( joystickIndex );
-    setName( SDL_GameControllerName( device ) );
-    qmlInstanceID = SDL_JoystickInstanceID( SDL_GameControllerGetJoystick( device ) );
-
-    auto *sdlJoystick = SDL_GameControllerGetJoystick( device );
-    qmlAxisCount = SDL_JoystickNumAxes( sdlJoystick );
-    qmlButtonCount = SDL_JoystickNumButtons( sdlJoystick );
+      mRawState(),
+      mMappedState(),
+      mStickLane( -1 ),
+      mDpadButtons( 0 ),
+      mStickDpad( 0 ),
+      backend( backend ) {
+
+    device = backend->open( joystickIndex );
+
+    // Unplugged before it could be opened. The backend can't say anything about a null handle.
+    if( !device ) {
+        return;
+    }
 
-    qmlHatCount = SDL_JoystickNumHats( sdlJoystick );
-    qmlBallCount = SDL_JoystickNumBalls( sdlJoystick );
+    setName( backend->name( device ) );
+    qmlInstanceID = backend->instanceID( device );
 
-    char guidStr[1024];
-    SDL_JoystickGUID guid = SDL_JoystickGetGUID( sdlJoystick );
-    SDL_JoystickGetGUIDString( guid, guidStr, sizeof( guidStr ) );
+    qmlAxisCount = backend->axisCount( device );
+    qmlButtonCount = backend->buttonCount( device );
 
-    qmlGuid = guidStr;
+    qmlHatCount = backend->hatCount( device );
+    qmlBallCount = backend->ballCount( device );
 
-    mDigitalTriggers = hasDigitalTriggers( qmlGuid );
+    qmlGuid = backend->guid( device );
 
     // This is really annoying, but for whatever reason, the SDL2 Game Controller API,
     // doesn't assign a proper mapping value certain controller buttons.
@@ -35,10 +43,14 @@ Joystick::Joystick( const int joystickIndex, QObject *parent )
 
     connect( this, &Joystick::resetMappingChanged, this, [ this ] {
         if( resetMapping() )
-            loadSDLMapping( sdlDevice() );
+            loadSDLMapping();
     } );
 
-    loadSDLMapping( sdlDevice() );
+    loadSDLMapping();
+
+    StickSettings stickSettings;
+    stickSettings.dpadThreshold = static_cast<qint16>( qmlDeadZone );
+    setStickSettings( stickSettings );
 
 }
 
@@ -78,45 +90,256 @@ bool Joystick::analogMode() const {
     return qmlAnalogMode;
 }
 
-bool Joystick::digitalTriggers() const {
-    return mDigitalTriggers;
+quint8 Joystick::getButtonState( const SDL_GameControllerButton &button ) const {
+
+    if( button < 0 || button >= SDL_CONTROLLER_BUTTON_MAX ) {
+        return 0;
+    }
+
+    return ( mMappedState.buttons >> button ) & 1;
+
 }
 
-quint8 Joystick::getButtonState( const SDL_GameControllerButton &button ) {
+qint16 Joystick::getAxisState( const SDL_GameControllerAxis &axis ) const {
 
-    if( button >= mSDLButtonVector.size() ) {
+    if( axis < 0 || axis >= SDL_CONTROLLER_AXIS_MAX ) {
         return 0;
     }
 
-    auto buttonID = mSDLButtonVector.at( button );
+    return mMappedState.axes[ axis ];
 
-    return SDL_JoystickGetButton( sdlJoystick(), buttonID );
+}
 
+bool Joystick::bindsRawButton( const int button ) const {
+    InputEpoch::Guard guard( mappingEpoch() );
+    return mMappingProgram.get()->bindsButton( button );
 }
 
-qint16 Joystick::getAxisState( const SDL_GameControllerAxis &axis ) {
+bool Joystick::bindsRawAxis( const int axis ) const {
+    InputEpoch::Guard guard( mappingEpoch() );
+    return mMappingProgram.get()->bindsAxis( axis );
+}
+
+bool Joystick::bindsRawHat( const int hat ) const {
+    InputEpoch::Guard guard( mappingEpoch() );
+    return mMappingProgram.get()->bindsHat( hat );
+}
+
+void Joystick::updateButton( const SDL_GameControllerButton &button, const bool pressed ) {
+
+    switch( button ) {
+
+        case SDL_CONTROLLER_BUTTON_DPAD_UP:
+        case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
+        case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
+        case SDL_CONTROLLER_BUTTON_DPAD_RIGHT: {
+            quint8 bit = 1 << ( button - SDL_CONTROLLER_BUTTON_DPAD_UP );
+            mDpadButtons = pressed ? ( mDpadButtons | bit ) : ( mDpadButtons & ~bit );
+            updateDpad();
+            break;
+        }
+
+        // The guide button isn't part of the RetroPad, it's only delivered to the
+        // frontend, see InputDevice::insert().
+        case SDL_CONTROLLER_BUTTON_GUIDE:
+            write( InputDeviceEvent::Guide, pressed );
+            break;
+
+        // The buttons are switched to a SNES controller layout.
+        // SDL GameControllers have Xbox360 controller layouts.
+        case SDL_CONTROLLER_BUTTON_A:
+            write( InputDeviceEvent::B, pressed );
+            break;
+
+        case SDL_CONTROLLER_BUTTON_B:
+            write( InputDeviceEvent::A, pressed );
+            break;
+
+        case SDL_CONTROLLER_BUTTON_X:
+            write( InputDeviceEvent::Y, pressed );
+            break;
+
+        case SDL_CONTROLLER_BUTTON_Y:
+            write( InputDeviceEvent::X, pressed );
+            break;
+
+        case SDL_CONTROLLER_BUTTON_START:
+            write( InputDeviceEvent::Start, pressed );
+            break;
+
+        case SDL_CONTROLLER_BUTTON_BACK:
+            write( InputDeviceEvent::Select, pressed );
+            break;
+
+        case SDL_CONTROLLER_BUTTON_LEFTSTICK:
+            write( InputDeviceEvent::L3, pressed );
+            break;
+
+        case SDL_CONTROLLER_BUTTON_RIGHTSTICK:
+            write( InputDeviceEvent::R3, pressed );
+            break;
+
+        case SDL_CONTROLLER_BUTTON_LEFTSHOULDER:
+            write( InputDeviceEvent::L, pressed );
+            break;
+
+        case SDL_CONTROLLER_BUTTON_RIGHTSHOULDER:
+            write( InputDeviceEvent::R, pressed );
+            break;
+
+        default:
+            break;
 
-    if( axis >= mSDLAxisVector.size() ) {
-        return 0;
     }
 
-    auto axisID = mSDLAxisVector.at( axis );
+}
+
+void Joystick::updateAxis( const SDL_GameControllerAxis &axis, const qint16 value ) {
 
     switch( axis ) {
 
         case SDL_CONTROLLER_AXIS_TRIGGERLEFT:
+            write( InputDeviceEvent::L2, value );
+            break;
+
         case SDL_CONTROLLER_AXIS_TRIGGERRIGHT:
-            if( digitalTriggers() ) {
-                return SDL_JoystickGetButton( sdlJoystick(), axisID );
+            write( InputDeviceEvent::R2, value );
+            break;
+
+        default:
+            break;
+
+    }
+
+}
+
+void Joystick::update( StickBatch &batch ) {
+
+    InputEpoch::Guard guard( mappingEpoch() );
+
+    batch.clear();
+    evaluate( batch );
+    batch.process();
+    updateSticks( batch );
+
+}
+
+void Joystick::evaluate( StickBatch &batch ) {
+
+    // Elements the mapping doesn't use are left alone, they're never read.
+    int buttons = qMin( qmlButtonCount, static_cast<int>( RawJoystickState::maxButtons ) );
+    int axes = qMin( qmlAxisCount, static_cast<int>( RawJoystickState::maxAxes ) );
+    int hats = qMin( qmlHatCount, static_cast<int>( RawJoystickState::maxHats ) );
+
+    {
+        // A remap swaps the program, this one stays valid until the guard goes.
+        InputEpoch::Guard guard( mappingEpoch() );
+        auto *program = mMappingProgram.get();
+
+        for( int i = 0; i < buttons; ++i ) {
+            if( program->bindsButton( i ) ) {
+                mRawState.buttons[ i ] = backend->button( device, i );
+            }
+        }
+
+        for( int i = 0; i < axes; ++i ) {
+            if( program->bindsAxis( i ) ) {
+                mRawState.axes[ i ] = backend->axis( device, i );
             }
+        }
 
-            return SDL_JoystickGetAxis( sdlJoystick(),  axisID );
+        for( int i = 0; i < hats; ++i ) {
+            if( program->bindsHat( i ) ) {
+                mRawState.hats[ i ] = backend->hat( device, i );
+            }
+        }
 
-        default:
-            return SDL_JoystickGetAxis( sdlJoystick(),  axisID );
+        program->evaluate( mRawState, mMappedState );
+    }
+
+    for( int i = 0; i < SDL_CONTROLLER_BUTTON_MAX; ++i ) {
+        auto button = static_cast<SDL_GameControllerButton>( i );
+        updateButton( button, getButtonState( button ) );
+    }
+
+    for( int i = SDL_CONTROLLER_AXIS_TRIGGERLEFT; i < SDL_CONTROLLER_AXIS_MAX; ++i ) {
+        auto axis = static_cast<SDL_GameControllerAxis>( i );
+        updateAxis( axis, getAxisState( axis ) );
+    }
+
+    // Lanes are only ever added in pairs and there's room for two per device, so the right stick fits if the left
+    // one did.
+    auto *settings = mStickSettings.get();
+    mStickLane = batch.add( getAxisState( SDL_CONTROLLER_AXIS_LEFTX ), getAxisState( SDL_CONTROLLER_AXIS_LEFTY ),
+                            settings );
+
+    if( mStickLane != -1 ) {
+        batch.add( getAxisState( SDL_CONTROLLER_AXIS_RIGHTX ), getAxisState( SDL_CONTROLLER_AXIS_RIGHTY ), settings );
+    }
+
+}
+
+void Joystick::updateSticks( const StickBatch &batch ) {
+
+    if( mStickLane == -1 ) {
+        return;
+    }
+
+    const InputPortState::Axis axes[] = {
+        InputPortState::LeftX, InputPortState::LeftY, InputPortState::RightX, InputPortState::RightY,
+    };
+
+    const qint16 values[] = {
+        batch.x[ mStickLane ], batch.y[ mStickLane ], batch.x[ mStickLane + 1 ], batch.y[ mStickLane + 1 ],
+    };
+
+    for( int i = 0; i < InputPortState::AxisCount; ++i ) {
+        if( states()->axis( axes[ i ] ) != values[ i ] ) {
+            insertAxis( axes[ i ], values[ i ] );
+        }
+    }
+
+    if( batch.dpad[ mStickLane ] != mStickDpad ) {
+        mStickDpad = batch.dpad[ mStickLane ];
+
+        if( !analogMode() ) {
+            updateDpad();
+        }
+    }
+
+}
+
+void Joystick::setStickSettings( const StickSettings &settings ) {
+    mStickSettings.publish( std::make_shared<StickSettings>( settings ) );
+}
+
+void Joystick::updateDpad() {
 
+    bool up = mDpadButtons & ( 1 << ( SDL_CONTROLLER_BUTTON_DPAD_UP - SDL_CONTROLLER_BUTTON_DPAD_UP ) );
+    bool down = mDpadButtons & ( 1 << ( SDL_CONTROLLER_BUTTON_DPAD_DOWN - SDL_CONTROLLER_BUTTON_DPAD_UP ) );
+    bool left = mDpadButtons & ( 1 << ( SDL_CONTROLLER_BUTTON_DPAD_LEFT - SDL_CONTROLLER_BUTTON_DPAD_UP ) );
+    bool right = mDpadButtons & ( 1 << ( SDL_CONTROLLER_BUTTON_DPAD_RIGHT - SDL_CONTROLLER_BUTTON_DPAD_UP ) );
+
+    // !analogMode means that the console being played doesn't support
+    // analog sticks. We will then have the left analog stick mimic the D-PAD, in 8 directions.
+    if( !analogMode() ) {
+        up |= mStickDpad & StickProcessor::Up;
+        down |= mStickDpad & StickProcessor::Down;
+        left |= mStickDpad & StickProcessor::Left;
+        right |= mStickDpad & StickProcessor::Right;
     }
 
+    write( InputDeviceEvent::Left, left );
+    write( InputDeviceEvent::Right, right );
+    write( InputDeviceEvent::Down, down );
+    write( InputDeviceEvent::Up, up );
+
+}
+
+void Joystick::write( const InputDeviceEvent::Event &event, const int16_t state ) {
+    if( value( event ) != state ) {
+        insert( event, state );
+    }
 }
 
 QHash<QString, int> &Joystick::sdlMapping() {
@@ -127,12 +350,12 @@ void Joystick::setAnalogMode( const bool mode ) {
     qmlAnalogMode = mode;
 }
 
-SDL_GameController *Joystick::sdlDevice() const {
-    return device;
+bool Joystick::attached() const {
+    return backend->attached( device );
 }
 
-SDL_Joystick *Joystick::sdlJoystick() const {
-    return SDL_GameControllerGetJoystick( device );
+JoystickBackend::Handle Joystick::sdlDevice() const {
+    return device;
 }
 
 SDL_JoystickID Joystick::instanceID() const {
@@ -144,8 +367,15 @@ void Joystick::setSDLIndex( const int index ) {
 }
 
 void Joystick::close() {
-    Q_ASSERT_X( device, "InputDevice" , "the device was deleted by an external source" );
-    SDL_GameControllerClose( device );
+
+    // Already closed on the hot-plug worker, see SDLEventLoop::retire().
+    if( !device ) {
+        return;
+    }
+
+    backend->close( device );
+    device = nullptr;
+
 }
 
 bool Joystick::loadMapping() {
@@ -212,110 +442,55 @@ void Joystick::emitEditModeEvent( int event, int state ) {
     emit editModeEvent( event, state );
 }
 
-void Joystick::emitInputDeviceEvent( InputDeviceEvent::Event event, int state ) {
-    emit inputDeviceEvent( event, state );
-}
-
-bool Joystick::hasDigitalTriggers( const QString &guid ) {
-
-    if( guid == "050000005769696d6f74652028313800" ) {
-        return true;
-    }
-
-    return false;
-
-}
-
 void Joystick::setMapping( const QVariantMap newMapping ) {
-    Q_UNUSED( newMapping );
 
-    /*
-    for ( auto &newEvent : newMapping.keys() ) {
-        auto newValue = newMapping.value( newEvent ).toInt();
+    auto current = mMappingProgram.snapshot();
+    QList<QByteArray> fields = current ? current->mapping().split( ',' ) : QList<QByteArray>();
 
-        bool foundCollision = false;
-        for ( auto &oldEvent : sdlControllerMapping.keys() ) {
-            auto oldValue = sdlControllerMapping.value( oldEvent );
+    // The GUID and the name come first, the mapping string may be empty if nothing was found.
+    while( fields.size() < 2 ) {
+        fields.append( fields.isEmpty() ? qmlGuid.toUtf8() : name().toUtf8() );
+    }
 
-            // Override old value.
-            if ( newEvent == oldEvent) {
+    for( auto it = newMapping.constBegin(); it != newMapping.constEnd(); ++it ) {
 
-                foundCollision = true;
+        QByteArray element = it.key().toUtf8();
+        QByteArray source = it.value().toString().toUtf8();
+        bool replaced = false;
 
-                // button collisions will have to be noticed by the user for the time being.
-                // This is because the InputDeviceEvent is <QString, int> instead
-                // of <QString, QString>.
-                qDebug() << name() << newEvent << ":" << oldValue  << "==>" << newValue;
-                //sdlControllerMapping[ newEvent ] = newValue;
+        for( int i = 2; i < fields.size(); ++i ) {
+            if( fields[ i ].startsWith( element + ':' ) ) {
+                fields[ i ] = element + ':' + source;
+                replaced = true;
                 break;
             }
         }
 
-        if ( !foundCollision ) {
-            //sdlControllerMapping.insert( newEvent, newValue );
+        if( !replaced ) {
+            fields.append( element + ':' + source );
         }
 
     }
-    */
-
-}
-
-void Joystick::loadSDLMapping( SDL_GameController *device ) {
-
-    // Handle populating our own mappings, because SDL2 often uses the incorrect mapping array.
-
-    QString mappingString = SDL_GameControllerMapping( device );
-
-    auto strList = mappingString.split( "," );
 
-    for( QString &str : strList ) {
+    // Compiled here, on the caller's thread. Only this joystick gets the new program, others of the same kind
+    // keep sharing the old one.
+    auto remapped = std::make_shared<MappingProgram>();
+    remapped->compile( fields.join( ',' ) );
+    mMappingProgram.publish( remapped );
 
-        auto keyValuePair = str.split( ":" );
+    qCDebug( phxInput ) << name() << "remapped," << remapped->size() << "bindings";
 
-        if( keyValuePair.size() <= 1 ) {
-            continue;
-        }
-
-        auto key = keyValuePair.at( 0 );
-        auto value = keyValuePair.at( 1 );
-
-        if( value.isEmpty() ) {
-            qCWarning( phxInput ) << "The value for " << key << " is empty.";
-            continue;
-        }
-
-        if( key == "platform" ) {
-            continue;
-        }
-
-        auto prefix = value.at( 0 );
-        int numberValue = value.remove( prefix ).toInt();
-        auto byteArray = key.toLocal8Bit();
-
-        if( key == "leftx"
-            || key == "lefty"
-            || key == "rightx"
-            || key == "righty"
-            || key == "lefttrigger"
-            || key == "righttrigger" ) {
-            mSDLAxisVector[ SDL_GameControllerGetAxisFromString( byteArray.constData() ) ] = numberValue;
-        }
-
-        else {
-
-            if( prefix == 'a' ) {
-
-                qCWarning( phxInput ) << key
-                                      << " has an unhandled axis value. Report this to the Phoenix "
-                                      << " developers.";
-                continue;
-
-            }
+}
 
-            mSDLButtonVector[ SDL_GameControllerGetButtonFromString( byteArray.constData() ) ] = numberValue;
+void Joystick::loadSDLMapping() {
 
-        }
+    // Handle populating our own mappings, because SDL2 often uses the incorrect mapping array. The mapping is only
+    // compiled the first time a controller of this kind shows up.
+    auto program = MappingProgram::forDevice( qmlGuid, backend->mapping( device ).toUtf8() );
+    mMappingProgram.publish( program );
 
+    if( program->size() == 0 ) {
+        qCWarning( phxInput ) << "No usable mapping for" << name() << qmlGuid;
     }
 
 }
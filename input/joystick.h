@@ -6,6 +6,10 @@
 #include <QVector>
 
 #include "input/inputdevice.h"
+#include "input/joystickbackend.h"
+#include "input/mappingprogram.h"
+#include "input/mappingtable.h"
+#include "input/stickprocessor.h"
 #include "libretro.h"
 #include "SDL.h"
 #include "SDL_gamecontroller.h"
@@ -15,7 +19,9 @@ class Joystick : public InputDevice {
 
         static const int maxNumOfDevices;
 
-        explicit Joystick( const int joystickIndex, QObject *parent = 0 );
+        // Opens the device at joystickIndex through the backend, which must outlive the joystick. If that fails,
+        // sdlDevice() is null and the joystick is only good for deleting.
+        explicit Joystick( JoystickBackend *backend, const int joystickIndex, QObject *parent = 0 );
         ~Joystick();
 
         // Getters
@@ -27,13 +33,40 @@ class Joystick : public InputDevice {
         int sdlIndex() const;
         qreal deadZone() const;
         bool analogMode() const;
-        bool digitalTriggers() const;
-        quint8 getButtonState( const SDL_GameControllerButton &button );
 
-        qint16 getAxisState( const SDL_GameControllerAxis &axis );
+        // Game controller elements, as of the last update().
+        quint8 getButtonState( const SDL_GameControllerButton &button ) const;
+        qint16 getAxisState( const SDL_GameControllerAxis &axis ) const;
 
-        SDL_GameController *sdlDevice() const;
-        SDL_Joystick *sdlJoystick() const;
+        // Whether our mapping uses this raw joystick element. Raw SDL joystick events for anything else can be
+        // ignored.
+        bool bindsRawButton( const int button ) const;
+        bool bindsRawAxis( const int axis ) const;
+        bool bindsRawHat( const int hat ) const;
+
+        // Translate one game controller element to the RetroPad and write it to the device state. Nothing is
+        // written if the value didn't change. The sticks aren't written by updateAxis(), they go through a
+        // StickBatch first.
+        void updateButton( const SDL_GameControllerButton &button, const bool pressed );
+        void updateAxis( const SDL_GameControllerAxis &axis, const qint16 value );
+
+        // Read every raw element our mapping uses, evaluate the mapping and update the device state with it.
+        // batch is only scratch space for the sticks, it's cleared first.
+        void update( StickBatch &batch );
+
+        // update() in two halves, so the sticks of every device can be processed as one batch. evaluate() writes
+        // the buttons and triggers and adds both sticks to the batch, updateSticks() writes them once it's been
+        // processed. Call both inside one guard on mappingEpoch(), it keeps the settings in the batch alive.
+        void evaluate( StickBatch &batch );
+        void updateSticks( const StickBatch &batch );
+
+        // Dead zone, response curve and D-Pad threshold of both sticks. Takes effect on the next poll, any thread.
+        void setStickSettings( const StickSettings &settings );
+
+        // Whether the device is still plugged in.
+        bool attached() const;
+
+        JoystickBackend::Handle sdlDevice() const;
         SDL_JoystickID instanceID() const;
 
         QHash< QString, int > &sdlMapping();
@@ -49,17 +82,18 @@ class Joystick : public InputDevice {
         // to mimic the D-PAD.
         void setAnalogMode( const bool mode );
 
-        // calls SDL_GameControllerClose().
+        // Closes the device through the backend. Does nothing if it's already closed.
         void close();
 
         bool loadMapping() override;
         void saveMapping() override;
 
         void emitEditModeEvent( int event, int state );
-        void emitInputDeviceEvent( InputDeviceEvent::Event event, int state );
 
     public slots:
 
+        // Rebind game controller elements, like { "a": "b2", "lefttrigger": "a5" }, in SDL's mapping syntax. Takes
+        // effect on the next poll, even mid-game. An empty source unbinds the element.
         void setMapping( QVariantMap mapping ) override;
 
 
@@ -78,19 +112,38 @@ class Joystick : public InputDevice {
         bool qmlAnalogMode;
 
         // Normal variables
-        bool mDigitalTriggers;
 
-        // Store button and axis values;
-        QVector<int> mSDLButtonVector;
-        QVector<int> mSDLAxisVector;
+        // Our mapping, shared with every other joystick of the same kind until it's remapped. Swapped as a whole by
+        // setMapping() and a reset, read by the poll thread without locking.
+        MappingTable<MappingProgram> mMappingProgram;
 
-        SDL_GameController *device;
-        QHash<QString, int> sdlControllerMapping;
+        RawJoystickState mRawState;
+        MappedJoystickState mMappedState;
 
-        void loadSDLMapping( SDL_GameController *device );
+        // Swapped as a whole like the mapping, read by the poll thread without locking.
+        MappingTable<StickSettings> mStickSettings;
 
-        bool hasDigitalTriggers( const QString &guid );
+        // The left stick's lane in the batch being processed, -1 if it didn't fit.
+        int mStickLane;
+
+        // The physical D-PAD, one bit per direction starting at SDL_CONTROLLER_BUTTON_DPAD_UP. The left stick's
+        // direction, also StickProcessor::Direction bits, is merged into it when analogMode is off.
+        quint8 mDpadButtons;
+        quint8 mStickDpad;
+
+        void updateDpad();
+
+        // Insert if the state is different from the stored one.
+        void write( const InputDeviceEvent::Event &event, const int16_t state );
+
+        JoystickBackend *backend;
+        JoystickBackend::Handle device;
+        QHash<QString, int> sdlControllerMapping;
+
+        void loadSDLMapping();
 
 };
 
+Q_DECLARE_METATYPE( Joystick * )
+
 #endif // JOYSTICK_H
@@ -0,0 +1,161 @@
+#include "joystickbackend.h"
+
+// SDL_GameController handles are used as is, the joystick is one call away.
+
+static inline SDL_GameController *controller( JoystickBackend::Handle device ) {
+    return static_cast<SDL_GameController *>( device );
+}
+
+static inline SDL_Joystick *joystick( JoystickBackend::Handle device ) {
+    return SDL_GameControllerGetJoystick( controller( device ) );
+}
+
+bool SDLJoystickBackend::init() {
+
+    if( SDL_Init( SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER ) < 0 ) {
+        return false;
+    }
+
+    // Allow game controller event states to be automatically updated.
+    SDL_GameControllerEventState( SDL_ENABLE );
+
+    // The event driven mode is built on the raw joystick events.
+    SDL_JoystickEventState( SDL_ENABLE );
+
+    return true;
+
+}
+
+void SDLJoystickBackend::quit() {
+    SDL_Quit();
+}
+
+Uint32 SDLJoystickBackend::registerEvent() {
+    return SDL_RegisterEvents( 1 );
+}
+
+bool SDLJoystickBackend::pollEvent( SDL_Event *event ) {
+    return SDL_PollEvent( event );
+}
+
+// Only the video subsystem gives SDL something to block on. With just joysticks, this is SDL_PumpEvents() and
+// SDL_Delay( 1 ) until an event shows up or the timeout runs out.
+bool SDLJoystickBackend::waitEvent( const int timeout ) {
+    return SDL_WaitEventTimeout( nullptr, timeout );
+}
+
+void SDLJoystickBackend::pushEvent( SDL_Event *event ) {
+    SDL_PushEvent( event );
+}
+
+void SDLJoystickBackend::update() {
+    SDL_GameControllerUpdate();
+}
+
+QString SDLJoystickBackend::deviceGuid( const int index ) {
+
+    char guidStr[1024];
+    SDL_JoystickGUID guid = SDL_JoystickGetDeviceGUID( index );
+    SDL_JoystickGetGUIDString( guid, guidStr, sizeof( guidStr ) );
+
+    return guidStr;
+
+}
+
+// Older versions of SDL have no way to tell, the device is taken to be whatever is at the index.
+SDL_JoystickID SDLJoystickBackend::deviceInstanceID( const int index ) {
+
+#if SDL_VERSION_ATLEAST( 2, 0, 6 )
+    return SDL_JoystickGetDeviceInstanceID( index );
+#else
+    Q_UNUSED( index );
+    return -1;
+#endif
+
+}
+
+bool SDLJoystickBackend::isGameController( const int index ) {
+    return SDL_IsGameController( index ) == SDL_TRUE;
+}
+
+bool SDLJoystickBackend::addMapping( const QByteArray &mapping ) {
+    return SDL_GameControllerAddMapping( mapping.constData() ) != -1;
+}
+
+JoystickBackend::Handle SDLJoystickBackend::open( const int index ) {
+    return SDL_GameControllerOpen( index );
+}
+
+void SDLJoystickBackend::close( Handle device ) {
+    SDL_GameControllerClose( controller( device ) );
+}
+
+// SDL only locks its joystick list, so devices can be opened and closed while another thread polls, since 2.0.7.
+bool SDLJoystickBackend::canOpenConcurrently() {
+
+    SDL_version linked;
+    SDL_GetVersion( &linked );
+
+    return SDL_VERSIONNUM( linked.major, linked.minor, linked.patch ) >= SDL_VERSIONNUM( 2, 0, 7 );
+
+}
+
+bool SDLJoystickBackend::attached( Handle device ) {
+    return SDL_GameControllerGetAttached( controller( device ) ) == SDL_TRUE;
+}
+
+SDL_JoystickID SDLJoystickBackend::instanceID( Handle device ) {
+    return SDL_JoystickInstanceID( joystick( device ) );
+}
+
+QString SDLJoystickBackend::name( Handle device ) {
+    return SDL_GameControllerName( controller( device ) );
+}
+
+QString SDLJoystickBackend::guid( Handle device ) {
+
+    char guidStr[1024];
+    SDL_JoystickGUID guid = SDL_JoystickGetGUID( joystick( device ) );
+    SDL_JoystickGetGUIDString( guid, guidStr, sizeof( guidStr ) );
+
+    return guidStr;
+
+}
+
+QString SDLJoystickBackend::mapping( Handle device ) {
+
+    char *mappingString = SDL_GameControllerMapping( controller( device ) );
+    QString mapping = mappingString;
+    SDL_free( mappingString );
+
+    return mapping;
+
+}
+
+int SDLJoystickBackend::buttonCount( Handle device ) {
+    return SDL_JoystickNumButtons( joystick( device ) );
+}
+
+int SDLJoystickBackend::axisCount( Handle device ) {
+    return SDL_JoystickNumAxes( joystick( device ) );
+}
+
+int SDLJoystickBackend::hatCount( Handle device ) {
+    return SDL_JoystickNumHats( joystick( device ) );
+}
+
+int SDLJoystickBackend::ballCount( Handle device ) {
+    return SDL_JoystickNumBalls( joystick( device ) );
+}
+
+quint8 SDLJoystickBackend::button( Handle device, const int button ) {
+    return SDL_JoystickGetButton( joystick( device ), button );
+}
+
+qint16 SDLJoystickBackend::axis( Handle device, const int axis ) {
+    return SDL_JoystickGetAxis( joystick( device ), axis );
+}
+
+quint8 SDLJoystickBackend::hat( Handle device, const int hat ) {
+    return SDL_JoystickGetHat( joystick( device ), hat );
+}
@@ -0,0 +1,121 @@
+#ifndef JOYSTICKBACKEND_H
+#define JOYSTICKBACKEND_H
+
+#include <QByteArray>
+#include <QString>
+
+#include "SDL.h"
+
+// JoystickBackend is everything Joystick and SDLEventLoop need from SDL's joystick and game controller APIs. The
+// real implementation, SDLJoystickBackend, forwards straight to SDL. Other implementations stand in for SDL
+// where there is no hardware, see SimulatedJoystickBackend.
+
+// Devices are referred to by an opaque handle, which is whatever the implementation finds cheapest to look up.
+// Events are plain SDL_Events, so SDLEventLoop handles every backend the same way.
+
+class JoystickBackend {
+
+    public:
+
+        using Handle = void *;
+
+        virtual ~JoystickBackend() = default;
+
+        // Start up with no mappings but the backend's own. Returns false on failure.
+        virtual bool init() = 0;
+        virtual void quit() = 0;
+
+        // A new event type, for SDL_USEREVENT style events of our own.
+        virtual Uint32 registerEvent() = 0;
+
+        // Same as SDL_PollEvent(), SDL_WaitEventTimeout( nullptr, timeout ) and SDL_PushEvent().
+        virtual bool pollEvent( SDL_Event *event ) = 0;
+        virtual bool waitEvent( const int timeout ) = 0;
+        virtual void pushEvent( SDL_Event *event ) = 0;
+
+        // Refresh the state of every open device.
+        virtual void update() = 0;
+
+        // The GUID of the device at this index, the index from SDL_JOYDEVICEADDED, before it's opened.
+        virtual QString deviceGuid( const int index ) = 0;
+
+        // The instance ID of the device at this index before it's opened, -1 if there's none or it can't be told.
+        virtual SDL_JoystickID deviceInstanceID( const int index ) = 0;
+
+        // Whether the device at this index has a game controller mapping, same as SDL_IsGameController().
+        virtual bool isGameController( const int index ) = 0;
+
+        // Add one mapping, a line of a SDL_HINT_GAMECONTROLLERCONFIG style database. Returns false on failure.
+        virtual bool addMapping( const QByteArray &mapping ) = 0;
+
+        // Open the device at this index, the index from SDL_CONTROLLERDEVICEADDED. Returns nullptr on failure.
+        virtual Handle open( const int index ) = 0;
+        virtual void close( Handle device ) = 0;
+
+        // Whether open() and close() may run on another thread while this one polls for events.
+        virtual bool canOpenConcurrently() = 0;
+
+        virtual bool attached( Handle device ) = 0;
+        virtual SDL_JoystickID instanceID( Handle device ) = 0;
+        virtual QString name( Handle device ) = 0;
+        virtual QString guid( Handle device ) = 0;
+
+        // The device's mapping string, the same format as a mapping database line.
+        virtual QString mapping( Handle device ) = 0;
+
+        virtual int buttonCount( Handle device ) = 0;
+        virtual int axisCount( Handle device ) = 0;
+        virtual int hatCount( Handle device ) = 0;
+        virtual int ballCount( Handle device ) = 0;
+
+        // Raw joystick elements, not game controller ones.
+        virtual quint8 button( Handle device, const int button ) = 0;
+        virtual qint16 axis( Handle device, const int axis ) = 0;
+        virtual quint8 hat( Handle device, const int hat ) = 0;
+
+};
+
+// The real thing.
+class SDLJoystickBackend : public JoystickBackend {
+
+    public:
+
+        bool init() override;
+        void quit() override;
+
+        Uint32 registerEvent() override;
+
+        bool pollEvent( SDL_Event *event ) override;
+        bool waitEvent( const int timeout ) override;
+        void pushEvent( SDL_Event *event ) override;
+
+        void update() override;
+
+        QString deviceGuid( const int index ) override;
+        SDL_JoystickID deviceInstanceID( const int index ) override;
+        bool isGameController( const int index ) override;
+        bool addMapping( const QByteArray &mapping ) override;
+
+        Handle open( const int index ) override;
+        void close( Handle device ) override;
+
+        bool canOpenConcurrently() override;
+
+        bool attached( Handle device ) override;
+        SDL_JoystickID instanceID( Handle device ) override;
+        QString name( Handle device ) override;
+        QString guid( Handle device ) override;
+        QString mapping( Handle device ) override;
+
+        int buttonCount( Handle device ) override;
+        int axisCount( Handle device ) override;
+        int hatCount( Handle device ) override;
+        int ballCount( Handle device ) override;
+
+        quint8 button( Handle device, const int button ) override;
+        qint16 axis( Handle device, const int axis ) override;
+        quint8 hat( Handle device, const int hat ) override;
+
+};
+
+#endif // JOYSTICKBACKEND_H
@@ -1,48 +1,128 @@
 #include "keyboard.h"
 
+const int Keyboard::maxHeldKeys;
+
+KeyboardMapping::KeyboardMapping( const InputDeviceMapping &keys )
+    : keys( keys ) {
+
+    for( auto &event : events ) {
+        event = InputDeviceEvent::Unknown;
+    }
+
+    for( auto it = keys.constBegin(); it != keys.constEnd(); ++it ) {
+
+        unsigned key = KeyboardState::fromQtKey( it.key(), Qt::NoModifier );
+
+        if( key != RETROK_UNKNOWN && key < static_cast<unsigned>( InputKeyboardState::keyCount ) ) {
+            events[ key ] = it.value();
+        }
+
+    }
+
+}
+
 Keyboard::Keyboard( QObject *parent )
-    : InputDevice( LibretroType::DigitalGamepad, "Keyboard", parent ) {
+    : InputDevice( LibretroType::DigitalGamepad, "Keyboard", parent ),
+      heldKeyCount( 0 ) {
+
+    publishMapping( InputDeviceMapping() );
 
     connect( this, &Keyboard::resetMappingChanged, this, [ this ] {
 
         if( resetMapping() ) {
-            mapping().clear();
-            loadDefaultMapping();
+            publishMapping( defaultMapping() );
         }
 
     } );
 
 }
 
-void Keyboard::loadDefaultMapping() {
-
-    mapping().insert( Qt::Key_A, InputDeviceEvent::A );
-    mapping().insert( Qt::Key_D, InputDeviceEvent::B );
-    mapping().insert( Qt::Key_W, InputDeviceEvent::Y );
-    mapping().insert( Qt::Key_S, InputDeviceEvent::X );
-    mapping().insert( Qt::Key_Up , InputDeviceEvent::Up );
-    mapping().insert( Qt::Key_Down, InputDeviceEvent::Down );
-    mapping().insert( Qt::Key_Right, InputDeviceEvent::Right );
-    mapping().insert( Qt::Key_Left, InputDeviceEvent::Left );
-    mapping().insert( Qt::Key_Space, InputDeviceEvent::Select );
-    mapping().insert( Qt::Key_Return, InputDeviceEvent::Start );
-    mapping().insert( Qt::Key_Z, InputDeviceEvent::L );
-    mapping().insert( Qt::Key_X, InputDeviceEvent::R );
-    mapping().insert( Qt::Key_P, InputDeviceEvent::L2 );
-    mapping().insert( Qt::Key_Shift, InputDeviceEvent::R2 );
-    mapping().insert( Qt::Key_N, InputDeviceEvent::L3 );
-    mapping().insert( Qt::Key_M, InputDeviceEvent::R3 );
+InputDeviceMapping Keyboard::defaultMapping() const {
+
+    InputDeviceMapping mapping;
+
+    mapping.insert( Qt::Key_A, InputDeviceEvent::A );
+    mapping.insert( Qt::Key_D, InputDeviceEvent::B );
+    mapping.insert( Qt::Key_W, InputDeviceEvent::Y );
+    mapping.insert( Qt::Key_S, InputDeviceEvent::X );
+    mapping.insert( Qt::Key_Up , InputDeviceEvent::Up );
+    mapping.insert( Qt::Key_Down, InputDeviceEvent::Down );
+    mapping.insert( Qt::Key_Right, InputDeviceEvent::Right );
+    mapping.insert( Qt::Key_Left, InputDeviceEvent::Left );
+    mapping.insert( Qt::Key_Space, InputDeviceEvent::Select );
+    mapping.insert( Qt::Key_Return, InputDeviceEvent::Start );
+    mapping.insert( Qt::Key_Z, InputDeviceEvent::L );
+    mapping.insert( Qt::Key_X, InputDeviceEvent::R );
+    mapping.insert( Qt::Key_P, InputDeviceEvent::L2 );
+    mapping.insert( Qt::Key_Shift, InputDeviceEvent::R2 );
+    mapping.insert( Qt::Key_N, InputDeviceEvent::L3 );
+    mapping.insert( Qt::Key_M, InputDeviceEvent::R3 );
+
+    return mapping;
+
+}
 
+void Keyboard::insert( QKeyEvent *event ) {
+    keyEvent( event->key(), event->type() == QEvent::KeyPress, event->text(), static_cast<int>( event->modifiers() ),
+              event->nativeScanCode() );
 }
 
-void Keyboard::insert( const int &event, int16_t pressed ) {
+void Keyboard::keyEvent( const int key, const bool pressed, const QString &text, const int modifiers,
+                         const quint32 scanCode ) {
 
     if( editMode() ) {
-        emit editModeEvent( event, pressed );
+        emit editModeEvent( key, pressed );
+        return;
+    }
+
+    unsigned retroKey = KeyboardState::fromQtKey( key, modifiers );
+
+    // Repeats and the release are of the key as it went down.
+    int held = 0;
+
+    while( held < heldKeyCount && ( scanCode == 0 || heldKeys[ held ].scanCode != scanCode ) ) {
+        held++;
+    }
+
+    if( held < heldKeyCount ) {
+
+        retroKey = heldKeys[ held ].retroKey;
+
+        if( !pressed ) {
+            heldKeys[ held ] = heldKeys[ --heldKeyCount ];
+        }
+
+    } else if( pressed && scanCode != 0 && retroKey != RETROK_UNKNOWN && heldKeyCount < maxHeldKeys ) {
+        heldKeys[ heldKeyCount ].scanCode = scanCode;
+        heldKeys[ heldKeyCount ].retroKey = retroKey;
+        heldKeyCount++;
+    }
+
+    bool changed = keys.set( retroKey, pressed );
+    keys.setModifiers( KeyboardState::fromQtModifiers( modifiers ) );
+
+    if( changed || pressed ) {
+
+        KeyboardState::KeyEvent event;
+        event.down = pressed;
+        event.keycode = retroKey;
+        event.character = text.isEmpty() ? 0 : text.toUcs4().value( 0 );
+        event.modifiers = keys.modifiers();
+
+        keys.queue( event );
+
+    }
+
+    if( !changed ) {
         return;
     }
 
-    InputDeviceEvent::Event newEvent = mapping().value( event, InputDeviceEvent::Unknown );
+    InputDeviceEvent::Event newEvent;
+
+    {
+        InputEpoch::Guard guard( mappingEpoch() );
+        newEvent = deviceMapping.get()->events[ retroKey ];
+    }
 
     if( newEvent != InputDeviceEvent::Unknown ) {
         InputDevice::insert( newEvent, pressed );
@@ -50,40 +130,96 @@ void Keyboard::insert( const int &event, int16_t pressed ) {
 
 }
 
-InputDeviceMapping &Keyboard::mapping() {
-    return deviceMapping;
+void Keyboard::releaseKeys() {
+
+    // The core's callback hears of the releases too, or it would think the keys are still held.
+    for( int key = 0; key < InputKeyboardState::keyCount; ++key ) {
+
+        if( !keys.isDown( static_cast<unsigned>( key ) ) ) {
+            continue;
+        }
+
+        KeyboardState::KeyEvent event;
+        event.down = false;
+        event.keycode = static_cast<unsigned>( key );
+        event.character = 0;
+        event.modifiers = 0;
+
+        keys.queue( event );
+
+    }
+
+    keys.clear();
+    heldKeyCount = 0;
+
+    updateRetroPad();
+
+}
+
+InputDeviceMapping Keyboard::mapping() const {
+    InputEpoch::Guard guard( mappingEpoch() );
+    return deviceMapping.get()->keys;
 }
 
-void Keyboard::setMapping( const QVariantMap newMapping ) {
-    Q_UNUSED( newMapping );
+KeyboardState &Keyboard::keyState() {
+    return keys;
+}
+
+void Keyboard::publishMapping( const InputDeviceMapping &mapping ) {
+    deviceMapping.publish( std::make_shared<KeyboardMapping>( mapping ) );
+    updateRetroPad();
+}
+
+void Keyboard::updateRetroPad() {
+
+    bool held[ InputDeviceEvent::Unknown ] = {};
+    auto table = deviceMapping.snapshot();
+
+    for( int key = 0; key < InputKeyboardState::keyCount; ++key ) {
+
+        auto event = table->events[ key ];
+
+        if( event != InputDeviceEvent::Unknown && keys.isDown( static_cast<unsigned>( key ) ) ) {
+            held[ event ] = true;
+        }
+
+    }
+
+    for( int i = 0; i < InputDeviceEvent::Unknown; ++i ) {
 
-    /*
-    for ( auto &newKey : newMapping.keys() ) {
-        auto newValue = newMapping.value( newKey ).toInt();
+        auto event = static_cast<InputDeviceEvent::Event>( i );
 
-        bool foundCollision = false;
-        for ( auto &oldKey : mapping().keys() ) {
-            auto oldValue = InputDeviceEvent::toString( mapping().value( oldKey ) );
+        if( ( value( event ) != 0 ) != held[ i ] ) {
+            InputDevice::insert( event, held[ i ] );
+        }
 
+    }
 
-            if ( oldValue == newKey ) {
-                foundCollision = true;
-                qDebug() << name() << oldValue  << newKey  << ":" << oldKey << "==>" << QString::number( newValue );
+}
 
-                mapping().remove( oldKey );
-                mapping().insert( QString::number( newValue ), InputDeviceEvent::toEvent( newKey ) );
-                break;
-            }
+void Keyboard::setMapping( const QVariantMap newMapping ) {
+
+    InputDeviceMapping mapping = deviceMapping.snapshot()->keys;
+
+    for( auto it = newMapping.constBegin(); it != newMapping.constEnd(); ++it ) {
+
+        auto event = InputDeviceEvent::toEvent( it.key() );
+
+        if( event == InputDeviceEvent::Unknown ) {
+            qCWarning( phxInput ) << "Unknown event" << it.key() << "in keyboard mapping, skipped";
+            continue;
         }
 
-        if ( !foundCollision ) {
-            qDebug() << "no collision " << QString::number( newValue ) << mapping()[ newV ];
-            mapping().insert( QString::number( newValue ), InputDeviceEvent::toEvent( newKey )  );
+        // One key per event.
+        for( auto &key : mapping.keys( event ) ) {
+            mapping.remove( key );
         }
 
+        mapping.insert( it.value().toInt(), event );
+
     }
-    */
-    // To do...
+
+    publishMapping( mapping );
 
 }
 
@@ -97,6 +233,8 @@ bool Keyboard::loadMapping() {
 
     settings.beginGroup( name() );
 
+    InputDeviceMapping mapping = deviceMapping.snapshot()->keys;
+
     for( int i = 0; i < InputDeviceEvent::Unknown; ++i ) {
 
         auto event = static_cast<InputDeviceEvent::Event>( i );
@@ -105,12 +243,14 @@ bool Keyboard::loadMapping() {
         auto key = settings.value( eventString );
 
         if( key.isValid() ) {
-            mapping().insert( key.toInt(), event );
+            mapping.insert( key.toInt(), event );
         }
 
     }
 
-    return !mapping().isEmpty();
+    publishMapping( mapping );
+
+    return !mapping.isEmpty();
 
 }
 
@@ -119,8 +259,10 @@ void Keyboard::saveMapping() {
     QSettings settings;
     settings.beginGroup( name() );
 
-    for( auto &key : mapping().keys() ) {
-        auto value = mapping().value( key );
+    auto mapping = deviceMapping.snapshot()->keys;
+
+    for( auto &key : mapping.keys() ) {
+        auto value = mapping.value( key );
         settings.setValue( InputDeviceEvent::toString( value ), key );
     }
 
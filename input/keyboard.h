@@ -1,16 +1,34 @@
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
+#include <QKeyEvent>
+
 #include "inputdevice.h"
 #include "inputdeviceevent.h"
+#include "keyboardstate.h"
+#include "mappingtable.h"
 
 // This class represents one Qt keyboard.
 // This class connects to the the window's keyPressEvent()
 // and keyReleaseEvent() functions, to handle incoming key values
 // and turn the into valid RETRO_PAD button.
 
+// Every key lands in a KeyboardState first, which is what a core sees as RETRO_DEVICE_KEYBOARD. The RetroPad is a
+// view over it: a key's mapped button is held for as long as the key is.
+
 using InputDeviceMapping = QHash< int, InputDeviceEvent::Event >;
 
+// A keyboard mapping as published: the Qt key to event hash it's saved as, and the same thing indexed by RETROK_
+// code for the key event path.
+struct KeyboardMapping {
+
+    explicit KeyboardMapping( const InputDeviceMapping &keys );
+
+    InputDeviceMapping keys;
+    InputDeviceEvent::Event events[ InputKeyboardState::keyCount ];
+
+};
+
 class Keyboard : public InputDevice {
         Q_OBJECT
 
@@ -22,21 +40,59 @@ class Keyboard : public InputDevice {
 
         explicit Keyboard( QObject *parent = 0 );
 
-        InputDeviceMapping &mapping();
+        // A copy of the current mapping, Qt key to event.
+        InputDeviceMapping mapping() const;
 
         bool loadMapping() override;
         void saveMapping() override;
 
+        // The keyboard as libretro sees it. Read from any thread.
+        KeyboardState &keyState();
+
     public slots:
 
-        void insert( const int &event, int16_t pressed );
+        // A press, release or repeat straight from the window's keyPressEvent() or keyReleaseEvent(), passed on to
+        // keyEvent() with its scan code and text.
+        void insert( QKeyEvent *event );
+
+        // A key event with everything a core's keyboard callback wants: the Qt key, the text it typed and
+        // Qt::KeyboardModifiers. The scan code is QKeyEvent::nativeScanCode(), 0 if there's none, and tells which
+        // physical key it was. Auto-repeats are passed on to the callback, but don't change any state.
+        void keyEvent( const int key, const bool pressed, const QString &text, const int modifiers,
+                       const quint32 scanCode = 0 );
+
+        // Release every key, for when the window loses focus and the releases would go to another one.
+        void releaseKeys();
+
+        // Rebind events to keys, like { "a": Qt::Key_J }. Whatever key the event was on before is freed. Safe while a
+        // game is running.
         void setMapping( const QVariantMap mapping ) override;
 
     private:
 
-        void loadDefaultMapping();
+        InputDeviceMapping defaultMapping() const;
+
+        // Never edited in place, every change publishes a new table.
+        MappingTable<KeyboardMapping> deviceMapping;
+
+        KeyboardState keys;
+
+        // Physical keys held down, with the libretro key each went down as. That's the one released, whatever the
+        // modifiers turned the key into since: Shift+1 goes down as '!' but may come up as '1'. GUI thread only.
+        static const int maxHeldKeys = 32;
+
+        struct HeldKey {
+            quint32 scanCode;
+            unsigned retroKey;
+        };
+
+        HeldKey heldKeys[ maxHeldKeys ];
+        int heldKeyCount;
+
+        void publishMapping( const InputDeviceMapping &mapping );
 
-        InputDeviceMapping deviceMapping;
+        // Set every RetroPad button from the keys, after the mapping changed.
+        void updateRetroPad();
 
 };
 
@@ -0,0 +1,235 @@
+#include "keyboardstate.h"
+
+#include <QKeyEvent>
+
+const int KeyboardState::queueSize;
+
+namespace {
+
+    // Qt's special keys are Qt::Key_Escape (0x01000000) onwards. The ones libretro knows all sit below
+    // 0x01000100, so the low byte indexes them.
+    const int specialBase = Qt::Key_Escape;
+    const int tableSize = 256;
+
+    struct KeyTables {
+        quint16 latin[ tableSize ];
+        quint16 special[ tableSize ];
+
+        KeyTables() {
+
+            for( int i = 0; i < tableSize; ++i ) {
+                latin[ i ] = RETROK_UNKNOWN;
+                special[ i ] = RETROK_UNKNOWN;
+            }
+
+            // Printable ASCII has the same codes in both, except that libretro's letters are lowercase.
+            for( int i = Qt::Key_Space; i <= Qt::Key_AsciiTilde; ++i ) {
+                latin[ i ] = static_cast<quint16>( i >= Qt::Key_A && i <= Qt::Key_Z ? i - Qt::Key_A + RETROK_a : i );
+            }
+
+            const struct {
+                int qt;
+                unsigned retro;
+            } specials[] = {
+                { Qt::Key_Escape, RETROK_ESCAPE },
+                { Qt::Key_Tab, RETROK_TAB },
+                { Qt::Key_Backtab, RETROK_TAB },
+                { Qt::Key_Backspace, RETROK_BACKSPACE },
+                { Qt::Key_Return, RETROK_RETURN },
+                { Qt::Key_Enter, RETROK_KP_ENTER },
+                { Qt::Key_Insert, RETROK_INSERT },
+                { Qt::Key_Delete, RETROK_DELETE },
+                { Qt::Key_Pause, RETROK_PAUSE },
+                { Qt::Key_Print, RETROK_PRINT },
+                { Qt::Key_SysReq, RETROK_SYSREQ },
+                { Qt::Key_Clear, RETROK_CLEAR },
+                { Qt::Key_Home, RETROK_HOME },
+                { Qt::Key_End, RETROK_END },
+                { Qt::Key_Left, RETROK_LEFT },
+                { Qt::Key_Up, RETROK_UP },
+                { Qt::Key_Right, RETROK_RIGHT },
+                { Qt::Key_Down, RETROK_DOWN },
+                { Qt::Key_PageUp, RETROK_PAGEUP },
+                { Qt::Key_PageDown, RETROK_PAGEDOWN },
+                { Qt::Key_Shift, RETROK_LSHIFT },
+                { Qt::Key_Control, RETROK_LCTRL },
+                { Qt::Key_Meta, RETROK_LMETA },
+                { Qt::Key_Alt, RETROK_LALT },
+                { Qt::Key_CapsLock, RETROK_CAPSLOCK },
+                { Qt::Key_NumLock, RETROK_NUMLOCK },
+                { Qt::Key_ScrollLock, RETROK_SCROLLOCK },
+                { Qt::Key_Super_L, RETROK_LSUPER },
+                { Qt::Key_Super_R, RETROK_RSUPER },
+                { Qt::Key_Menu, RETROK_MENU },
+                { Qt::Key_Help, RETROK_HELP },
+            };
+
+            for( auto &key : specials ) {
+                special[ key.qt - specialBase ] = static_cast<quint16>( key.retro );
+            }
+
+            // F1 - F15 are consecutive in both.
+            for( int i = 0; i < 15; ++i ) {
+                special[ Qt::Key_F1 - specialBase + i ] = static_cast<quint16>( RETROK_F1 + i );
+            }
+
+        }
+    };
+
+    const KeyTables &keyTables() {
+        static const KeyTables tables;
+        return tables;
+    }
+
+}
+
+KeyboardState::KeyboardState()
+    : heldModifiers( 0 ),
+      queued( 0 ),
+      taken( 0 ) {
+
+    for( auto &word : keys ) {
+        word.store( 0, std::memory_order_relaxed );
+    }
+
+    // Built here, so the first key press doesn't.
+    keyTables();
+
+}
+
+bool KeyboardState::set( const unsigned key, const bool down ) {
+
+    if( key == RETROK_UNKNOWN || key >= static_cast<unsigned>( InputKeyboardState::keyCount ) ) {
+        return false;
+    }
+
+    quint64 bit = Q_UINT64_C( 1 ) << ( key % 64 );
+    auto &word = keys[ key / 64 ];
+
+    quint64 before = down ? word.fetch_or( bit, std::memory_order_relaxed )
+                     : word.fetch_and( ~bit, std::memory_order_relaxed );
+
+    return ( ( before & bit ) != 0 ) != down;
+
+}
+
+bool KeyboardState::isDown( const unsigned key ) const {
+    return key < static_cast<unsigned>( InputKeyboardState::keyCount )
+           && ( keys[ key / 64 ].load( std::memory_order_relaxed ) >> ( key % 64 ) ) & 1;
+}
+
+void KeyboardState::setModifiers( const quint16 modifiers ) {
+    heldModifiers.store( modifiers, std::memory_order_relaxed );
+}
+
+quint16 KeyboardState::modifiers() const {
+    return heldModifiers.load( std::memory_order_relaxed );
+}
+
+void KeyboardState::clear() {
+
+    for( auto &word : keys ) {
+        word.store( 0, std::memory_order_relaxed );
+    }
+
+    heldModifiers.store( 0, std::memory_order_relaxed );
+
+}
+
+void KeyboardState::copyTo( InputKeyboardState &state ) const {
+
+    for( int i = 0; i < InputKeyboardState::wordCount; ++i ) {
+        state.keys[ i ] = keys[ i ].load( std::memory_order_relaxed );
+    }
+
+    state.modifiers = heldModifiers.load( std::memory_order_relaxed );
+
+}
+
+bool KeyboardState::queue( const KeyEvent &event ) {
+
+    quint32 head = queued.load( std::memory_order_relaxed );
+
+    if( head - taken.load( std::memory_order_acquire ) >= static_cast<quint32>( queueSize ) ) {
+        return false;
+    }
+
+    events[ head % queueSize ] = event;
+    queued.store( head + 1, std::memory_order_release );
+
+    return true;
+
+}
+
+bool KeyboardState::take( KeyEvent &event ) {
+
+    quint32 tail = taken.load( std::memory_order_relaxed );
+
+    if( tail == queued.load( std::memory_order_acquire ) ) {
+        return false;
+    }
+
+    event = events[ tail % queueSize ];
+    taken.store( tail + 1, std::memory_order_release );
+
+    return true;
+
+}
+
+unsigned KeyboardState::fromQtKey( const int key, const int qtModifiers ) {
+
+    if( qtModifiers & Qt::KeypadModifier ) {
+
+        if( key >= Qt::Key_0 && key <= Qt::Key_9 ) {
+            return RETROK_KP0 + ( key - Qt::Key_0 );
+        }
+
+        switch( key ) {
+            case Qt::Key_Period:
+                return RETROK_KP_PERIOD;
+
+            case Qt::Key_Slash:
+                return RETROK_KP_DIVIDE;
+
+            case Qt::Key_Asterisk:
+                return RETROK_KP_MULTIPLY;
+
+            case Qt::Key_Minus:
+                return RETROK_KP_MINUS;
+
+            case Qt::Key_Plus:
+                return RETROK_KP_PLUS;
+
+            case Qt::Key_Equal:
+                return RETROK_KP_EQUALS;
+
+            default:
+                break;
+        }
+
+    }
+
+    if( key >= 0 && key < tableSize ) {
+        return keyTables().latin[ key ];
+    }
+
+    if( key >= specialBase && key < specialBase + tableSize ) {
+        return keyTables().special[ key - specialBase ];
+    }
+
+    return RETROK_UNKNOWN;
+
+}
+
+quint16 KeyboardState::fromQtModifiers( const int qtModifiers ) {
+
+    quint16 modifiers = 0;
+
+    modifiers |= ( qtModifiers & Qt::ShiftModifier ) ? RETROKMOD_SHIFT : 0;
+    modifiers |= ( qtModifiers & Qt::ControlModifier ) ? RETROKMOD_CTRL : 0;
+    modifiers |= ( qtModifiers & Qt::AltModifier ) ? RETROKMOD_ALT : 0;
+    modifiers |= ( qtModifiers & Qt::MetaModifier ) ? RETROKMOD_META : 0;
+
+    return modifiers;
+
+}
@@ -0,0 +1,76 @@
+#ifndef KEYBOARDSTATE_H
+#define KEYBOARDSTATE_H
+
+#include <QtGlobal>
+
+#include "inputsnapshot.h"
+#include "libretro.h"
+
+#include <atomic>
+
+// KeyboardState is the live state of the keyboard in libretro's terms: a bitmap with one bit per RETROK_ code,
+// the RETROKMOD_ modifiers, and the key events a core's retro_keyboard_callback hasn't been given yet.
+
+// Keys are set by the thread that gets Qt's key events and read by anyone, without locking: a key is looked up
+// with one shift, and the whole bitmap is copied into every snapshot. Qt keys are translated through two flat
+// tables, one for Latin-1 keys and one for Qt's special keys, so there's no hashing on the way either.
+
+// The event queue is a fixed ring with one producer, the thread setting keys, and one consumer, the core thread.
+// When it's full, new events are dropped: a core that never registered a callback never empties it.
+
+class KeyboardState {
+
+    public:
+
+        struct KeyEvent {
+            bool down;
+            unsigned keycode;
+            quint32 character;
+            quint16 modifiers;
+        };
+
+        static const int queueSize = 64;
+
+        KeyboardState();
+
+        // Returns true if the key changed. RETROK_UNKNOWN and keys past RETROK_LAST are ignored.
+        bool set( const unsigned key, const bool down );
+        bool isDown( const unsigned key ) const;
+
+        void setModifiers( const quint16 modifiers );
+        quint16 modifiers() const;
+
+        // Release every key, for when the window loses focus and the releases would go missing.
+        void clear();
+
+        void copyTo( InputKeyboardState &state ) const;
+
+        // Producer: returns false if the queue is full.
+        bool queue( const KeyEvent &event );
+
+        // Consumer: returns false if there's nothing queued.
+        bool take( KeyEvent &event );
+
+        // RETROK_UNKNOWN if the key has no libretro code. Digits and operators with Qt::KeypadModifier set are
+        // the keypad's.
+        static unsigned fromQtKey( const int key, const int qtModifiers );
+
+        // Qt::KeyboardModifiers to RETROKMOD_ flags.
+        static quint16 fromQtModifiers( const int qtModifiers );
+
+    private:
+
+        std::atomic<quint64> keys[ InputKeyboardState::wordCount ];
+        std::atomic<quint16> heldModifiers;
+
+        KeyEvent events[ queueSize ];
+
+        // Only ever incremented, the slot is the count modulo queueSize.
+        std::atomic<quint32> queued;
+        std::atomic<quint32> taken;
+
+        Q_DISABLE_COPY( KeyboardState )
+
+};
+
+#endif // KEYBOARDSTATE_H
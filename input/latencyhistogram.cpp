@@ -0,0 +1,93 @@
+#include "latencyhistogram.h"
+
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+quint64 LatencyHistogram::count() const {
+    return total.load( std::memory_order_relaxed );
+}
+
+qint64 LatencyHistogram::percentile( const qreal fraction ) const {
+
+    quint64 samples = count();
+
+    if( samples == 0 ) {
+        return 0;
+    }
+
+    auto target = static_cast<quint64>( std::ceil( qBound<qreal>( 0.0, fraction, 1.0 ) * samples ) );
+    quint64 seen = 0;
+
+    for( int i = 0; i < bucketCount; ++i ) {
+
+        seen += buckets[ i ].load( std::memory_order_relaxed );
+
+        if( seen >= target && seen > 0 ) {
+            return qMin( upperEdge( i ), max() );
+        }
+
+    }
+
+    return max();
+
+}
+
+qint64 LatencyHistogram::max() const {
+    return maximum.load( std::memory_order_relaxed );
+}
+
+void LatencyHistogram::merge( const LatencyHistogram &other ) {
+
+    for( int i = 0; i < bucketCount; ++i ) {
+        buckets[ i ].fetch_add( other.buckets[ i ].load( std::memory_order_relaxed ), std::memory_order_relaxed );
+    }
+
+    total.fetch_add( other.count(), std::memory_order_relaxed );
+
+    if( other.max() > max() ) {
+        maximum.store( other.max(), std::memory_order_relaxed );
+    }
+
+}
+
+void LatencyHistogram::reset() {
+
+    for( auto &bucket : buckets ) {
+        bucket.store( 0, std::memory_order_relaxed );
+    }
+
+    total.store( 0, std::memory_order_relaxed );
+    maximum.store( 0, std::memory_order_relaxed );
+
+}
+
+QString LatencyHistogram::summary() const {
+
+    if( count() == 0 ) {
+        return QStringLiteral( "no samples" );
+    }
+
+    return QStringLiteral( "p50 %1 ms, p99 %2 ms, max %3 ms (%4 samples)" )
+           .arg( percentile( 0.50 ) / 1000.0, 0, 'f', 2 )
+           .arg( percentile( 0.99 ) / 1000.0, 0, 'f', 2 )
+           .arg( max() / 1000.0, 0, 'f', 2 )
+           .arg( count() );
+
+}
+
+qint64 LatencyHistogram::upperEdge( const int bucket ) {
+
+    if( bucket < 16 ) {
+        return bucket;
+    }
+
+    int exponent = ( bucket - 16 ) / 4 + 4;
+    int subBucket = ( bucket - 16 ) % 4;
+    qint64 width = Q_INT64_C( 1 ) << ( exponent - 2 );
+
+    return ( 4 + subBucket ) * width + width - 1;
+
+}
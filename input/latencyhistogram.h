@@ -0,0 +1,79 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include <atomic>
+
+// LatencyHistogram counts latencies into fixed, roughly logarithmic buckets: one per microsecond below 16 us,
+// then four per power of two, up to about 17 minutes. Buckets are never more than 25% wide, which is plenty to
+// tell a 1 ms p99 from a 4 ms one.
+
+// record() is a couple of relaxed atomic adds. It never allocates and never locks, so it's safe to call from the
+// poll thread or the core thread in the middle of a frame. Any thread may read the percentiles at any time.
+
+class LatencyHistogram {
+
+    public:
+
+        static const int bucketCount = 16 + ( 30 - 4 + 1 ) * 4;
+
+        LatencyHistogram();
+
+        void record( const qint64 nanoseconds ) {
+            qint64 usec = qMax<qint64>( nanoseconds, 0 ) / 1000;
+
+            buckets[ bucketFor( usec ) ].fetch_add( 1, std::memory_order_relaxed );
+            total.fetch_add( 1, std::memory_order_relaxed );
+
+            qint64 previousMax = maximum.load( std::memory_order_relaxed );
+
+            while( usec > previousMax
+                   && !maximum.compare_exchange_weak( previousMax, usec, std::memory_order_relaxed ) ) {
+            }
+        }
+
+        quint64 count() const;
+
+        // In microseconds. The percentile is the upper edge of the bucket it falls in.
+        qint64 percentile( const qreal fraction ) const;
+        qint64 max() const;
+
+        // Add another histogram's counts to this one.
+        void merge( const LatencyHistogram &other );
+
+        void reset();
+
+        // "p50 0.42 ms, p99 1.10 ms, max 3.02 ms (1234 samples)"
+        QString summary() const;
+
+    private:
+
+        std::atomic<quint32> buckets[ bucketCount ];
+        std::atomic<quint64> total;
+        std::atomic<qint64> maximum;
+
+        static int bucketFor( qint64 usec ) {
+            if( usec < 16 ) {
+                return static_cast<int>( usec );
+            }
+
+            int exponent = 63 - __builtin_clzll( static_cast<quint64>( usec ) );
+
+            if( exponent > 30 ) {
+                return bucketCount - 1;
+            }
+
+            int subBucket = static_cast<int>( usec >> ( exponent - 2 ) ) & 0x3;
+
+            return 16 + ( exponent - 4 ) * 4 + subBucket;
+        }
+
+        static qint64 upperEdge( const int bucket );
+
+        Q_DISABLE_COPY( LatencyHistogram )
+
+};
+
+#endif // LATENCYHISTOGRAM_H
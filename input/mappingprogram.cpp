@@ -0,0 +1,307 @@
+#include "mappingprogram.h"
+
+#include "logging.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <cstring>
+
+const int MappingProgram::maxBindings;
+const int MappingProgram::pressThreshold;
+
+// Parse the digits at text, up to end. Returns the position after them, or nullptr if there were none.
+static const char *parseNumber( const char *text, const char *end, int &number ) {
+
+    number = 0;
+    const char *start = text;
+
+    while( text < end && *text >= '0' && *text <= '9' && number < 256 ) {
+        number = number * 10 + ( *text++ - '0' );
+    }
+
+    return text > start ? text : nullptr;
+
+}
+
+MappingProgram::MappingProgram()
+    : bindingCount( 0 ),
+      usedButtons( 0 ),
+      usedAxes( 0 ),
+      usedHats( 0 ) {
+
+}
+
+void MappingProgram::compile( const QByteArray &mapping ) {
+
+    bindingCount = 0;
+    usedButtons = 0;
+    usedAxes = 0;
+    usedHats = 0;
+    source = mapping;
+
+    const char *field = mapping.constData();
+    const char *end = field + mapping.size();
+
+    // The first two fields are the GUID and the name.
+    for( int skip = 0; skip < 2 && field < end; ++skip ) {
+        auto *comma = static_cast<const char *>( std::memchr( field, ',', end - field ) );
+        field = comma ? comma + 1 : end;
+    }
+
+    while( field < end ) {
+
+        auto *comma = static_cast<const char *>( std::memchr( field, ',', end - field ) );
+        auto *fieldEnd = comma ? comma : end;
+
+        Binding binding;
+
+        if( bindingCount < maxBindings && parseBinding( field, static_cast<int>( fieldEnd - field ), binding ) ) {
+
+            bindings[ bindingCount++ ] = binding;
+
+            switch( binding.source ) {
+                case SourceButton:
+                    usedButtons |= Q_UINT64_C( 1 ) << binding.index;
+                    break;
+
+                case SourceAxis:
+                    usedAxes |= 1u << binding.index;
+                    break;
+
+                case SourceHat:
+                    usedHats |= 1u << binding.index;
+                    break;
+            }
+
+        }
+
+        field = fieldEnd + 1;
+
+    }
+
+}
+
+void MappingProgram::evaluate( const RawJoystickState &raw, MappedJoystickState &mapped ) const {
+
+    mapped.buttons = 0;
+
+    for( auto &axis : mapped.axes ) {
+        axis = 0;
+    }
+
+    for( int i = 0; i < bindingCount; ++i ) {
+
+        const Binding &binding = bindings[ i ];
+        int value;
+
+        // Every source becomes an axis value first, digital ones are either 0 or all the way.
+        switch( binding.source ) {
+            case SourceButton:
+                value = raw.buttons[ binding.index ] ? 32767 : 0;
+                break;
+
+            case SourceHat:
+                value = ( raw.hats[ binding.index ] & binding.hatMask ) ? 32767 : 0;
+                break;
+
+            default:
+                value = raw.axes[ binding.index ];
+                value = binding.invert ? -value - 1 : value;
+
+                // Halves are folded to 0 - 32767.
+                if( binding.sourceRange == Positive ) {
+                    value = qMax( value, 0 );
+                } else if( binding.sourceRange == Negative ) {
+                    value = value < 0 ? -( value + 1 ) : 0;
+                }
+
+                break;
+        }
+
+        if( binding.target == TargetButton ) {
+            mapped.buttons |= static_cast<quint32>( value > pressThreshold ) << binding.element;
+            continue;
+        }
+
+        if( binding.targetRange == Positive ) {
+            value = qMax( value, 0 );
+        } else if( binding.targetRange == Negative ) {
+            value = -qMax( value, 0 );
+        }
+
+        // With several bindings on one axis, like a D-Pad on "-leftx" and "+leftx", the one in use wins.
+        if( value != 0 ) {
+            mapped.axes[ binding.element ] = static_cast<qint16>( value );
+        }
+
+    }
+
+}
+
+bool MappingProgram::bindsButton( const int button ) const {
+    return button >= 0 && button < RawJoystickState::maxButtons && ( usedButtons >> button ) & 1;
+}
+
+bool MappingProgram::bindsAxis( const int axis ) const {
+    return axis >= 0 && axis < RawJoystickState::maxAxes && ( usedAxes >> axis ) & 1;
+}
+
+bool MappingProgram::bindsHat( const int hat ) const {
+    return hat >= 0 && hat < RawJoystickState::maxHats && ( usedHats >> hat ) & 1;
+}
+
+int MappingProgram::size() const {
+    return bindingCount;
+}
+
+QByteArray MappingProgram::mapping() const {
+    return source;
+}
+
+std::shared_ptr<const MappingProgram> MappingProgram::forDevice( const QString &guid, const QByteArray &mapping ) {
+
+    static QMutex cacheMutex;
+    static QHash<QString, std::shared_ptr<const MappingProgram>> cache;
+
+    QMutexLocker locker( &cacheMutex );
+
+    auto &program = cache[ guid ];
+
+    // A GUID's mapping only changes if the user remapped it, or an override was added since.
+    if( !program || program->mapping() != mapping ) {
+        auto compiled = std::make_shared<MappingProgram>();
+        compiled->compile( mapping );
+        program = compiled;
+    }
+
+    return program;
+
+}
+
+bool MappingProgram::parseBinding( const char *field, const int length, Binding &binding ) const {
+
+    auto *colon = static_cast<const char *>( std::memchr( field, ':', length ) );
+
+    if( !colon ) {
+        return false;
+    }
+
+    const char *key = field;
+    const char *value = colon + 1;
+    const char *end = field + length;
+
+    binding.targetRange = Full;
+
+    if( *key == '+' || *key == '-' ) {
+        binding.targetRange = *key == '+' ? Positive : Negative;
+        key++;
+    }
+
+    // SDL only takes NUL terminated names.
+    char name[ 32 ];
+    int nameLength = static_cast<int>( colon - key );
+
+    if( nameLength <= 0 || nameLength >= static_cast<int>( sizeof( name ) ) ) {
+        return false;
+    }
+
+    std::memcpy( name, key, nameLength );
+    name[ nameLength ] = '\0';
+
+    if( std::strcmp( name, "platform" ) == 0 ) {
+        return false;
+    }
+
+    auto button = SDL_GameControllerGetButtonFromString( name );
+    auto axis = SDL_GameControllerGetAxisFromString( name );
+
+    if( button != SDL_CONTROLLER_BUTTON_INVALID ) {
+        binding.target = TargetButton;
+        binding.element = static_cast<quint8>( button );
+    } else if( axis != SDL_CONTROLLER_AXIS_INVALID ) {
+        binding.target = TargetAxis;
+        binding.element = static_cast<quint8>( axis );
+    } else {
+        qCDebug( phxInput ) << "Unknown controller element" << name << "in mapping, skipped";
+        return false;
+    }
+
+    if( value == end ) {
+
+        // Plenty of mappings leave out elements like this, "guide:,".
+        return false;
+
+    }
+
+    binding.sourceRange = Full;
+    binding.invert = false;
+    binding.hatMask = 0;
+
+    if( *value == '+' || *value == '-' ) {
+        binding.sourceRange = *value == '+' ? Positive : Negative;
+        value++;
+    }
+
+    if( value < end && end[ -1 ] == '~' ) {
+        binding.invert = true;
+        end--;
+    }
+
+    if( value == end ) {
+        return false;
+    }
+
+    char kind = *value++;
+    int index;
+
+    value = parseNumber( value, end, index );
+
+    if( !value ) {
+        return false;
+    }
+
+    switch( kind ) {
+        case 'b':
+            binding.source = SourceButton;
+
+            if( index >= RawJoystickState::maxButtons ) {
+                return false;
+            }
+
+            break;
+
+        case 'a':
+            binding.source = SourceAxis;
+
+            if( index >= RawJoystickState::maxAxes ) {
+                return false;
+            }
+
+            break;
+
+        case 'h': {
+            binding.source = SourceHat;
+
+            int mask;
+
+            if( index >= RawJoystickState::maxHats || value == end || *value != '.'
+                || !( value = parseNumber( value + 1, end, mask ) ) ) {
+                return false;
+            }
+
+            binding.hatMask = static_cast<quint8>( mask );
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    binding.index = static_cast<quint8>( index );
+
+    // Anything left over, like "b3x", isn't a binding we understand.
+    return value == end;
+
+}
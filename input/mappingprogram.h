@@ -0,0 +1,129 @@
+#ifndef MAPPINGPROGRAM_H
+#define MAPPINGPROGRAM_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QString>
+
+#include <memory>
+
+#include "SDL.h"
+
+// The raw elements of one joystick, read straight from the backend. Elements past the counts, and past the
+// maximums, are never read.
+
+struct RawJoystickState {
+
+    static const int maxButtons = 64;
+    static const int maxAxes = 32;
+    static const int maxHats = 8;
+
+    quint8 buttons[ maxButtons ];
+    qint16 axes[ maxAxes ];
+    quint8 hats[ maxHats ];
+
+};
+
+// The game controller elements a MappingProgram makes out of a RawJoystickState.
+
+struct MappedJoystickState {
+
+    // One bit per SDL_GameControllerButton.
+    quint32 buttons;
+
+    qint16 axes[ SDL_CONTROLLER_AXIS_MAX ];
+
+};
+
+// MappingProgram is a SDL game controller mapping string, compiled into a flat list of bindings. Evaluating it
+// turns the raw state of a joystick into game controller buttons and axes in one pass, with no lookups and no
+// string handling.
+
+// A binding's source is a raw button (b3), axis (a2) or hat direction (h0.4). Axes can be limited to one half
+// (+a2, -a2) and inverted (a2~). Its target is a game controller button or axis, and axes can be limited to one
+// half too (+leftx, -leftx). Between them they cover digital triggers (lefttrigger:b6), D-Pads on hats or axes
+// and sticks made of buttons.
+
+// Compiling parses the string in place and never allocates. Programs are shared by every joystick with the same
+// GUID and mapping, see forDevice().
+
+class MappingProgram {
+
+    public:
+
+        static const int maxBindings = 64;
+
+        // Axes only hold a button down past halfway.
+        static const int pressThreshold = 16384;
+
+        MappingProgram();
+
+        // Compile a mapping string, "guid,name,a:b0,b:b1,...". Malformed and unknown bindings are skipped.
+        void compile( const QByteArray &mapping );
+
+        void evaluate( const RawJoystickState &raw, MappedJoystickState &mapped ) const;
+
+        // Whether any binding reads this raw element. Changes to the other elements can be ignored.
+        bool bindsButton( const int button ) const;
+        bool bindsAxis( const int axis ) const;
+        bool bindsHat( const int hat ) const;
+
+        int size() const;
+
+        // The mapping string this was compiled from.
+        QByteArray mapping() const;
+
+        // The program for a device, compiled on first use and shared from then on. Hot-plugging the same kind of
+        // controller again only costs a lookup. Thread safe.
+        static std::shared_ptr<const MappingProgram> forDevice( const QString &guid, const QByteArray &mapping );
+
+    private:
+
+        enum Source : quint8 {
+            SourceButton,
+            SourceAxis,
+            SourceHat,
+        };
+
+        enum Target : quint8 {
+            TargetButton,
+            TargetAxis,
+        };
+
+        // Which part of an axis is used: all of it, or the positive or negative half.
+        enum Range : qint8 {
+            Negative = -1,
+            Full = 0,
+            Positive = 1,
+        };
+
+        struct Binding {
+            Source source;
+            quint8 index;
+
+            // Directions of a hat, SDL_HAT_UP and so on.
+            quint8 hatMask;
+
+            Range sourceRange;
+            bool invert;
+
+            Target target;
+            quint8 element;
+            Range targetRange;
+        };
+
+        Binding bindings[ maxBindings ];
+        int bindingCount;
+
+        quint64 usedButtons;
+        quint32 usedAxes;
+        quint8 usedHats;
+
+        QByteArray source;
+
+        // Parse one "key:value" field. Returns false if it isn't a binding.
+        bool parseBinding( const char *field, const int length, Binding &binding ) const;
+
+};
+
+#endif // MAPPINGPROGRAM_H
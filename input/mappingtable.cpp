@@ -0,0 +1,6 @@
+#include "mappingtable.h"
+
+InputEpoch &mappingEpoch() {
+    static InputEpoch epoch;
+    return epoch;
+}
@@ -0,0 +1,70 @@
+#ifndef MAPPINGTABLE_H
+#define MAPPINGTABLE_H
+
+#include <QMutex>
+#include <QMutexLocker>
+
+#include "inputepoch.h"
+
+#include <atomic>
+#include <memory>
+
+// MappingTable holds a device's mapping as an immutable table behind one atomic pointer, so it can be changed while
+// a game is running. A remap builds a whole new table off the input path and publishes it in one store, readers
+// never see a half edited one and never lock.
+
+// Readers call get() inside a guard on mappingEpoch() and don't keep the pointer past it. publish() waits for
+// every guard that might still be reading the old table before freeing it, which takes as long as one poll at
+// most. Writers may be on any thread but must never hold a guard themselves. Building the next table from
+// snapshot() and publishing it isn't one step, so edits meant to build on each other belong on one thread.
+
+// The epoch that protects every mapping table. Separate from the device epoch, so a thread reading a mapping can
+// still retire devices.
+InputEpoch &mappingEpoch();
+
+template<typename Table>
+class MappingTable {
+
+    public:
+
+        MappingTable()
+            : current( nullptr ) {
+
+        }
+
+        // nullptr until the first publish().
+        const Table *get() const {
+            return current.load( std::memory_order_acquire );
+        }
+
+        void publish( std::shared_ptr<const Table> table ) {
+
+            QMutexLocker locker( &writeMutex );
+
+            current.store( table.get(), std::memory_order_release );
+            mappingEpoch().synchronize();
+
+            // Nobody can see the old table now.
+            owner = std::move( table );
+
+        }
+
+        // The table itself, for keeping it around or building the next one from it. Writers only.
+        std::shared_ptr<const Table> snapshot() {
+            QMutexLocker locker( &writeMutex );
+            return owner;
+        }
+
+    private:
+
+        std::atomic<const Table *> current;
+
+        // Keeps current alive. Tables may be shared between devices, see MappingProgram::forDevice().
+        std::shared_ptr<const Table> owner;
+        QMutex writeMutex;
+
+        Q_DISABLE_COPY( MappingTable )
+
+};
+
+#endif // MAPPINGTABLE_H
@@ -0,0 +1,311 @@
+#include "netplaytransport.h"
+
+#include "inputclock.h"
+#include "logging.h"
+#include "xorshift.h"
+
+#ifdef Q_OS_UNIX
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+const int NetplayTransport::maxDatagramSize;
+const int NetplayTransport::maxHeld;
+
+NetplayTransport::NetplayTransport()
+    : fd( -1 ),
+      boundPort( 0 ),
+      peerAddress( 0 ),
+      peerPort( 0 ),
+      latency( 0 ),
+      jitter( 0 ),
+      lossThreshold( 0 ),
+      random( 1 ),
+      heldCount( 0 ),
+      sent( 0 ),
+      sentBytes( 0 ),
+      received( 0 ),
+      dropped( 0 ) {
+
+}
+
+NetplayTransport::~NetplayTransport() {
+    close();
+}
+
+bool NetplayTransport::open( const quint16 port ) {
+
+    close();
+
+#ifdef Q_OS_UNIX
+
+    // Not SOCK_NONBLOCK, macOS doesn't have it.
+    fd = socket( AF_INET, SOCK_DGRAM, 0 );
+
+    if( fd != -1 && ( fcntl( fd, F_SETFL, O_NONBLOCK ) == -1 || fcntl( fd, F_SETFD, FD_CLOEXEC ) == -1 ) ) {
+        ::close( fd );
+        fd = -1;
+    }
+
+    if( fd == -1 ) {
+        qCWarning( phxInput ) << "Unable to open a netplay socket:" << strerror( errno );
+        return false;
+    }
+
+    struct sockaddr_in address;
+    std::memset( &address, 0, sizeof( address ) );
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_ANY );
+    address.sin_port = htons( port );
+
+    socklen_t length = sizeof( address );
+
+    if( bind( fd, reinterpret_cast<struct sockaddr *>( &address ), sizeof( address ) ) == -1
+        || getsockname( fd, reinterpret_cast<struct sockaddr *>( &address ), &length ) == -1 ) {
+        qCWarning( phxInput ) << "Unable to listen for netplay on port" << port << ":" << strerror( errno );
+        ::close( fd );
+        fd = -1;
+        return false;
+    }
+
+    boundPort = ntohs( address.sin_port );
+    sent = 0;
+    sentBytes = 0;
+    received = 0;
+    dropped = 0;
+
+    return true;
+
+#else
+
+    qCWarning( phxInput ) << "Unable to listen for netplay on port" << port << ": there are no sockets here";
+    return false;
+
+#endif
+
+}
+
+void NetplayTransport::close() {
+
+#ifdef Q_OS_UNIX
+
+    if( fd != -1 ) {
+        ::close( fd );
+    }
+
+#endif
+
+    fd = -1;
+    boundPort = 0;
+    peerAddress = 0;
+    peerPort = 0;
+    heldCount = 0;
+
+}
+
+bool NetplayTransport::isOpen() const {
+    return fd != -1;
+}
+
+quint16 NetplayTransport::localPort() const {
+    return boundPort;
+}
+
+bool NetplayTransport::setPeer( const QString &host, const quint16 port ) {
+
+#ifdef Q_OS_UNIX
+
+    struct addrinfo hints;
+    std::memset( &hints, 0, sizeof( hints ) );
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    struct addrinfo *found = nullptr;
+    int error = getaddrinfo( host.toLocal8Bit().constData(), nullptr, &hints, &found );
+
+    if( error != 0 || !found ) {
+        qCWarning( phxInput ) << "Unable to find the netplay peer" << host << ":" << gai_strerror( error );
+        return false;
+    }
+
+    peerAddress = reinterpret_cast<struct sockaddr_in *>( found->ai_addr )->sin_addr.s_addr;
+    peerPort = htons( port );
+
+    freeaddrinfo( found );
+
+    return true;
+
+#else
+
+    Q_UNUSED( host );
+    Q_UNUSED( port );
+    return false;
+
+#endif
+
+}
+
+void NetplayTransport::simulate( const qint64 latency, const qint64 jitter, const qreal loss, const quint32 seed ) {
+
+    this->latency = qMax<qint64>( latency, 0 );
+    this->jitter = qBound<qint64>( 0, jitter, this->latency );
+    lossThreshold = static_cast<quint32>( qBound( 0.0, loss, 1.0 ) * 4294967295.0 );
+    random = seed ? seed : 1;
+
+    // Allocated once, sending never does.
+    if( this->latency > 0 && !held ) {
+        held.reset( new Held[ maxHeld ] );
+    }
+
+    heldCount = 0;
+
+}
+
+bool NetplayTransport::send( const uchar *data, const int size ) {
+
+    if( fd == -1 || !peerPort || size <= 0 || size > maxDatagramSize ) {
+        return false;
+    }
+
+    release();
+
+    if( lossThreshold && xorshift32( random ) < lossThreshold ) {
+        dropped++;
+        return true;
+    }
+
+    if( latency == 0 ) {
+        return sendNow( data, size );
+    }
+
+    if( heldCount == maxHeld ) {
+        dropped++;
+        return true;
+    }
+
+    qint64 spread = jitter
+                    ? static_cast<qint64>( xorshift32( random ) % static_cast<quint32>( jitter * 2 + 1 ) ) - jitter
+                    : 0;
+
+    auto &datagram = held[ heldCount++ ];
+    datagram.due = inputClockNs() + latency + spread;
+    datagram.size = size;
+    std::memcpy( datagram.data, data, size );
+
+    return true;
+
+}
+
+int NetplayTransport::receive( uchar *data, const int capacity ) {
+
+    if( fd == -1 ) {
+        return -1;
+    }
+
+    release();
+
+#ifdef Q_OS_UNIX
+
+    for( ;; ) {
+
+        struct sockaddr_in from;
+        socklen_t length = sizeof( from );
+
+        ssize_t size = recvfrom( fd, data, capacity, 0, reinterpret_cast<struct sockaddr *>( &from ), &length );
+
+        if( size < 0 ) {
+            return -1;
+        }
+
+        // Anybody can send to the port, only the peer is listened to.
+        if( from.sin_addr.s_addr == peerAddress && from.sin_port == peerPort ) {
+            received++;
+            return static_cast<int>( size );
+        }
+
+    }
+
+#else
+
+    Q_UNUSED( data );
+    Q_UNUSED( capacity );
+    return -1;
+
+#endif
+
+}
+
+quint64 NetplayTransport::datagramsSent() const {
+    return sent;
+}
+
+quint64 NetplayTransport::bytesSent() const {
+    return sentBytes;
+}
+
+quint64 NetplayTransport::datagramsReceived() const {
+    return received;
+}
+
+quint64 NetplayTransport::datagramsDropped() const {
+    return dropped;
+}
+
+bool NetplayTransport::sendNow( const uchar *data, const int size ) {
+
+#ifdef Q_OS_UNIX
+
+    struct sockaddr_in to;
+    std::memset( &to, 0, sizeof( to ) );
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = peerAddress;
+    to.sin_port = peerPort;
+
+    // A full socket buffer is the same as a lost datagram, the protocol has to live with those anyway.
+    if( sendto( fd, data, size, 0, reinterpret_cast<struct sockaddr *>( &to ), sizeof( to ) ) != size ) {
+        dropped++;
+        return false;
+    }
+
+    sent++;
+    sentBytes += size;
+
+    return true;
+
+#else
+
+    Q_UNUSED( data );
+    Q_UNUSED( size );
+    return false;
+
+#endif
+
+}
+
+void NetplayTransport::release() {
+
+    if( heldCount == 0 ) {
+        return;
+    }
+
+    qint64 now = inputClockNs();
+
+    // Jitter can make a later datagram due first, which is the reordering a real network does too.
+    for( int i = 0; i < heldCount; ) {
+        if( held[ i ].due <= now ) {
+            sendNow( held[ i ].data, held[ i ].size );
+            held[ i ] = held[ --heldCount ];
+        } else {
+            ++i;
+        }
+    }
+
+}
@@ -0,0 +1,91 @@
+#ifndef NETPLAYTRANSPORT_H
+#define NETPLAYTRANSPORT_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include <memory>
+
+// NetplayTransport is a non-blocking UDP socket talking to one peer, IPv4 only. Sending and receiving are a system
+// call each, so it can be polled once a frame from the core thread.
+
+// For testing, simulate() holds every datagram sent back for a while, and drops some of them, like a real network
+// would. Held back datagrams go out on the next send() or receive() after they're due, so with a transport polled
+// once a frame the latency is rounded up to the next frame.
+
+// Only where there are POSIX sockets. Not thread safe.
+
+class NetplayTransport {
+
+    public:
+
+        static const int maxDatagramSize = 1200;
+
+        // Datagrams the simulation can hold back at once, more than that are dropped.
+        static const int maxHeld = 64;
+
+        NetplayTransport();
+        ~NetplayTransport();
+
+        // Port 0 picks any free one, see localPort().
+        bool open( const quint16 port );
+        void close();
+
+        bool isOpen() const;
+        quint16 localPort() const;
+
+        // Where send() sends to. Only datagrams from there are received.
+        bool setPeer( const QString &host, const quint16 port );
+
+        // Hold every datagram back latency ± jitter nanoseconds, and drop loss of them, 0 - 1. Both 0 turns it off.
+        // The seed makes the losses repeatable.
+        void simulate( const qint64 latency, const qint64 jitter, const qreal loss, const quint32 seed = 1 );
+
+        bool send( const uchar *data, const int size );
+
+        // The size of the next datagram, or -1 if there's none.
+        int receive( uchar *data, const int capacity );
+
+        quint64 datagramsSent() const;
+        quint64 bytesSent() const;
+        quint64 datagramsReceived() const;
+        quint64 datagramsDropped() const;
+
+    private:
+
+        struct Held {
+            qint64 due;
+            int size;
+            uchar data[ maxDatagramSize ];
+        };
+
+        int fd;
+        quint16 boundPort;
+
+        // In network byte order, 0 until there's a peer.
+        quint32 peerAddress;
+        quint16 peerPort;
+
+        qint64 latency;
+        qint64 jitter;
+        quint32 lossThreshold;
+        quint32 random;
+
+        std::unique_ptr<Held[]> held;
+        int heldCount;
+
+        quint64 sent;
+        quint64 sentBytes;
+        quint64 received;
+        quint64 dropped;
+
+        bool sendNow( const uchar *data, const int size );
+
+        // Send whatever's held back and due.
+        void release();
+
+        Q_DISABLE_COPY( NetplayTransport )
+
+};
+
+#endif // NETPLAYTRANSPORT_H
@@ -0,0 +1,83 @@
+#include "networkgamepad.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+int NetworkGamepadPacket::write( uchar *out, const Type type, const quint16 sequence, const InputPortState &state,
+                                 const bool guide, const QByteArray &name ) {
+
+    qToLittleEndian<quint32>( magic, out );
+    out[ 4 ] = version;
+    out[ 5 ] = static_cast<uchar>( type );
+    qToLittleEndian<quint16>( sequence, out + 6 );
+    qToLittleEndian<quint16>( state.buttons, out + 8 );
+    out[ 10 ] = guide ? 1 : 0;
+    out[ 11 ] = 0;
+
+    for( int i = 0; i < InputPortState::AxisCount; ++i ) {
+        qToLittleEndian<qint16>( state.axes[ i ], out + 12 + i * 2 );
+    }
+
+    int nameSize = type == Hello ? qMin( name.size(), maxNameSize ) : 0;
+    std::memcpy( out + headerSize, name.constData(), static_cast<size_t>( nameSize ) );
+
+    return headerSize + nameSize;
+
+}
+
+bool NetworkGamepadPacket::read( const uchar *in, const int size, Packet &packet ) {
+
+    if( size < headerSize || size > maxSize || qFromLittleEndian<quint32>( in ) != magic || in[ 4 ] != version
+        || in[ 5 ] > Goodbye ) {
+        return false;
+    }
+
+    packet.type = static_cast<Type>( in[ 5 ] );
+    packet.sequence = qFromLittleEndian<quint16>( in + 6 );
+    packet.state.buttons = qFromLittleEndian<quint16>( in + 8 );
+    packet.guide = in[ 10 ] & 1;
+
+    for( int i = 0; i < InputPortState::AxisCount; ++i ) {
+        packet.state.axes[ i ] = qFromLittleEndian<qint16>( in + 12 + i * 2 );
+    }
+
+    packet.name = reinterpret_cast<const char *>( in + headerSize );
+    packet.nameSize = packet.type == Hello ? size - headerSize : 0;
+
+    return true;
+
+}
+
+NetworkGamepad::NetworkGamepad( const QString &name, QObject *parent )
+    : InputDevice( LibretroType::DigitalGamepad, name, parent ),
+      held(),
+      guideHeld( false ) {
+
+}
+
+void NetworkGamepad::apply( const InputPortState &state, const bool guide, const qint64 timestamp ) {
+
+    // Most packets are keep-alives, or one button or stick of difference.
+    quint16 changed = state.buttons ^ held.buttons;
+
+    for( int id = 0; changed >> id; ++id ) {
+        if( ( changed >> id ) & 1 ) {
+            insertAt( static_cast<InputDeviceEvent::Event>( id ), ( state.buttons >> id ) & 1, timestamp );
+        }
+    }
+
+    if( guide != guideHeld ) {
+        insertAt( InputDeviceEvent::Guide, guide, timestamp );
+    }
+
+    for( int i = 0; i < InputPortState::AxisCount; ++i ) {
+        if( state.axes[ i ] != held.axes[ i ] ) {
+            insertAxisAt( static_cast<InputPortState::Axis>( i ), state.axes[ i ], timestamp );
+        }
+    }
+
+    held = state;
+    guideHeld = guide;
+
+}
@@ -0,0 +1,89 @@
+#ifndef NETWORKGAMEPAD_H
+#define NETWORKGAMEPAD_H
+
+#include "inputdevice.h"
+
+// A network gamepad packet is one UDP datagram, a phone or tablet's whole controller state:
+//     magic               32 bits, "PXGP"
+//     version             8 bits
+//     type                8 bits, State, Hello or Goodbye
+//     sequence            16 bits, one more than the sender's last packet, wrapping around
+//     buttons             16 bits, bit n is RETRO_DEVICE_ID_JOYPAD n
+//     flags               8 bits, bit 0 is the Guide button
+//     reserved            8 bits
+//     axes                4 x 16 bits, signed, in InputPortState::Axis order
+// A Hello is sent first, and carries the controller's name after that, up to maxNameSize bytes of UTF-8. It
+// restarts the sequence, so an app that was closed and opened again is let back in. A Goodbye disconnects. The
+// server ignores anything but a Hello from a sender it doesn't know, so one that timed out has to say hello again.
+
+// Since every packet has the whole state, a lost one is made up for by the next, and an old one that arrives late
+// is simply dropped. Clients send one on every change, and at least every keepAliveInterval while idle, so a lost
+// release doesn't leave a button held for long and the server can tell when a client went away.
+
+// Every integer is little endian.
+
+namespace NetworkGamepadPacket {
+
+    static const quint32 magic = 0x50475850; // "PXGP"
+    static const quint8 version = 1;
+
+    enum Type {
+        State = 0,
+        Hello = 1,
+        Goodbye = 2,
+    };
+
+    static const int headerSize = 20;
+    static const int maxNameSize = 32;
+    static const int maxSize = headerSize + maxNameSize;
+
+    static const qint64 keepAliveInterval = Q_INT64_C( 500000000 );
+
+    struct Packet {
+        Type type;
+        quint16 sequence;
+        InputPortState state;
+        bool guide;
+
+        // Hello only, not terminated.
+        const char *name;
+        int nameSize;
+    };
+
+    // Write a packet to out, which holds at least maxSize bytes. Returns its size.
+    int write( uchar *out, const Type type, const quint16 sequence, const InputPortState &state,
+               const bool guide = false, const QByteArray &name = QByteArray() );
+
+    // False if it isn't one.
+    bool read( const uchar *in, const int size, Packet &packet );
+
+    // Whether sequence came after last, as long as they're less than half the range apart.
+    inline bool newer( const quint16 sequence, const quint16 last ) {
+        return static_cast<qint16>( static_cast<quint16>( sequence - last ) ) > 0;
+    }
+
+}
+
+// NetworkGamepad is a controller on another device on the network, like a phone or a tablet running a gamepad
+// app, that sends its state to a NetworkGamepadServer. Only changes are written, each with the time the packet
+// arrived, so a state's capture time is when the kernel had it and not when anyone got around to reading it.
+
+// Only the server's thread calls apply(), see NetworkGamepadServer.
+
+class NetworkGamepad : public InputDevice {
+
+    public:
+
+        explicit NetworkGamepad( const QString &name, QObject *parent = 0 );
+
+        // A packet's state, timestamp already on inputClockNs()'s clock.
+        void apply( const InputPortState &state, const bool guide, const qint64 timestamp );
+
+    private:
+
+        InputPortState held;
+        bool guideHeld;
+
+};
+
+#endif // NETWORKGAMEPAD_H
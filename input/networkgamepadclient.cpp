@@ -0,0 +1,140 @@
+#include "networkgamepadclient.h"
+
+#include "logging.h"
+#include "networkgamepad.h"
+
+#ifdef Q_OS_UNIX
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+NetworkGamepadClient::NetworkGamepadClient()
+    : fd( -1 ),
+      lastSequence( 0 ) {
+
+}
+
+NetworkGamepadClient::~NetworkGamepadClient() {
+    close();
+}
+
+bool NetworkGamepadClient::connectTo( const QString &host, const quint16 port ) {
+
+    close();
+
+#ifdef Q_OS_UNIX
+
+    struct addrinfo hints;
+    memset( &hints, 0, sizeof( hints ) );
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    struct addrinfo *found = nullptr;
+    int error = getaddrinfo( host.toLocal8Bit().constData(), nullptr, &hints, &found );
+
+    if( error != 0 || !found ) {
+        qCWarning( phxInput ) << "Unable to find the network gamepad server" << host << ":" << gai_strerror( error );
+        return false;
+    }
+
+    struct sockaddr_in address = *reinterpret_cast<struct sockaddr_in *>( found->ai_addr );
+    address.sin_port = htons( port );
+    freeaddrinfo( found );
+
+    // Not SOCK_NONBLOCK, macOS doesn't have it. A connected socket keeps one local port, which the server tells
+    // clients apart by.
+    fd = socket( AF_INET, SOCK_DGRAM, 0 );
+
+    if( fd == -1 || fcntl( fd, F_SETFL, O_NONBLOCK ) == -1
+        || connect( fd, reinterpret_cast<struct sockaddr *>( &address ), sizeof( address ) ) == -1 ) {
+        qCWarning( phxInput ) << "Unable to connect to the network gamepad server" << host << ":" << strerror( errno );
+        close();
+        return false;
+    }
+
+    return true;
+
+#else
+
+    Q_UNUSED( host );
+    Q_UNUSED( port );
+    return false;
+
+#endif
+
+}
+
+void NetworkGamepadClient::close() {
+
+#ifdef Q_OS_UNIX
+
+    if( fd != -1 ) {
+        ::close( fd );
+    }
+
+#endif
+
+    fd = -1;
+
+}
+
+bool NetworkGamepadClient::isConnected() const {
+    return fd != -1;
+}
+
+bool NetworkGamepadClient::sendHello( const QString &name, const InputPortState &state ) {
+
+    uchar packet[ NetworkGamepadPacket::maxSize ];
+    lastSequence = 0;
+
+    int size = NetworkGamepadPacket::write( packet, NetworkGamepadPacket::Hello, lastSequence, state, false,
+                                            name.toUtf8() );
+
+    return send( packet, size );
+
+}
+
+bool NetworkGamepadClient::sendState( const InputPortState &state, const bool guide ) {
+
+    uchar packet[ NetworkGamepadPacket::maxSize ];
+    int size = NetworkGamepadPacket::write( packet, NetworkGamepadPacket::State, ++lastSequence, state, guide );
+
+    return send( packet, size );
+
+}
+
+bool NetworkGamepadClient::sendGoodbye() {
+
+    uchar packet[ NetworkGamepadPacket::maxSize ];
+    int size = NetworkGamepadPacket::write( packet, NetworkGamepadPacket::Goodbye, ++lastSequence,
+                                            InputPortState() );
+
+    return send( packet, size );
+
+}
+
+bool NetworkGamepadClient::send( const uchar *data, const int size ) {
+
+#ifdef Q_OS_UNIX
+
+    return fd != -1 && ::send( fd, data, static_cast<size_t>( size ), 0 ) == size;
+
+#else
+
+    Q_UNUSED( data );
+    Q_UNUSED( size );
+    return false;
+
+#endif
+
+}
+
+quint16 NetworkGamepadClient::sequence() const {
+    return lastSequence;
+}
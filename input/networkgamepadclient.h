@@ -0,0 +1,48 @@
+#ifndef NETWORKGAMEPADCLIENT_H
+#define NETWORKGAMEPADCLIENT_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include "inputsnapshot.h"
+
+// NetworkGamepadClient is what a gamepad app does, for standing in for a phone in tests and benchmarks: it says
+// hello to a NetworkGamepadServer, then sends it its state, numbering every packet. Keeping the server's
+// connection alive while the state doesn't change is up to the caller, see NetworkGamepadPacket.
+
+// Only where there are POSIX sockets. Not thread safe.
+
+class NetworkGamepadClient {
+
+    public:
+
+        NetworkGamepadClient();
+        ~NetworkGamepadClient();
+
+        // Every packet goes to this server from now on, from one local port.
+        bool connectTo( const QString &host, const quint16 port );
+        void close();
+
+        bool isConnected() const;
+
+        // Restarts the sequence, and connects as a gamepad with this name.
+        bool sendHello( const QString &name, const InputPortState &state = InputPortState() );
+        bool sendState( const InputPortState &state, const bool guide = false );
+        bool sendGoodbye();
+
+        // Any datagram, for sending packets out of order or broken ones.
+        bool send( const uchar *data, const int size );
+
+        // The sequence number of the last packet sent.
+        quint16 sequence() const;
+
+    private:
+
+        int fd;
+        quint16 lastSequence;
+
+        Q_DISABLE_COPY( NetworkGamepadClient )
+
+};
+
+#endif // NETWORKGAMEPADCLIENT_H
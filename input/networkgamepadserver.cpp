@@ -0,0 +1,448 @@
+#include "networkgamepadserver.h"
+
+#include "inputclock.h"
+#include "logging.h"
+#include "networkgamepad.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+const int NetworkGamepadServer::batchSize;
+const int NetworkGamepadServer::maxClients;
+const quint16 NetworkGamepadServer::defaultPort;
+
+// epoll tags.
+static const quint64 socketTag = 0;
+static const quint64 wakeTag = 1;
+
+static QString addressString( const quint32 address ) {
+    struct in_addr in;
+    in.s_addr = address;
+
+    char text[ INET_ADDRSTRLEN ] = {};
+    inet_ntop( AF_INET, &in, text, sizeof( text ) );
+
+    return QString::fromLatin1( text );
+}
+
+NetworkGamepadServer::NetworkGamepadServer( QObject *parent )
+    : QThread( parent ),
+      socketFd( -1 ),
+      boundPort( 0 ),
+      silenceTimeout( Q_INT64_C( 3000000000 ) ) {
+
+    for( auto &client : clients ) {
+        client.device = nullptr;
+    }
+
+    resetStatistics();
+
+    epollFd = epoll_create1( EPOLL_CLOEXEC );
+    wakeFd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+
+    if( epollFd == -1 || wakeFd == -1 ) {
+        qFatal( "Fatal: Unable to create the network gamepad server: %s", strerror( errno ) );
+    }
+
+    struct epoll_event wake = {};
+    wake.events = EPOLLIN;
+    wake.data.u64 = wakeTag;
+    epoll_ctl( epollFd, EPOLL_CTL_ADD, wakeFd, &wake );
+
+}
+
+NetworkGamepadServer::~NetworkGamepadServer() {
+
+    stop();
+
+    if( socketFd != -1 ) {
+        close( socketFd );
+    }
+
+    close( epollFd );
+    close( wakeFd );
+
+}
+
+bool NetworkGamepadServer::listen( const quint16 port ) {
+
+    Q_ASSERT( !isRunning() );
+
+    if( socketFd != -1 ) {
+        epoll_ctl( epollFd, EPOLL_CTL_DEL, socketFd, nullptr );
+        close( socketFd );
+        boundPort = 0;
+    }
+
+    socketFd = socket( AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+
+    if( socketFd == -1 ) {
+        qCWarning( phxInput ) << "Unable to open the network gamepad socket:" << strerror( errno );
+        return false;
+    }
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_ANY );
+    address.sin_port = htons( port );
+
+    socklen_t length = sizeof( address );
+
+    if( bind( socketFd, reinterpret_cast<struct sockaddr *>( &address ), sizeof( address ) ) == -1
+        || getsockname( socketFd, reinterpret_cast<struct sockaddr *>( &address ), &length ) == -1 ) {
+        qCWarning( phxInput ) << "Unable to listen for network gamepads on port" << port << ":" << strerror( errno );
+        close( socketFd );
+        socketFd = -1;
+        return false;
+    }
+
+    // Without the kernel's timestamps packets are stamped when they're read, which hides time spent queued.
+    int on = 1;
+
+    if( setsockopt( socketFd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof( on ) ) == -1 ) {
+        qCWarning( phxInput ) << "Network gamepad packets can't be timestamped on arrival:" << strerror( errno );
+    }
+
+    struct epoll_event readable = {};
+    readable.events = EPOLLIN;
+    readable.data.u64 = socketTag;
+    epoll_ctl( epollFd, EPOLL_CTL_ADD, socketFd, &readable );
+
+    boundPort = ntohs( address.sin_port );
+
+    return true;
+
+}
+
+quint16 NetworkGamepadServer::port() const {
+    return boundPort;
+}
+
+void NetworkGamepadServer::setTimeout( const qint64 nanoseconds ) {
+    Q_ASSERT( !isRunning() );
+    silenceTimeout = qMax<qint64>( nanoseconds, NetworkGamepadPacket::keepAliveInterval * 2 );
+}
+
+qint64 NetworkGamepadServer::timeout() const {
+    return silenceTimeout;
+}
+
+void NetworkGamepadServer::stop() {
+
+    if( !isRunning() ) {
+        return;
+    }
+
+    requestInterruption();
+
+    quint64 one = 1;
+
+    if( write( wakeFd, &one, sizeof( one ) ) < 0 ) {
+        qCWarning( phxInput ) << "Unable to wake the network gamepad server:" << strerror( errno );
+    }
+
+    wait();
+
+}
+
+quint64 NetworkGamepadServer::packetsReceived() const {
+    return received.load( std::memory_order_relaxed );
+}
+
+quint64 NetworkGamepadServer::packetsOutOfOrder() const {
+    return outOfOrder.load( std::memory_order_relaxed );
+}
+
+quint64 NetworkGamepadServer::packetsLost() const {
+    return lost.load( std::memory_order_relaxed );
+}
+
+quint64 NetworkGamepadServer::packetsRejected() const {
+    return rejected.load( std::memory_order_relaxed );
+}
+
+quint64 NetworkGamepadServer::batches() const {
+    return batchCount.load( std::memory_order_relaxed );
+}
+
+const LatencyHistogram &NetworkGamepadServer::packetLatency() const {
+    return latency;
+}
+
+void NetworkGamepadServer::resetStatistics() {
+    received.store( 0, std::memory_order_relaxed );
+    outOfOrder.store( 0, std::memory_order_relaxed );
+    lost.store( 0, std::memory_order_relaxed );
+    rejected.store( 0, std::memory_order_relaxed );
+    batchCount.store( 0, std::memory_order_relaxed );
+    latency.reset();
+}
+
+void NetworkGamepadServer::run() {
+
+    if( socketFd == -1 ) {
+        qCWarning( phxInput ) << "The network gamepad server isn't listening";
+        return;
+    }
+
+    qCDebug( phxInput ) << "Listening for network gamepads on port" << boundPort;
+
+    // Often enough to notice silent clients, a wakeup or two a second costs nothing.
+    int checkInterval = static_cast<int>( silenceTimeout / 4 / 1000000 );
+
+    while( !isInterruptionRequested() ) {
+
+        struct epoll_event ready[ 2 ];
+        int count = epoll_wait( epollFd, ready, 2, checkInterval );
+
+        if( count < 0 ) {
+
+            if( errno != EINTR ) {
+                qCWarning( phxInput ) << "Network gamepad server stopped:" << strerror( errno );
+                break;
+            }
+
+            continue;
+
+        }
+
+        for( int i = 0; i < count; ++i ) {
+
+            if( ready[ i ].data.u64 == wakeTag ) {
+                quint64 wakeups;
+
+                if( read( wakeFd, &wakeups, sizeof( wakeups ) ) < 0 ) {
+                    continue;
+                }
+            } else {
+                readPackets();
+            }
+
+        }
+
+        dropSilentClients( inputClockNs() );
+
+    }
+
+    for( int i = 0; i < maxClients; ++i ) {
+        if( clients[ i ].device ) {
+            disconnectClient( i );
+        }
+    }
+
+}
+
+void NetworkGamepadServer::readPackets() {
+
+    uchar buffers[ batchSize ][ NetworkGamepadPacket::maxSize ];
+    struct sockaddr_in senders[ batchSize ];
+    struct iovec vectors[ batchSize ];
+    struct mmsghdr messages[ batchSize ];
+    alignas( struct cmsghdr ) char controls[ batchSize ][ CMSG_SPACE( sizeof( struct timespec ) ) ];
+
+    forever {
+
+        for( int i = 0; i < batchSize; ++i ) {
+            vectors[ i ].iov_base = buffers[ i ];
+            vectors[ i ].iov_len = sizeof( buffers[ i ] );
+
+            memset( &messages[ i ], 0, sizeof( messages[ i ] ) );
+            messages[ i ].msg_hdr.msg_name = &senders[ i ];
+            messages[ i ].msg_hdr.msg_namelen = sizeof( senders[ i ] );
+            messages[ i ].msg_hdr.msg_iov = &vectors[ i ];
+            messages[ i ].msg_hdr.msg_iovlen = 1;
+            messages[ i ].msg_hdr.msg_control = controls[ i ];
+            messages[ i ].msg_hdr.msg_controllen = sizeof( controls[ i ] );
+        }
+
+        int count = recvmmsg( socketFd, messages, batchSize, MSG_DONTWAIT, nullptr );
+
+        if( count <= 0 ) {
+
+            if( count < 0 && errno != EAGAIN && errno != EINTR ) {
+                qCWarning( phxInput ) << "Unable to read network gamepad packets:" << strerror( errno );
+            }
+
+            return;
+
+        }
+
+        batchCount.fetch_add( 1, std::memory_order_relaxed );
+
+        // Kernel timestamps are on the wall clock, which only the difference to ours makes comparable. It may
+        // step between two batches, never by enough to matter within one.
+        struct timespec wall;
+        clock_gettime( CLOCK_REALTIME, &wall );
+        qint64 now = inputClockNs();
+        qint64 offset = static_cast<qint64>( wall.tv_sec ) * 1000000000 + wall.tv_nsec - now;
+
+        for( int i = 0; i < count; ++i ) {
+
+            auto &header = messages[ i ].msg_hdr;
+            qint64 arrival = now;
+
+            for( auto *control = CMSG_FIRSTHDR( &header ); control; control = CMSG_NXTHDR( &header, control ) ) {
+                if( control->cmsg_level == SOL_SOCKET && control->cmsg_type == SCM_TIMESTAMPNS ) {
+                    struct timespec stamp;
+                    memcpy( &stamp, CMSG_DATA( control ), sizeof( stamp ) );
+                    arrival = qMin( now, static_cast<qint64>( stamp.tv_sec ) * 1000000000 + stamp.tv_nsec - offset );
+                }
+            }
+
+            if( header.msg_flags & MSG_TRUNC ) {
+                rejected.fetch_add( 1, std::memory_order_relaxed );
+                continue;
+            }
+
+            handlePacket( senders[ i ].sin_addr.s_addr, senders[ i ].sin_port, buffers[ i ],
+                          static_cast<int>( messages[ i ].msg_len ), arrival );
+
+        }
+
+        // Drained.
+        if( count < batchSize ) {
+            return;
+        }
+
+    }
+
+}
+
+void NetworkGamepadServer::handlePacket( const quint32 address, const quint16 port, const uchar *data,
+                                         const int size, const qint64 arrival ) {
+
+    using namespace NetworkGamepadPacket;
+
+    Packet packet;
+
+    if( !read( data, size, packet ) ) {
+        rejected.fetch_add( 1, std::memory_order_relaxed );
+        return;
+    }
+
+    received.fetch_add( 1, std::memory_order_relaxed );
+
+    int index = findClient( address, port );
+
+    if( index == -1 ) {
+
+        // Only a Hello makes a client. Anything else is still on its way from one that said goodbye or timed out,
+        // or from someone who never said hello at all.
+        if( packet.type != Hello ) {
+            rejected.fetch_add( 1, std::memory_order_relaxed );
+            return;
+        }
+
+        QString name = packet.nameSize > 0 ? QString::fromUtf8( packet.name, packet.nameSize )
+                       : QStringLiteral( "Network Gamepad %1" ).arg( addressString( address ) );
+
+        connectClient( address, port, name );
+        index = findClient( address, port );
+
+        if( index == -1 ) {
+            return;
+        }
+
+    }
+
+    // A Hello from a client we know means its app was started again, and its sequence starts over.
+    else if( packet.type != Hello ) {
+
+        if( !newer( packet.sequence, clients[ index ].sequence ) ) {
+            outOfOrder.fetch_add( 1, std::memory_order_relaxed );
+            return;
+        }
+
+        lost.fetch_add( static_cast<quint16>( packet.sequence - clients[ index ].sequence ) - 1u,
+                        std::memory_order_relaxed );
+
+    }
+
+    Client &client = clients[ index ];
+    client.sequence = packet.sequence;
+    client.lastHeard = arrival;
+
+    if( packet.type == Goodbye ) {
+        disconnectClient( index );
+        return;
+    }
+
+    client.device->apply( packet.state, packet.guide, arrival );
+    latency.record( inputClockNs() - arrival );
+
+}
+
+int NetworkGamepadServer::findClient( const quint32 address, const quint16 port ) const {
+
+    for( int i = 0; i < maxClients; ++i ) {
+        if( clients[ i ].device && clients[ i ].address == address && clients[ i ].port == port ) {
+            return i;
+        }
+    }
+
+    return -1;
+
+}
+
+void NetworkGamepadServer::connectClient( const quint32 address, const quint16 port, const QString &name ) {
+
+    int index = -1;
+
+    for( int i = 0; i < maxClients; ++i ) {
+        if( !clients[ i ].device ) {
+            index = i;
+            break;
+        }
+    }
+
+    if( index == -1 ) {
+        qCWarning( phxInput ) << "Too many network gamepads," << name << "ignored";
+        return;
+    }
+
+    auto *device = new NetworkGamepad( name );
+
+    Client &client = clients[ index ];
+    client.device = device;
+    client.address = address;
+    client.port = port;
+    client.sequence = 0;
+    client.lastHeard = inputClockNs();
+
+    qCDebug( phxInput ) << "Network gamepad" << name << "connected from" << addressString( address ) << "port"
+                        << ntohs( port );
+
+    // Owned by the thread that made us from now on, like the SDL joysticks are.
+    device->moveToThread( thread() );
+
+    emit deviceConnected( device );
+
+}
+
+void NetworkGamepadServer::disconnectClient( const int index ) {
+
+    auto *device = clients[ index ].device;
+    clients[ index ].device = nullptr;
+
+    qCDebug( phxInput ) << "Network gamepad" << device->name() << "disconnected";
+
+    emit deviceRemoved( device );
+
+}
+
+void NetworkGamepadServer::dropSilentClients( const qint64 now ) {
+
+    for( int i = 0; i < maxClients; ++i ) {
+        if( clients[ i ].device && now - clients[ i ].lastHeard > silenceTimeout ) {
+            disconnectClient( i );
+        }
+    }
+
+}
@@ -0,0 +1,118 @@
+#ifndef NETWORKGAMEPADSERVER_H
+#define NETWORKGAMEPADSERVER_H
+
+#include <QThread>
+
+#include <atomic>
+
+#include "latencyhistogram.h"
+
+class InputDevice;
+class NetworkGamepad;
+
+// NetworkGamepadServer lets phones and tablets on the network be gamepads, see NetworkGamepad for their packets.
+// It listens on one UDP port on its own thread, which sleeps in epoll until packets arrive and then takes them in
+// with recvmmsg(), up to batchSize per system call, so a burst from many clients costs one wakeup.
+
+// Each sender address is one client, from its Hello on. Its packets are applied in sequence order: one older than
+// what was applied already arrived out of order and is dropped, a gap means packets were lost, and both are
+// counted. Since every packet carries the whole state, neither needs anything more. A client that hasn't been
+// heard from for timeout() is disconnected.
+
+// Every packet carries the kernel's receive timestamp, which becomes its state's capture time. packetLatency()
+// is the time from there to the state being written, which is what the server itself adds.
+
+// Like EvdevMonitor, new devices are handed to the thread that made the server through deviceConnected(). One that
+// went away is reported with deviceRemoved() and never touched again, its owner retires it. Loopback clients, like
+// NetworkGamepadClient, can stand in for real ones in tests. Linux only.
+
+class NetworkGamepadServer : public QThread {
+        Q_OBJECT
+
+    public:
+
+        static const int batchSize = 32;
+        static const int maxClients = 16;
+        static const quint16 defaultPort = 55400;
+
+        explicit NetworkGamepadServer( QObject *parent = 0 );
+        ~NetworkGamepadServer();
+
+        // Bind to this UDP port on every interface, 0 picks any free one. Only before start().
+        bool listen( const quint16 port );
+        quint16 port() const;
+
+        // How long a client can be silent before it's disconnected, 3 seconds by default. Only before start().
+        void setTimeout( const qint64 nanoseconds );
+        qint64 timeout() const;
+
+        // Ask the thread to finish, and block until it does.
+        void stop();
+
+        // Any thread, at any time.
+        quint64 packetsReceived() const;
+        quint64 packetsOutOfOrder() const;
+        quint64 packetsLost() const;
+        // Malformed, or from a sender that isn't a client.
+        quint64 packetsRejected() const;
+        quint64 batches() const;
+        const LatencyHistogram &packetLatency() const;
+
+        void resetStatistics();
+
+    signals:
+
+        void deviceConnected( InputDevice *device );
+        void deviceRemoved( InputDevice *device );
+
+    protected:
+
+        void run() override;
+
+    private:
+
+        struct Client {
+            NetworkGamepad *device;
+
+            // In network byte order.
+            quint32 address;
+            quint16 port;
+
+            quint16 sequence;
+            qint64 lastHeard;
+        };
+
+        Client clients[ maxClients ];
+
+        int socketFd;
+        int epollFd;
+        int wakeFd;
+        quint16 boundPort;
+        qint64 silenceTimeout;
+
+        std::atomic<quint64> received;
+        std::atomic<quint64> outOfOrder;
+        std::atomic<quint64> lost;
+        std::atomic<quint64> rejected;
+        std::atomic<quint64> batchCount;
+        LatencyHistogram latency;
+
+        // Take in every packet that's queued, a batch at a time.
+        void readPackets();
+
+        void handlePacket( const quint32 address, const quint16 port, const uchar *data, const int size,
+                           const qint64 arrival );
+
+        // The client at this address, -1 if there's none.
+        int findClient( const quint32 address, const quint16 port ) const;
+
+        void connectClient( const quint32 address, const quint16 port, const QString &name );
+        void disconnectClient( const int index );
+
+        void dropSilentClients( const qint64 now );
+
+        Q_DISABLE_COPY( NetworkGamepadServer )
+
+};
+
+#endif // NETWORKGAMEPADSERVER_H
@@ -0,0 +1,238 @@
+#include "pollthread.h"
+
+#include "inputclock.h"
+#include "logging.h"
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+PollThread::PollThread( PollThread::Callback callback, QObject *parent )
+    : QThread( parent ),
+      callback( callback ),
+      pollRate( 200 ),
+      priority( 0 ),
+      cpu( -1 ) {
+
+#ifdef Q_OS_LINUX
+    timerFd = timerfd_create( CLOCK_MONOTONIC, TFD_CLOEXEC );
+    wakeFd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+    watchFd = -1;
+
+    if( timerFd == -1 || wakeFd == -1 ) {
+        qFatal( "Fatal: Unable to create the input poll timer: %s", strerror( errno ) );
+    }
+
+#endif
+
+}
+
+PollThread::~PollThread() {
+
+    stop();
+
+#ifdef Q_OS_LINUX
+    close( timerFd );
+    close( wakeFd );
+#endif
+
+}
+
+int PollThread::rate() const {
+    return pollRate;
+}
+
+void PollThread::setRate( const int rate ) {
+    pollRate = qMax( rate, 0 );
+    wake();
+}
+
+void PollThread::setScheduler( PollThread::Scheduler scheduler ) {
+    Q_ASSERT( !isRunning() );
+    this->scheduler = scheduler;
+}
+
+int PollThread::realtimePriority() const {
+    return priority;
+}
+
+void PollThread::setRealtimePriority( const int priority ) {
+    this->priority = priority;
+}
+
+int PollThread::cpuAffinity() const {
+    return cpu;
+}
+
+void PollThread::setCpuAffinity( const int cpu ) {
+    this->cpu = cpu;
+}
+
+void PollThread::setWatchDescriptor( const int descriptor ) {
+
+    Q_ASSERT( !isRunning() );
+
+#ifdef Q_OS_LINUX
+    watchFd = descriptor;
+#else
+    Q_UNUSED( descriptor );
+#endif
+
+}
+
+void PollThread::wake() {
+
+#ifdef Q_OS_LINUX
+    quint64 one = 1;
+    auto written = write( wakeFd, &one, sizeof( one ) );
+    Q_UNUSED( written );
+#else
+    QMutexLocker locker( &sleepMutex );
+    wakeCondition.wakeAll();
+#endif
+
+}
+
+void PollThread::stop() {
+
+    if( !isRunning() ) {
+        return;
+    }
+
+    requestInterruption();
+    wake();
+    wait();
+
+}
+
+void PollThread::run() {
+
+    applySchedulingOptions();
+
+    qint64 deadline = inputClockNs();
+
+    while( !isInterruptionRequested() ) {
+
+        callback();
+
+        qint64 next = nextDeadline( deadline );
+
+        if( next < 0 ) {
+            continue;
+        }
+
+        // If we fell behind, start counting from now instead of firing a burst of late polls.
+        deadline = qMax( next, inputClockNs() );
+
+        sleepUntil( deadline );
+
+    }
+
+}
+
+qint64 PollThread::nextDeadline( const qint64 previousDeadline ) const {
+
+    if( scheduler ) {
+        return scheduler( previousDeadline );
+    }
+
+    int rate = pollRate;
+
+    if( rate == 0 ) {
+        return -1;
+    }
+
+    return previousDeadline + 1000000000 / rate;
+
+}
+
+void PollThread::applySchedulingOptions() {
+
+#ifdef Q_OS_LINUX
+
+    if( priority > 0 ) {
+        sched_param param;
+        param.sched_priority = priority;
+
+        int error = pthread_setschedparam( pthread_self(), SCHED_FIFO, &param );
+
+        if( error ) {
+            qCWarning( phxInput ) << "Unable to set the input thread's SCHED_FIFO priority to" << priority
+                                  << ":" << strerror( error );
+        }
+    }
+
+    if( cpu >= 0 ) {
+        cpu_set_t cpuSet;
+        CPU_ZERO( &cpuSet );
+        CPU_SET( cpu, &cpuSet );
+
+        int error = pthread_setaffinity_np( pthread_self(), sizeof( cpuSet ), &cpuSet );
+
+        if( error ) {
+            qCWarning( phxInput ) << "Unable to pin the input thread to CPU" << cpu << ":" << strerror( error );
+        }
+    }
+
+#else
+
+    if( priority > 0 || cpu >= 0 ) {
+        qCWarning( phxInput ) << "Real-time priority and CPU affinity are only supported on Linux";
+    }
+
+#endif
+
+}
+
+void PollThread::sleepUntil( const qint64 deadline ) {
+
+#ifdef Q_OS_LINUX
+
+    itimerspec timer = {};
+    timer.it_value.tv_sec = deadline / 1000000000;
+    timer.it_value.tv_nsec = deadline % 1000000000;
+    timerfd_settime( timerFd, TFD_TIMER_ABSTIME, &timer, nullptr );
+
+    pollfd fds[ 3 ] = {
+        { timerFd, POLLIN, 0 },
+        { wakeFd, POLLIN, 0 },
+        { watchFd, POLLIN, 0 },
+    };
+
+    nfds_t descriptors = watchFd != -1 ? 3 : 2;
+
+    while( poll( fds, descriptors, -1 ) == -1 && errno == EINTR ) {
+    }
+
+    // Drain whichever fired so the next sleep starts clean.
+    quint64 count;
+
+    if( fds[ 0 ].revents & POLLIN ) {
+        auto bytes = read( timerFd, &count, sizeof( count ) );
+        Q_UNUSED( bytes );
+    }
+
+    if( fds[ 1 ].revents & POLLIN ) {
+        auto bytes = read( wakeFd, &count, sizeof( count ) );
+        Q_UNUSED( bytes );
+    }
+
+#else
+
+    auto remaining = ( deadline - inputClockNs() ) / 1000000;
+
+    if( remaining > 0 ) {
+        QMutexLocker locker( &sleepMutex );
+        wakeCondition.wait( &sleepMutex, remaining );
+    }
+
+#endif
+
+}
@@ -0,0 +1,89 @@
+#ifndef POLLTHREAD_H
+#define POLLTHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <functional>
+
+// PollThread calls a function over and over on its own thread, at a fixed rate.
+
+// On Linux the thread sleeps on a timerfd with absolute deadlines, so the rate doesn't drift and each wakeup is
+// accurate to the kernel's timer slack instead of the event loop's. The thread can also be given a SCHED_FIFO
+// priority and pinned to one CPU, which keeps it from being starved by the GUI while a heavy QML view loads.
+
+// The options only take effect the next time the thread is started.
+
+class PollThread : public QThread {
+        Q_OBJECT
+
+    public:
+
+        using Callback = std::function<void()>;
+
+        // Given the deadline the thread last woke up at, return the absolute inputClockNs() time to wake up at
+        // next, or -1 to call the callback again straight away.
+        using Scheduler = std::function<qint64( qint64 previousDeadline )>;
+
+        explicit PollThread( Callback callback, QObject *parent = 0 );
+        ~PollThread();
+
+        // Calls per second. With a rate of 0 the callback isn't paced at all, it's expected to block by itself.
+        int rate() const;
+        void setRate( const int rate );
+
+        // Replaces the fixed rate with a schedule of your own. Must be set while the thread isn't running.
+        void setScheduler( Scheduler scheduler );
+
+        // SCHED_FIFO priority, 1 - 99. 0 leaves the thread in the normal scheduling class.
+        int realtimePriority() const;
+        void setRealtimePriority( const int priority );
+
+        // The CPU to pin the thread to. -1 lets it run anywhere.
+        int cpuAffinity() const;
+        void setCpuAffinity( const int cpu );
+
+        // Also wake up when this descriptor turns readable, -1 (the default) for none. Reading it is up to the
+        // callback, the thread won't sleep again until it's drained. Must be set while the thread isn't running.
+        // Ignored where there's no timerfd.
+        void setWatchDescriptor( const int descriptor );
+
+        // Wake the thread early if it's asleep.
+        void wake();
+
+        // Ask the thread to finish, and block until it does.
+        void stop();
+
+    protected:
+
+        void run() override;
+
+    private:
+
+        Callback callback;
+        Scheduler scheduler;
+
+        std::atomic<int> pollRate;
+        int priority;
+        int cpu;
+
+        void applySchedulingOptions();
+
+        qint64 nextDeadline( const qint64 previousDeadline ) const;
+
+        void sleepUntil( const qint64 deadline );
+
+#ifdef Q_OS_LINUX
+        int timerFd;
+        int wakeFd;
+        int watchFd;
+#else
+        QMutex sleepMutex;
+        QWaitCondition wakeCondition;
+#endif
+
+};
+
+#endif // POLLTHREAD_H
@@ -1,304 +1,123 @@
 #include "qmlinputdevice.h"
 
-QMLInputDevice::QMLInputDevice( QObject *parent )
-    : InputDevice( parent ) {
-}
-
-void QMLInputDevice::insert( const InputDeviceEvent::Event &event, const int &state ) {
-
-    // Process the incoming event and assign it to the correct button value.
-    switch( event ) {
-
-        case InputDeviceEvent::B:
-            setB( state );
-            break;
-
-        case InputDeviceEvent::A:
-            setA( state );
-            break;
-
-        case InputDeviceEvent::X:
-            setX( state );
-            break;
-
-        case InputDeviceEvent::Y:
-            setY( state );
-            break;
-
-        // The Guide button is always recieving input, even when in game, unlike the other buttons.
-        // This is so the Frontend can expose menus whenever the user hits the Guide button.
-        case InputDeviceEvent::Guide:
-            setGuide( state );
-            break;
-
-        case InputDeviceEvent::Start:
-            setStart( state );
-            break;
-
-        case InputDeviceEvent::Select:
-            setSelect( state );
-            break;
-
-        case InputDeviceEvent::Left:
-            setLeft( state );
-            break;
-
-        case InputDeviceEvent::Up:
-            setUp( state );
-            break;
-
-        case InputDeviceEvent::Down:
-            setDown( state );
-            break;
-
-        case InputDeviceEvent::Right:
-            setRight( state );
-            break;
-
-        case InputDeviceEvent::L:
-            setLeftShoulder( state );
-            break;
-
-        case InputDeviceEvent::R:
-            setRightShoulder( state );
-            break;
-
-        case InputDeviceEvent::L2:
-            setLeftTrigger( state );
-            break;
-
-        case InputDeviceEvent::R2:
-            setRightTrigger( state );
-            break;
-
-        default:
-            break;
-
-    }
-
-}
-
-void QMLInputDevice::setA( const bool &state ) {
-
-    if( state == qmlA ) {
-        return;
-    }
-
-    qmlA = state;
-    emit aChanged();
-
-}
-
-void QMLInputDevice::setB( const bool &state ) {
-
-    if( state == qmlB ) {
-        return;
-    }
-
-    qmlB = state;
-    emit bChanged();
-
-}
-
-void QMLInputDevice::setX( const bool &state ) {
-
-    if( state == qmlX ) {
-        return;
-    }
-
-    qmlX = state;
-    emit xChanged();
-
-}
-
-void QMLInputDevice::setY( const bool &state ) {
-
-    if( state == qmlY ) {
-        return;
-    }
-
-    qmlY = state;
-    emit yChanged();
-
-}
-
-void QMLInputDevice::setLeft( const bool &state ) {
-
-    if( state == qmlLeft ) {
-        return;
-    }
-
-    qmlLeft = state;
-    emit leftChanged();
+#include "inputclock.h"
 
+QMLInputDevice::QMLInputDevice( QObject *parent )
+    : InputDevice( parent ),
+      qmlButtons( 0 ),
+      qmlChangedButtons( 0 ) {
 }
 
-void QMLInputDevice::setRight( const bool &state ) {
-
-    if( state == qmlRight ) {
-        return;
-    }
-
-    qmlRight = state;
-    emit rightChanged();
-
-}
+void QMLInputDevice::updateStates( const quint32 changed, const quint32 state ) {
 
-void QMLInputDevice::setUp( const bool &state ) {
+    // The sender's capture time is the time of its latest change, which is in this batch unless it's been
+    // overtaken by the next one.
+    auto *device = qobject_cast<InputDevice *>( sender() );
 
-    if( state == qmlUp ) {
-        return;
+    if( device && ( changed & ~( 1u << InputStateBlock::GuideSlot ) ) ) {
+        eventLatency.record( inputClockNs() - device->states()->captureTime() );
     }
 
-    qmlUp = state;
-    emit upChanged();
-
-}
+    // Only the bits in changed come from this device, the rest stay as other devices left them.
+    quint32 buttons = ( qmlButtons & ~changed ) | ( state & changed );
 
-void QMLInputDevice::setDown( const bool &state ) {
-
-    if( state == qmlDown ) {
+    if( buttons == qmlButtons ) {
         return;
     }
 
-    qmlDown = state;
-    emit downChanged();
-
-}
-
-void QMLInputDevice::setStart( const bool &state ) {
-
-    if( state == qmlStart ) {
-        return;
-    }
+    qmlChangedButtons = buttons ^ qmlButtons;
+    qmlButtons = buttons;
 
-    qmlStart = state;
-    emit startChanged();
+    emit buttonsChanged();
 
 }
 
-void QMLInputDevice::setSelect( const bool &state ) {
-
-    if( state == qmlSelect ) {
-        return;
-    }
-
-    qmlSelect = state;
-    emit selectChanged();
-
+int QMLInputDevice::buttons() const {
+    return static_cast<int>( qmlButtons );
 }
 
-void QMLInputDevice::setGuide( const bool &state ) {
-
-    if( state == qmlGuide ) {
-        return;
-    }
-
-    qmlGuide = state;
-    emit guideChanged();
-
+int QMLInputDevice::changedButtons() const {
+    return static_cast<int>( qmlChangedButtons );
 }
 
-void QMLInputDevice::setLeftShoulder( const bool &state ) {
-
-    if( state == qmlLeftShoulder ) {
-        return;
-    }
-
-    qmlLeftShoulder = state;
-    emit leftShoulderChanged();
-
+bool QMLInputDevice::pressed( const int event ) const {
+    return isHeld( static_cast<InputDeviceEvent::Event>( event ) );
 }
 
-void QMLInputDevice::setRightShoulder( const bool &state ) {
-
-    if( state == qmlRightShoulder ) {
-        return;
-    }
-
-    qmlRightShoulder = state;
-    emit rightShoulderChanged();
-
+const LatencyHistogram &QMLInputDevice::latency() const {
+    return eventLatency;
 }
 
-void QMLInputDevice::setLeftTrigger( const bool &state ) {
-
-    if( state == qmlLeftTrigger ) {
-        return;
-    }
-
-    qmlLeftTrigger = state;
-    emit leftTriggerChanged();
-
-}
-
-void QMLInputDevice::setRightTrigger( const bool &state ) {
-
-    if( state == qmlRightTrigger ) {
-        return;
-    }
-
-    qmlRightTrigger = state;
-    emit rightTriggerChanged();
-
+QString QMLInputDevice::latencySummary() const {
+    return eventLatency.summary();
 }
 
 bool QMLInputDevice::a() const {
-    return qmlA;
+    return isHeld( InputDeviceEvent::A );
 }
 
 bool QMLInputDevice::b() const {
-    return qmlB;
+    return isHeld( InputDeviceEvent::B );
 }
 
 bool QMLInputDevice::x() const {
-    return qmlX;
+    return isHeld( InputDeviceEvent::X );
 }
 
 bool QMLInputDevice::y() const {
-    return qmlY;
+    return isHeld( InputDeviceEvent::Y );
 }
 
 bool QMLInputDevice::left() const {
-    return qmlLeft;
+    return isHeld( InputDeviceEvent::Left );
 }
 
 bool QMLInputDevice::right() const {
-    return qmlRight;
+    return isHeld( InputDeviceEvent::Right );
 }
 
 bool QMLInputDevice::up() const {
-    return qmlUp;
+    return isHeld( InputDeviceEvent::Up );
 }
 
 bool QMLInputDevice::down() const {
-    return qmlDown;
+    return isHeld( InputDeviceEvent::Down );
 }
+
 bool QMLInputDevice::start() const {
-    return qmlStart;
+    return isHeld( InputDeviceEvent::Start );
 }
 
 bool QMLInputDevice::select() const {
-    return qmlSelect;
+    return isHeld( InputDeviceEvent::Select );
 }
+
+// The Guide button is always recieving input, even when in game, unlike the other buttons.
+// This is so the Frontend can expose menus whenever the user hits the Guide button.
 bool QMLInputDevice::guide() const {
-    return qmlGuide;
+    return isHeld( InputDeviceEvent::Guide );
 }
 
 bool QMLInputDevice::leftShoulder() const {
-    return qmlLeftShoulder;
+    return isHeld( InputDeviceEvent::L );
 }
 
 bool QMLInputDevice::rightShoulder() const {
-    return qmlRightShoulder;
+    return isHeld( InputDeviceEvent::R );
 }
 
 bool QMLInputDevice::leftTrigger() const {
-    return qmlLeftTrigger;
+    return isHeld( InputDeviceEvent::L2 );
 }
 
 bool QMLInputDevice::rightTrigger() const {
-    return qmlRightTrigger;
+    return isHeld( InputDeviceEvent::R2 );
 }
 
+bool QMLInputDevice::isHeld( const InputDeviceEvent::Event &event ) const {
 
+    int slot = InputStateBlock::slot( event );
+
+    return slot != InputStateBlock::InvalidSlot && ( qmlButtons & ( 1u << slot ) );
+
+}
@@ -2,37 +2,49 @@
 #define QMLINPUTDEVICE_H
 
 #include "inputdevice.h"
+#include "latencyhistogram.h"
 
 // This QMLInputDevice is responsible for controlling the frontend, such as selecting games, and
 // editing settings while using any InputDevice. The main reason for this is so the a Joystick
 // instance can control the UI.
 
 // Currently, every single InputDevice stored in the InputManager, should connect their
-// InputDevice::inputDeviceEvent() signal to this classes insert() function.
+// InputDevice::inputStateChanged() signal to this classes updateStates() function.
 // The actual button presses can then be obtained by reading the Q_PROPERTY values.
 
+// Every button lives in one bitmask, buttons, indexed by InputStateBlock::slot(): bit InputDeviceEvent::A is
+// A, and so on, with Guide in bit InputStateBlock::GuideSlot. A whole batch of changes, like both directions of a
+// diagonal or every button of a chord, is applied at once and notified with a single buttonsChanged(), so
+// bindings re-evaluate once per batch instead of once per button. changedButtons says which bits the batch
+// touched, for handlers that only care about presses.
+
+// The named properties are derived from buttons and share its NOTIFY signal.
+
 // There should only ever be one and only one QMLInputDevice every created.
 class QMLInputDevice : public InputDevice {
         Q_OBJECT
-        Q_PROPERTY( bool a READ a NOTIFY aChanged )
-        Q_PROPERTY( bool b READ b NOTIFY bChanged )
-        Q_PROPERTY( bool x READ x NOTIFY xChanged )
-        Q_PROPERTY( bool y READ y NOTIFY yChanged )
+        Q_PROPERTY( int buttons READ buttons NOTIFY buttonsChanged )
+        Q_PROPERTY( int changedButtons READ changedButtons NOTIFY buttonsChanged )
 
-        Q_PROPERTY( bool right READ right NOTIFY rightChanged )
-        Q_PROPERTY( bool left READ left NOTIFY leftChanged )
-        Q_PROPERTY( bool up READ up NOTIFY upChanged )
-        Q_PROPERTY( bool down READ down NOTIFY downChanged )
+        Q_PROPERTY( bool a READ a NOTIFY buttonsChanged )
+        Q_PROPERTY( bool b READ b NOTIFY buttonsChanged )
+        Q_PROPERTY( bool x READ x NOTIFY buttonsChanged )
+        Q_PROPERTY( bool y READ y NOTIFY buttonsChanged )
 
+        Q_PROPERTY( bool right READ right NOTIFY buttonsChanged )
+        Q_PROPERTY( bool left READ left NOTIFY buttonsChanged )
+        Q_PROPERTY( bool up READ up NOTIFY buttonsChanged )
+        Q_PROPERTY( bool down READ down NOTIFY buttonsChanged )
 
-        Q_PROPERTY( bool start READ start NOTIFY startChanged )
-        Q_PROPERTY( bool select READ select NOTIFY selectChanged )
-        Q_PROPERTY( bool guide READ guide NOTIFY guideChanged )
 
-        Q_PROPERTY( bool leftShoulder READ leftShoulder NOTIFY leftShoulderChanged )
-        Q_PROPERTY( bool rightShoulder READ rightShoulder NOTIFY rightShoulderChanged )
-        Q_PROPERTY( bool leftTrigger READ leftTrigger NOTIFY leftTriggerChanged )
-        Q_PROPERTY( bool rightTrigger READ rightTrigger NOTIFY rightTriggerChanged )
+        Q_PROPERTY( bool start READ start NOTIFY buttonsChanged )
+        Q_PROPERTY( bool select READ select NOTIFY buttonsChanged )
+        Q_PROPERTY( bool guide READ guide NOTIFY buttonsChanged )
+
+        Q_PROPERTY( bool leftShoulder READ leftShoulder NOTIFY buttonsChanged )
+        Q_PROPERTY( bool rightShoulder READ rightShoulder NOTIFY buttonsChanged )
+        Q_PROPERTY( bool leftTrigger READ leftTrigger NOTIFY buttonsChanged )
+        Q_PROPERTY( bool rightTrigger READ rightTrigger NOTIFY buttonsChanged )
 
     public:
 
@@ -40,6 +52,12 @@ class QMLInputDevice : public InputDevice {
 
         QMLInputDevice( QObject *parent = 0 );
 
+        int buttons() const;
+        int changedButtons() const;
+
+        // Whether a button is held, for QML code that has an InputDeviceEvent::Event at hand.
+        Q_INVOKABLE bool pressed( const int event ) const;
+
         bool a() const;
         bool b() const;
         bool x() const;
@@ -59,71 +77,27 @@ class QMLInputDevice : public InputDevice {
         bool leftTrigger() const;
         bool rightTrigger() const;
 
+        // Time from a button changing on an InputDevice, to the change reaching these properties.
+        const LatencyHistogram &latency() const;
+        Q_INVOKABLE QString latencySummary() const;
+
     public slots:
 
-        void insert( const InputDeviceEvent::Event &value, const int &state );
+        // A batch of changes from InputDevice::inputStateChanged().
+        void updateStates( const quint32 changed, const quint32 state );
 
     signals:
 
-        void aChanged();
-        void bChanged();
-        void xChanged();
-        void yChanged();
-
-        void leftChanged();
-        void rightChanged();
-        void upChanged();
-        void downChanged();
-
-        void startChanged();
-        void selectChanged();
-        void guideChanged();
-
-        void leftShoulderChanged();
-        void rightShoulderChanged();
-        void leftTriggerChanged();
-        void rightTriggerChanged();
+        void buttonsChanged();
 
     private:
 
-        bool qmlA;
-        bool qmlB;
-        bool qmlX;
-        bool qmlY;
-
-        bool qmlLeft;
-        bool qmlRight;
-        bool qmlUp;
-        bool qmlDown;
-
-        bool qmlStart;
-        bool qmlSelect;
-        bool qmlGuide;
-
-        bool qmlLeftShoulder;
-        bool qmlRightShoulder;
-        bool qmlLeftTrigger;
-        bool qmlRightTrigger;
-
-        void setA( const bool &state );
-        void setB( const bool &state );
-        void setX( const bool &state );
-        void setY( const bool &state );
-
-        void setLeft( const bool &state );
-        void setRight( const bool &state );
-        void setUp( const bool &state );
-        void setDown( const bool &state );
-
+        LatencyHistogram eventLatency;
 
-        void setStart( const bool &state );
-        void setSelect( const bool &state );
-        void setGuide( const bool &state );
+        quint32 qmlButtons;
+        quint32 qmlChangedButtons;
 
-        void setLeftShoulder( const bool &state );
-        void setRightShoulder( const bool &state );
-        void setLeftTrigger( const bool &state );
-        void setRightTrigger( const bool &state );
+        bool isHeld( const InputDeviceEvent::Event &event ) const;
 
 };
 
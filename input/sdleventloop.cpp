@@ -1,287 +1,585 @@
 #include "sdleventloop.h"
 
+#include "inputclock.h"
 #include "logging.h"
 
-#include <QFile>
-#include <QMutexLocker>
-
+const qint64 SDLEventLoop::activeHoldTime;
+const qint64 SDLEventLoop::notifiedHotplugInterval;
+const qint64 SDLEventLoop::hotplugCheckInterval;
 
 SDLEventLoop::SDLEventLoop( QObject *parent )
+    : SDLEventLoop( nullptr, parent ) {
+
+}
+
+SDLEventLoop::SDLEventLoop( JoystickBackend *joystickBackend, QObject *parent )
     : QObject( parent ),
-      sdlPollTimer( this ),
+      ownedBackend( joystickBackend ? nullptr : new SDLJoystickBackend ),
+      backend( joystickBackend ? joystickBackend : ownedBackend.get() ),
+      sdlPollThread( [ this ] { waitEvents(); }, this ),
       numOfDevices( 0 ),
-      forceEventsHandling( true ) {
+      pollRate( 200 ),
+      forceEventsHandling( true ),
+      idlePollRate( 20 ),
+      activity( false ),
+      lastActivity( inputClockNs() ),
+      adaptiveInterval( 0 ),
+      hotplugNotifier( joystickBackend ? nullptr : new HotplugNotifier ),
+      pollMode( Adaptive ),
+      frameScheduler( nullptr ),
+      hotplugQueue( [ this ] { wakePollThread(); } ) {
+
+    // New and removed joysticks cross from the poll thread to the InputManager's thread.
+    qRegisterMetaType<Joystick *>();
+    qRegisterMetaType<InputDevice *>();
+
+    // Nothing is parsed here unless the bundled database changed, see ControllerDatabase.
+    controllerDatabase.load();
+    controllerDatabase.addOverrides( ControllerDatabase::overridesPath() );
+
+    sdlPollThread.setObjectName( "SDL poll thread" );
+    sdlPollThread.setScheduler( [ this ]( qint64 previousDeadline ) {
+        return nextPollDeadline( previousDeadline );
+    } );
+
+    if( hotplugNotifier ) {
+        sdlPollThread.setWatchDescriptor( hotplugNotifier->descriptor() );
+    }
 
-    // TODO: The poll timer isn't in the sdlEventLoopThread. It needs to be.
+    // Load SDL
+    initSDL();
 
-    // Ensures the resources at loaded at startup, even during
-    // static compilation.
-    Q_INIT_RESOURCE( controllerdb );
-    QFile gameControllerDBFile( ":/input/gamecontrollerdb.txt" );
-    Q_ASSERT( gameControllerDBFile.open( QIODevice::ReadOnly ) );
+    wakeEventType = backend->registerEvent();
 
-    auto mappingData = gameControllerDBFile.readAll();
+}
 
-    SDL_SetHint( SDL_HINT_GAMECONTROLLERCONFIG, mappingData.constData() );
+SDLEventLoop::~SDLEventLoop() {
+    stop();
 
-    gameControllerDBFile.close();
+    // Nothing may be opening or closing a device once the backend goes away.
+    hotplugQueue.waitForDone();
+}
 
-    for( int i = 0; i < Joystick::maxNumOfDevices; ++i ) {
-        sdlDeviceList.append( nullptr );
-    }
+void SDLEventLoop::setPollRate( const int rate ) {
+    pollRate = qMax( rate, 1 );
+    wakePollThread();
+}
 
-    sdlPollTimer.setInterval( 5 );
+void SDLEventLoop::setIdlePollRate( const int rate ) {
+    idlePollRate = qMax( rate, 1 );
+    wakePollThread();
+}
 
-    connect( &sdlPollTimer, &QTimer::timeout, this, &SDLEventLoop::pollEvents );
+void SDLEventLoop::setFrameScheduler( FramePollScheduler *scheduler ) {
+    Q_ASSERT( !sdlPollThread.isRunning() );
+    frameScheduler = scheduler;
+}
 
-    // Load SDL
-    initSDL();
+void SDLEventLoop::setPollHook( std::function<void()> hook ) {
+    Q_ASSERT( !sdlPollThread.isRunning() );
+    pollHook = hook;
+}
+
+void SDLEventLoop::setRealtimePriority( const int priority ) {
+    sdlPollThread.setRealtimePriority( priority );
+}
 
+void SDLEventLoop::setCpuAffinity( const int cpu ) {
+    sdlPollThread.setCpuAffinity( cpu );
+}
+
+InputStatistics &SDLEventLoop::statistics() {
+    return pollStatistics;
+}
+
+InputDeviceRegistry &SDLEventLoop::registry() {
+    return deviceRegistry;
+}
+
+InputEpoch &SDLEventLoop::epoch() {
+    return deviceEpoch;
 }
 
 void SDLEventLoop::pollEvents() {
 
-    if( !forceEventsHandling ) {
+    qint64 started = inputThreadCpuNs();
+
+    pollStatistics.lock( sdlEventMutex );
+    handleEvents();
+    sdlEventMutex.unlock();
+
+    pollStatistics.recordPoll( inputThreadCpuNs() - started );
+
+}
+
+void SDLEventLoop::handleEvents() {
+
+    publishReadyControllers();
+
+    if( pollMode == Polled && !forceEventsHandling ) {
 
         // Update all connected controller states.
-        SDL_GameControllerUpdate();
+        backend->update();
 
-        // All joystick instance ID's are stored inside of this map.
-        // This is necessary because the instance ID could be any number, and
-        // so cannot be used for indexing the deviceLocationMap. The value of the map
-        // is the actual index that the sdlDeviceList uses.
-        for( auto &key : deviceLocationMap.keys() ) {
+        // Keeps the stick settings in the batch alive until they're written.
+        InputEpoch::Guard guard( mappingEpoch() );
 
-            auto index = deviceLocationMap[ key ];
+        stickBatch.clear();
+        int evaluated = 0;
 
-            auto *joystick = sdlDeviceList.at( index );
-            auto *sdlGamepad = joystick->sdlDevice();
+        // Only the connected joysticks are visited, packed together in the registry.
+        for( ; evaluated < deviceRegistry.count(); ++evaluated ) {
 
-            // Check to see if sdlGamepad is actually connected. If it isn't this will terminate the
+            auto *joystick = static_cast<Joystick *>( deviceRegistry.at( evaluated ) );
+
+            // Check to see if the joystick is actually connected. If it isn't this will terminate the
             // polling and initialize the event handling.
 
-            forceEventsHandling = joystick->editMode()
-                                  | ( SDL_GameControllerGetAttached( sdlGamepad ) == SDL_FALSE );
+            forceEventsHandling = joystick->editMode() || !joystick->attached();
 
             if( forceEventsHandling ) {
-                return;
+                break;
             }
 
-            bool left, right, down, up, a, b, x, y, start, select, rightShoulder, leftShoulder;
-            bool guide, leftStick, rightStick;
+            joystick->evaluate( stickBatch );
 
-            qint16 leftTrigger, rightTrigger, leftXAxis, leftYAxis, rightXAxis, rightYAxis;
-            Q_UNUSED( rightXAxis );
-            Q_UNUSED( rightYAxis );
+        }
 
-            // Read D-PAD Button States
-            left = joystick->getButtonState( SDL_CONTROLLER_BUTTON_DPAD_LEFT );
-            right = joystick->getButtonState( SDL_CONTROLLER_BUTTON_DPAD_RIGHT );
-            up = joystick->getButtonState( SDL_CONTROLLER_BUTTON_DPAD_UP );
-            down = joystick->getButtonState( SDL_CONTROLLER_BUTTON_DPAD_DOWN );
+        // Every stick of every controller in one pass.
+        stickBatch.process();
 
-            // Read Menu Button States
-            start = joystick->getButtonState( SDL_CONTROLLER_BUTTON_START );
-            select = joystick->getButtonState( SDL_CONTROLLER_BUTTON_BACK );
-            guide = joystick->getButtonState( SDL_CONTROLLER_BUTTON_GUIDE );
+        for( int i = 0; i < evaluated; ++i ) {
+            static_cast<Joystick *>( deviceRegistry.at( i ) )->updateSticks( stickBatch );
+        }
 
-            // Read Action Button States
-            a = joystick->getButtonState( SDL_CONTROLLER_BUTTON_A );
-            b = joystick->getButtonState( SDL_CONTROLLER_BUTTON_B );
-            x = joystick->getButtonState( SDL_CONTROLLER_BUTTON_X );
-            y = joystick->getButtonState( SDL_CONTROLLER_BUTTON_Y );
+    }
 
-            // Read Analog Click Button States
-            leftStick = joystick->getButtonState( SDL_CONTROLLER_BUTTON_LEFTSTICK );
-            rightStick = joystick->getButtonState( SDL_CONTROLLER_BUTTON_RIGHTSTICK );
+    else {
 
-            // Read Shoulder Button States
-            leftShoulder = joystick->getButtonState( SDL_CONTROLLER_BUTTON_LEFTSHOULDER );
-            rightShoulder = joystick->getButtonState( SDL_CONTROLLER_BUTTON_RIGHTSHOULDER );
+        SDL_Event sdlEvent;
 
-            // Check if the joystick has digital triggers, like the Wii U Pro Controlle, and
-            // read the values.
+        // In polled mode, the only events that should be handled here are, SDL_JOYDEVICEADDED,
+        // SDL_CONTROLLERDEVICEADDED and SDL_CONTROLLERDEVICEREMOVED. In event driven mode, the raw joystick events are also used
+        // to update the controller states.
+        while( backend->pollEvent( &sdlEvent ) ) {
 
-            leftTrigger = joystick->getAxisState( SDL_CONTROLLER_AXIS_TRIGGERLEFT );
+            switch( sdlEvent.type ) {
 
-            rightTrigger = joystick->getAxisState( SDL_CONTROLLER_AXIS_TRIGGERRIGHT );
+                case SDL_JOYDEVICEADDED: {
 
-            //gamecontroller->mapping.buttons[button]
-            // Read Analog Joystick Values
-            leftXAxis = joystick->getAxisState( SDL_CONTROLLER_AXIS_LEFTX );
-            leftYAxis = joystick->getAxisState( SDL_CONTROLLER_AXIS_LEFTY );
-            rightXAxis = joystick->getAxisState( SDL_CONTROLLER_AXIS_RIGHTX );
-            rightYAxis = joystick->getAxisState( SDL_CONTROLLER_AXIS_RIGHTY );
+                    if( registerMapping( sdlEvent.jdevice.which ) ) {
+                        addController( sdlEvent.jdevice.which );
+                    }
 
-            // !analogMode means that the console being played doesn't support
-            // analog sticks. We will then have the left analog stick mimic the D-PAD.
-            if( !joystick->analogMode() ) {
+                    break;
 
-                if( leftXAxis <= 0 ) {
-                    left |= ( leftXAxis < -joystick->deadZone() );
                 }
 
-                if( leftXAxis > 0 ) {
-                    right |= ( leftXAxis > joystick->deadZone() );
+                case SDL_CONTROLLERDEVICEADDED: {
+
+                    addController( sdlEvent.cdevice.which );
+
+                    break;
+
                 }
 
-                if( leftYAxis <= 0 ) {
-                    up |= ( leftYAxis < -joystick->deadZone() );
+                case SDL_CONTROLLERDEVICEREMOVED: {
+
+                    // A controller that's still being opened isn't registered yet, publishController() drops it.
+                    auto *device = deviceRegistry.find( sdlEvent.cdevice.which );
+                    int slot = deviceRegistry.remove( sdlEvent.cdevice.which );
+
+                    if( slot != -1 ) {
+                        emit deviceRemoved( slot, device );
+                        forceEventsHandling = true;
+                        activity = true;
+                    }
+
+                    break;
+
                 }
 
-                if( leftYAxis > 0 ) {
-                    down |= ( leftYAxis > joystick->deadZone() );
+                case SDL_CONTROLLERBUTTONUP:
+                case SDL_CONTROLLERBUTTONDOWN:
+                case SDL_JOYBUTTONDOWN:
+                case SDL_JOYBUTTONUP: {
+
+                    auto *joystick = joystickForInstance( sdlEvent.cbutton.which );
+
+                    if( !joystick ) {
+                        break;
+                    }
+
+                    activity = true;
+
+                    int state = sdlEvent.cbutton.state;
+
+                    if( pollMode == Polled || joystick->editMode() ) {
+                        joystick->emitEditModeEvent( sdlEvent.cbutton.button, state );
+                        break;
+                    }
+
+                    // SDL's own game controller events use SDL's mapping, we only trust ours.
+                    if( sdlEvent.type == SDL_CONTROLLERBUTTONUP || sdlEvent.type == SDL_CONTROLLERBUTTONDOWN ) {
+                        break;
+                    }
+
+                    // The mapping is evaluated as a whole, a raw button can feed a button, a digital trigger or
+                    // half of an axis. Only what changed is written.
+                    if( joystick->bindsRawButton( sdlEvent.jbutton.button ) ) {
+                        joystick->update( stickBatch );
+                    }
+
+                    break;
+
                 }
 
-            }
+                case SDL_JOYAXISMOTION: {
+
+                    auto *joystick = joystickForInstance( sdlEvent.jaxis.which );
+
+                    if( pollMode == Polled || !joystick || joystick->editMode() ) {
+                        break;
+                    }
 
-            joystick->insert( InputDeviceEvent::Left, left );
-            joystick->insert( InputDeviceEvent::Right, right );
-            joystick->insert( InputDeviceEvent::Down, down );
-            joystick->insert( InputDeviceEvent::Up,  up );
+                    if( joystick->bindsRawAxis( sdlEvent.jaxis.axis ) ) {
+                        joystick->update( stickBatch );
+                        activity = true;
+                    }
 
-            joystick->insert( InputDeviceEvent::Start, start );
-            joystick->insert( InputDeviceEvent::Select, select );
+                    break;
 
-            // The guide button is emitted to the frontend and is hooked up the to
-            // QMLInputDevice.
-            joystick->emitInputDeviceEvent( InputDeviceEvent::Guide, guide );
+                }
 
-            // The buttons are switched to a SNES controller layout.
-            // SDL GameControllers have Xbox360 controller layouts.
-            joystick->insert( InputDeviceEvent::A, b );
-            joystick->insert( InputDeviceEvent::B, a );
-            joystick->insert( InputDeviceEvent::X, y );
-            joystick->insert( InputDeviceEvent::Y, x );
+                case SDL_JOYHATMOTION: {
 
-            joystick->insert( InputDeviceEvent::L3, leftStick );
-            joystick->insert( InputDeviceEvent::R3, rightStick );
+                    auto *joystick = joystickForInstance( sdlEvent.jhat.which );
 
-            joystick->insert( InputDeviceEvent::L, leftShoulder );
-            joystick->insert( InputDeviceEvent::R, rightShoulder );
+                    if( pollMode == Polled || !joystick || joystick->editMode() ) {
+                        break;
+                    }
 
-            joystick->insert( InputDeviceEvent::L2, leftTrigger );
-            joystick->insert( InputDeviceEvent::R2, rightTrigger );
+                    if( joystick->bindsRawHat( sdlEvent.jhat.hat ) ) {
+                        joystick->update( stickBatch );
+                        activity = true;
+                    }
+
+                    break;
+
+                }
+
+                default:
+                    break;
 
-            //qDebug() << left << right << down << up << start << select <<
-            //         a << b << x << y << leftShoulder << rightShoulder << leftTrigger << rightTrigger
-            //     << leftStick << rightStick << leftXAxis << leftYAxis << rightYAxis << rightXAxis;
+            }
 
         }
 
     }
 
-    else {
+}
 
-        SDL_Event sdlEvent;
+void SDLEventLoop::waitEvents() {
 
-        // The only events that should be handled here are, SDL_CONTROLLERDEVICEADDED
-        // and SDL_CONTROLLERDEVICEREMOVED.
-        while( SDL_PollEvent( &sdlEvent ) ) {
+    pollStatistics.recordWakeup();
 
-            switch( sdlEvent.type ) {
+    // Sleep until SDL has something for us. The timeout only bounds how late a rate or mode change is noticed,
+    // stop() wakes us up with an event of its own. SDL polls once a millisecond underneath, see the class comment.
+    if( pollMode == EventDriven ) {
+        backend->waitEvent( eventWaitTimeout );
+    }
 
-                case SDL_CONTROLLERDEVICEADDED: {
+    pollEvents();
 
-                    forceEventsHandling = false;
+    if( pollHook ) {
+        pollHook();
+    }
 
-                    // This needs to be checked for, because the first time a controller
-                    // sdl starts up, it fires this signal twice, pretty annoying...
+    // The poll thread wakes up as long as the hot-plug notifications are unread, so whatever the mode they're
+    // cleared here. Only the adaptive schedule makes use of them, SDL finds the devices on its own.
+    if( pollMode == Adaptive ) {
+        adaptPollInterval();
+    } else if( hotplugNotifier ) {
+        hotplugNotifier->drain();
+    }
 
-                    if( sdlDeviceList.at( sdlEvent.cdevice.which ) != nullptr ) {
+}
 
-                        qCDebug( phxInput ).nospace() << "Duplicate controller added at slot "
-                                                      << sdlEvent.cdevice.which << ", ignored";
-                        break;
+qint64 SDLEventLoop::nextPollDeadline( const qint64 previousDeadline ) const {
 
-                    }
+    switch( pollMode ) {
 
-                    auto *joystick = new Joystick( sdlEvent.cdevice.which );
+        case EventDriven:
+            return -1;
 
-                    deviceLocationMap.insert( joystick->instanceID(), sdlEvent.cdevice.which );
+        // Counted from this poll rather than the last deadline, a hot-plug may have woken us long before it.
+        case Adaptive:
+            return qMin( previousDeadline, inputClockNs() ) + adaptiveInterval;
 
-                    sdlDeviceList[ sdlEvent.cdevice.which ] = joystick;
+        case FrameSynchronized:
+            if( frameScheduler ) {
+                return frameScheduler->nextPollTime( inputClockNs() );
+            }
 
-                    emit deviceConnected( joystick );
+        // Fall through, without a scheduler there's nothing to synchronize with.
+        default:
+            return previousDeadline + 1000000000 / pollRate;
 
-                    break;
+    }
 
-                }
+}
 
-                case SDL_CONTROLLERDEVICEREMOVED: {
+void SDLEventLoop::adaptPollInterval() {
 
-                    int index = deviceLocationMap.value( sdlEvent.cbutton.which, -1 );
+    qint64 now = inputClockNs();
 
-                    Q_ASSERT( index != -1 );
+    bool hotplugged = hotplugNotifier && hotplugNotifier->drain();
 
-                    auto *joystick = sdlDeviceList.at( index );
+    if( activity.exchange( false ) || hotplugged ) {
+        lastActivity = now;
+    }
 
-                    Q_ASSERT( joystick != nullptr );
+    qint64 activeInterval = 1000000000 / pollRate;
+    qint64 idleInterval = 1000000000 / idlePollRate;
 
-                    if( joystick->instanceID() == sdlEvent.cdevice.which ) {
+    if( now - lastActivity < activeHoldTime ) {
 
-                        emit deviceRemoved( joystick->sdlIndex() );
-                        sdlDeviceList[ index ] = nullptr;
-                        deviceLocationMap.remove( sdlEvent.cbutton.which );
-                        forceEventsHandling = true;
-                        break;
+        // In use, or something was just plugged in that SDL may not have noticed yet.
+        adaptiveInterval = activeInterval;
 
-                    }
+    } else if( deviceRegistry.count() == 0 ) {
 
-                    break;
+        // Nothing to read, and only a hot-plug can change that. Controllers that are being opened wake us up
+        // once they're ready.
+        bool watching = hotplugNotifier && hotplugNotifier->descriptor() != -1;
+        adaptiveInterval = watching ? notifiedHotplugInterval : hotplugCheckInterval;
 
-                }
+    } else {
 
-                case SDL_CONTROLLERBUTTONUP:
-                case SDL_CONTROLLERBUTTONDOWN:
-                case SDL_JOYBUTTONDOWN:
-                case SDL_JOYBUTTONUP: {
+        // Idle controllers, back off one step per quiet poll.
+        adaptiveInterval = qBound( activeInterval, adaptiveInterval * 2, idleInterval );
 
-                    int index = deviceLocationMap.value( sdlEvent.cbutton.which, -1 );
-                    Q_ASSERT( index != -1 );
+    }
 
-                    auto *joystick = sdlDeviceList.at( index );
+}
 
-                    Q_ASSERT( joystick != nullptr );
+void SDLEventLoop::wakePollThread() {
 
-                    int state = sdlEvent.cbutton.state;
+    if( !sdlPollThread.isRunning() ) {
+        return;
+    }
 
-                    joystick->emitEditModeEvent( sdlEvent.cbutton.button, state );
+    // The thread is either sleeping on its timer, or on SDL's event queue.
+    SDL_Event wakeEvent = {};
+    wakeEvent.type = wakeEventType;
+    backend->pushEvent( &wakeEvent );
 
-                    break;
+    sdlPollThread.wake();
 
-                }
+}
 
-                default:
-                    break;
+Joystick *SDLEventLoop::joystickForInstance( const SDL_JoystickID instanceID ) const {
+    return static_cast<Joystick *>( deviceRegistry.find( instanceID ) );
+}
+
+bool SDLEventLoop::registerMapping( const int index ) {
+
+    if( backend->isGameController( index ) ) {
+        return false;
+    }
+
+    auto guid = backend->deviceGuid( index );
+    auto mapping = controllerDatabase.mapping( guid );
+
+    if( mapping.isEmpty() ) {
+        qCDebug( phxInput ) << "No mapping for joystick" << guid << "at slot" << index;
+        return false;
+    }
+
+    if( !backend->addMapping( mapping ) ) {
+        qCWarning( phxInput ) << "Unable to add the mapping of" << guid << ":" << SDL_GetError();
+        return false;
+    }
+
+    return backend->isGameController( index );
+
+}
+
+void SDLEventLoop::addController( const int index ) {
+
+    forceEventsHandling = false;
+
+    // This needs to be checked for, because the first time a controller
+    // sdl starts up, it fires this signal twice, pretty annoying...
+
+    if( deviceRegistry.atSlot( index ) != nullptr || hotplugQueue.isOpening( index ) ) {
+
+        qCDebug( phxInput ).nospace() << "Duplicate controller added at slot " << index << ", ignored";
+        return;
+
+    }
+
+    // Indices shift as other devices come and go, by the time it's opened this one may be somewhere else.
+    SDL_JoystickID instanceID = backend->deviceInstanceID( index );
+
+    // Opening a device and preparing its mapping can take milliseconds, the other controllers shouldn't have to
+    // wait for it.
+    if( !backend->canOpenConcurrently() ) {
+        publishController( index, prepareController( index, instanceID ) );
+        return;
+    }
+
+    if( !hotplugQueue.open( index, [ this, index, instanceID ] { return prepareController( index, instanceID ); } ) ) {
+        qCWarning( phxInput ).nospace() << "Unable to register controller at slot " << index << ", ignored";
+    }
+
+}
+
+Joystick *SDLEventLoop::prepareController( const int index, const SDL_JoystickID instanceID ) {
+
+    int current = index;
 
+    if( instanceID != -1 ) {
+
+        current = -1;
+
+        // Past the last device there's no instance ID either.
+        for( int i = 0; current == -1 && i < InputDeviceRegistry::maxDevices; ++i ) {
+
+            SDL_JoystickID found = backend->deviceInstanceID( i );
+
+            if( found == -1 ) {
+                break;
             }
 
+            current = found == instanceID ? i : -1;
+
+        }
+
+        // Unplugged before we got to it.
+        if( current == -1 ) {
+            return nullptr;
         }
 
     }
 
+    auto *joystick = new Joystick( backend, current );
+
+    // Failed to open, or the devices moved again in the meantime. Still on the thread that made it, so it can go
+    // right away.
+    if( !joystick->sdlDevice() || ( instanceID != -1 && joystick->instanceID() != instanceID ) ) {
+        delete joystick;
+        return nullptr;
+    }
+
+    joystick->loadMapping();
+
+    // Hand the joystick over to the thread that will own it, which isn't this one.
+    joystick->moveToThread( thread() );
+
+    return joystick;
+
+}
+
+void SDLEventLoop::publishController( const int index, Joystick *joystick ) {
+
+    if( !joystick ) {
+        qCDebug( phxInput ).nospace() << "Controller at slot " << index << " was gone before it could be opened";
+        return;
+    }
+
+    // Unplugged again while it was being opened, SDL won't tell us a second time.
+    if( !joystick->attached() ) {
+        qCDebug( phxInput ).nospace() << "Controller at slot " << index << " went away while opening";
+        retire( joystick );
+        return;
+    }
+
+    if( !deviceRegistry.add( joystick->instanceID(), index, joystick ) ) {
+
+        qCWarning( phxInput ).nospace() << "Unable to register controller at slot " << index << ", ignored";
+        retire( joystick );
+        return;
+
+    }
+
+    // Events only carry changes, so start from the controller's current state.
+    if( pollMode != Polled ) {
+        joystick->update( stickBatch );
+    }
+
+    activity = true;
+
+    emit deviceConnected( joystick );
+
+}
+
+void SDLEventLoop::publishReadyControllers() {
+
+    int slot;
+    InputDevice *device;
+
+    while( hotplugQueue.takeReady( slot, device ) ) {
+        publishController( slot, static_cast<Joystick *>( device ) );
+    }
+
+}
+
+void SDLEventLoop::retire( InputDevice *device ) {
+
+    if( !backend->canOpenConcurrently() ) {
+        deviceEpoch.synchronize();
+        device->selfDestruct();
+        return;
+    }
+
+    // Saving the mapping and closing the device happen on the worker, the QObject itself has to be deleted on
+    // its own thread.
+    hotplugQueue.run( [ this, device ] {
+        deviceEpoch.synchronize();
+        device->saveMapping();
+
+        if( auto *joystick = dynamic_cast<Joystick *>( device ) ) {
+            joystick->close();
+        }
+
+        QMetaObject::invokeMethod( device, "deleteLater", Qt::QueuedConnection );
+    } );
+
 }
 
 void SDLEventLoop::start() {
-    sdlPollTimer.start();
+    sdlPollThread.start();
 }
 
 void SDLEventLoop::stop() {
-    sdlPollTimer.stop();
+
+    if( sdlPollThread.isRunning() ) {
+        sdlPollThread.requestInterruption();
+        wakePollThread();
+    }
+
+    sdlPollThread.stop();
+
+}
+
+SDLEventLoop::PollMode SDLEventLoop::mode() const {
+    return pollMode;
+}
+
+void SDLEventLoop::setMode( const SDLEventLoop::PollMode mode ) {
+    pollMode = mode;
+    wakePollThread();
 }
 
 void SDLEventLoop::initSDL() {
 
-    if( SDL_Init( SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER ) < 0 ) {
+    if( !backend->init() ) {
         qFatal( "Fatal: Unable to initialize SDL2: %s", SDL_GetError() );
     }
 
-    // Allow game controller event states to be automatically updated.
-    SDL_GameControllerEventState( SDL_ENABLE );
-
 }
 
 void SDLEventLoop::quitSDL() {
-    SDL_Quit();
+    backend->quit();
 }
@@ -2,21 +2,60 @@
 #define SDLEVENTLOOP_H
 
 #include <QObject>
-#include <QTimer>
 #include <QThread>
 #include <QMutex>
-#include <QHash>
 #include <SDL.h>
 
+#include "controllerdatabase.h"
+#include "framepollscheduler.h"
+#include "hotplugnotifier.h"
+#include "hotplugqueue.h"
+#include "inputdeviceregistry.h"
+#include "inputepoch.h"
+#include "inputstatistics.h"
 #include "joystick.h"
+#include "joystickbackend.h"
+#include "pollthread.h"
+#include "stickprocessor.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
 
 // The SDLEventLoop's job is to poll for button states,
 // and to react the handle to newly connected, or disconnected, devices.
 
+// There are two ways of getting button states. Polled mode reads every button and axis of every controller at a
+// fixed rate. EventDriven mode sleeps until SDL reports a raw joystick event, and only writes the buttons that
+// event changed, so the work done follows what the player does rather than how many controllers are plugged in.
+// FrameSynchronized mode handles events the same way, but only wakes up when the FramePollScheduler says the
+// core is about to read input.
+
+// EventDriven mode doesn't really sleep with SDL itself, though. Without the video subsystem SDL has nothing to
+// block on, and SDL_WaitEventTimeout() pumps events and sleeps for a millisecond in a loop. That's about a thousand
+// wakeups a second inside SDL while idle, they just don't read any controller. Adaptive mode is the one to use
+// where idle power matters.
+
+// Adaptive mode (the default) handles events too, but picks its own rate: the full poll rate while controllers are
+// in use, backing off to the idle rate once they've been left alone, and next to nothing with no controllers at
+// all, when only a hot-plug can change anything. On Linux the thread then sleeps until /dev/input changes. It's
+// meant for the frontend, the InputManager switches to FrameSynchronized while a game runs.
+
+// Polling happens on a dedicated PollThread, so a busy GUI thread never delays it. The deviceConnected() and
+// deviceRemoved() signals are emitted from that thread, connect to them with an automatic or queued connection.
+
+// Every call into SDL goes through a JoystickBackend. By default that's SDL itself, but any other backend can be
+// given instead, such as the SimulatedJoystickBackend the input benchmark runs on.
+
 class SDLEventLoop : public QObject {
         Q_OBJECT
-        QTimer sdlPollTimer;
+        std::unique_ptr<JoystickBackend> ownedBackend;
+        JoystickBackend *backend;
+        PollThread sdlPollThread;
         int numOfDevices;
+        std::atomic<int> pollRate;
+
+        // Held for the length of a poll, pollEvents() can be called by both the poll thread and the core thread.
         QMutex sdlEventMutex;
 
         bool forceEventsHandling;
@@ -24,30 +63,150 @@ class SDLEventLoop : public QObject {
         // The InputManager is in charge of deleting these devices.
         // The InputManager gains access to these devices by the
         // deviceConnected( Joystick * ) signal.
+        InputDeviceRegistry deviceRegistry;
 
-        // Also for this list, make use of the 'which' index, for
-        // proper insertions and retrievals.
-        QList<Joystick *> sdlDeviceList;
-        QHash<int, int> deviceLocationMap;
+        // Mappings are handed to SDL one at a time, as their controllers show up.
+        ControllerDatabase controllerDatabase;
 
     public:
 
+        enum PollMode {
+            Polled,
+            EventDriven,
+            FrameSynchronized,
+            Adaptive,
+        };
+
         explicit SDLEventLoop( QObject *parent = 0 );
 
+        // Use this backend instead of SDL. It must outlive the SDLEventLoop, and every Joystick it creates.
+        explicit SDLEventLoop( JoystickBackend *joystickBackend, QObject *parent = 0 );
+        ~SDLEventLoop();
+
+        PollMode mode() const;
+        void setMode( const PollMode mode );
+
+        // Polls per second in polled mode, and in adaptive mode while controllers are in use. 200 by default.
+        void setPollRate( const int rate );
+
+        // The fewest polls per second adaptive mode backs off to while controllers are connected but idle, 20 by
+        // default.
+        void setIdlePollRate( const int rate );
+
+        // Times the polls in FrameSynchronized mode. Must be set while the poll thread isn't running.
+        void setFrameScheduler( FramePollScheduler *scheduler );
+
+        // Called on the poll thread after every poll. Must be set while the poll thread isn't running.
+        void setPollHook( std::function<void()> hook );
+
+        // SCHED_FIFO priority for the poll thread, 0 (the default) to leave it alone.
+        void setRealtimePriority( const int priority );
+
+        // Pin the poll thread to this CPU, -1 (the default) to let it run anywhere.
+        void setCpuAffinity( const int cpu );
+
+        // Counters for polls, their CPU time and lock contention. Shared with the InputManager, which adds its
+        // own lock to them.
+        InputStatistics &statistics();
+
+        // Every connected joystick. The slots belong to the poll thread, the ports to the InputManager.
+        InputDeviceRegistry &registry();
+
+        // Guards reads of the registry's ports that don't take the InputManager's lock.
+        InputEpoch &epoch();
+
+        // Save the mapping of a device that's been removed, close it and delete it, without blocking the caller.
+        // It's only closed once every reader that could still have found it on its port is done with it. Any thread.
+        void retire( InputDevice *device );
+
     public slots:
 
         void pollEvents();
 
+        // Start or stop the poll thread. The thread options take effect on start().
         void start();
         void stop();
 
     signals:
 
         void deviceConnected( Joystick *joystick );
-        void deviceRemoved( int which );
+        // The device has already been unregistered, it's gone from its slot but may still be on a port.
+        void deviceRemoved( int which, InputDevice *device );
 
     private:
 
+        // How long the poll thread sleeps on SDL in event driven mode, in milliseconds.
+        static const int eventWaitTimeout = 100;
+
+        // Adaptive mode stays at the full rate this long after the last input or hot-plug, in nanoseconds.
+        static const qint64 activeHoldTime = Q_INT64_C( 1000000000 );
+
+        // How often adaptive mode looks for new controllers while there are none, with and without a
+        // HotplugNotifier to wake it up, in nanoseconds. The first is only a safety net.
+        static const qint64 notifiedHotplugInterval = Q_INT64_C( 10000000000 );
+        static const qint64 hotplugCheckInterval = Q_INT64_C( 1000000000 );
+
+        std::atomic<int> idlePollRate;
+
+        // Adaptive mode's schedule, poll thread only. activity is set by every poll that saw input or a hot-plug,
+        // which the core thread may run too.
+        std::atomic<bool> activity;
+        qint64 lastActivity;
+        qint64 adaptiveInterval;
+
+        // Only the real SDL backend has devices in /dev/input.
+        std::unique_ptr<HotplugNotifier> hotplugNotifier;
+
+        // The sticks of a poll, processed together. Only used under sdlEventMutex.
+        StickBatch stickBatch;
+
+        std::atomic<PollMode> pollMode;
+
+        FramePollScheduler *frameScheduler;
+        std::function<void()> pollHook;
+
+        InputStatistics pollStatistics;
+
+        // A user event that wakes the poll thread when it's waiting on SDL.
+        Uint32 wakeEventType;
+
+        // Declared before the queue, whose tasks wait on it.
+        InputEpoch deviceEpoch;
+
+        HotplugQueue hotplugQueue;
+
+        // The poll thread's loop, blocks until there's something to read in event driven mode.
+        void waitEvents();
+
+        // pollEvents(), minus the locking and the bookkeeping.
+        void handleEvents();
+
+        // The poll thread's schedule, depends on the mode.
+        qint64 nextPollDeadline( const qint64 previousDeadline ) const;
+
+        // Pick adaptive mode's next interval from what the last poll saw.
+        void adaptPollInterval();
+
+        // Make the poll thread notice a mode change, or a stop request, right away.
+        void wakePollThread();
+
+        Joystick *joystickForInstance( const SDL_JoystickID instanceID ) const;
+
+        // A joystick showed up, give SDL its mapping if we have one. Returns true if that made it a game
+        // controller, SDL won't announce it as one by itself then.
+        bool registerMapping( const int index );
+
+        // Open the game controller at this index on the hot-plug worker, it's published once it's ready.
+        void addController( const int index );
+
+        // Hot-plug worker: open the device announced at this index and load its mapping. Returns nullptr if it's
+        // gone by now. The instance ID is what the index had when it was announced, -1 if it isn't known.
+        Joystick *prepareController( const int index, const SDL_JoystickID instanceID );
+
+        // Register a prepared controller and hand it to the InputManager.
+        void publishController( const int index, Joystick *joystick );
+        void publishReadyControllers();
+
         void initSDL();
         void quitSDL();
 
@@ -0,0 +1,528 @@
+#include "simulatedjoystickbackend.h"
+
+#include "inputclock.h"
+#include "xorshift.h"
+
+#include <QIODevice>
+#include <QMutexLocker>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+const int SimulatedJoystickBackend::maxPads;
+const int SimulatedJoystickBackend::buttonsPerPad;
+const int SimulatedJoystickBackend::guideButton;
+const int SimulatedJoystickBackend::axesPerPad;
+
+static const char simulatedGuid[] = "53696d756c61746564204a6f79000000";
+
+static const char simulatedMapping[] = "53696d756c61746564204a6f79000000,Simulated Gamepad,"
+                                       "a:b0,b:b1,x:b2,y:b3,back:b4,guide:b5,start:b6,leftstick:b7,rightstick:b8,"
+                                       "leftshoulder:b9,rightshoulder:b10,dpup:b11,dpdown:b12,dpleft:b13,dpright:b14,"
+                                       "leftx:a0,lefty:a1,rightx:a2,righty:a3,lefttrigger:a4,righttrigger:a5,";
+
+SimulatedJoystickBackend::SimulatedJoystickBackend()
+    : queueHead( 0 ),
+      queueCount( 0 ),
+      dropped( 0 ),
+      traceNext( 0 ),
+      traceStart( 0 ),
+      nextEventType( SDL_USEREVENT ) {
+
+    for( int i = 0; i < maxPads; ++i ) {
+        pads[ i ].reset( new Pad );
+        pads[ i ]->index = i;
+        pads[ i ]->attached = false;
+        pads[ i ]->buttons = 0;
+        pads[ i ]->hat = SDL_HAT_CENTERED;
+
+        for( auto &axis : pads[ i ]->axes ) {
+            axis = 0;
+        }
+    }
+
+}
+
+SimulatedJoystickBackend::~SimulatedJoystickBackend() {
+
+}
+
+void SimulatedJoystickBackend::plugIn( const int count ) {
+
+    QMutexLocker locker( &mutex );
+
+    for( int i = 0; i < qMin( count, maxPads ); ++i ) {
+
+        if( pads[ i ]->attached ) {
+            continue;
+        }
+
+        pads[ i ]->attached = true;
+
+        SDL_Event event = {};
+        event.type = SDL_CONTROLLERDEVICEADDED;
+        event.cdevice.which = i;
+        enqueue( event );
+
+    }
+
+    eventQueued.wakeAll();
+
+}
+
+void SimulatedJoystickBackend::unplug( const int pad ) {
+
+    QMutexLocker locker( &mutex );
+
+    if( pad < 0 || pad >= maxPads || !pads[ pad ]->attached ) {
+        return;
+    }
+
+    pads[ pad ]->attached = false;
+
+    SDL_Event event = {};
+    event.type = SDL_CONTROLLERDEVICEREMOVED;
+    event.cdevice.which = pad;
+    enqueue( event );
+
+    eventQueued.wakeAll();
+
+}
+
+void SimulatedJoystickBackend::setTrace( const QVector<SimulatedInput> &newTrace ) {
+
+    QMutexLocker locker( &mutex );
+
+    trace = newTrace;
+    std::stable_sort( trace.begin(), trace.end(), []( const SimulatedInput & a, const SimulatedInput & b ) {
+        return a.time < b.time;
+    } );
+
+    traceNext = trace.size();
+
+}
+
+void SimulatedJoystickBackend::start( const qint64 now ) {
+
+    QMutexLocker locker( &mutex );
+
+    traceStart = now;
+    traceNext = 0;
+
+    eventQueued.wakeAll();
+
+}
+
+bool SimulatedJoystickBackend::finished() {
+    QMutexLocker locker( &mutex );
+    return traceNext >= trace.size();
+}
+
+quint64 SimulatedJoystickBackend::droppedEvents() const {
+    return dropped;
+}
+
+QVector<SimulatedInput> SimulatedJoystickBackend::randomTrace( const int pads, const qint64 duration,
+                                                               const int eventsPerSecond, const quint32 seed ) {
+
+    QVector<SimulatedInput> trace;
+
+    if( pads <= 0 || eventsPerSecond <= 0 ) {
+        return trace;
+    }
+
+    trace.reserve( static_cast<int>( pads * eventsPerSecond * ( duration / 1000000000 + 1 ) ) );
+
+    quint32 state = seed ? seed : 1;
+    auto next = [ &state ] {
+        return xorshift32( state );
+    };
+
+    for( int pad = 0; pad < qMin( pads, maxPads ); ++pad ) {
+
+        quint32 held = 0;
+        qint64 time = 0;
+
+        forever {
+
+            // Exponentially distributed gaps, like presses from a player who isn't keeping time.
+            qreal uniform = ( next() % 1000000 + 1 ) / 1000001.0;
+            time += static_cast<qint64>( -std::log( uniform ) * 1000000000.0 / eventsPerSecond );
+
+            if( time >= duration ) {
+                break;
+            }
+
+            SimulatedInput input;
+            input.time = time;
+            input.pad = pad;
+
+            quint32 roll = next();
+
+            if( roll % 10 < 6 ) {
+                input.element = SimulatedInput::Button;
+                input.index = static_cast<int>( ( roll >> 8 ) % ( buttonsPerPad - 1 ) );
+                input.index += input.index >= guideButton ? 1 : 0;
+                held ^= 1u << input.index;
+                input.value = ( held >> input.index ) & 1;
+            } else if( roll % 10 < 9 ) {
+                input.element = SimulatedInput::Axis;
+                input.index = static_cast<int>( ( roll >> 8 ) % axesPerPad );
+                input.value = static_cast<int>( next() % 65536 ) - 32768;
+            } else {
+                static const int directions[] = {
+                    SDL_HAT_CENTERED, SDL_HAT_UP, SDL_HAT_RIGHT, SDL_HAT_DOWN, SDL_HAT_LEFT,
+                };
+                input.element = SimulatedInput::Hat;
+                input.index = 0;
+                input.value = directions[ ( roll >> 8 ) % 5 ];
+            }
+
+            trace.append( input );
+
+        }
+
+    }
+
+    std::stable_sort( trace.begin(), trace.end(), []( const SimulatedInput & a, const SimulatedInput & b ) {
+        return a.time < b.time;
+    } );
+
+    return trace;
+
+}
+
+QVector<SimulatedInput> SimulatedJoystickBackend::loadTrace( QIODevice *file ) {
+
+    QVector<SimulatedInput> trace;
+    QTextStream stream( file );
+
+    while( !stream.atEnd() ) {
+
+        QString line = stream.readLine().trimmed();
+
+        if( line.isEmpty() || line.startsWith( '#' ) ) {
+            continue;
+        }
+
+        auto fields = line.split( ' ', QString::SkipEmptyParts );
+
+        if( fields.size() != 4 || fields.at( 2 ).size() < 2 ) {
+            qWarning( "Ignoring malformed trace line: %s", qPrintable( line ) );
+            continue;
+        }
+
+        SimulatedInput input;
+        input.time = static_cast<qint64>( fields.at( 0 ).toDouble() * 1000000 );
+        input.pad = fields.at( 1 ).toInt();
+        input.index = fields.at( 2 ).mid( 1 ).toInt();
+        input.value = fields.at( 3 ).toInt();
+
+        switch( fields.at( 2 ).at( 0 ).toLatin1() ) {
+            case 'b':
+                input.element = SimulatedInput::Button;
+                break;
+
+            case 'a':
+                input.element = SimulatedInput::Axis;
+                break;
+
+            case 'h':
+                input.element = SimulatedInput::Hat;
+                break;
+
+            default:
+                qWarning( "Ignoring malformed trace line: %s", qPrintable( line ) );
+                continue;
+        }
+
+        trace.append( input );
+
+    }
+
+    return trace;
+
+}
+
+bool SimulatedJoystickBackend::init() {
+    return true;
+}
+
+void SimulatedJoystickBackend::quit() {
+
+}
+
+Uint32 SimulatedJoystickBackend::registerEvent() {
+    QMutexLocker locker( &mutex );
+    return nextEventType++;
+}
+
+bool SimulatedJoystickBackend::pollEvent( SDL_Event *event ) {
+
+    QMutexLocker locker( &mutex );
+
+    advance( inputClockNs(), true );
+
+    if( queueCount == 0 ) {
+        return false;
+    }
+
+    *event = queue[ queueHead ];
+    queueHead = ( queueHead + 1 ) % queueSize;
+    queueCount--;
+
+    return true;
+
+}
+
+bool SimulatedJoystickBackend::waitEvent( const int timeout ) {
+
+    QMutexLocker locker( &mutex );
+
+    qint64 deadline = inputClockNs() + static_cast<qint64>( timeout ) * 1000000;
+
+    forever {
+
+        qint64 now = inputClockNs();
+        advance( now, true );
+
+        if( queueCount > 0 ) {
+            return true;
+        }
+
+        qint64 wakeup = qMin( deadline, nextChangeTime() );
+
+        if( now >= deadline ) {
+            return false;
+        }
+
+        // Like SDL's own wait, this only has millisecond resolution.
+        auto milliseconds = static_cast<unsigned long>( ( qMax<qint64>( wakeup - now, 0 ) + 999999 ) / 1000000 );
+        eventQueued.wait( &mutex, qMax( milliseconds, 1ul ) );
+
+    }
+
+}
+
+void SimulatedJoystickBackend::pushEvent( SDL_Event *event ) {
+
+    QMutexLocker locker( &mutex );
+
+    enqueue( *event );
+    eventQueued.wakeAll();
+
+}
+
+void SimulatedJoystickBackend::update() {
+
+    QMutexLocker locker( &mutex );
+
+    // Polled mode never reads the queue, so only the states change.
+    advance( inputClockNs(), false );
+
+}
+
+QString SimulatedJoystickBackend::deviceGuid( const int index ) {
+    Q_UNUSED( index );
+    return simulatedGuid;
+}
+
+// Pads never move, the instance ID is the index, see instanceID().
+SDL_JoystickID SimulatedJoystickBackend::deviceInstanceID( const int index ) {
+    return index >= 0 && index < maxPads ? index : -1;
+}
+
+// Every pad comes with its mapping built in, and is announced with SDL_CONTROLLERDEVICEADDED right away.
+bool SimulatedJoystickBackend::isGameController( const int index ) {
+    return index >= 0 && index < maxPads;
+}
+
+bool SimulatedJoystickBackend::addMapping( const QByteArray &mapping ) {
+    Q_UNUSED( mapping );
+    return true;
+}
+
+JoystickBackend::Handle SimulatedJoystickBackend::open( const int index ) {
+
+    if( index < 0 || index >= maxPads ) {
+        return nullptr;
+    }
+
+    return pads[ index ].get();
+
+}
+
+void SimulatedJoystickBackend::close( Handle device ) {
+    Q_UNUSED( device );
+}
+
+// Pads are never really opened, they're always there.
+bool SimulatedJoystickBackend::canOpenConcurrently() {
+    return true;
+}
+
+bool SimulatedJoystickBackend::attached( Handle device ) {
+    return pad( device )->attached;
+}
+
+SDL_JoystickID SimulatedJoystickBackend::instanceID( Handle device ) {
+    return pad( device )->index;
+}
+
+QString SimulatedJoystickBackend::name( Handle device ) {
+    return QStringLiteral( "Simulated Gamepad %1" ).arg( pad( device )->index );
+}
+
+QString SimulatedJoystickBackend::guid( Handle device ) {
+    Q_UNUSED( device );
+    return simulatedGuid;
+}
+
+QString SimulatedJoystickBackend::mapping( Handle device ) {
+    Q_UNUSED( device );
+    return simulatedMapping;
+}
+
+int SimulatedJoystickBackend::buttonCount( Handle device ) {
+    Q_UNUSED( device );
+    return buttonsPerPad;
+}
+
+int SimulatedJoystickBackend::axisCount( Handle device ) {
+    Q_UNUSED( device );
+    return axesPerPad;
+}
+
+int SimulatedJoystickBackend::hatCount( Handle device ) {
+    Q_UNUSED( device );
+    return 1;
+}
+
+int SimulatedJoystickBackend::ballCount( Handle device ) {
+    Q_UNUSED( device );
+    return 0;
+}
+
+quint8 SimulatedJoystickBackend::button( Handle device, const int button ) {
+
+    if( button < 0 || button >= buttonsPerPad ) {
+        return 0;
+    }
+
+    return ( pad( device )->buttons.load( std::memory_order_relaxed ) >> button ) & 1;
+
+}
+
+qint16 SimulatedJoystickBackend::axis( Handle device, const int axis ) {
+
+    if( axis < 0 || axis >= axesPerPad ) {
+        return 0;
+    }
+
+    return pad( device )->axes[ axis ].load( std::memory_order_relaxed );
+
+}
+
+quint8 SimulatedJoystickBackend::hat( Handle device, const int hat ) {
+    return hat == 0 ? pad( device )->hat.load( std::memory_order_relaxed ) : SDL_HAT_CENTERED;
+}
+
+SimulatedJoystickBackend::Pad *SimulatedJoystickBackend::pad( Handle device ) {
+    return static_cast<Pad *>( device );
+}
+
+void SimulatedJoystickBackend::enqueue( const SDL_Event &event ) {
+
+    if( queueCount == queueSize ) {
+        dropped.fetch_add( 1, std::memory_order_relaxed );
+        return;
+    }
+
+    queue[ ( queueHead + queueCount ) % queueSize ] = event;
+    queueCount++;
+
+}
+
+void SimulatedJoystickBackend::advance( const qint64 now, const bool queueEvents ) {
+
+    while( traceNext < trace.size() && traceStart + trace.at( traceNext ).time <= now ) {
+
+        const SimulatedInput &input = trace.at( traceNext++ );
+
+        if( input.pad < 0 || input.pad >= maxPads || !pads[ input.pad ]->attached ) {
+            continue;
+        }
+
+        Pad *target = pads[ input.pad ].get();
+
+        SDL_Event event = {};
+        event.common.timestamp = static_cast<Uint32>( ( traceStart + input.time ) / 1000000 );
+
+        switch( input.element ) {
+
+            case SimulatedInput::Button: {
+                if( input.index < 0 || input.index >= buttonsPerPad ) {
+                    continue;
+                }
+
+                quint32 bit = 1u << input.index;
+                quint32 buttons = target->buttons.load( std::memory_order_relaxed );
+                target->buttons.store( input.value ? ( buttons | bit ) : ( buttons & ~bit ), std::memory_order_relaxed );
+
+                event.type = input.value ? SDL_JOYBUTTONDOWN : SDL_JOYBUTTONUP;
+                event.jbutton.which = target->index;
+                event.jbutton.button = static_cast<Uint8>( input.index );
+                event.jbutton.state = input.value ? SDL_PRESSED : SDL_RELEASED;
+                break;
+            }
+
+            case SimulatedInput::Axis: {
+                if( input.index < 0 || input.index >= axesPerPad ) {
+                    continue;
+                }
+
+                auto value = static_cast<qint16>( qBound( -32768, input.value, 32767 ) );
+                target->axes[ input.index ].store( value, std::memory_order_relaxed );
+
+                event.type = SDL_JOYAXISMOTION;
+                event.jaxis.which = target->index;
+                event.jaxis.axis = static_cast<Uint8>( input.index );
+                event.jaxis.value = value;
+                break;
+            }
+
+            case SimulatedInput::Hat: {
+                if( input.index != 0 ) {
+                    continue;
+                }
+
+                target->hat.store( static_cast<quint8>( input.value ), std::memory_order_relaxed );
+
+                event.type = SDL_JOYHATMOTION;
+                event.jhat.which = target->index;
+                event.jhat.hat = 0;
+                event.jhat.value = static_cast<Uint8>( input.value );
+                break;
+            }
+
+        }
+
+        if( queueEvents ) {
+            enqueue( event );
+        }
+
+    }
+
+}
+
+qint64 SimulatedJoystickBackend::nextChangeTime() const {
+
+    if( traceNext >= trace.size() ) {
+        return std::numeric_limits<qint64>::max();
+    }
+
+    return traceStart + trace.at( traceNext ).time;
+
+}
@@ -0,0 +1,157 @@
+#ifndef SIMULATEDJOYSTICKBACKEND_H
+#define SIMULATEDJOYSTICKBACKEND_H
+
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "joystickbackend.h"
+
+#include <atomic>
+#include <memory>
+
+class QIODevice;
+
+// One change to a simulated controller: at this many nanoseconds after the trace started, set this raw element of
+// this pad to this value.
+
+struct SimulatedInput {
+
+    enum Element {
+        Button,
+        Axis,
+        Hat,
+    };
+
+    qint64 time;
+    int pad;
+    Element element;
+    int index;
+    int value;
+
+};
+
+// SimulatedJoystickBackend stands in for SDL with up to Joystick::maxNumOfDevices fake controllers, so the whole
+// input pipeline can run without any hardware, display or SDL_Init(). Every pad uses the same layout: buttons
+// b0 - b14, both sticks and both triggers on a0 - a5, and one hat.
+
+// The pads are driven by a trace, replayed against inputClockNs(). Whenever SDLEventLoop polls or waits, every
+// change that's due is applied and queued as a raw SDL joystick event, just like SDL would. waitEvent() sleeps
+// until the next change is due, so the poll thread wakes up when a real controller would have woken it.
+
+class SimulatedJoystickBackend : public JoystickBackend {
+
+    public:
+
+        // Same as Joystick::maxNumOfDevices
+        static const int maxPads = 128;
+
+        static const int buttonsPerPad = 15;
+        static const int guideButton = 5;
+        static const int axesPerPad = 6;
+
+        SimulatedJoystickBackend();
+        ~SimulatedJoystickBackend();
+
+        // Connect pads 0 to count - 1, the SDLEventLoop sees them on its next poll.
+        void plugIn( const int count );
+
+        // Disconnect one pad.
+        void unplug( const int pad );
+
+        // Replaces the trace, it starts replaying at start().
+        void setTrace( const QVector<SimulatedInput> &trace );
+        void start( const qint64 now );
+
+        // Whether every change in the trace has been applied.
+        bool finished();
+
+        // Events lost because the queue was full, nonzero means the numbers are off.
+        quint64 droppedEvents() const;
+
+        // A random trace, with changes arriving at eventsPerSecond per pad on average. The same seed always gives
+        // the same trace. The Guide button is left alone, it's for opening the frontend's menus, not for playing.
+        static QVector<SimulatedInput> randomTrace( const int pads, const qint64 duration,
+                                                    const int eventsPerSecond, const quint32 seed );
+
+        // A scripted trace, one change per line: "<milliseconds> <pad> <element><index> <value>", where the
+        // element is b, a or h. Blank lines and lines starting with # are skipped.
+        static QVector<SimulatedInput> loadTrace( QIODevice *file );
+
+        // JoystickBackend
+        bool init() override;
+        void quit() override;
+
+        Uint32 registerEvent() override;
+
+        bool pollEvent( SDL_Event *event ) override;
+        bool waitEvent( const int timeout ) override;
+        void pushEvent( SDL_Event *event ) override;
+
+        void update() override;
+
+        QString deviceGuid( const int index ) override;
+        SDL_JoystickID deviceInstanceID( const int index ) override;
+        bool isGameController( const int index ) override;
+        bool addMapping( const QByteArray &mapping ) override;
+
+        Handle open( const int index ) override;
+        void close( Handle device ) override;
+
+        bool canOpenConcurrently() override;
+
+        bool attached( Handle device ) override;
+        SDL_JoystickID instanceID( Handle device ) override;
+        QString name( Handle device ) override;
+        QString guid( Handle device ) override;
+        QString mapping( Handle device ) override;
+
+        int buttonCount( Handle device ) override;
+        int axisCount( Handle device ) override;
+        int hatCount( Handle device ) override;
+        int ballCount( Handle device ) override;
+
+        quint8 button( Handle device, const int button ) override;
+        qint16 axis( Handle device, const int axis ) override;
+        quint8 hat( Handle device, const int hat ) override;
+
+    private:
+
+        // Element states are atomic, they're read without the mutex.
+        struct Pad {
+            int index;
+            std::atomic<bool> attached;
+            std::atomic<quint32> buttons;
+            std::atomic<qint16> axes[ axesPerPad ];
+            std::atomic<quint8> hat;
+        };
+
+        // Fixed size, so queueing never allocates.
+        static const int queueSize = 4096;
+
+        QMutex mutex;
+        QWaitCondition eventQueued;
+
+        std::unique_ptr<Pad> pads[ maxPads ];
+
+        SDL_Event queue[ queueSize ];
+        int queueHead;
+        int queueCount;
+        std::atomic<quint64> dropped;
+
+        QVector<SimulatedInput> trace;
+        int traceNext;
+        qint64 traceStart;
+
+        Uint32 nextEventType;
+
+        static Pad *pad( Handle device );
+
+        // The mutex must be held for these.
+        void enqueue( const SDL_Event &event );
+        void advance( const qint64 now, const bool queueEvents );
+        qint64 nextChangeTime() const;
+
+};
+
+#endif // SIMULATEDJOYSTICKBACKEND_H
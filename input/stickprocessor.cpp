@@ -0,0 +1,260 @@
+#include "stickprocessor.h"
+
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+const int StickCurve::segments;
+const int StickBatch::maxSticks;
+
+// A stick all the way out, in either direction.
+static const float fullScale = 32767.0f;
+
+// tan( 67.5 degrees ). A stick points right while it's within 67.5 degrees of straight right, and right and up
+// overlap between 22.5 and 67.5 degrees, which makes 8 sectors of 45 degrees.
+static const float sectorSlope = 2.41421356f;
+
+// Past this the dead zone would leave nothing to stretch.
+static const qint16 maxDeadZone = 32000;
+
+// Both paths do the same float operations in the same order, which is what keeps their results identical. Don't
+// let one of them take a shortcut, like a reciprocal instead of a division.
+
+StickCurve::StickCurve( const qreal exponent ) {
+
+    qreal power = qMax( exponent, 0.1 );
+
+    for( int i = 0; i <= segments; ++i ) {
+        points[ i ] = static_cast<float>( std::pow( static_cast<qreal>( i ) / segments, power ) );
+    }
+
+    points[ segments + 1 ] = points[ segments ];
+
+}
+
+float StickCurve::map( const float magnitude ) const {
+
+    float position = qBound( 0.0f, magnitude, 1.0f ) * segments;
+    int index = static_cast<int>( position );
+
+    return points[ index ] + ( points[ index + 1 ] - points[ index ] ) * ( position - index );
+
+}
+
+StickSettings::StickSettings()
+    : shape( ScaledRadial ),
+      deadZone( 0 ),
+      dpadThreshold( 12000 ) {
+
+}
+
+static qint16 toStick( const float value ) {
+    return static_cast<qint16>( qBound( -32768l, std::lrint( value * fullScale ), 32767l ) );
+}
+
+static void processStick( qint16 &x, qint16 &y, const StickSettings &settings, quint8 &dpad ) {
+
+    float fx = x / fullScale;
+    float fy = y / fullScale;
+    float deadZone = qBound<qint16>( 0, settings.deadZone, maxDeadZone ) / fullScale;
+    float magnitude = std::sqrt( fx * fx + fy * fy );
+
+    float outX;
+    float outY;
+
+    switch( settings.shape ) {
+        case StickSettings::Axial:
+            outX = std::fabs( fx ) >= deadZone ? fx : 0.0f;
+            outY = std::fabs( fy ) >= deadZone ? fy : 0.0f;
+            break;
+
+        case StickSettings::Radial:
+            outX = magnitude >= deadZone ? fx : 0.0f;
+            outY = magnitude >= deadZone ? fy : 0.0f;
+            break;
+
+        default: {
+            float scale = magnitude >= deadZone && magnitude > 0.0f
+                          ? ( magnitude - deadZone ) / ( 1.0f - deadZone ) / magnitude : 0.0f;
+            outX = fx * scale;
+            outY = fy * scale;
+            break;
+        }
+    }
+
+    float curveScale = 1.0f;
+
+    if( settings.curve ) {
+        float outMagnitude = std::sqrt( outX * outX + outY * outY );
+
+        if( outMagnitude > 0.0f ) {
+            curveScale = settings.curve->map( outMagnitude ) / outMagnitude;
+        }
+    }
+
+    x = toStick( outX * curveScale );
+    y = toStick( outY * curveScale );
+
+    // The D-Pad goes by where the stick physically is.
+    float absX = std::fabs( fx );
+    float absY = std::fabs( fy );
+    bool pushed = magnitude > settings.dpadThreshold / fullScale;
+    bool horizontal = pushed && absY < absX * sectorSlope;
+    bool vertical = pushed && absX < absY * sectorSlope;
+
+    dpad = ( vertical && fy < 0.0f ? StickProcessor::Up : 0 )
+           | ( vertical && fy > 0.0f ? StickProcessor::Down : 0 )
+           | ( horizontal && fx < 0.0f ? StickProcessor::Left : 0 )
+           | ( horizontal && fx > 0.0f ? StickProcessor::Right : 0 );
+
+}
+
+void StickProcessor::processScalar( qint16 *x, qint16 *y, const StickSettings *const *settings, quint8 *dpad,
+                                    const int count ) {
+
+    for( int i = 0; i < count; ++i ) {
+        processStick( x[ i ], y[ i ], *settings[ i ], dpad[ i ] );
+    }
+
+}
+
+#ifdef __SSE2__
+
+// Sign extend four sticks to 32 bits and make floats of them, 0 - 1.
+static __m128 loadSticks( const qint16 *values, const __m128 scale ) {
+    __m128i packed = _mm_loadl_epi64( reinterpret_cast<const __m128i *>( values ) );
+    __m128i wide = _mm_srai_epi32( _mm_unpacklo_epi16( packed, packed ), 16 );
+    return _mm_div_ps( _mm_cvtepi32_ps( wide ), scale );
+}
+
+static void storeSticks( qint16 *values, const __m128 sticks, const __m128 scale ) {
+    __m128i wide = _mm_cvtps_epi32( _mm_mul_ps( sticks, scale ) );
+    _mm_storel_epi64( reinterpret_cast<__m128i *>( values ), _mm_packs_epi32( wide, wide ) );
+}
+
+static __m128 select( const __m128 mask, const __m128 value ) {
+    return _mm_and_ps( mask, value );
+}
+
+static void processFourSticks( qint16 *x, qint16 *y, const StickSettings *const *settings, quint8 *dpad ) {
+
+    const __m128 scale = _mm_set1_ps( fullScale );
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128 slope = _mm_set1_ps( sectorSlope );
+    const __m128 absMask = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+
+    // Every stick has its own settings, gather them into lanes.
+    float deadZones[ 4 ];
+
+    for( int i = 0; i < 4; ++i ) {
+        deadZones[ i ] = qBound<qint16>( 0, settings[ i ]->deadZone, maxDeadZone );
+    }
+
+    __m128 deadZone = _mm_div_ps( _mm_loadu_ps( deadZones ), scale );
+    __m128 threshold = _mm_div_ps( _mm_set_ps( settings[ 3 ]->dpadThreshold, settings[ 2 ]->dpadThreshold,
+                                               settings[ 1 ]->dpadThreshold, settings[ 0 ]->dpadThreshold ), scale );
+    __m128i shape = _mm_set_epi32( settings[ 3 ]->shape, settings[ 2 ]->shape, settings[ 1 ]->shape,
+                                   settings[ 0 ]->shape );
+
+    __m128 fx = loadSticks( x, scale );
+    __m128 fy = loadSticks( y, scale );
+    __m128 magnitude = _mm_sqrt_ps( _mm_add_ps( _mm_mul_ps( fx, fx ), _mm_mul_ps( fy, fy ) ) );
+    __m128 absX = _mm_and_ps( fx, absMask );
+    __m128 absY = _mm_and_ps( fy, absMask );
+
+    // Every shape is worked out, then each lane keeps its own.
+    __m128 axialX = select( _mm_cmpge_ps( absX, deadZone ), fx );
+    __m128 axialY = select( _mm_cmpge_ps( absY, deadZone ), fy );
+
+    __m128 outside = _mm_cmpge_ps( magnitude, deadZone );
+    __m128 radialX = select( outside, fx );
+    __m128 radialY = select( outside, fy );
+
+    __m128 stretch = _mm_div_ps( _mm_div_ps( _mm_sub_ps( magnitude, deadZone ), _mm_sub_ps( one, deadZone ) ),
+                                 magnitude );
+    stretch = select( _mm_and_ps( outside, _mm_cmpgt_ps( magnitude, zero ) ), stretch );
+    __m128 scaledX = _mm_mul_ps( fx, stretch );
+    __m128 scaledY = _mm_mul_ps( fy, stretch );
+
+    __m128 isAxial = _mm_castsi128_ps( _mm_cmpeq_epi32( shape, _mm_set1_epi32( StickSettings::Axial ) ) );
+    __m128 isRadial = _mm_castsi128_ps( _mm_cmpeq_epi32( shape, _mm_set1_epi32( StickSettings::Radial ) ) );
+    __m128 isScaled = _mm_andnot_ps( _mm_or_ps( isAxial, isRadial ), _mm_castsi128_ps( _mm_set1_epi32( -1 ) ) );
+
+    __m128 outX = _mm_or_ps( _mm_or_ps( select( isAxial, axialX ), select( isRadial, radialX ) ),
+                             select( isScaled, scaledX ) );
+    __m128 outY = _mm_or_ps( _mm_or_ps( select( isAxial, axialY ), select( isRadial, radialY ) ),
+                             select( isScaled, scaledY ) );
+
+    // Curves are tables, which SSE2 can't look up in. Only sticks that have one pay for it.
+    if( settings[ 0 ]->curve || settings[ 1 ]->curve || settings[ 2 ]->curve || settings[ 3 ]->curve ) {
+
+        float outMagnitude[ 4 ];
+        float curveScale[ 4 ];
+
+        _mm_storeu_ps( outMagnitude, _mm_sqrt_ps( _mm_add_ps( _mm_mul_ps( outX, outX ),
+                                                              _mm_mul_ps( outY, outY ) ) ) );
+
+        for( int i = 0; i < 4; ++i ) {
+            curveScale[ i ] = settings[ i ]->curve && outMagnitude[ i ] > 0.0f
+                              ? settings[ i ]->curve->map( outMagnitude[ i ] ) / outMagnitude[ i ] : 1.0f;
+        }
+
+        __m128 curve = _mm_loadu_ps( curveScale );
+        outX = _mm_mul_ps( outX, curve );
+        outY = _mm_mul_ps( outY, curve );
+
+    }
+
+    storeSticks( x, outX, scale );
+    storeSticks( y, outY, scale );
+
+    __m128 pushed = _mm_cmpgt_ps( magnitude, threshold );
+    __m128 horizontal = _mm_and_ps( pushed, _mm_cmplt_ps( absY, _mm_mul_ps( absX, slope ) ) );
+    __m128 vertical = _mm_and_ps( pushed, _mm_cmplt_ps( absX, _mm_mul_ps( absY, slope ) ) );
+
+    int up = _mm_movemask_ps( _mm_and_ps( vertical, _mm_cmplt_ps( fy, zero ) ) );
+    int down = _mm_movemask_ps( _mm_and_ps( vertical, _mm_cmpgt_ps( fy, zero ) ) );
+    int left = _mm_movemask_ps( _mm_and_ps( horizontal, _mm_cmplt_ps( fx, zero ) ) );
+    int right = _mm_movemask_ps( _mm_and_ps( horizontal, _mm_cmpgt_ps( fx, zero ) ) );
+
+    for( int i = 0; i < 4; ++i ) {
+        dpad[ i ] = ( ( up >> i ) & 1 ? StickProcessor::Up : 0 )
+                    | ( ( down >> i ) & 1 ? StickProcessor::Down : 0 )
+                    | ( ( left >> i ) & 1 ? StickProcessor::Left : 0 )
+                    | ( ( right >> i ) & 1 ? StickProcessor::Right : 0 );
+    }
+
+}
+
+void StickProcessor::process( qint16 *x, qint16 *y, const StickSettings *const *settings, quint8 *dpad,
+                              const int count ) {
+
+    int i = 0;
+
+    for( ; i + 4 <= count; i += 4 ) {
+        processFourSticks( x + i, y + i, settings + i, dpad + i );
+    }
+
+    processScalar( x + i, y + i, settings + i, dpad + i, count - i );
+
+}
+
+bool StickProcessor::vectorized() {
+    return true;
+}
+
+#else
+
+void StickProcessor::process( qint16 *x, qint16 *y, const StickSettings *const *settings, quint8 *dpad,
+                              const int count ) {
+    processScalar( x, y, settings, dpad, count );
+}
+
+bool StickProcessor::vectorized() {
+    return false;
+}
+
+#endif
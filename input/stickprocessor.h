@@ -0,0 +1,139 @@
+#ifndef STICKPROCESSOR_H
+#define STICKPROCESSOR_H
+
+#include <QtGlobal>
+
+#include <memory>
+
+#include "inputdeviceregistry.h"
+
+// StickCurve is a response curve for an analog stick: how far the stick reports being pushed, for how far it
+// really is, both 0 - 1. It's a table of evenly spaced points with straight lines in between, so a lookup is one
+// multiply and one interpolation whatever shape the curve has.
+
+class StickCurve {
+
+    public:
+
+        static const int segments = 32;
+
+        // magnitude ^ exponent. 1 is linear, above 1 gives more precision around the center, below 1 less.
+        explicit StickCurve( const qreal exponent = 1.0 );
+
+        // Magnitudes past 1, like a square gate's corners, are treated as 1.
+        float map( const float magnitude ) const;
+
+    private:
+
+        // One past the end, so interpolating at exactly 1 doesn't need a branch.
+        float points[ segments + 2 ];
+
+};
+
+// How a device's sticks are processed. Values are in stick units, 0 - 32767.
+
+struct StickSettings {
+
+    enum DeadZoneShape : quint8 {
+
+        // Each axis on its own, a square around the center. Moving along one axis can't leak into the other, but
+        // diagonals near the center snap to the axes.
+        Axial,
+
+        // The distance from the center. Outside of it the position is passed through unchanged, so the stick
+        // jumps from 0 to the edge of the dead zone.
+        Radial,
+
+        // Radial, with what's left stretched back out to the full range, so there's no jump.
+        ScaledRadial,
+
+    };
+
+    StickSettings();
+
+    DeadZoneShape shape;
+    qint16 deadZone;
+
+    // How far the stick has to be pushed, before any dead zone, to count as a D-Pad direction.
+    qint16 dpadThreshold;
+
+    // Applied after the dead zone, nullptr for linear. Curves may be shared between devices.
+    std::shared_ptr<const StickCurve> curve;
+
+};
+
+// StickProcessor turns raw stick positions into what the core gets: the dead zone, then the response curve. It
+// also works out the 8-way D-Pad direction each stick points in, for cores without analog sticks.
+
+// Each of the 8 directions gets a 45 degree sector, so diagonals are as easy to hit as the four main directions,
+// which a square dead zone per axis doesn't manage.
+
+// It works on batches of sticks, as many as there are, each with its own settings. With SSE2 four sticks are
+// done at once. processScalar() is the same thing a stick at a time, and gives exactly the same results.
+
+class StickProcessor {
+
+    public:
+
+        // The bits of a D-Pad direction, in the order of SDL_CONTROLLER_BUTTON_DPAD_UP and the ones after it.
+        enum Direction : quint8 {
+            Up = 1 << 0,
+            Down = 1 << 1,
+            Left = 1 << 2,
+            Right = 1 << 3,
+        };
+
+        // Process count sticks in place. x and y are the positions in and the processed positions out, settings
+        // holds one pointer per stick and dpad gets each stick's Direction bits.
+        static void process( qint16 *x, qint16 *y, const StickSettings *const *settings, quint8 *dpad,
+                             const int count );
+        static void processScalar( qint16 *x, qint16 *y, const StickSettings *const *settings, quint8 *dpad,
+                                   const int count );
+
+        // Whether process() uses SSE2 on this build.
+        static bool vectorized();
+
+};
+
+// A batch of sticks for the StickProcessor, filled by every device in a poll and processed in one go.
+
+struct StickBatch {
+
+    // Two sticks for every device.
+    static const int maxSticks = InputDeviceRegistry::maxDevices * 2;
+
+    int count;
+    qint16 x[ maxSticks ];
+    qint16 y[ maxSticks ];
+    const StickSettings *settings[ maxSticks ];
+    quint8 dpad[ maxSticks ];
+
+    StickBatch()
+        : count( 0 ) {
+
+    }
+
+    // Returns the stick's lane, or -1 if the batch is full. The settings must stay valid until it's processed.
+    int add( const qint16 stickX, const qint16 stickY, const StickSettings *stickSettings ) {
+        if( count == maxSticks ) {
+            return -1;
+        }
+
+        x[ count ] = stickX;
+        y[ count ] = stickY;
+        settings[ count ] = stickSettings;
+
+        return count++;
+    }
+
+    void process() {
+        StickProcessor::process( x, y, settings, dpad, count );
+    }
+
+    void clear() {
+        count = 0;
+    }
+
+};
+
+#endif // STICKPROCESSOR_H
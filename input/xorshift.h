@@ -0,0 +1,16 @@
+#ifndef XORSHIFT_H
+#define XORSHIFT_H
+
+#include <QtGlobal>
+
+// The random numbers of the simulations and benchmarks: xorshift32, it only has to be repeatable. The state must
+// never be 0, it would stay 0.
+
+inline quint32 xorshift32( quint32 &state ) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+#endif // XORSHIFT_H